@@ -58,6 +58,12 @@ atomic_set(atomic_t *a, int v)
   a->v = v;
 }
 
+static inline void
+atomic_or_int(int *p, int v)
+{
+  __sync_fetch_and_or(p, v);
+}
+
 #elif defined(_MSC_VER)
 
 #include <Windows.h>
@@ -97,6 +103,12 @@ atomic_set(atomic_t *a, int v)
   a->v = v;
 }
 
+static __inline void
+atomic_or_int(int *p, int v)
+{
+  InterlockedOr((long *)p, v);
+}
+
 #else
 #error Missing atomic ops
 #endif
@@ -154,7 +154,12 @@ main(int argc, char **argv)
 
   gdk_threads_init();
   gdk_threads_enter();
+#if ENABLE_GLW_FRONTEND_HEADLESS
+  // Only the main loop is used so no display is needed
+  gtk_init_check(&argc, &argv);
+#else
   gtk_init(&argc, &argv);
+#endif
 
   parse_opts(argc, argv);
 
@@ -337,6 +337,15 @@ backend_imageloader(rstr_t *url0, const image_meta_t *im0,
 
   im.im_margin = MAX(im.im_shadow * 2, im.im_margin);
 
+  if(cache_control != BYPASS_CACHE) {
+    img = image_cache_load(url, &im);
+    if(img != NULL) {
+      if(m)
+        htsmsg_release(m);
+      return img;
+    }
+  }
+
   hts_mutex_lock(&imageloader_mutex);
 
   loading_image_t *li;
@@ -416,7 +425,13 @@ backend_imageloader(rstr_t *url0, const image_meta_t *im0,
       li->li_image = image_retain(img);
 
     if(!im.im_no_decoding) {
+      const int coded = img->im_components[0].type == IMAGE_CODED;
+
       img = image_decode(img, &im, errbuf, errlen);
+
+      // Only worth caching if we actually had to decode something
+      if(img != NULL && coded)
+        image_cache_store(url, &im, img);
     }
 
   }
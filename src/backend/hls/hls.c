@@ -158,6 +158,9 @@ segment_destroy(hls_segment_t *hs)
   if(hs->hs_fh != NULL)
     fa_close(hs->hs_fh);
 
+  if(hs->hs_prefetch != NULL)
+    hls_prefetch_release(hs->hs_prefetch);
+
   TAILQ_REMOVE(&hs->hs_variant->hv_segments, hs, hs_link);
   free(hs->hs_url);
   rstr_release(hs->hs_key_url);
@@ -590,6 +593,47 @@ check_audio_only(hls_demuxer_t *hd)
 
 
 
+/**
+ * Feed bandwidth estimator with a segment download of 'bytes' that
+ * took 'ts' microseconds
+ */
+static void
+hls_demuxer_update_bw(hls_demuxer_t *hd, int64_t bytes, int64_t ts)
+{
+  hls_t *h = hd->hd_hls;
+
+  if(ts > 1000) {
+    int64_t bw = 8000000LL * bytes / ts;
+    bw = MIN(100000000, bw);
+
+
+    int low_buffer = h->h_mp->mp_buffer_delay < 5000000;
+    const char *delta;
+    if(hd->hd_bw == 0)
+      delta = "Initial";
+    else if(bw < hd->hd_bw)
+      delta = "Decrease";
+    else
+      delta = "Increase";
+
+    hd->hd_bw = hls_abr_legacy_bw(hd->hd_bw, bw, low_buffer);
+    hls_abr_add_sample(&hd->hd_abr, bytes, ts);
+
+    HLS_TRACE(h, "Estimated bandwidth updated %d bps "
+              "(most recent segment %d bps) "
+              "buffer: %ds (%s) delta: %s\n",
+              hd->hd_bw, (int)bw,
+              (int)(h->h_mp->mp_buffer_delay / 1000000),
+              low_buffer ? "Low" : "OK",
+              delta);
+
+    // Can be fed to support/hlsabr for offline comparison of policies
+    HLS_TRACE(h, "ABR sample: %"PRId64" bytes in %"PRId64" us", bytes, ts);
+    hd->hd_bw_updated = 1;
+  }
+}
+
+
 /**
  *
  */
@@ -607,6 +651,24 @@ hls_segment_open(hls_segment_t *hs)
   hs->hs_open_time = arch_get_ts();
   hs->hs_blocked_counter = h->h_blocked;
 
+  hls_prefetch_t *hp = hls_prefetch_get(hd, hs);
+  if(hp != NULL) {
+    hs->hs_prefetch = hp;
+    hs->hs_size = buf_size(hp->hp_buf);
+    fh = memfile_make(buf_data(hp->hp_buf), buf_size(hp->hp_buf));
+
+    // Download was not limited by the media queue, so this is a
+    // clean measurement of throughput
+    hls_demuxer_update_bw(hd, hs->hs_size, hp->hp_download_time);
+
+    if(hp->hp_key != NULL && !rstr_eq(hs->hs_key_url, hv->hv_key_url)) {
+      buf_release(hv->hv_key);
+      hv->hv_key = buf_retain(hp->hp_key);
+      rstr_set(&hv->hv_key_url, hs->hs_key_url);
+    }
+    goto opened;
+  }
+
   foe.foe_open_timeout = 3000;
   foe.foe_cancellable = hd->hd_cancellable;
 
@@ -640,6 +702,7 @@ hls_segment_open(hls_segment_t *hs)
 
   hs->hs_size = fa_fsize(fh);
 
+ opened:
   switch(hs->hs_crypto) {
   case HLS_CRYPTO_AES128:
 
@@ -653,6 +716,10 @@ hls_segment_open(hls_segment_t *hs)
 	TRACE(TRACE_ERROR, "HLS", "Unable to load key file %s",
 	      rstr_get(hs->hs_key_url));
 	fa_close(fh);
+        if(hs->hs_prefetch != NULL) {
+          hls_prefetch_release(hs->hs_prefetch);
+          hs->hs_prefetch = NULL;
+        }
         return HLS_ERROR_SEGMENT_BAD_KEY;
       }
       rstr_set(&hv->hv_key_url, hs->hs_key_url);
@@ -661,8 +728,11 @@ hls_segment_open(hls_segment_t *hs)
     fh = fa_aescbc_open(fh, hs->hs_iv, buf_c8(hv->hv_key));
   }
   hs->hs_fh = fh;
-  HLS_TRACE(h, "Opened %s (sequence %d) ranges:[%d + %d] OK",
-            hs->hs_url, hs->hs_seq, hs->hs_byte_offset, hs->hs_byte_size);
+  HLS_TRACE(h, "Opened %s (sequence %d) ranges:[%d + %d] OK%s",
+            hs->hs_url, hs->hs_seq, hs->hs_byte_offset, hs->hs_byte_size,
+            hs->hs_prefetch ? " (prefetched)" : "");
+
+  hls_prefetch_schedule(hd, hs);
   return 0;
 }
 
@@ -679,39 +749,18 @@ hls_segment_close(hls_segment_t *hs)
   hls_demuxer_t *hd = hs->hs_variant->hv_demuxer;
   hls_t *h = hd->hd_hls;
 
-  if(hs->hs_blocked_counter == h->h_blocked) {
-    int64_t ts = arch_get_ts() - hs->hs_open_time;
-    if(ts > 1000) {
-      int64_t bw = 8000000LL * hs->hs_size / ts;
-      bw = MIN(100000000, bw);
-
-
-      int low_buffer = h->h_mp->mp_buffer_delay < 5000000;
-      const char *delta;
-      if(hd->hd_bw == 0) {
-        hd->hd_bw = bw;
-        delta = "Initial";
-      } else if(bw < hd->hd_bw) {
-        delta = "Decrease";
-        if(low_buffer)
-          hd->hd_bw = (hd->hd_bw + bw) / 2;
-        else
-          hd->hd_bw = (hd->hd_bw * 7 + bw) / 8;
-      } else {
-        delta = "Increase";
-        hd->hd_bw = (hd->hd_bw + bw) / 2;
-      }
-      HLS_TRACE(h, "Estimated bandwidth updated %d bps "
-                "(most recent segment %d bps) "
-                "buffer: %ds (%s) delta: %s\n",
-                hd->hd_bw, (int)bw,
-                (int)(h->h_mp->mp_buffer_delay / 1000000),
-                low_buffer ? "Low" : "OK",
-                delta);
-      hd->hd_bw_updated = 1;
-    }
+  if(hs->hs_prefetch != NULL) {
+    // Bandwidth was accounted for when opened
+    fa_close(hs->hs_fh);
+    hs->hs_fh = NULL;
+    hls_prefetch_release(hs->hs_prefetch);
+    hs->hs_prefetch = NULL;
+    return;
   }
 
+  if(hs->hs_blocked_counter == h->h_blocked)
+    hls_demuxer_update_bw(hd, hs->hs_size, arch_get_ts() - hs->hs_open_time);
+
   fa_close(hs->hs_fh);
   hs->hs_fh = NULL;
 }
@@ -1082,6 +1131,50 @@ demuxer_select_variant_random(hls_demuxer_t *hd)
   return hv;
 }
 
+/**
+ * Throughput and buffer based selection, see hls_abr.c
+ */
+static hls_variant_t *
+demuxer_select_variant_abr(hls_demuxer_t *hd, int64_t now)
+{
+  hls_variant_t *hv;
+  hls_variant_t *candidates[32];
+  int bitrates[32];
+  int num = 0;
+  int current = -1;
+
+  TAILQ_FOREACH(hv, &hd->hd_variants, hv_link) {
+    if(hv->hv_audio_only)
+      continue;
+    if(hv->hv_corrupt_timer < now - HLS_CORRUPTION_MEASURE_PERIOD)
+      hv->hv_corruptions_last_period = 0;
+    if(hv->hv_corruptions_last_period >= 3)
+      continue;
+    if(num == 32)
+      break;
+    if(hv == hd->hd_current)
+      current = num;
+    candidates[num] = hv;
+    bitrates[num] = hv->hv_bitrate;
+    num++;
+  }
+
+  if(num == 0) {
+    hd->hd_no_functional_streams = 1;
+    return NULL;
+  }
+
+  const int64_t buffer_delay = hd->hd_hls->h_mp->mp_buffer_delay;
+  const int idx = hls_abr_select(&hd->hd_abr, bitrates, num, current,
+                                 buffer_delay);
+
+  HLS_TRACE(hd->hd_hls, "ABR selected bitrate %d (estimate: %d bps "
+            "buffer: %ds)", bitrates[idx], hls_abr_estimate(&hd->hd_abr),
+            (int)(buffer_delay / 1000000));
+  return candidates[idx];
+}
+
+
 /**
  *
  */
@@ -1091,6 +1184,9 @@ hls_demuxer_select_variant(hls_demuxer_t *hd, int64_t now, int bw)
   if(0)
     return demuxer_select_variant_random(hd);
 
+  if(gconf.enable_hls_abr && bw)
+    return demuxer_select_variant_abr(hd, now);
+
   return demuxer_select_variant_simple(hd, now, bw);
 }
 
@@ -2144,6 +2240,8 @@ hls_demuxer_init(hls_demuxer_t *hd, hls_t *h, const char *type)
   hd->hd_seek_to_segment = PTS_UNSET;
   hd->hd_last_dts = PTS_UNSET;
   hd->hd_cancellable = cancellable_create();
+  hls_abr_reset(&hd->hd_abr);
+  hls_prefetch_init(hd);
 }
 
 
@@ -2153,6 +2251,7 @@ hls_demuxer_init(hls_demuxer_t *hd, hls_t *h, const char *type)
 static void
 hls_demuxer_close(media_pipe_t *mp, hls_demuxer_t *hd)
 {
+  hls_prefetch_fini(hd);
   variants_destroy(&hd->hd_variants);
   if(hd->hd_audio_codec != NULL)
     media_codec_deref(hd->hd_audio_codec);
@@ -17,6 +17,8 @@
  *  This program is also available under a commercial proprietary license.
  *  For more information, contact andreas@lonelycoder.com
  */
+#include "hls_abr.h"
+
 event_t *hls_play_extm3u(char *s, const char *url, media_pipe_t *mp,
 			 char *errbuf, size_t errlen,
 			 video_queue_t *vq, struct vsource_list *vsl,
@@ -35,6 +37,7 @@ event_t *hls_play_extm3u(char *s, const char *url, media_pipe_t *mp,
 
 TAILQ_HEAD(hls_variant_queue, hls_variant);
 TAILQ_HEAD(hls_segment_queue, hls_segment);
+TAILQ_HEAD(hls_prefetch_queue, hls_prefetch);
 LIST_HEAD(hls_audio_track_list, hls_audio_track);
 
 #define HLS_CRYPTO_NONE   0
@@ -81,6 +84,7 @@ typedef struct hls_segment {
   char hs_mark;
 
   fa_handle_t *hs_fh;
+  struct hls_prefetch *hs_prefetch; // Backing memory for hs_fh if prefetched
 
   int64_t hs_open_time;
   int hs_blocked_counter;
@@ -88,6 +92,33 @@ typedef struct hls_segment {
 } hls_segment_t;
 
 
+/**
+ * A segment downloaded (or being downloaded) ahead of time
+ */
+typedef struct hls_prefetch {
+  TAILQ_ENTRY(hls_prefetch) hp_link;
+  char *hp_url;
+  int hp_byte_offset;
+  int hp_byte_size;
+
+  rstr_t *hp_key_url;
+  buf_t *hp_key;
+  buf_t *hp_buf;
+
+  int64_t hp_download_time;
+
+  enum {
+    HLS_PREFETCH_QUEUED,
+    HLS_PREFETCH_LOADING,
+    HLS_PREFETCH_DONE,
+    HLS_PREFETCH_FAILED,
+  } hp_state;
+
+  char hp_stale; // Removed while loading, free when done
+
+} hls_prefetch_t;
+
+
 typedef enum {
   HLS_ERROR_OK = 0,
   HLS_ERROR_SEGMENT_NOT_FOUND,
@@ -186,6 +217,7 @@ typedef struct hls_demuxer {
 
   int hd_bw;
   int hd_bw_updated;
+  hls_abr_t hd_abr;
   int64_t hd_download_counter_reset_at;
   int64_t hd_download_counter;
   int64_t hd_download_counter2;
@@ -219,6 +251,14 @@ typedef struct hls_demuxer {
 
   int64_t hd_last_dts;
 
+  struct hls_prefetch_queue hd_prefetch;
+  hts_mutex_t hd_prefetch_mutex;
+  hts_cond_t hd_prefetch_cond;
+  hts_thread_t hd_prefetch_thread;
+  int hd_prefetch_running;
+  int64_t hd_prefetch_bytes;
+  cancellable_t *hd_prefetch_cancellable;
+
 } hls_demuxer_t;
 
 LIST_HEAD(hls_discontinuity_segment_list, hls_discontinuity_segment);
@@ -298,6 +338,16 @@ hls_segment_t *hv_find_segment_by_seq(hls_variant_t *hv, int seq);
 
 void hls_bad_variant(hls_variant_t *hv, hls_error_t err);
 
+void hls_prefetch_init(hls_demuxer_t *hd);
+
+void hls_prefetch_fini(hls_demuxer_t *hd);
+
+void hls_prefetch_schedule(hls_demuxer_t *hd, const hls_segment_t *hs);
+
+hls_prefetch_t *hls_prefetch_get(hls_demuxer_t *hd, const hls_segment_t *hs);
+
+void hls_prefetch_release(hls_prefetch_t *hp);
+
 // TS demuxer
 
 media_buf_t *hls_ts_demuxer_read(hls_demuxer_t *hd);
@@ -0,0 +1,227 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+#include <math.h>
+
+#include "hls_abr.h"
+
+/**
+ * Throughput is tracked using two exponentially weighted moving
+ * averages where the weight of each sample is the time it took to
+ * download. The fast one reacts quickly to drops, the slow one keeps
+ * a single fast segment from pushing the estimate up. In addition we
+ * keep a harmonic mean over the last few samples which is not skewed
+ * by the occasional burst (ie, a segment served from a nearby cache).
+ *
+ * The estimate is the smallest of the three.
+ */
+
+#define HLS_ABR_FAST_HALFLIFE 3.0  // Seconds of download time
+#define HLS_ABR_SLOW_HALFLIFE 8.0
+
+#define HLS_ABR_SAFETY_FACTOR 0.9
+
+#define HLS_ABR_MAX_BW 100000000
+
+
+/**
+ * The estimator used before this file existed. Moved here so the
+ * replay tool can compare against it
+ */
+int
+hls_abr_legacy_bw(int current, int sample, int low_buffer)
+{
+  if(current == 0)
+    return sample;
+
+  if(sample < current) {
+    if(low_buffer)
+      return (current + sample) / 2;
+    return (current * 7 + sample) / 8;
+  }
+  return (current + sample) / 2;
+}
+
+
+/**
+ *
+ */
+void
+hls_abr_reset(hls_abr_t *ha)
+{
+  memset(ha, 0, sizeof(hls_abr_t));
+}
+
+
+/**
+ *
+ */
+static void
+ewma_add(double *estimate, double *weight, double halflife,
+         double duration, double value)
+{
+  const double a = pow(0.5, duration / halflife);
+  *estimate = value * (1.0 - a) + *estimate * a;
+  *weight = *weight * a + (1.0 - a);
+}
+
+
+/**
+ * Feed a segment download of 'bytes' that took 'ts' microseconds
+ */
+void
+hls_abr_add_sample(hls_abr_t *ha, int64_t bytes, int64_t ts)
+{
+  if(ts <= 1000 || bytes <= 0)
+    return;
+
+  int64_t bw = 8000000LL * bytes / ts;
+  if(bw > HLS_ABR_MAX_BW)
+    bw = HLS_ABR_MAX_BW;
+
+  const double duration = ts / 1000000.0;
+
+  ewma_add(&ha->ha_fast, &ha->ha_fast_weight, HLS_ABR_FAST_HALFLIFE,
+           duration, bw);
+  ewma_add(&ha->ha_slow, &ha->ha_slow_weight, HLS_ABR_SLOW_HALFLIFE,
+           duration, bw);
+
+  ha->ha_samples[ha->ha_sample_ptr] = bw;
+  ha->ha_sample_ptr = (ha->ha_sample_ptr + 1) % HLS_ABR_SAMPLES;
+  if(ha->ha_num_samples < HLS_ABR_SAMPLES)
+    ha->ha_num_samples++;
+}
+
+
+/**
+ * Return estimated throughput in bps, or 0 if nothing is known yet
+ */
+int
+hls_abr_estimate(const hls_abr_t *ha)
+{
+  if(ha->ha_num_samples == 0)
+    return 0;
+
+  // Weights start at zero so divide to remove the bias of early samples
+  double fast = ha->ha_fast / ha->ha_fast_weight;
+  double slow = ha->ha_slow / ha->ha_slow_weight;
+
+  double sum = 0;
+  for(int i = 0; i < ha->ha_num_samples; i++)
+    sum += 1.0 / (ha->ha_samples[i] ?: 1);
+  double harmonic = ha->ha_num_samples / sum;
+
+  double r = fast;
+  if(slow < r)
+    r = slow;
+  if(harmonic < r)
+    r = harmonic;
+  return r;
+}
+
+
+/**
+ * Pick the first bitrate lower than 'bw'.
+ *
+ * 'bitrates' is sorted in descending order, returns index of selected
+ * entry. This is the rule used by the simple selection in hls.c
+ */
+int
+hls_abr_select_simple(const int *bitrates, int num, int bw)
+{
+  for(int i = 0; i < num; i++)
+    if(bitrates[i] < bw)
+      return i;
+  return num - 1;
+}
+
+
+/**
+ * Throughput and buffer based selection.
+ *
+ * When the buffer is low (or we have no idea what's playing) we pick
+ * the highest bitrate that fits within the throughput estimate.
+ *
+ * Once enough is buffered we switch to a buffer occupancy rule (BOLA)
+ * where each bitrate gets a utility of ln(bitrate / lowest bitrate)
+ * and we maximize (V * (utility + gp) - buffer) / bitrate.
+ * V and gp are derived so that the lowest bitrate is chosen at
+ * HLS_ABR_LOW_BUFFER and the highest at HLS_ABR_TARGET_BUFFER.
+ *
+ * To avoid oscillation the buffer rule is never allowed to go above
+ * what the throughput would allow unless we're already playing a
+ * higher bitrate, in which case we stay there until the buffer
+ * drains (this is what the BOLA paper calls BOLA-O).
+ *
+ * Nor is it allowed to go below what the throughput would allow.
+ * Its curve starts at the lowest bitrate right where we hand over
+ * from the throughput rule, so on its own more buffer could mean a
+ * lower bitrate. Above HLS_ABR_TARGET_BUFFER it always picks the
+ * highest bitrate so this only matters on the way up.
+ *
+ * 'bitrates' is sorted in descending order, 'current' is the index of
+ * the currently playing bitrate or -1. Returns index of selected entry
+ */
+int
+hls_abr_select(const hls_abr_t *ha, const int *bitrates, int num,
+               int current, int64_t buffer_delay)
+{
+  if(num <= 1)
+    return 0;
+
+  const int bw = hls_abr_estimate(ha);
+  const int tput = hls_abr_select_simple(bitrates, num,
+                                         bw * HLS_ABR_SAFETY_FACTOR);
+
+  const double buffer = buffer_delay / 1000000.0;
+
+  if(current < 0 || current >= num || buffer < HLS_ABR_LOW_BUFFER)
+    return tput;
+
+  const double lowest = bitrates[num - 1];
+  const double umax = log(bitrates[0] / lowest) + 1.0;
+  const double gp = (umax - 1.0) /
+    ((double)HLS_ABR_TARGET_BUFFER / HLS_ABR_LOW_BUFFER - 1.0);
+  const double vp = HLS_ABR_LOW_BUFFER / gp;
+
+  int bola = num - 1;
+  double best = -INFINITY;
+  for(int i = 0; i < num; i++) {
+    const double u = log(bitrates[i] / lowest) + 1.0;
+    const double score = (vp * (u + gp) - buffer) / bitrates[i];
+    if(score > best) {
+      best = score;
+      bola = i;
+    }
+  }
+
+  if(bitrates[bola] > bitrates[tput]) {
+    if(bitrates[current] > bitrates[tput]) {
+      // Hold on to current bitrate, but don't step further up
+      if(bitrates[bola] > bitrates[current])
+        bola = current;
+    } else {
+      bola = tput;
+    }
+  } else {
+    bola = tput;
+  }
+  return bola;
+}
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Adaptive bitrate control for HLS variant selection
+ *
+ * This file does not depend on anything else in the tree so it can be
+ * built into the offline trace replay tool in support/hlsabr
+ */
+
+#define HLS_ABR_SAMPLES 8
+
+// Buffer levels (in seconds) used by the buffer based selection
+#define HLS_ABR_LOW_BUFFER    10
+#define HLS_ABR_TARGET_BUFFER 30
+
+typedef struct hls_abr {
+  double ha_fast;                    // EWMA, short half-life (bps)
+  double ha_slow;                    // EWMA, long half-life (bps)
+  double ha_fast_weight;             // Accumulated weight for bias removal
+  double ha_slow_weight;
+  int ha_samples[HLS_ABR_SAMPLES];   // Most recent throughput samples (bps)
+  int ha_num_samples;
+  int ha_sample_ptr;
+} hls_abr_t;
+
+int hls_abr_legacy_bw(int current, int sample, int low_buffer);
+
+void hls_abr_reset(hls_abr_t *ha);
+
+void hls_abr_add_sample(hls_abr_t *ha, int64_t bytes, int64_t ts);
+
+int hls_abr_estimate(const hls_abr_t *ha);
+
+int hls_abr_select_simple(const int *bitrates, int num, int bw);
+
+int hls_abr_select(const hls_abr_t *ha, const int *bitrates, int num,
+                   int current, int64_t buffer_delay);
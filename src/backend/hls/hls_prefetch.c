@@ -0,0 +1,383 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "main.h"
+#include "media/media.h"
+#include "backend/backend.h"
+#include "fileaccess/fileaccess.h"
+#include "misc/minmax.h"
+#include "hls.h"
+
+/**
+ * Segment prefetcher
+ *
+ * Every time a segment is opened we schedule download of the segments
+ * following it (in the same variant) into memory. When the demuxer
+ * then reaches the next segment it can start reading it right away
+ * instead of paying for a full connection setup and request round trip
+ * at every segment boundary.
+ *
+ * Lookahead is bounded both by number of segments, by total number of
+ * bytes held and by how much is already buffered in the media pipe.
+ *
+ * Entries are identified by URL and byte range (not by hls_segment_t)
+ * as segments may be destroyed on the demuxer thread when a live
+ * playlist is reloaded.
+ */
+
+#define HLS_PREFETCH_SEGMENTS   3
+#define HLS_PREFETCH_MAX_BYTES  (48 * 1024 * 1024)
+#define HLS_PREFETCH_MAX_DELAY  (30 * 1000000)
+
+
+/**
+ *
+ */
+static void
+hp_destroy(hls_prefetch_t *hp)
+{
+  free(hp->hp_url);
+  rstr_release(hp->hp_key_url);
+  buf_release(hp->hp_key);
+  buf_release(hp->hp_buf);
+  free(hp);
+}
+
+
+/**
+ * Remove an entry from the queue. If it's currently being downloaded
+ * the prefetch thread will free it once done
+ */
+static void
+hp_remove(hls_demuxer_t *hd, hls_prefetch_t *hp)
+{
+  TAILQ_REMOVE(&hd->hd_prefetch, hp, hp_link);
+
+  if(hp->hp_state == HLS_PREFETCH_LOADING) {
+    hp->hp_stale = 1;
+    cancellable_cancel(hd->hd_prefetch_cancellable);
+    return;
+  }
+
+  if(hp->hp_buf != NULL)
+    hd->hd_prefetch_bytes -= buf_size(hp->hp_buf);
+  hp_destroy(hp);
+  hts_cond_broadcast(&hd->hd_prefetch_cond);
+}
+
+
+/**
+ *
+ */
+static int
+hp_match(const hls_prefetch_t *hp, const hls_segment_t *hs)
+{
+  return !strcmp(hp->hp_url, hs->hs_url) &&
+    hp->hp_byte_offset == hs->hs_byte_offset &&
+    hp->hp_byte_size == hs->hs_byte_size;
+}
+
+
+/**
+ *
+ */
+static buf_t *
+hp_load(hls_prefetch_t *hp, cancellable_t *c, char *errbuf, size_t errlen)
+{
+  fa_open_extra_t foe = {0};
+
+  foe.foe_open_timeout = 3000;
+  foe.foe_cancellable = c;
+
+  fa_handle_t *fh = fa_open_ex(hp->hp_url, errbuf, errlen, FA_BUFFERED_BIG,
+                               &foe);
+  if(fh == NULL)
+    return NULL;
+
+  fa_set_read_timeout(fh, 3000);
+
+  if(hp->hp_byte_size != -1 && hp->hp_byte_offset != -1)
+    fh = fa_slice_open(fh, hp->hp_byte_offset, hp->hp_byte_size);
+
+  const int64_t size = fa_fsize(fh);
+
+  if(size <= 0 || size > HLS_PREFETCH_MAX_BYTES) {
+    // Unknown size (chunked) or just silly big, let demuxer stream it
+    snprintf(errbuf, errlen, "Unsupported size %"PRId64, size);
+    fa_close(fh);
+    return NULL;
+  }
+
+  uint8_t *mem = malloc(size);
+  if(mem == NULL) {
+    snprintf(errbuf, errlen, "Unable to allocate %"PRId64" bytes", size);
+    fa_close(fh);
+    return NULL;
+  }
+
+  int64_t got = 0;
+
+  while(got < size) {
+    int r = fa_read(fh, mem + got, size - got);
+    if(r <= 0 || cancellable_is_cancelled(c))
+      break;
+    got += r;
+  }
+  fa_close(fh);
+
+  if(got != size) {
+    snprintf(errbuf, errlen, "Short read");
+    free(mem);
+    return NULL;
+  }
+  return buf_create_from_malloced(size, mem);
+}
+
+
+/**
+ *
+ */
+static void *
+hls_prefetch_thread(void *aux)
+{
+  hls_demuxer_t *hd = aux;
+  const hls_t *h = hd->hd_hls;
+  hls_prefetch_t *hp;
+  char errbuf[256];
+
+  hts_mutex_lock(&hd->hd_prefetch_mutex);
+
+  while(hd->hd_prefetch_running) {
+
+    TAILQ_FOREACH(hp, &hd->hd_prefetch, hp_link)
+      if(hp->hp_state == HLS_PREFETCH_QUEUED)
+        break;
+
+    if(hp == NULL || hd->hd_prefetch_bytes >= HLS_PREFETCH_MAX_BYTES) {
+      hts_cond_wait(&hd->hd_prefetch_cond, &hd->hd_prefetch_mutex);
+      continue;
+    }
+
+    hp->hp_state = HLS_PREFETCH_LOADING;
+    cancellable_reset(hd->hd_prefetch_cancellable);
+    hts_mutex_unlock(&hd->hd_prefetch_mutex);
+
+    const int64_t start = arch_get_ts();
+    buf_t *key = NULL;
+
+    if(hp->hp_key_url != NULL) {
+      key = fa_load(rstr_get(hp->hp_key_url),
+                    FA_LOAD_ERRBUF(errbuf, sizeof(errbuf)),
+                    FA_LOAD_CANCELLABLE(hd->hd_prefetch_cancellable),
+                    NULL);
+    }
+
+    buf_t *b = NULL;
+    if(hp->hp_key_url == NULL || key != NULL)
+      b = hp_load(hp, hd->hd_prefetch_cancellable, errbuf, sizeof(errbuf));
+
+    const int64_t download_time = arch_get_ts() - start;
+
+    hts_mutex_lock(&hd->hd_prefetch_mutex);
+
+    if(hp->hp_stale) {
+      buf_release(key);
+      buf_release(b);
+      hp_destroy(hp);
+      continue;
+    }
+
+    if(b == NULL) {
+      HLS_TRACE(h, "%s: Prefetch of %s failed -- %s",
+                hd->hd_type, hp->hp_url, errbuf);
+      buf_release(key);
+      hp->hp_state = HLS_PREFETCH_FAILED;
+    } else {
+      HLS_TRACE(h, "%s: Prefetched %s, %d bytes in %d ms (%d kb/s)",
+                hd->hd_type, hp->hp_url, (int)buf_size(b),
+                (int)(download_time / 1000),
+                (int)(8000LL * buf_size(b) / MAX(download_time, 1)));
+      hp->hp_buf = b;
+      hp->hp_key = key;
+      hp->hp_download_time = download_time;
+      hp->hp_state = HLS_PREFETCH_DONE;
+      hd->hd_prefetch_bytes += buf_size(b);
+    }
+    hts_cond_broadcast(&hd->hd_prefetch_cond);
+  }
+
+  hts_mutex_unlock(&hd->hd_prefetch_mutex);
+  return NULL;
+}
+
+
+/**
+ * Schedule prefetch of segments following 'hs'. Anything queued that
+ * is not among those (seek, variant switch, etc) is dropped.
+ *
+ * The buffer delay bound only stops us from queuing new segments,
+ * what's already fetched for the upcoming segments is kept
+ */
+void
+hls_prefetch_schedule(hls_demuxer_t *hd, const hls_segment_t *hs)
+{
+  const hls_t *h = hd->hd_hls;
+  const hls_segment_t *want[HLS_PREFETCH_SEGMENTS];
+  int may_queue[HLS_PREFETCH_SEGMENTS];
+  int num_want = 0;
+  hls_prefetch_t *hp, *next;
+
+  int64_t delay = h->h_mp->mp_buffer_delay + hs->hs_duration;
+
+  for(hs = TAILQ_NEXT(hs, hs_link);
+      hs != NULL && num_want < HLS_PREFETCH_SEGMENTS;
+      hs = TAILQ_NEXT(hs, hs_link)) {
+    may_queue[num_want] = delay < HLS_PREFETCH_MAX_DELAY;
+    want[num_want++] = hs;
+    delay += hs->hs_duration;
+  }
+
+  hts_mutex_lock(&hd->hd_prefetch_mutex);
+
+  for(hp = TAILQ_FIRST(&hd->hd_prefetch); hp != NULL; hp = next) {
+    next = TAILQ_NEXT(hp, hp_link);
+    int i;
+    for(i = 0; i < num_want; i++)
+      if(want[i] != NULL && hp_match(hp, want[i]))
+        break;
+
+    if(i == num_want)
+      hp_remove(hd, hp);
+    else
+      want[i] = NULL; // Already queued
+  }
+
+  for(int i = 0; i < num_want; i++) {
+    if(want[i] == NULL || !may_queue[i])
+      continue;
+    hp = calloc(1, sizeof(hls_prefetch_t));
+    hp->hp_url = strdup(want[i]->hs_url);
+    hp->hp_byte_offset = want[i]->hs_byte_offset;
+    hp->hp_byte_size = want[i]->hs_byte_size;
+    if(want[i]->hs_crypto == HLS_CRYPTO_AES128)
+      hp->hp_key_url = rstr_dup(want[i]->hs_key_url);
+    TAILQ_INSERT_TAIL(&hd->hd_prefetch, hp, hp_link);
+  }
+
+  if(num_want > 0 && may_queue[0] && !hd->hd_prefetch_running) {
+    hd->hd_prefetch_running = 1;
+    hts_thread_create_joinable("HLS prefetch", &hd->hd_prefetch_thread,
+                               hls_prefetch_thread, hd,
+                               THREAD_PRIO_DEMUXER);
+  }
+
+  hts_cond_broadcast(&hd->hd_prefetch_cond);
+  hts_mutex_unlock(&hd->hd_prefetch_mutex);
+}
+
+
+/**
+ * Returns prefetched data for the segment or NULL if it's not been
+ * prefetched. If it's currently being downloaded we wait for it as
+ * that's quicker than starting over
+ */
+hls_prefetch_t *
+hls_prefetch_get(hls_demuxer_t *hd, const hls_segment_t *hs)
+{
+  hls_prefetch_t *hp;
+
+  hts_mutex_lock(&hd->hd_prefetch_mutex);
+
+  TAILQ_FOREACH(hp, &hd->hd_prefetch, hp_link)
+    if(hp_match(hp, hs))
+      break;
+
+  while(hp != NULL && hp->hp_state == HLS_PREFETCH_LOADING &&
+        !cancellable_is_cancelled(hd->hd_cancellable))
+    hts_cond_wait_timeout(&hd->hd_prefetch_cond, &hd->hd_prefetch_mutex,
+                          100);
+
+  if(hp != NULL && hp->hp_state == HLS_PREFETCH_DONE) {
+    TAILQ_REMOVE(&hd->hd_prefetch, hp, hp_link);
+    hd->hd_prefetch_bytes -= buf_size(hp->hp_buf);
+    hts_cond_broadcast(&hd->hd_prefetch_cond);
+  } else {
+    if(hp != NULL)
+      hp_remove(hd, hp);
+    hp = NULL;
+  }
+
+  hts_mutex_unlock(&hd->hd_prefetch_mutex);
+  return hp;
+}
+
+
+/**
+ *
+ */
+void
+hls_prefetch_release(hls_prefetch_t *hp)
+{
+  hp_destroy(hp);
+}
+
+
+/**
+ *
+ */
+void
+hls_prefetch_init(hls_demuxer_t *hd)
+{
+  TAILQ_INIT(&hd->hd_prefetch);
+  hts_mutex_init(&hd->hd_prefetch_mutex);
+  hts_cond_init(&hd->hd_prefetch_cond, &hd->hd_prefetch_mutex);
+  hd->hd_prefetch_cancellable = cancellable_create();
+}
+
+
+/**
+ *
+ */
+void
+hls_prefetch_fini(hls_demuxer_t *hd)
+{
+  hls_prefetch_t *hp;
+
+  hts_mutex_lock(&hd->hd_prefetch_mutex);
+  const int running = hd->hd_prefetch_running;
+  hd->hd_prefetch_running = 0;
+  cancellable_cancel(hd->hd_prefetch_cancellable);
+  hts_cond_broadcast(&hd->hd_prefetch_cond);
+  hts_mutex_unlock(&hd->hd_prefetch_mutex);
+
+  if(running)
+    hts_thread_join(&hd->hd_prefetch_thread);
+
+  while((hp = TAILQ_FIRST(&hd->hd_prefetch)) != NULL) {
+    TAILQ_REMOVE(&hd->hd_prefetch, hp, hp_link);
+    hp_destroy(hp);
+  }
+
+  cancellable_release(hd->hd_prefetch_cancellable);
+  hts_cond_destroy(&hd->hd_prefetch_cond);
+  hts_mutex_destroy(&hd->hd_prefetch_mutex);
+}
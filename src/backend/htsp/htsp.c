@@ -2389,6 +2389,7 @@ htsp_subscriptionStart(htsp_connection_t *hc, htsmsg_t *m)
 
       htsmsg_get_u32(sub, "width", &mcp.width);
       htsmsg_get_u32(sub, "height", &mcp.height);
+      mcp.low_latency = 1;
 
       /**
        * Try to create the codec
@@ -344,6 +344,7 @@ get_packet_v(rtmp_t *r, uint8_t *data, int size, int64_t dts,
     }
     mcp.width = r->width;
     mcp.height = r->height;
+    mcp.low_latency = 1;
     r->vcodec = media_codec_create(id, 0, NULL, NULL, &mcp, mp);
     return NULL;
   }
@@ -26,7 +26,7 @@ buf_t *blobcache_get(const char *key, const char *stash, int pad,
 		    int *is_expired, char **etag, time_t *mtime);
 
 int blobcache_get_meta(const char *key, const char *stash,
-		       char **etag, time_t *mtime);
+		       char **etag, time_t *mtime, int *is_expired);
 
 int blobcache_put(const char *key, const char *stash, buf_t *buf,
 		  int maxage, const char *etag, time_t mtime,
@@ -39,6 +39,8 @@
 
 // Flags
 
+#define BC2_MAGIC_09      0x62630209
+#define BC2_MAGIC_08      0x62630208
 #define BC2_MAGIC_07      0x62630207
 #define BC2_MAGIC_06      0x62630206
 #define BC2_MAGIC_05      0x62630205
@@ -54,6 +56,9 @@ typedef struct blobcache_item {
   uint32_t bi_size;
   uint8_t bi_content_type_len;
   uint8_t bi_flags;
+  uint8_t bi_journaled; // Queued in journal_keys[]
+  uint32_t bi_pack_id;  // 0 if stored in a file of its own
+  uint32_t bi_pack_offset;
 } blobcache_item_t;
 
 typedef struct blobcache_diskitem_06 {
@@ -82,6 +87,85 @@ typedef struct blobcache_diskitem_07 {
 } __attribute__((packed)) blobcache_diskitem_07_t;
 
 
+/**
+ * The BC2_MAGIC_08/09 index is an append-only journal:
+ *
+ *   uint32_t magic
+ *   uint32_t time of last full rewrite
+ *   { blobcache_diskchunk_t, blobcache_diskitem_09_t[] } ...
+ *
+ * Each save appends one chunk with the items that changed since the
+ * previous save. Records for the same key supersede earlier ones.
+ * Replay stops at the first truncated or corrupt chunk. Once the journal
+ * holds many more records than there are live items it is compacted
+ * by writing a fresh file with a single chunk.
+ */
+typedef struct blobcache_diskchunk {
+  uint32_t dc_len;   // Length of payload
+  uint32_t dc_hash;  // MurHash3_32 of payload
+} __attribute__((packed)) blobcache_diskchunk_t;
+
+#define BC2_OP_PUT 1
+#define BC2_OP_DEL 2
+
+typedef struct blobcache_diskitem_08 {
+  uint8_t di_op;
+  uint64_t di_key_hash;
+  uint64_t di_content_hash;
+  uint32_t di_lastaccess;
+  uint32_t di_expiry;
+  uint32_t di_modtime;
+  uint32_t di_size;
+  uint8_t di_flags;
+  uint8_t di_etaglen;
+  uint8_t di_content_type_len;
+  uint8_t di_etag[0];
+} __attribute__((packed)) blobcache_diskitem_08_t;
+
+typedef struct blobcache_diskitem_09 {
+  blobcache_diskitem_08_t di_08; // Must be first, etag is not used though
+  uint32_t di_pack_id;
+  uint32_t di_pack_offset;
+  uint8_t di_etag[0];
+} __attribute__((packed)) blobcache_diskitem_09_t;
+
+
+/**
+ * Pack files
+ *
+ * Small items are appended to segment files in bc2/packs instead of
+ * getting a file of their own. Each record is a blobcache_packrec_t
+ * followed by content type and payload, exactly as in a standalone
+ * file. Only the flush thread writes to packs and it always writes to
+ * the newest one. Segments that are mostly dead are compacted by
+ * moving the live records to the current segment.
+ */
+typedef struct blobcache_packrec {
+  uint64_t pr_key_hash;
+  uint32_t pr_size;  // Content type + payload
+} __attribute__((packed)) blobcache_packrec_t;
+
+#define BLOBCACHE_PACK_MAXITEM  (64 * 1024)
+#define BLOBCACHE_PACK_SEGSIZE  (16 * 1024 * 1024)
+
+LIST_HEAD(blobcache_pack_list, blobcache_pack);
+
+typedef struct blobcache_pack {
+  LIST_ENTRY(blobcache_pack) bp_link;
+  uint32_t bp_id;
+  int bp_refcount;       // List + readers in flight
+  uint64_t bp_size;      // Bytes in file
+  uint64_t bp_live;      // Bytes referenced by items
+  hts_mutex_t bp_mutex;  // Serializes seek + read on bp_fh
+  fa_handle_t *bp_fh;
+} blobcache_pack_t;
+
+static struct blobcache_pack_list packs;
+static blobcache_pack_t *current_pack;
+static fa_handle_t *current_pack_fh;
+static uint32_t next_pack_id = 1;
+
+
 TAILQ_HEAD(blobcache_flush_queue, blobcache_flush);
 
 typedef struct blobcache_flush {
@@ -92,10 +176,22 @@ typedef struct blobcache_flush {
 
 
 
-#define ITEM_HASH_SIZE 256
-#define ITEM_HASH_MASK (ITEM_HASH_SIZE - 1)
+#define ITEM_HASH_INITIAL_SIZE 256
+
+static blobcache_item_t **hashvector;
+static unsigned int hashvector_size; // Always a power of 2
+static unsigned int num_items;
+
+// Keys changed since last save of the index
+static uint64_t *journal_keys;
+static int journal_len;
+static int journal_capacity;
 
-static blobcache_item_t *hashvector[ITEM_HASH_SIZE];
+// Number of records in the on disk journal
+static int journal_records;
+static int index_need_rewrite;
+static int index_loaded;
+static hts_cond_t index_cond;
 
 static struct blobcache_flush_queue flush_queue;
 
@@ -109,7 +205,7 @@ static enum {
   BLOBCACHE_STOPPING,
 } bcstate;
 
-static int loaded_cache_is_from;
+static uint32_t loaded_cache_is_from;
 
 static int index_dirty;
 
@@ -185,87 +281,587 @@ make_filename(char *buf, size_t len, uint64_t hash, int for_write)
  *
  */
 static void
-save_index(void)
+make_pack_filename(char *buf, size_t len, uint32_t id)
+{
+  snprintf(buf, len, "%s/bc2/packs/%08x.pak", gconf.cache_path, id);
+}
+
+
+/**
+ *
+ */
+static blobcache_pack_t *
+pack_get(uint32_t id, int create)
+{
+  blobcache_pack_t *bp;
+
+  LIST_FOREACH(bp, &packs, bp_link)
+    if(bp->bp_id == id)
+      return bp;
+
+  if(!create)
+    return NULL;
+
+  bp = calloc(1, sizeof(blobcache_pack_t));
+  bp->bp_id = id;
+  bp->bp_refcount = 1;
+  hts_mutex_init(&bp->bp_mutex);
+  LIST_INSERT_HEAD(&packs, bp, bp_link);
+  next_pack_id = MAX(next_pack_id, id + 1);
+  return bp;
+}
+
+
+/**
+ * The file is removed once the pack has been unlinked from the list
+ * and all readers are done with it
+ */
+static void
+pack_release(blobcache_pack_t *bp)
 {
-  char errbuf[512];
   char filename[PATH_MAX];
-  uint8_t *out, *base;
-  int i;
+
+  if(--bp->bp_refcount)
+    return;
+
+  if(bp->bp_fh != NULL)
+    fa_close(bp->bp_fh);
+  make_pack_filename(filename, sizeof(filename), bp->bp_id);
+  fa_unlink(filename, NULL, 0);
+  hts_mutex_destroy(&bp->bp_mutex);
+  free(bp);
+}
+
+
+/**
+ *
+ */
+static void
+pack_remove(blobcache_pack_t *bp)
+{
+  LIST_REMOVE(bp, bp_link);
+  if(bp == current_pack) {
+    current_pack = NULL;
+    fa_close(current_pack_fh);
+    current_pack_fh = NULL;
+  }
+  pack_release(bp);
+}
+
+
+/**
+ *
+ */
+static uint32_t
+item_packed_size(const blobcache_item_t *p)
+{
+  return sizeof(blobcache_packrec_t) + p->bi_size + p->bi_content_type_len;
+}
+
+
+/**
+ * Move item to a new location, pack == NULL means a file of its own
+ */
+static void
+item_set_pack(blobcache_item_t *p, blobcache_pack_t *bp, uint32_t offset)
+{
+  blobcache_pack_t *old;
+
+  if(p->bi_pack_id && (old = pack_get(p->bi_pack_id, 0)) != NULL)
+    old->bp_live -= MIN(old->bp_live, item_packed_size(p));
+
+  p->bi_pack_id = bp ? bp->bp_id : 0;
+  p->bi_pack_offset = offset;
+
+  if(bp != NULL)
+    bp->bp_live += item_packed_size(p);
+}
+
+
+/**
+ *
+ */
+static blobcache_item_t **
+item_bucket(uint64_t dk)
+{
+  return &hashvector[dk & (hashvector_size - 1)];
+}
+
+
+/**
+ *
+ */
+static void
+item_hash_resize(unsigned int size)
+{
+  blobcache_item_t **nv = calloc(size, sizeof(blobcache_item_t *));
+  blobcache_item_t *p, *n;
+  unsigned int i;
+
+  if(nv == NULL)
+    return; // Keep going with longer chains
+
+  for(i = 0; i < hashvector_size; i++) {
+    for(p = hashvector[i]; p != NULL; p = n) {
+      n = p->bi_link;
+      p->bi_link = nv[p->bi_key_hash & (size - 1)];
+      nv[p->bi_key_hash & (size - 1)] = p;
+    }
+  }
+  free(hashvector);
+  hashvector = nv;
+  hashvector_size = size;
+}
+
+
+/**
+ *
+ */
+static void
+item_insert(blobcache_item_t *p)
+{
+  if(num_items >= hashvector_size * 2)
+    item_hash_resize(hashvector_size * 2);
+
+  blobcache_item_t **q = item_bucket(p->bi_key_hash);
+  p->bi_link = *q;
+  *q = p;
+  num_items++;
+}
+
+
+/**
+ * Assume we're locked
+ */
+static blobcache_item_t *
+lookup_item(uint64_t dk)
+{
   blobcache_item_t *p;
-  blobcache_diskitem_07_t *di;
-  size_t siz;
+  for(p = *item_bucket(dk); p != NULL; p = p->bi_link)
+    if(p->bi_key_hash == dk)
+      return p;
+  return NULL;
+}
+
 
-  if(!index_dirty)
+/**
+ * Queue key for the next journal append
+ */
+static void
+journal_add(uint64_t dk)
+{
+  index_dirty = 1;
+
+  if(index_need_rewrite)
     return;
 
-  snprintf(filename, sizeof(filename), "%s/bc2/index.dat", gconf.cache_path);
+  if(journal_len == journal_capacity) {
+    int cap = MAX(256, journal_capacity * 2);
+    uint64_t *v = realloc(journal_keys, cap * sizeof(uint64_t));
+    if(v == NULL) {
+      index_need_rewrite = 1;
+      return;
+    }
+    journal_keys = v;
+    journal_capacity = cap;
+  }
+  journal_keys[journal_len++] = dk;
+}
 
-  fa_handle_t *fh = fa_open_ex(filename, errbuf, sizeof(errbuf),
-                               FA_WRITE, NULL);
-  if(fh == NULL) {
-    TRACE(TRACE_ERROR, "blobcache", "Unable to write index %s -- %s",
-          filename, errbuf);
+
+/**
+ *
+ */
+static void
+item_touch(blobcache_item_t *p)
+{
+  if(p->bi_journaled || index_need_rewrite) {
+    index_dirty = 1;
     return;
   }
+  p->bi_journaled = 1;
+  journal_add(p->bi_key_hash);
+}
 
-  int items = 0;
-  siz = 12 + 20;
 
-  for(i = 0; i < ITEM_HASH_SIZE; i++) {
-    for(p = hashvector[i]; p != NULL; p = p->bi_link) {
-      siz += sizeof(blobcache_diskitem_07_t);
-      siz += p->bi_etag ? strlen(p->bi_etag) : 0;
-      items++;
-    }
+/**
+ *
+ */
+static void
+journal_reset(void)
+{
+  int i;
+  blobcache_item_t *p;
+
+  for(i = 0; i < journal_len; i++)
+    if((p = lookup_item(journal_keys[i])) != NULL)
+      p->bi_journaled = 0;
+  journal_len = 0;
+}
+
+
+/**
+ *
+ */
+static uint8_t *
+serialize_item(uint8_t *out, int op, uint64_t dk, const blobcache_item_t *p)
+{
+  blobcache_diskitem_09_t *di9 = (blobcache_diskitem_09_t *)out;
+  blobcache_diskitem_08_t *di = &di9->di_08;
+  const int etaglen = p && p->bi_etag ? strlen(p->bi_etag) : 0;
+
+  memset(di9, 0, sizeof(blobcache_diskitem_09_t));
+  di->di_op       = op;
+  di->di_key_hash = dk;
+
+  if(p != NULL) {
+    di->di_content_hash = p->bi_content_hash;
+    di->di_lastaccess   = p->bi_lastaccess;
+    di->di_expiry       = p->bi_expiry;
+    di->di_modtime      = p->bi_modtime;
+    di->di_size         = p->bi_size;
+    di->di_flags        = p->bi_flags;
+    di->di_etaglen      = etaglen;
+    di->di_content_type_len = p->bi_content_type_len;
+    di9->di_pack_id     = p->bi_pack_id;
+    di9->di_pack_offset = p->bi_pack_offset;
   }
+  out += sizeof(blobcache_diskitem_09_t);
+  if(etaglen) {
+    memcpy(out, p->bi_etag, etaglen);
+    out += etaglen;
+  }
+  return out;
+}
+
+
+/**
+ *
+ */
+static size_t
+item_disksize(const blobcache_item_t *p)
+{
+  return sizeof(blobcache_diskitem_09_t) + (p->bi_etag ? strlen(p->bi_etag) : 0);
+}
+
+
+/**
+ * Write a fresh index with all live items in a single chunk
+ */
+static void
+rewrite_index(void)
+{
+  char errbuf[512];
+  char filename[PATH_MAX];
+  char tmpname[PATH_MAX];
+  uint8_t *out, *base;
+  unsigned int i;
+  blobcache_item_t *p;
+  size_t siz = 8 + sizeof(blobcache_diskchunk_t);
+
+  snprintf(filename, sizeof(filename), "%s/bc2/index.dat", gconf.cache_path);
+  snprintf(tmpname, sizeof(tmpname), "%s/bc2/index.tmp", gconf.cache_path);
+
+  for(i = 0; i < hashvector_size; i++)
+    for(p = hashvector[i]; p != NULL; p = p->bi_link)
+      siz += item_disksize(p);
 
   base = out = mymalloc(siz);
-  if(out == NULL) {
-    fa_close(fh);
+  if(out == NULL)
     return;
-  }
-  *(uint32_t *)out = BC2_MAGIC_07;
-  out += 4;
-  *(uint32_t *)out = items;
+
+  *(uint32_t *)out = BC2_MAGIC_09;
   out += 4;
   *(uint32_t *)out = time(NULL);
   out += 4;
-  for(i = 0; i < ITEM_HASH_SIZE; i++) {
-    for(p = hashvector[i]; p != NULL; p = p->bi_link) {
-      const int etaglen = p->bi_etag ? strlen(p->bi_etag) : 0;
-      di = (blobcache_diskitem_07_t *)out;
-      di->di_key_hash     = p->bi_key_hash;
-      di->di_content_hash = p->bi_content_hash;
-      di->di_lastaccess   = p->bi_lastaccess;
-      di->di_expiry       = p->bi_expiry;
-      di->di_modtime      = p->bi_modtime;
-      di->di_size         = p->bi_size;
-      di->di_flags        = p->bi_flags;
-      di->di_etaglen      = etaglen;
-      di->di_content_type_len = p->bi_content_type_len;
-      out += sizeof(blobcache_diskitem_07_t);
-      if(etaglen) {
-	memcpy(out, p->bi_etag, etaglen);
-	out += etaglen;
-      }
 
+  blobcache_diskchunk_t *dc = (blobcache_diskchunk_t *)out;
+  out += sizeof(blobcache_diskchunk_t);
+  uint8_t *payload = out;
+
+  for(i = 0; i < hashvector_size; i++) {
+    for(p = hashvector[i]; p != NULL; p = p->bi_link) {
+      out = serialize_item(out, BC2_OP_PUT, p->bi_key_hash, p);
+      p->bi_journaled = 0;
     }
   }
+  // Journal state is lost from here on until the new file is in place
+  index_need_rewrite = 1;
 
-  sha1_decl(shactx);
-  sha1_init(shactx);
-  sha1_update(shactx, base, siz - 20);
-  sha1_final(shactx, out);
+  assert(out == base + siz);
+  dc->dc_len  = out - payload;
+  dc->dc_hash = MurHash3_32(payload, dc->dc_len, 0);
+
+  fa_handle_t *fh = fa_open_ex(tmpname, errbuf, sizeof(errbuf),
+                               FA_WRITE, NULL);
+  if(fh == NULL) {
+    TRACE(TRACE_ERROR, "blobcache", "Unable to write index %s -- %s",
+          tmpname, errbuf);
+    free(base);
+    return;
+  }
 
   if(fa_write(fh, base, siz) != siz) {
     TRACE(TRACE_INFO, "blobcache", "Unable to store index file %s -- %s",
+	  tmpname, strerror(errno));
+    fa_close(fh);
+    fa_unlink(tmpname, NULL, 0);
+    free(base);
+    return;
+  }
+  fa_close(fh);
+  free(base);
+
+  if(fa_rename(tmpname, filename, errbuf, sizeof(errbuf))) {
+    TRACE(TRACE_ERROR, "blobcache", "Unable to rename %s -> %s -- %s",
+          tmpname, filename, errbuf);
+    fa_unlink(tmpname, NULL, 0);
+    return;
+  }
+
+  journal_len = 0;
+  journal_records = num_items;
+  index_need_rewrite = 0;
+  index_dirty = 0;
+}
+
+
+/**
+ * Append items changed since last save as a new chunk
+ */
+static void
+append_index(void)
+{
+  char errbuf[512];
+  char filename[PATH_MAX];
+  uint8_t *out, *base;
+  blobcache_item_t *p;
+  size_t siz = sizeof(blobcache_diskchunk_t);
+  int i;
+
+  snprintf(filename, sizeof(filename), "%s/bc2/index.dat", gconf.cache_path);
+
+  for(i = 0; i < journal_len; i++) {
+    p = lookup_item(journal_keys[i]);
+    siz += p != NULL ? item_disksize(p) : sizeof(blobcache_diskitem_09_t);
+  }
+
+  base = out = mymalloc(siz);
+  if(out == NULL)
+    return;
+
+  blobcache_diskchunk_t *dc = (blobcache_diskchunk_t *)out;
+  out += sizeof(blobcache_diskchunk_t);
+  uint8_t *payload = out;
+
+  for(i = 0; i < journal_len; i++) {
+    uint64_t dk = journal_keys[i];
+    p = lookup_item(dk);
+    out = serialize_item(out, p != NULL ? BC2_OP_PUT : BC2_OP_DEL, dk, p);
+  }
+
+  assert(out == base + siz);
+  dc->dc_len  = out - payload;
+  dc->dc_hash = MurHash3_32(payload, dc->dc_len, 0);
+
+  fa_handle_t *fh = fa_open_ex(filename, errbuf, sizeof(errbuf),
+                               FA_WRITE | FA_APPEND, NULL);
+  if(fh == NULL) {
+    TRACE(TRACE_ERROR, "blobcache", "Unable to append to index %s -- %s",
+          filename, errbuf);
+    index_need_rewrite = 1;
+    free(base);
+    return;
+  }
+
+  if(fa_write(fh, base, siz) != siz) {
+    TRACE(TRACE_INFO, "blobcache", "Unable to append to index file %s -- %s",
 	  filename, strerror(errno));
+    // File might have a partial chunk at the end now, start over
+    index_need_rewrite = 1;
   } else {
+    journal_records += journal_len;
+    journal_reset();
     index_dirty = 0;
   }
-
-  free(base);
   fa_close(fh);
+  free(base);
+}
+
+
+/**
+ *
+ */
+static void
+save_index(void)
+{
+  if(!index_dirty || !index_loaded)
+    return;
+
+  if(index_need_rewrite || journal_records > num_items * 2 + 1024)
+    rewrite_index();
+  else
+    append_index();
+}
+
+
+/**
+ * Load indexes written before BC2_MAGIC_08, they are rewritten in the
+ * journal format on next save
+ */
+static void
+load_legacy_index(const uint8_t *in, int64_t size, uint32_t magic)
+{
+  uint8_t digest[20];
+  blobcache_item_t *p;
+  int i;
+
+  sha1_decl(shactx);
+  sha1_init(shactx);
+  sha1_update(shactx, in, size - 20);
+  sha1_final(shactx, digest);
+
+  if(memcmp(digest, in + size - 20, 20)) {
+    TRACE(TRACE_INFO, "blobcache", "Index file corrupt, throwing away cache");
+    return;
+  }
+
+  in += 4;
+  int items = *(uint32_t *)in;
+  in += 4;
+
+  TRACE(TRACE_DEBUG, "blobcache", "Cache magic 0x%08x %d items", magic, items);
+  TRACE(TRACE_INFO, "blobcache", "Upgrading from older format 0x%08x", magic);
+
+  if(magic != BC2_MAGIC_05) {
+    loaded_cache_is_from = *(uint32_t *)in;
+    in += 4;
+  }
+
+  for(i = 0; i < items; i++) {
+    p = pool_get(item_pool);
+    int etaglen;
+
+    switch(magic) {
+    case BC2_MAGIC_05:
+    case BC2_MAGIC_06: {
+      const blobcache_diskitem_06_t *di = (blobcache_diskitem_06_t *)in;
+
+      p->bi_key_hash         = di->di_key_hash;
+      p->bi_content_hash     = di->di_content_hash;
+      p->bi_lastaccess       = di->di_lastaccess;
+      p->bi_expiry           = di->di_expiry;
+      p->bi_modtime          = di->di_modtime;
+      p->bi_size             = di->di_size;
+      p->bi_content_type_len = di->di_content_type_len;
+      p->bi_flags            = 0;
+      etaglen                = di->di_etaglen;
+      in += sizeof(blobcache_diskitem_06_t);
+    }
+      break;
+
+    case BC2_MAGIC_07: {
+      const blobcache_diskitem_07_t *di = (blobcache_diskitem_07_t *)in;
+
+      p->bi_key_hash         = di->di_key_hash;
+      p->bi_content_hash     = di->di_content_hash;
+      p->bi_lastaccess       = di->di_lastaccess;
+      p->bi_expiry           = di->di_expiry;
+      p->bi_modtime          = di->di_modtime;
+      p->bi_size             = di->di_size;
+      p->bi_content_type_len = di->di_content_type_len;
+      p->bi_flags            = di->di_flags;
+      etaglen                = di->di_etaglen;
+      in += sizeof(blobcache_diskitem_07_t);
+    }
+      break;
+    default:
+      abort(); // Prevent compilers whining about etaglen not initialized
+    }
+
+    if(etaglen) {
+      p->bi_etag = malloc(etaglen+1);
+      memcpy(p->bi_etag, in, etaglen);
+      p->bi_etag[etaglen] = 0;
+      in += etaglen;
+    } else {
+      p->bi_etag = NULL;
+    }
+    p->bi_journaled = 0;
+    item_insert(p);
+    current_cache_size += p->bi_size;
+  }
+}
+
+
+/**
+ * Replay one journal chunk. BC2_MAGIC_08 records lack pack location
+ */
+static void
+load_index_chunk(const uint8_t *in, const uint8_t *end, size_t recsize)
+{
+  blobcache_item_t *p, **q;
+
+  while(in + recsize <= end) {
+    const blobcache_diskitem_08_t *di = (blobcache_diskitem_08_t *)in;
+    const blobcache_diskitem_09_t *di9 =
+      recsize == sizeof(blobcache_diskitem_09_t) ?
+      (blobcache_diskitem_09_t *)in : NULL;
+    const int etaglen = di->di_etaglen;
+    const uint64_t dk = di->di_key_hash;
+
+    in += recsize;
+    if(in + etaglen > end)
+      break;
+
+    journal_records++;
+
+    for(q = item_bucket(dk); (p = *q) != NULL; q = &p->bi_link)
+      if(p->bi_key_hash == dk)
+        break;
+
+    if(di->di_op == BC2_OP_DEL) {
+      if(p != NULL) {
+        *q = p->bi_link;
+        num_items--;
+        current_cache_size -= p->bi_size;
+        free(p->bi_etag);
+        pool_put(item_pool, p);
+      }
+      continue;
+    }
+
+    if(p == NULL) {
+      p = pool_get(item_pool);
+      p->bi_key_hash = dk;
+      p->bi_etag = NULL;
+      p->bi_size = 0;
+      p->bi_journaled = 0;
+      item_insert(p);
+    }
+
+    current_cache_size -= p->bi_size;
+    p->bi_content_hash     = di->di_content_hash;
+    p->bi_lastaccess       = di->di_lastaccess;
+    p->bi_expiry           = di->di_expiry;
+    p->bi_modtime          = di->di_modtime;
+    p->bi_size             = di->di_size;
+    p->bi_content_type_len = di->di_content_type_len;
+    p->bi_flags            = di->di_flags;
+    p->bi_pack_id          = di9 ? di9->di_pack_id : 0;
+    p->bi_pack_offset      = di9 ? di9->di_pack_offset : 0;
+    current_cache_size += p->bi_size;
+
+    free(p->bi_etag);
+    if(etaglen) {
+      p->bi_etag = malloc(etaglen + 1);
+      memcpy(p->bi_etag, in, etaglen);
+      p->bi_etag[etaglen] = 0;
+      in += etaglen;
+    } else {
+      p->bi_etag = NULL;
+    }
+  }
 }
 
 
@@ -277,11 +873,12 @@ load_index(void)
 {
   char errbuf[512];
   char filename[PATH_MAX];
-  const uint8_t *in;
+  const uint8_t *in, *end;
   void *base;
-  int i;
-  blobcache_item_t *p;
-  uint8_t digest[20];
+  size_t recsize;
+
+  // If anything goes wrong we start over with a fresh file
+  index_need_rewrite = 1;
 
   snprintf(filename, sizeof(filename), "%s/bc2/index.dat", gconf.cache_path);
 
@@ -312,99 +909,141 @@ load_index(void)
     return;
   }
 
+  uint32_t magic = *(uint32_t *)in;
 
-  sha1_decl(shactx);
-  sha1_init(shactx);
-  sha1_update(shactx, in, size - 20);
-  sha1_final(shactx, digest);
+  switch(magic) {
+  case BC2_MAGIC_05:
+  case BC2_MAGIC_06:
+  case BC2_MAGIC_07:
+    load_legacy_index(in, size, magic);
+    free(base);
+    return;
 
-  if(memcmp(digest, in + size - 20, 20)) {
+  case BC2_MAGIC_08:
+    recsize = sizeof(blobcache_diskitem_08_t);
+    break;
+
+  case BC2_MAGIC_09:
+    recsize = sizeof(blobcache_diskitem_09_t);
+    break;
+
+  default:
+    TRACE(TRACE_INFO, "blobcache", "Invalid magic 0x%08x", magic);
     free(base);
-    TRACE(TRACE_INFO, "blobcache", "Index file corrupt, throwing away cache");
     return;
   }
 
-  uint32_t magic = *(uint32_t *)in;
+  end = in + size;
   in += 4;
-  int items = *(uint32_t *)in;
+  loaded_cache_is_from = *(uint32_t *)in;
   in += 4;
 
-  TRACE(TRACE_DEBUG, "blobcache", "Cache magic 0x%08x %d items", magic, items);
+  int chunks = 0;
+  while(in + sizeof(blobcache_diskchunk_t) <= end) {
+    const blobcache_diskchunk_t *dc = (blobcache_diskchunk_t *)in;
+    in += sizeof(blobcache_diskchunk_t);
+
+    if(dc->dc_len > end - in ||
+       MurHash3_32(in, dc->dc_len, 0) != dc->dc_hash) {
+      TRACE(TRACE_INFO, "blobcache",
+            "Index journal truncated after %d chunks", chunks);
+      free(base);
+      return;
+    }
+    load_index_chunk(in, in + dc->dc_len, recsize);
+    in += dc->dc_len;
+    chunks++;
+  }
+
+  TRACE(TRACE_DEBUG, "blobcache", "Loaded %d items from %d journal records",
+        num_items, journal_records);
+  index_need_rewrite = in != end || magic != BC2_MAGIC_09;
+  free(base);
+}
+
+
+/**
+ * The index is loaded by the flush thread so startup does not have to
+ * wait for it. Callers block here on first access until it's done
+ */
+static void
+wait_for_index(void)
+{
+  while(!index_loaded)
+    hts_cond_wait(&index_cond, &cache_lock);
+}
 
-  switch(magic) {
-  case BC2_MAGIC_06:
-    TRACE(TRACE_INFO, "blobcache", "Upgrading from older format 0x%08x", magic);
-    // FALLTHRU
-  case BC2_MAGIC_07:
-    loaded_cache_is_from = *(uint32_t *)in;
-    in += 4;
-    break;
 
-  case BC2_MAGIC_05:
-    TRACE(TRACE_INFO, "blobcache", "Upgrading from older format 0x%08x", magic);
-    break;
+/**
+ * Remove item if it's still stored at the given location
+ */
+static void
+item_drop(uint64_t dk, uint32_t pack_id, uint32_t offset)
+{
+  blobcache_item_t *p, **q;
 
-  default:
-    TRACE(TRACE_INFO, "blobcache", "Invalid magic 0x%08x", magic);
-    free(base);
+  for(q = item_bucket(dk); (p = *q) != NULL; q = &p->bi_link)
+    if(p->bi_key_hash == dk)
+      break;
+
+  if(p == NULL || p->bi_pack_id != pack_id || p->bi_pack_offset != offset)
     return;
-  }
 
+  *q = p->bi_link;
+  num_items--;
+  current_cache_size -= p->bi_size;
+  journal_add(dk);
+  item_set_pack(p, NULL, 0);
+  free(p->bi_etag);
+  pool_put(item_pool, p);
+}
 
-  for(i = 0; i < items; i++) {
-    p = pool_get(item_pool);
-    int etaglen;
 
-    switch(magic) {
-    case BC2_MAGIC_05:
-    case BC2_MAGIC_06: {
-      const blobcache_diskitem_06_t *di = (blobcache_diskitem_06_t *)in;
+/**
+ * Read a record from a pack with a single read. The record header is
+ * verified so a stale location is detected
+ */
+static buf_t *
+pack_read(blobcache_pack_t *bp, uint64_t dk, uint32_t offset,
+          uint32_t size, uint32_t ctlen, int pad)
+{
+  char filename[PATH_MAX];
+  const size_t hdrlen = sizeof(blobcache_packrec_t);
+  const size_t total = hdrlen + ctlen + size;
+  buf_t *b = buf_create(total + pad);
 
-      p->bi_key_hash         = di->di_key_hash;
-      p->bi_content_hash     = di->di_content_hash;
-      p->bi_lastaccess       = di->di_lastaccess;
-      p->bi_expiry           = di->di_expiry;
-      p->bi_modtime          = di->di_modtime;
-      p->bi_size             = di->di_size;
-      p->bi_content_type_len = di->di_content_type_len;
-      p->bi_flags            = 0;
-      etaglen                = di->di_etaglen;
-      in += sizeof(blobcache_diskitem_06_t);
-    }
-      break;
+  if(b == NULL)
+    return NULL;
 
-    case BC2_MAGIC_07: {
-      const blobcache_diskitem_07_t *di = (blobcache_diskitem_07_t *)in;
+  hts_mutex_lock(&bp->bp_mutex);
 
-      p->bi_key_hash         = di->di_key_hash;
-      p->bi_content_hash     = di->di_content_hash;
-      p->bi_lastaccess       = di->di_lastaccess;
-      p->bi_expiry           = di->di_expiry;
-      p->bi_modtime          = di->di_modtime;
-      p->bi_size             = di->di_size;
-      p->bi_content_type_len = di->di_content_type_len;
-      p->bi_flags            = di->di_flags;
-      etaglen                = di->di_etaglen;
-      in += sizeof(blobcache_diskitem_07_t);
-    }
-      break;
-    default:
-      abort(); // Prevent compilers whining about etaglen not initialized
-    }
+  if(bp->bp_fh == NULL) {
+    make_pack_filename(filename, sizeof(filename), bp->bp_id);
+    bp->bp_fh = fa_open(filename, NULL, 0);
+  }
 
-    if(etaglen) {
-      p->bi_etag = malloc(etaglen+1);
-      memcpy(p->bi_etag, in, etaglen);
-      p->bi_etag[etaglen] = 0;
-      in += etaglen;
-    } else {
-      p->bi_etag = NULL;
-    }
-    p->bi_link = hashvector[p->bi_key_hash & ITEM_HASH_MASK];
-    hashvector[p->bi_key_hash & ITEM_HASH_MASK] = p;
-    current_cache_size += p->bi_size;
+  if(bp->bp_fh == NULL ||
+     fa_seek(bp->bp_fh, offset, SEEK_SET) != offset ||
+     fa_read(bp->bp_fh, b->b_ptr, total) != total) {
+    hts_mutex_unlock(&bp->bp_mutex);
+    buf_release(b);
+    return NULL;
   }
-  free(base);
+  hts_mutex_unlock(&bp->bp_mutex);
+
+  const blobcache_packrec_t *pr = b->b_ptr;
+  if(pr->pr_key_hash != dk || pr->pr_size != ctlen + size) {
+    buf_release(b);
+    return NULL;
+  }
+
+  if(ctlen)
+    b->b_content_type = rstr_allocl(b->b_ptr + hdrlen, ctlen);
+
+  b->b_ptr += hdrlen + ctlen;
+  b->b_size = size;
+  memset(b->b_ptr + size, 0, pad);
+  return b;
 }
 
 
@@ -427,18 +1066,16 @@ blobcache_put(const char *key, const char *stash, buf_t *b,
   bcprintf("cache: Writing %s ... ", key);
 
   hts_mutex_lock(&cache_lock);
+  wait_for_index();
   if(bcstate != BLOBCACHE_RUN) {
     bcprintf("Cache not running\n");
     hts_mutex_unlock(&cache_lock);
     return 0;
   }
 
-  for(p = hashvector[dk & ITEM_HASH_MASK]; p != NULL; p = p->bi_link)
-    if(p->bi_key_hash == dk)
-      break;
+  p = lookup_item(dk);
 
   hts_cond_signal(&cache_cond);
-  index_dirty = 1;
 
   if(p != NULL && p->bi_content_hash == dc && p->bi_size == b->b_size) {
     p->bi_modtime = mtime;
@@ -446,6 +1083,7 @@ blobcache_put(const char *key, const char *stash, buf_t *b,
     p->bi_lastaccess = now;
     p->bi_flags = flags;
     mystrset(&p->bi_etag, etag);
+    item_touch(p);
     hts_mutex_unlock(&cache_lock);
     bcprintf("Already in\n");
     return 1;
@@ -464,9 +1102,13 @@ blobcache_put(const char *key, const char *stash, buf_t *b,
     p->bi_key_hash = dk;
     p->bi_size = 0;
     p->bi_content_type_len = 0;
-    p->bi_link = hashvector[dk & ITEM_HASH_MASK];
     p->bi_etag = NULL;
-    hashvector[dk & ITEM_HASH_MASK] = p;
+    p->bi_journaled = 0;
+    p->bi_pack_id = 0;
+    item_insert(p);
+  } else {
+    // Old content is dead, new location is assigned once flushed
+    item_set_pack(p, NULL, 0);
   }
 
   int64_t expiry = (int64_t)maxage + now;
@@ -482,6 +1124,7 @@ blobcache_put(const char *key, const char *stash, buf_t *b,
   p->bi_content_type_len = b->b_content_type ?
     strlen(rstr_get(b->b_content_type)) : 0;
   p->bi_flags = flags;
+  item_touch(p);
   hts_mutex_unlock(&cache_lock);
   return 0;
 }
@@ -502,12 +1145,13 @@ blobcache_get(const char *key, const char *stash, int pad,
   bcprintf("cache: Reading %s ... ", key);
 
   hts_mutex_lock(&cache_lock);
+  wait_for_index();
 
   if(bcstate == BLOBCACHE_STOPPING) {
     bcprintf("Cache stopped ... ");
     p = NULL;
   } else {
-    for(q = &hashvector[dk & ITEM_HASH_MASK]; (p = *q); q = &p->bi_link)
+    for(q = item_bucket(dk); (p = *q); q = &p->bi_link)
       if(p->bi_key_hash == dk)
 	break;
   }
@@ -534,6 +1178,11 @@ blobcache_get(const char *key, const char *stash, int pad,
   blobcache_flush_t *bf;
   buf_t *b = NULL;
   fa_handle_t *fh = NULL;
+  blobcache_pack_t *bp = NULL;
+  const uint32_t size = p->bi_size;
+  const uint32_t ctlen = p->bi_content_type_len;
+  const uint32_t pack_offset = p->bi_pack_offset;
+
   TAILQ_FOREACH_REVERSE(bf, &flush_queue, blobcache_flush_queue, bf_link) {
     if(bf->bf_key_hash == p->bi_key_hash) {
       // Item is not yet written to disk
@@ -542,12 +1191,22 @@ blobcache_get(const char *key, const char *stash, int pad,
     }
   }
 
-  if(b == NULL) {
+  if(b == NULL && p->bi_pack_id) {
+    if((bp = pack_get(p->bi_pack_id, 0)) == NULL)
+      goto bad;
+    bp->bp_refcount++;
+
+  } else if(b == NULL) {
     make_filename(filename, sizeof(filename), p->bi_key_hash, 0);
     fh = fa_open(filename, NULL, 0);
     if(fh == NULL) {
     bad:
       *q = p->bi_link;
+      num_items--;
+      current_cache_size -= p->bi_size;
+      journal_add(p->bi_key_hash);
+      item_set_pack(p, NULL, 0);
+      free(p->bi_etag);
       pool_put(item_pool, p);
       hts_mutex_unlock(&cache_lock);
       return NULL;
@@ -568,40 +1227,50 @@ blobcache_get(const char *key, const char *stash, int pad,
     *etagp = p->bi_etag ? strdup(p->bi_etag) : NULL;
 
   // Only mark lastaccess if clock is good
-  if(bcstate == BLOBCACHE_RUN)
+  if(bcstate == BLOBCACHE_RUN) {
     p->bi_lastaccess = now;
-
-  index_dirty = 1; // We don't deem it important enough to wakeup on get
+    // We don't deem it important enough to wakeup on get
+    item_touch(p);
+  }
 
   if(ignore_expiry != NULL)
     *ignore_expiry = expired;
 
   hts_mutex_unlock(&cache_lock);
 
-  if(b == NULL) {
+  if(bp != NULL) {
+    b = pack_read(bp, dk, pack_offset, size, ctlen, pad);
+
+    hts_mutex_lock(&cache_lock);
+    if(b == NULL)
+      item_drop(dk, bp->bp_id, pack_offset);
+    pack_release(bp);
+    hts_mutex_unlock(&cache_lock);
+
+  } else if(b == NULL) {
 
-    b = buf_create(p->bi_size + pad);
+    // 'p' may be gone once cache_lock is released, use the copies
+    b = buf_create(size + pad);
     if(b == NULL) {
       fa_close(fh);
       return NULL;
     }
-    b->b_size = p->bi_size; // Get rid of padding in reported length
-    if(p->bi_content_type_len) {
-      b->b_content_type = rstr_allocl(NULL, p->bi_content_type_len);
-      if(fa_read(fh, rstr_data(b->b_content_type), p->bi_content_type_len) !=
-	 p->bi_content_type_len) {
+    b->b_size = size; // Get rid of padding in reported length
+    if(ctlen) {
+      b->b_content_type = rstr_allocl(NULL, ctlen);
+      if(fa_read(fh, rstr_data(b->b_content_type), ctlen) != ctlen) {
 	buf_release(b);
 	fa_close(fh);
 	return NULL;
       }
     }
 
-    if(fa_read(fh, b->b_ptr, p->bi_size) != p->bi_size) {
+    if(fa_read(fh, b->b_ptr, size) != size) {
       buf_release(b);
       fa_close(fh);
       return NULL;
     }
-    memset(b->b_ptr + p->bi_size, 0, pad);
+    memset(b->b_ptr + size, 0, pad);
     fa_close(fh);
   }
   return b;
@@ -616,19 +1285,18 @@ blobcache_get(const char *key, const char *stash, int pad,
  */
 int
 blobcache_get_meta(const char *key, const char *stash, 
-		   char **etagp, time_t *mtimep)
+		   char **etagp, time_t *mtimep, int *is_expired)
 {
   uint64_t dk = digest_key(key, stash);
   blobcache_item_t *p;
   int r;
   hts_mutex_lock(&cache_lock);
+  wait_for_index();
 
   if(bcstate == BLOBCACHE_STOPPING) {
     p = NULL;
   } else {
-    for(p = hashvector[dk & ITEM_HASH_MASK]; p != NULL; p = p->bi_link)
-      if(p->bi_key_hash == dk)
-	break;
+    p = lookup_item(dk);
   }
 
   if(p != NULL) {
@@ -640,6 +1308,11 @@ blobcache_get_meta(const char *key, const char *stash,
     if(etagp != NULL)
       *etagp = p->bi_etag ? strdup(p->bi_etag) : NULL;
 
+    if(is_expired != NULL) {
+      time_t now = time(NULL);
+      *is_expired = now > p->bi_expiry && now >= 1426926328;
+    }
+
   } else {
     r = -1;
   }
@@ -649,19 +1322,6 @@ blobcache_get_meta(const char *key, const char *stash,
 }
 
 
-/**
- * Assume we're locked
- */
-static blobcache_item_t *
-lookup_item(uint64_t dk)
-{
-  blobcache_item_t *p;
-  for(p = hashvector[dk & ITEM_HASH_MASK]; p != NULL; p = p->bi_link)
-    if(p->bi_key_hash == dk)
-      return p;
-  return NULL;
-}
-
 /**
  *
  */
@@ -682,7 +1342,7 @@ prune_stale(void)
 
   RB_FOREACH(de1, &d1->fd_entries, fde_link) {
     const char *n1 = rstr_get(de1->fde_filename);
-    if(n1[0] != '.') {
+    if(n1[0] != '.' && strcmp(n1, "packs")) {
       snprintf(path2, sizeof(path2), "%s/bc2/%s",
 	       gconf.cache_path, n1);
 
@@ -722,8 +1382,14 @@ static void
 prune_item(blobcache_item_t *p)
 {
   char filename[PATH_MAX];
-  make_filename(filename, sizeof(filename), p->bi_key_hash, 0);
-  fa_unlink(filename, NULL, 0);
+  if(p->bi_pack_id) {
+    // Space is reclaimed when the pack is compacted
+    item_set_pack(p, NULL, 0);
+  } else {
+    make_filename(filename, sizeof(filename), p->bi_key_hash, 0);
+    fa_unlink(filename, NULL, 0);
+  }
+  free(p->bi_etag);
   pool_put(item_pool, p);
 }
 
@@ -738,13 +1404,16 @@ blobcache_evict(const char *key, const char *stash)
   uint64_t dk = digest_key(key, stash);
 
   hts_mutex_lock(&cache_lock);
+  wait_for_index();
   if(bcstate == BLOBCACHE_RUN) {
     blobcache_item_t *p, **q;
-    q = &hashvector[dk & ITEM_HASH_MASK];
+    q = item_bucket(dk);
     while((p = *q) != NULL) {
       if(p->bi_key_hash == dk) {
         current_cache_size -= p->bi_size;
         *q = p->bi_link;
+        num_items--;
+        journal_add(dk);
         prune_item(p);
         break;
       }
@@ -755,67 +1424,77 @@ blobcache_evict(const char *key, const char *stash)
 }
 
 
+#define PRUNE_BUCKETS 256
+
 /**
- *
+ * Map an item to its eviction order. Non-important items go first and
+ * within each class older items go first. Items are grouped into
+ * buckets by last access time
  */
 static int
-accesstimecmp(const void *A, const void *B)
+prune_bucket(const blobcache_item_t *p, uint32_t oldest, uint64_t span)
 {
-  const blobcache_item_t *a = *(const blobcache_item_t **)A;
-  const blobcache_item_t *b = *(const blobcache_item_t **)B;
-
-  const int a_imp = !!(a->bi_flags & BLOBCACHE_IMPORTANT_ITEM);
-  const int b_imp = !!(b->bi_flags & BLOBCACHE_IMPORTANT_ITEM);
-
-  if(a_imp != b_imp)
-    return a_imp - b_imp;
-
-  return a->bi_lastaccess - b->bi_lastaccess;
+  int b = (uint64_t)(p->bi_lastaccess - oldest) * PRUNE_BUCKETS / span;
+  return b + (p->bi_flags & BLOBCACHE_IMPORTANT_ITEM ? PRUNE_BUCKETS : 0);
 }
 
 
 /**
+ * Evict least recently used items until the cache is below maxsize
  *
+ * Instead of sorting all items we build a histogram of sizes per
+ * access-time bucket, find the bucket where enough data has been
+ * accumulated and then evict everything older than that in a second
+ * pass. Items within the cutoff bucket are evicted in hash order
  */
 static void
 prune_to_size(uint64_t maxsize)
 {
-  int i, tot = 0, j = 0;
-  blobcache_item_t *p, **sv;
-
-  for(i = 0; i < ITEM_HASH_SIZE; i++)
-    for(p = hashvector[i]; p != NULL; p = p->bi_link)
-      tot++;
+  uint64_t sizes[PRUNE_BUCKETS * 2] = {0};
+  uint32_t oldest = UINT32_MAX, newest = 0;
+  blobcache_item_t *p, **q;
+  unsigned int i;
+  int cutoff;
 
-  sv = malloc(sizeof(blobcache_item_t *) * tot);
   current_cache_size = 0;
-  for(i = 0; i < ITEM_HASH_SIZE; i++) {
+  for(i = 0; i < hashvector_size; i++) {
     for(p = hashvector[i]; p != NULL; p = p->bi_link) {
-      sv[j++] = p;
       current_cache_size += p->bi_size;
+      oldest = MIN(oldest, p->bi_lastaccess);
+      newest = MAX(newest, p->bi_lastaccess);
     }
-    hashvector[i] = NULL;
   }
 
-  assert(j == tot);
+  if(current_cache_size >= maxsize) {
+    const uint64_t span = (uint64_t)newest - oldest + 1;
+    uint64_t acc = 0;
 
-  qsort(sv, j, sizeof(blobcache_item_t *), accesstimecmp);
-  for(i = 0; i < j; i++) {
-    p = sv[i];
-    if(current_cache_size < maxsize)
-      break;
-    current_cache_size -= p->bi_size;
-    prune_item(p);
-    index_dirty = 1;
-  }
+    for(i = 0; i < hashvector_size; i++)
+      for(p = hashvector[i]; p != NULL; p = p->bi_link)
+        sizes[prune_bucket(p, oldest, span)] += p->bi_size;
 
-  for(; i < j; i++) {
-    p = sv[i];
-    p->bi_link = hashvector[p->bi_key_hash & ITEM_HASH_MASK];
-    hashvector[p->bi_key_hash & ITEM_HASH_MASK] = p;
-  }
+    for(cutoff = 0; cutoff < PRUNE_BUCKETS * 2 - 1; cutoff++) {
+      acc += sizes[cutoff];
+      if(current_cache_size - acc < maxsize)
+        break;
+    }
 
-  free(sv);
+    for(i = 0; i < hashvector_size; i++) {
+      q = &hashvector[i];
+      while((p = *q) != NULL) {
+        const int b = prune_bucket(p, oldest, span);
+        if(b < cutoff || (b == cutoff && current_cache_size >= maxsize)) {
+          *q = p->bi_link;
+          num_items--;
+          current_cache_size -= p->bi_size;
+          journal_add(p->bi_key_hash);
+          prune_item(p);
+        } else {
+          q = &p->bi_link;
+        }
+      }
+    }
+  }
   save_index();
 }
 
@@ -847,20 +1526,24 @@ blobcache_prune_old(void)
 static void
 cache_clear(void *opaque, prop_event_t event, ...)
 {
-  int i;
+  unsigned int i;
   blobcache_item_t *p, *n;
 
   hts_mutex_lock(&cache_lock);
+  wait_for_index();
 
-  for(i = 0; i < ITEM_HASH_SIZE; i++) {
+  for(i = 0; i < hashvector_size; i++) {
     for(p = hashvector[i]; p != NULL; p = n) {
       n = p->bi_link;
       prune_item(p);
-      index_dirty = 1;
     }
     hashvector[i] = NULL;
   }
+  num_items = 0;
   current_cache_size = 0;
+  journal_len = 0;
+  index_need_rewrite = 1;
+  index_dirty = 1;
   save_index();
   hts_mutex_unlock(&cache_lock);
   notify_add(NULL, NOTIFY_INFO, NULL, 3, _("Cache cleared"));
@@ -868,6 +1551,244 @@ cache_clear(void *opaque, prop_event_t event, ...)
 
 
 
+/**
+ * Append a record to the current pack. Only called from the flush
+ * thread without cache_lock held
+ */
+static blobcache_pack_t *
+pack_append(uint64_t dk, const void *ct, uint32_t ctlen,
+            const void *data, uint32_t size, uint32_t *offsetp)
+{
+  char filename[PATH_MAX];
+  blobcache_pack_t *bp;
+  blobcache_packrec_t pr;
+
+  if(current_pack != NULL && current_pack->bp_size >= BLOBCACHE_PACK_SEGSIZE) {
+    fa_close(current_pack_fh);
+    current_pack_fh = NULL;
+    current_pack = NULL;
+  }
+
+  if(current_pack == NULL) {
+    hts_mutex_lock(&cache_lock);
+    bp = pack_get(next_pack_id, 1);
+    hts_mutex_unlock(&cache_lock);
+
+    make_pack_filename(filename, sizeof(filename), bp->bp_id);
+    current_pack_fh = fa_open_ex(filename, NULL, 0, FA_WRITE, NULL);
+    if(current_pack_fh == NULL) {
+      hts_mutex_lock(&cache_lock);
+      pack_remove(bp);
+      hts_mutex_unlock(&cache_lock);
+      return NULL;
+    }
+    current_pack = bp;
+  }
+
+  bp = current_pack;
+
+  pr.pr_key_hash = dk;
+  pr.pr_size = ctlen + size;
+
+  if(fa_write(current_pack_fh, &pr, sizeof(pr)) != sizeof(pr) ||
+     fa_write(current_pack_fh, ct, ctlen) != ctlen ||
+     fa_write(current_pack_fh, data, size) != size) {
+    // Don't know what made it to disk, continue in a new segment
+    TRACE(TRACE_ERROR, "blobcache", "Unable to write to pack %08x",
+          bp->bp_id);
+    fa_close(current_pack_fh);
+    current_pack_fh = NULL;
+    current_pack = NULL;
+    bp->bp_size = BLOBCACHE_PACK_SEGSIZE;
+    return NULL;
+  }
+
+  *offsetp = bp->bp_size;
+  bp->bp_size += sizeof(pr) + ctlen + size;
+  return bp;
+}
+
+
+/**
+ * Move the live records out of the most fragmented pack. Called with
+ * cache_lock held from the flush thread. Returns 1 if a pack was
+ * processed
+ */
+static int
+pack_compact(void)
+{
+  char filename[PATH_MAX];
+  blobcache_pack_t *bp, *dst;
+  blobcache_item_t *p;
+  uint32_t offset, newoffset;
+  int moved = 0;
+
+  LIST_FOREACH(bp, &packs, bp_link)
+    if(bp != current_pack &&
+       (bp->bp_live == 0 || bp->bp_live * 2 < bp->bp_size))
+      break;
+
+  if(bp == NULL)
+    return 0;
+
+  if(bp->bp_live == 0) {
+    pack_remove(bp);
+    return 1;
+  }
+
+  bp->bp_refcount++;
+  hts_mutex_unlock(&cache_lock);
+
+  make_pack_filename(filename, sizeof(filename), bp->bp_id);
+  fa_handle_t *fh = fa_open(filename, NULL, 0);
+  buf_t *b = fh != NULL ? fa_load_and_close(fh) : NULL;
+
+  hts_mutex_lock(&cache_lock);
+
+  if(b != NULL) {
+    const uint8_t *data = b->b_ptr;
+    offset = 0;
+
+    while(offset + sizeof(blobcache_packrec_t) <= b->b_size) {
+      const blobcache_packrec_t *pr = (const void *)(data + offset);
+      const uint32_t reclen = sizeof(blobcache_packrec_t) + pr->pr_size;
+      if(offset + reclen > b->b_size)
+        break;
+
+      p = lookup_item(pr->pr_key_hash);
+      if(p != NULL && p->bi_pack_id == bp->bp_id &&
+         p->bi_pack_offset == offset &&
+         pr->pr_size == p->bi_size + p->bi_content_type_len) {
+
+        const uint32_t ctlen = p->bi_content_type_len;
+        const uint64_t dk = pr->pr_key_hash;
+
+        hts_mutex_unlock(&cache_lock);
+        dst = pack_append(dk, pr + 1, ctlen, (const uint8_t *)(pr + 1) + ctlen,
+                          pr->pr_size - ctlen, &newoffset);
+        hts_mutex_lock(&cache_lock);
+
+        if(dst == NULL)
+          break;
+
+        // Item might have been changed while we were unlocked
+        p = lookup_item(dk);
+        if(p != NULL && p->bi_pack_id == bp->bp_id &&
+           p->bi_pack_offset == offset) {
+          item_set_pack(p, dst, newoffset);
+          journal_add(dk);
+          moved++;
+        }
+      }
+      offset += reclen;
+    }
+    buf_release(b);
+  }
+
+  TRACE(TRACE_DEBUG, "blobcache", "Compacted pack %08x, %d items moved",
+        bp->bp_id, moved);
+
+  // Anything left behind is lost, reading will fail and drop the items
+  pack_remove(bp);
+  pack_release(bp);
+  return 1;
+}
+
+
+/**
+ * Compute space used in each pack and get rid of unreferenced packs
+ */
+static void
+load_packs(void)
+{
+  char path[PATH_MAX];
+  char filename[PATH_MAX];
+  blobcache_pack_t *bp;
+  blobcache_item_t *p;
+  fa_dir_t *fd;
+  fa_dir_entry_t *fde;
+  unsigned int i, id;
+  fa_stat_t st;
+
+  for(i = 0; i < hashvector_size; i++) {
+    for(p = hashvector[i]; p != NULL; p = p->bi_link) {
+      if(p->bi_pack_id) {
+        bp = pack_get(p->bi_pack_id, 1);
+        bp->bp_live += item_packed_size(p);
+      }
+    }
+  }
+
+  snprintf(path, sizeof(path), "%s/bc2/packs", gconf.cache_path);
+  fa_makedir(path);
+
+  if((fd = fa_scandir(path, NULL, 0)) == NULL)
+    return;
+
+  RB_FOREACH(fde, &fd->fd_entries, fde_link) {
+    const char *fn = rstr_get(fde->fde_filename);
+    if(sscanf(fn, "%08x.pak", &id) != 1)
+      continue;
+
+    snprintf(filename, sizeof(filename), "%s/%s", path, fn);
+
+    if((bp = pack_get(id, 0)) == NULL) {
+      TRACE(TRACE_DEBUG, "blobcache", "Removed unreferenced pack %s", fn);
+      fa_unlink(filename, NULL, 0);
+      continue;
+    }
+    next_pack_id = MAX(next_pack_id, id + 1);
+    if(!fa_stat(filename, &st, NULL, 0))
+      bp->bp_size = st.fs_size;
+  }
+  fa_dir_free(fd);
+}
+
+
+/**
+ * Write a flushed buffer to a pack or to a file of its own
+ */
+static void
+flush_item(blobcache_flush_t *bf)
+{
+  char filename[PATH_MAX];
+  buf_t *b = bf->bf_buf;
+  const char *ct = rstr_get(b->b_content_type);
+  const uint32_t ctlen = ct ? strlen(ct) : 0;
+  blobcache_pack_t *bp = NULL;
+  blobcache_item_t *p;
+  uint32_t offset = 0;
+
+  if(!gconf.disable_blobcache_packs &&
+     ctlen + b->b_size <= BLOBCACHE_PACK_MAXITEM)
+    bp = pack_append(bf->bf_key_hash, ct, ctlen, b->b_ptr, b->b_size,
+                     &offset);
+
+  if(bp == NULL) {
+    make_filename(filename, sizeof(filename), bf->bf_key_hash, 1);
+
+    fa_handle_t *fh = fa_open_ex(filename, NULL, 0, FA_WRITE, NULL);
+    if(fh != NULL) {
+
+      if(ctlen && fa_write(fh, ct, ctlen) != ctlen)
+        fa_unlink(filename, NULL, 0);
+
+      if(fa_write(fh, b->b_ptr, b->b_size) != b->b_size)
+        fa_unlink(filename, NULL, 0);
+
+      fa_close(fh);
+    }
+  }
+
+  hts_mutex_lock(&cache_lock);
+  if((p = lookup_item(bf->bf_key_hash)) != NULL &&
+     (bp != NULL || p->bi_pack_id)) {
+    item_set_pack(p, bp, offset);
+    item_touch(p);
+  }
+}
+
+
 /**
  *
  */
@@ -876,6 +1797,13 @@ flushthread(void *aux)
 {
   blobcache_flush_t *bf;
 
+  hts_mutex_lock(&cache_lock);
+  load_index();
+  load_packs();
+  index_loaded = 1;
+  hts_cond_broadcast(&index_cond);
+  hts_mutex_unlock(&cache_lock);
+
   sleep(3);
 
   prune_stale();
@@ -888,7 +1816,7 @@ flushthread(void *aux)
   TRACE(TRACE_INFO, "blobcache",
 	"Initialized: %d items consuming %.2f MB "
         "(out of maximum %.2f MB) on disk in %s/bc2",
-	pool_num(item_pool), current_cache_size / 1000000.0,
+	num_items, current_cache_size / 1000000.0,
         maxsize / 1000000.0, gconf.cache_path);
 
   // First make sure clock is valid
@@ -909,6 +1837,9 @@ flushthread(void *aux)
 
     if((bf = TAILQ_FIRST(&flush_queue)) == NULL) {
 
+      if(pack_compact())
+        continue;
+
       if(index_dirty) {
         if(hts_cond_wait_timeout(&cache_cond, &cache_lock, 5000))
           save_index();
@@ -919,26 +1850,7 @@ flushthread(void *aux)
     }
 
     hts_mutex_unlock(&cache_lock);
-    char filename[PATH_MAX];
-    make_filename(filename, sizeof(filename), bf->bf_key_hash, 1);
-    buf_t *b = bf->bf_buf;
-
-    fa_handle_t *fh = fa_open_ex(filename, NULL, 0, FA_WRITE, NULL);
-    if(fh != NULL) {
-
-      if(b->b_content_type != NULL) {
-	const char *str = rstr_get(b->b_content_type);
-	size_t len = strlen(str);
-	if(fa_write(fh, str, len) != len)
-	  fa_unlink(filename, NULL, 0);
-      }
-
-      if(fa_write(fh, b->b_ptr, b->b_size) != b->b_size)
-        fa_unlink(filename, NULL, 0);
-
-      fa_close(fh);
-    }
-    hts_mutex_lock(&cache_lock);
+    flush_item(bf); // Returns with cache_lock held
 
     assert(TAILQ_FIRST(&flush_queue) == bf);
     TAILQ_REMOVE(&flush_queue, bf, bf_link);
@@ -947,10 +1859,15 @@ flushthread(void *aux)
 
     uint64_t maxsize = blobcache_compute_maxsize();
 
+    // Leave some headroom so we don't end up scanning on every write
     if(maxsize < current_cache_size)
-      prune_to_size(maxsize);
+      prune_to_size(maxsize - maxsize / 16);
   }
   save_index();
+  if(current_pack_fh != NULL)
+    fa_close(current_pack_fh);
+  current_pack_fh = NULL;
+  current_pack = NULL;
   hts_mutex_unlock(&cache_lock);
   return NULL;
 }
@@ -978,11 +1895,11 @@ blobcache_init(void)
 
   hts_mutex_init(&cache_lock);
   hts_cond_init(&cache_cond, &cache_lock);
+  hts_cond_init(&index_cond, &cache_lock);
   item_pool = pool_create("blobcacheitems", sizeof(blobcache_item_t), 0);
 
-
-  load_index();
-
+  hashvector_size = ITEM_HASH_INITIAL_SIZE;
+  hashvector = calloc(hashvector_size, sizeof(blobcache_item_t *));
 
   prop_t *dir = setting_get_dir("general:resets");
   settings_create_action(dir, _p("Clear cached files"),
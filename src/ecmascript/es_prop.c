@@ -349,15 +349,8 @@ es_prop_has_duk(duk_context *ctx)
 
   hts_mutex_lock(&prop_mutex);
 
-  if(p->hp_type == PROP_DIR) {
-    prop_t *c;
-    TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link) {
-      if(c->hp_name != NULL && !strcmp(c->hp_name, name)) {
-        yes = 1;
-        break;
-      }
-    }
-  }
+  if(p->hp_type == PROP_DIR)
+    yes = prop_find_child0(p, name) != NULL;
   hts_mutex_unlock(&prop_mutex);
   duk_push_boolean(ctx, yes);
   return 1;
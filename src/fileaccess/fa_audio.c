@@ -102,84 +102,78 @@ rescale(AVFormatContext *fctx, int64_t ts, int si)
 
 #define MB_SPECIAL_EOF ((void *)-1)
 
+// Number of packets demuxed ahead when pre-opening the next track
+#define AUDIO_PREOPEN_PACKETS 32
+
+/**
+ * An opened and probed audio file, ready to be played
+ */
+struct audio_preopen {
+  AVFormatContext *ap_fctx;
+  media_format_t *ap_fw;
+  media_codec_t *ap_cw;
+  int ap_stream;
+  int ap_error;  // Demuxing ahead hit EOF or error, delivered after ap_head
+  struct media_buf_queue ap_head; // Packets demuxed ahead of playback
+};
+
+
 /**
  *
  */
 static void
-seekflush(media_pipe_t *mp, media_buf_t **mbp)
+audio_preopen_flush(audio_preopen_t *ap, media_pipe_t *mp)
+{
+  media_buf_t *mb;
+
+  while((mb = TAILQ_FIRST(&ap->ap_head)) != NULL) {
+    TAILQ_REMOVE(&ap->ap_head, mb, mb_link);
+    media_buf_free_unlocked(mp, mb);
+  }
+  ap->ap_error = 0;
+}
+
+
+/**
+ *
+ */
+void
+fa_audio_preopen_free(audio_preopen_t *ap, media_pipe_t *mp)
+{
+  audio_preopen_flush(ap, mp);
+  media_codec_deref(ap->ap_cw);
+  media_format_deref(ap->ap_fw);
+  free(ap);
+}
+
+
+/**
+ *
+ */
+static void
+seekflush(media_pipe_t *mp, media_buf_t **mbp, audio_preopen_t *ap)
 {
   mp_flush(mp);
+  audio_preopen_flush(ap, mp);
   
   if(*mbp != NULL && *mbp != MB_SPECIAL_EOF)
     media_buf_free_unlocked(mp, *mbp);
   *mbp = NULL;
 }
 
+
 /**
- *
+ * Open format and audio codec
  */
-event_t *
-be_file_playaudio(const char *url, media_pipe_t *mp,
-		  char *errbuf, size_t errlen, int hold, const char *mimetype,
-                  void *opaque)
+static audio_preopen_t *
+audio_open(fa_handle_t *fh, const char *url, media_pipe_t *mp,
+           char *errbuf, size_t errlen, const char *mimetype)
 {
   AVFormatContext *fctx;
   AVCodecContext *ctx;
-  AVPacket pkt;
   media_format_t *fw;
-  int i, r, si;
-  media_buf_t *mb = NULL;
-  media_queue_t *mq;
-  event_ts_t *ets;
-  int64_t ts;
-  media_codec_t *cw;
-  event_t *e;
-  int registered_play = 0;
-  uint8_t pb[4096];
-  size_t psiz;
-
-  mp->mp_seek_base = 0;
-
-  fa_handle_t *fh = fa_open_ex(url, errbuf, errlen, FA_BUFFERED_SMALL, NULL);
-  if(fh == NULL)
-    return NULL;
-
-
-  psiz = fa_read(fh, pb, sizeof(pb));
-  if(psiz < 128) {
-    fa_close(fh);
-    snprintf(errbuf, errlen, "File too small");
-    return NULL;
-  }
-
-  if(pb[0] == 0x50 && pb[1] == 0x4b && pb[2] == 0x03 && pb[3] == 0x04)
-    // ZIP File
-    return audio_play_zipfile(fh, mp, errbuf, errlen, hold);
-
-#if ENABLE_PLUGINS
-  plugin_probe_for_autoinstall(fh, pb, psiz, url);
-#endif
-
-#if ENABLE_VMIR
-  metadata_t *md = metadata_create();
-  if(np_fa_probe(fh, pb, psiz, md, url) == 0) {
-    fa_close_with_park(fh, 1);
-    event_t *e = NULL;
-    if(md->md_redirect == NULL) {
-      snprintf(errbuf, errlen, "External player provided no redirect URL");
-    } else if(!strcmp(md->md_redirect, url)) {
-      snprintf(errbuf, errlen, "Redirect loop %s -> %s", url, md->md_redirect);
-    } else {
-      TRACE(TRACE_DEBUG, "Audio", "%s redirects to %s",
-            url, md->md_redirect);
-      e = backend_play_audio(md->md_redirect, mp, errbuf, errlen, hold,
-                             mimetype);
-    }
-    metadata_destroy(md);
-    return e;
-  }
-  metadata_destroy(md);
-#endif
+  media_codec_t *cw = NULL;
+  int i;
 
   AVIOContext *avio = fa_libav_reopen(fh, 0);
 
@@ -194,19 +188,8 @@ be_file_playaudio(const char *url, media_pipe_t *mp,
     return NULL;
   }
 
-  usage_event("Play audio", 1, USAGE_SEG("format", fctx->iformat->name));
-
-  TRACE(TRACE_DEBUG, "Audio", "Starting playback of %s", url);
-
-  mp_configure(mp, MP_CAN_SEEK | MP_CAN_PAUSE,
-	       MP_BUFFER_SHALLOW, fctx->duration, "tracks");
-
-  mp->mp_audio.mq_stream = -1;
-  mp->mp_video.mq_stream = -1;
-
   fw = media_format_create(fctx);
 
-  cw = NULL;
   for(i = 0; i < fctx->nb_streams; i++) {
     ctx = fctx->streams[i]->codec;
 
@@ -214,7 +197,6 @@ be_file_playaudio(const char *url, media_pipe_t *mp,
       continue;
 
     cw = media_codec_create(ctx->codec_id, 0, fw, ctx, NULL, mp);
-    mp->mp_audio.mq_stream = i;
     break;
   }
   
@@ -224,6 +206,94 @@ be_file_playaudio(const char *url, media_pipe_t *mp,
     return NULL;
   }
 
+  audio_preopen_t *ap = calloc(1, sizeof(audio_preopen_t));
+  ap->ap_fctx = fctx;
+  ap->ap_fw = fw;
+  ap->ap_cw = cw;
+  ap->ap_stream = i;
+  TAILQ_INIT(&ap->ap_head);
+  return ap;
+}
+
+
+/**
+ * Read next packet of our stream. Returns NULL on EOF or error
+ * in which case *rp is set to the libav error code
+ */
+static media_buf_t *
+audio_read_packet(audio_preopen_t *ap, media_pipe_t *mp, int *rp)
+{
+  AVFormatContext *fctx = ap->ap_fctx;
+  AVPacket pkt;
+  int r, si;
+
+  while(1) {
+    r = av_read_frame(fctx, &pkt);
+    if(r == AVERROR(EAGAIN))
+      continue;
+
+    if(r != 0) {
+      *rp = r;
+      return NULL;
+    }
+
+    si = pkt.stream_index;
+
+    if(si == ap->ap_stream)
+      break;
+
+    av_free_packet(&pkt);
+  }
+
+  media_buf_t *mb = media_buf_from_avpkt_unlocked(mp, &pkt);
+  mb->mb_data_type = MB_AUDIO;
+
+  mb->mb_pts      = rescale(fctx, pkt.pts,      si);
+  mb->mb_dts      = rescale(fctx, pkt.dts,      si);
+  mb->mb_duration = rescale(fctx, pkt.duration, si);
+
+  mb->mb_cw = media_codec_ref(ap->ap_cw);
+  mb->mb_stream = pkt.stream_index;
+
+  if(mb->mb_pts != AV_NOPTS_VALUE) {
+    const int64_t offset = fctx->start_time;
+    mb->mb_user_time = mb->mb_pts + (offset != PTS_UNSET ? offset : 0);
+    mb->mb_drive_clock = 1;
+  }
+
+  av_free_packet(&pkt);
+  return mb;
+}
+
+
+/**
+ *
+ */
+static event_t *
+audio_play(audio_preopen_t *ap, const char *url, media_pipe_t *mp,
+           int hold)
+{
+  AVFormatContext *fctx = ap->ap_fctx;
+  media_buf_t *mb = NULL;
+  media_queue_t *mq;
+  event_ts_t *ets;
+  int64_t ts;
+  event_t *e;
+  int registered_play = 0;
+  int r;
+
+  mp->mp_seek_base = 0;
+
+  usage_event("Play audio", 1, USAGE_SEG("format", fctx->iformat->name));
+
+  TRACE(TRACE_DEBUG, "Audio", "Starting playback of %s", url);
+
+  mp_configure(mp, MP_CAN_SEEK | MP_CAN_PAUSE,
+	       MP_BUFFER_SHALLOW, fctx->duration, "tracks");
+
+  mp->mp_audio.mq_stream = ap->ap_stream;
+  mp->mp_video.mq_stream = -1;
+
   mp_become_primary(mp);
   mq = &mp->mp_audio;
 
@@ -238,60 +308,48 @@ be_file_playaudio(const char *url, media_pipe_t *mp,
     if(mb == NULL) {
       
       mp->mp_eof = 0;
-      r = av_read_frame(fctx, &pkt);
-      if(r == AVERROR(EAGAIN))
-	continue;
+
+      if((mb = TAILQ_FIRST(&ap->ap_head)) != NULL) {
+        TAILQ_REMOVE(&ap->ap_head, mb, mb_link);
+        continue;
+      }
+
+      if(ap->ap_error) {
+        r = ap->ap_error;
+        ap->ap_error = 0;
+      } else {
+        mb = audio_read_packet(ap, mp, &r);
+        if(mb != NULL)
+          continue;
+      }
       
       if(r == AVERROR_EOF || r == AVERROR(EIO)) {
 	mb = MB_SPECIAL_EOF;
 	mp->mp_eof = 1;
-	continue;
-      }
-      
-      if(r != 0) {
-	char msg[100];
-	fa_libav_error_to_txt(r, msg, sizeof(msg));
-	TRACE(TRACE_ERROR, "Audio", "Playback error: %s", msg);
-
-	while((e = mp_wait_for_empty_queues(mp)) != NULL) {
-	  if(event_is_type(e, EVENT_PLAYQUEUE_JUMP) ||
-	     event_is_action(e, ACTION_SKIP_BACKWARD) ||
-	     event_is_action(e, ACTION_SKIP_FORWARD) ||
-	     event_is_action(e, ACTION_STOP)) {
-	    mp_flush(mp);
-	    break;
-	  }
-	  event_release(e);
-	}
-	if(e == NULL)
-	  e = event_create_type(EVENT_EOF);
-	break;
-      }
-
-      si = pkt.stream_index;
 
-      if(si != mp->mp_audio.mq_stream) {
-	av_free_packet(&pkt);
+        // Give the owner a chance to start preparing whatever comes next
+        if(mp->mp_track_ending != NULL)
+          mp->mp_track_ending(mp);
 	continue;
       }
-
-      mb = media_buf_from_avpkt_unlocked(mp, &pkt);
-      mb->mb_data_type = MB_AUDIO;
-
-      mb->mb_pts      = rescale(fctx, pkt.pts,      si);
-      mb->mb_dts      = rescale(fctx, pkt.dts,      si);
-      mb->mb_duration = rescale(fctx, pkt.duration, si);
-
-      mb->mb_cw = media_codec_ref(cw);
-      mb->mb_stream = pkt.stream_index;
-
-      if(mb->mb_pts != AV_NOPTS_VALUE) {
-        const int64_t offset = fctx->start_time;
-        mb->mb_user_time = mb->mb_pts + (offset != PTS_UNSET ? offset : 0);
-	mb->mb_drive_clock = 1;
+      
+      char msg[100];
+      fa_libav_error_to_txt(r, msg, sizeof(msg));
+      TRACE(TRACE_ERROR, "Audio", "Playback error: %s", msg);
+
+      while((e = mp_wait_for_empty_queues(mp)) != NULL) {
+        if(event_is_type(e, EVENT_PLAYQUEUE_JUMP) ||
+           event_is_action(e, ACTION_SKIP_BACKWARD) ||
+           event_is_action(e, ACTION_SKIP_FORWARD) ||
+           event_is_action(e, ACTION_STOP)) {
+          mp_flush(mp);
+          break;
+        }
+        event_release(e);
       }
-
-      av_free_packet(&pkt);
+      if(e == NULL)
+        e = event_create_type(EVENT_EOF);
+      break;
     }
 
     /*
@@ -305,12 +363,21 @@ be_file_playaudio(const char *url, media_pipe_t *mp,
       e = mp_wait_for_empty_queues(mp);
       
       if(e == NULL) {
+        mp->mp_track_drained = arch_get_ts();
 	e = event_create_type(EVENT_EOF);
 	break;
       }
 
     } else if((e = mb_enqueue_with_events(mp, mq, mb)) == NULL) {
       mb = NULL; /* Enqueue succeeded */
+
+      if(mp->mp_track_drained) {
+        // First packet after previous track ran out of data
+        const int gap = (arch_get_ts() - mp->mp_track_drained) / 1000;
+        mp->mp_track_drained = 0;
+        TRACE(TRACE_DEBUG, "Audio", "Inter-track gap: %d ms", gap);
+        prop_set(mp->mp_prop_root, "trackGap", PROP_SET_INT, gap);
+      }
       continue;
     }      
 
@@ -340,7 +407,7 @@ be_file_playaudio(const char *url, media_pipe_t *mp,
 	ts = MAX(ets->ts, 0);
       }
       av_seek_frame(fctx, -1, ts, AVSEEK_FLAG_BACKWARD);
-      seekflush(mp, &mb);
+      seekflush(mp, &mb, ap);
       
     } else if(event_is_action(e, ACTION_SKIP_BACKWARD)) {
 
@@ -348,7 +415,7 @@ be_file_playaudio(const char *url, media_pipe_t *mp,
 	goto skip;
       int64_t z = fctx->start_time != PTS_UNSET ? fctx->start_time : 0;
       av_seek_frame(fctx, -1, z, AVSEEK_FLAG_BACKWARD);
-      seekflush(mp, &mb);
+      seekflush(mp, &mb, ap);
 
     } else if(event_is_action(e, ACTION_SKIP_FORWARD) ||
 	      event_is_action(e, ACTION_STOP)) {
@@ -359,11 +426,154 @@ be_file_playaudio(const char *url, media_pipe_t *mp,
     event_release(e);
   }
 
+  if(!event_is_type(e, EVENT_EOF))
+    mp->mp_track_drained = 0;
+
   if(mb != NULL && mb != MB_SPECIAL_EOF)
     media_buf_free_unlocked(mp, mb);
 
-  media_codec_deref(cw);
-  media_format_deref(fw);
+  return e;
+}
+
+
+/**
+ *
+ */
+event_t *
+be_file_playaudio(const char *url, media_pipe_t *mp,
+		  char *errbuf, size_t errlen, int hold, const char *mimetype,
+                  void *opaque)
+{
+  uint8_t pb[4096];
+  size_t psiz;
+
+  // Only meaningful if we end up in audio_play()
+  const int64_t drained = mp->mp_track_drained;
+  mp->mp_track_drained = 0;
+
+  fa_handle_t *fh = fa_open_ex(url, errbuf, errlen, FA_BUFFERED_SMALL, NULL);
+  if(fh == NULL)
+    return NULL;
+
+
+  psiz = fa_read(fh, pb, sizeof(pb));
+  if(psiz < 128) {
+    fa_close(fh);
+    snprintf(errbuf, errlen, "File too small");
+    return NULL;
+  }
+
+  if(pb[0] == 0x50 && pb[1] == 0x4b && pb[2] == 0x03 && pb[3] == 0x04)
+    // ZIP File
+    return audio_play_zipfile(fh, mp, errbuf, errlen, hold);
+
+#if ENABLE_PLUGINS
+  plugin_probe_for_autoinstall(fh, pb, psiz, url);
+#endif
+
+#if ENABLE_VMIR
+  metadata_t *md = metadata_create();
+  if(np_fa_probe(fh, pb, psiz, md, url) == 0) {
+    fa_close_with_park(fh, 1);
+    event_t *e = NULL;
+    if(md->md_redirect == NULL) {
+      snprintf(errbuf, errlen, "External player provided no redirect URL");
+    } else if(!strcmp(md->md_redirect, url)) {
+      snprintf(errbuf, errlen, "Redirect loop %s -> %s", url, md->md_redirect);
+    } else {
+      TRACE(TRACE_DEBUG, "Audio", "%s redirects to %s",
+            url, md->md_redirect);
+      e = backend_play_audio(md->md_redirect, mp, errbuf, errlen, hold,
+                             mimetype);
+    }
+    metadata_destroy(md);
+    return e;
+  }
+  metadata_destroy(md);
+#endif
+
+  audio_preopen_t *ap = audio_open(fh, url, mp, errbuf, errlen, mimetype);
+  if(ap == NULL)
+    return NULL;
+
+  mp->mp_track_drained = drained;
+  event_t *e = audio_play(ap, url, mp, hold);
+  fa_audio_preopen_free(ap, mp);
+  return e;
+}
 
+
+/**
+ * Open, probe and demux the first few packets of 'url' while something
+ * else is still playing on 'mp'. Only plain audio files are handled,
+ * anything that needs redirection or unpacking will return NULL and
+ * should be played using backend_play_audio() as usual.
+ *
+ * Does not touch the state of 'mp' so it's safe to call from any thread
+ */
+audio_preopen_t *
+fa_audio_preopen(const char *url, media_pipe_t *mp,
+                 char *errbuf, size_t errlen, cancellable_t *c)
+{
+  uint8_t pb[4096];
+  size_t psiz;
+  int r;
+  fa_open_extra_t foe = {
+    .foe_cancellable = c
+  };
+
+  fa_handle_t *fh = fa_open_ex(url, errbuf, errlen, FA_BUFFERED_SMALL, &foe);
+  if(fh == NULL)
+    return NULL;
+
+  psiz = fa_read(fh, pb, sizeof(pb));
+  if(psiz < 128 ||
+     (pb[0] == 0x50 && pb[1] == 0x4b && pb[2] == 0x03 && pb[3] == 0x04)) {
+    fa_close(fh);
+    snprintf(errbuf, errlen, "Not a plain audio file");
+    return NULL;
+  }
+
+#if ENABLE_VMIR
+  metadata_t *md = metadata_create();
+  r = np_fa_probe(fh, pb, psiz, md, url);
+  metadata_destroy(md);
+  if(r == 0) {
+    fa_close(fh);
+    snprintf(errbuf, errlen, "Handled by external player");
+    return NULL;
+  }
+#endif
+
+  audio_preopen_t *ap = audio_open(fh, url, mp, errbuf, errlen, NULL);
+  if(ap == NULL)
+    return NULL;
+
+  for(int i = 0; i < AUDIO_PREOPEN_PACKETS; i++) {
+    if(cancellable_is_cancelled(c)) {
+      fa_audio_preopen_free(ap, mp);
+      snprintf(errbuf, errlen, "Cancelled");
+      return NULL;
+    }
+    media_buf_t *mb = audio_read_packet(ap, mp, &r);
+    if(mb == NULL) {
+      ap->ap_error = r;
+      break;
+    }
+    TAILQ_INSERT_TAIL(&ap->ap_head, mb, mb_link);
+  }
+  return ap;
+}
+
+
+/**
+ * Play a file opened with fa_audio_preopen(). 'ap' is consumed
+ */
+event_t *
+fa_audio_play_preopened(audio_preopen_t *ap, const char *url,
+                        media_pipe_t *mp, int hold)
+{
+  event_t *e = audio_play(ap, url, mp, hold);
+  fa_audio_preopen_free(ap, mp);
   return e;
 }
@@ -26,3 +26,14 @@ struct fa_handle;
 event_t *be_file_playaudio(const char *url, media_pipe_t *mp,
 			   char *errbuf, size_t errlen, int hold,
 			   const char *mimetype, void *opaque);
+
+typedef struct audio_preopen audio_preopen_t;
+
+audio_preopen_t *fa_audio_preopen(const char *url, media_pipe_t *mp,
+                                  char *errbuf, size_t errlen,
+                                  struct cancellable *c);
+
+event_t *fa_audio_play_preopened(audio_preopen_t *ap, const char *url,
+                                 media_pipe_t *mp, int hold);
+
+void fa_audio_preopen_free(audio_preopen_t *ap, media_pipe_t *mp);
@@ -72,6 +72,23 @@ typedef struct buffered_file {
 
   buffered_zone_t bf_zones[BF_ZONES];
 
+  /**
+   * bf_mutex protects the cache state above and is held by the reader
+   * for the duration of a read. bf_src_mutex serializes access to
+   * bf_src between the reader and the prefetch thread. Lock order is
+   * bf_mutex -> bf_src_mutex. The prefetch thread never holds both.
+   */
+  hts_mutex_t bf_mutex;
+  hts_mutex_t bf_src_mutex;
+  hts_cond_t bf_cond;
+
+  hts_thread_t bf_pf_thread;
+  int bf_pf_running;
+  int bf_pf_stop;
+  int bf_pf_window;          // Bytes to keep buffered ahead of bf_fpos
+  int bf_pf_inflight_size;
+  int64_t bf_pf_inflight_pos; // -1 if no read in progress
+  int64_t bf_pf_stall_pos;    // Source failed here, don't retry
 
 } buffered_file_t;
 
@@ -231,14 +248,90 @@ need_to_fill(const buffered_file_t *bf, int64_t fpos, size_t rd)
 }
 
 
+/**
+ * Seek and read from the source
+ */
+static int
+src_read(buffered_file_t *bf, int64_t pos, void *buf, int size)
+{
+  fa_handle_t *src = bf->bf_src;
+  int r;
+
+  hts_mutex_lock(&bf->bf_src_mutex);
+  if(src->fh_proto->fap_seek(src, pos, SEEK_SET, 0) != pos)
+    r = -1;
+  else
+    r = src->fh_proto->fap_read(src, buf, size);
+  hts_mutex_unlock(&bf->bf_src_mutex);
+  return r;
+}
+
+
+/**
+ * Like src_read() but keeps reading until 'size' bytes are read.
+ * '*eof' is set if the source ran out of data. Returns -1 if nothing
+ * could be read due to an error
+ */
+static int
+src_read_fully(buffered_file_t *bf, int64_t pos, void *buf, int size,
+               int *eof)
+{
+  int done = 0;
+
+  *eof = 0;
+  while(done < size &&
+        !cancellable_is_cancelled(bf->bf_outbound_cancellable)) {
+    int r = src_read(bf, pos + done, buf + done, size - done);
+    if(r < 0)
+      return done ?: -1;
+    if(r == 0) {
+      *eof = 1;
+      break;
+    }
+    done += r;
+  }
+  return done;
+}
+
+
+/**
+ * Stop the prefetch thread (if running)
+ *
+ * If abort is set an inflight read is cancelled rather than waited for
+ */
+static void
+fab_prefetch_stop(buffered_file_t *bf, int abort)
+{
+  if(!bf->bf_pf_running)
+    return;
+
+  hts_mutex_lock(&bf->bf_mutex);
+  bf->bf_pf_stop = 1;
+  hts_cond_broadcast(&bf->bf_cond);
+  if(abort && bf->bf_pf_inflight_pos != -1)
+    cancellable_cancel(bf->bf_outbound_cancellable);
+  hts_mutex_unlock(&bf->bf_mutex);
+
+  hts_thread_join(&bf->bf_pf_thread);
+  bf->bf_pf_running = 0;
+  bf->bf_pf_stop = 0;
+}
+
+
 /**
  *
  */
 static void
 fab_destroy(buffered_file_t *bf)
 {
+  fab_prefetch_stop(bf, 1);
+
   bf->bf_src->fh_proto->fap_close(bf->bf_src);
 
+  hts_cond_destroy(&bf->bf_cond);
+  hts_mutex_destroy(&bf->bf_mutex);
+  hts_mutex_destroy(&bf->bf_src_mutex);
+
   if(bf->bf_mem != NULL)
     hfree(bf->bf_mem, bf->bf_mem_size);
   free(bf->bf_url);
@@ -287,6 +380,9 @@ fab_park(fa_handle_t *handle)
     return;
   }
 
+  // Don't keep reading on behalf of a file nobody has open
+  fab_prefetch_stop(bf, 0);
+
   hts_mutex_lock(&buffered_global_mutex);
   if(parked)
     closeme = parked;
@@ -323,6 +419,7 @@ fab_seek(fa_handle_t *handle, int64_t pos, int whence, int lazy)
   fa_handle_t *src = bf->bf_src;
   int64_t np;
 
+  hts_mutex_lock(&bf->bf_mutex);
 
   switch(whence) {
   case SEEK_SET:
@@ -334,15 +431,18 @@ fab_seek(fa_handle_t *handle, int64_t pos, int whence, int lazy)
     break;
 
   case SEEK_END:
+    hts_mutex_lock(&bf->bf_src_mutex);
     np = src->fh_proto->fap_seek(src, pos, whence, lazy);
+    hts_mutex_unlock(&bf->bf_src_mutex);
     break;
 
   default:
-    return -1;
+    np = -1;
+    break;
   }
 
   if(np < 0)
-    return -1;
+    goto out;
 
   int mpos;
   int cs = resolve_zone(bf, np, 1, &mpos);
@@ -351,11 +451,19 @@ fab_seek(fa_handle_t *handle, int64_t pos, int whence, int lazy)
     // If seeked to position is not mapped in our buffers, seek in
     // source to check if it's possible to reach position at all.
 
+    hts_mutex_lock(&bf->bf_src_mutex);
     if(src->fh_proto->fap_seek(src, np, SEEK_SET, lazy) != np)
-      return -1;
+      np = -1;
+    hts_mutex_unlock(&bf->bf_src_mutex);
+    if(np == -1)
+      goto out;
   }
 
   bf->bf_fpos = np;
+  bf->bf_pf_stall_pos = -1;
+  hts_cond_broadcast(&bf->bf_cond);
+ out:
+  hts_mutex_unlock(&bf->bf_mutex);
   return np;
 }
 
@@ -367,12 +475,18 @@ static int64_t
 fab_fsize(fa_handle_t *handle)
 {
   buffered_file_t *bf = (buffered_file_t *)handle;
-  if(bf->bf_size != -1)
-    return bf->bf_size;
-
-  fa_handle_t *src = bf->bf_src;
-  bf->bf_size = src->fh_proto->fap_fsize(src);
-  return bf->bf_size;
+  int64_t size;
+
+  hts_mutex_lock(&bf->bf_mutex);
+  if(bf->bf_size == -1) {
+    fa_handle_t *src = bf->bf_src;
+    hts_mutex_lock(&bf->bf_src_mutex);
+    bf->bf_size = src->fh_proto->fap_fsize(src);
+    hts_mutex_unlock(&bf->bf_src_mutex);
+  }
+  size = bf->bf_size;
+  hts_mutex_unlock(&bf->bf_mutex);
+  return size;
 }
 
 
@@ -380,7 +494,7 @@ fab_fsize(fa_handle_t *handle)
  *
  */
 static void
-store_in_cache(buffered_file_t *bf, const void *buf, size_t size)
+store_in_cache(buffered_file_t *bf, int64_t fpos, const void *buf, size_t size)
 {
   if(size > bf->bf_mem_size)
     return;
@@ -396,7 +510,7 @@ store_in_cache(buffered_file_t *bf, const void *buf, size_t size)
 
   erase_zone(bf, bf->bf_mem_ptr, s1);
 
-  map_zone(bf, bf->bf_mem_ptr, s1, bf->bf_fpos);
+  map_zone(bf, bf->bf_mem_ptr, s1, fpos);
   memcpy(bf->bf_mem + bf->bf_mem_ptr, buf, s1);
 
   bf->bf_mem_ptr += s1;
@@ -408,7 +522,7 @@ store_in_cache(buffered_file_t *bf, const void *buf, size_t size)
   if(s2 > 0) {
     erase_zone(bf, bf->bf_mem_ptr, s2);
 
-    map_zone(bf, bf->bf_mem_ptr, s2, bf->bf_fpos + s1);
+    map_zone(bf, bf->bf_mem_ptr, s2, fpos + s1);
     memcpy(bf->bf_mem + bf->bf_mem_ptr, buf + s1, s2);
 
     bf->bf_mem_ptr += s2;
@@ -417,21 +531,104 @@ store_in_cache(buffered_file_t *bf, const void *buf, size_t size)
 
 
 
+/**
+ * Find the first position within the prefetch window that is not
+ * in the cache. Returns -1 if there is nothing to fetch
+ */
+static int64_t
+prefetch_pos(const buffered_file_t *bf)
+{
+  int64_t pos = bf->bf_fpos;
+  int64_t end = bf->bf_fpos + bf->bf_pf_window;
+  int mpos;
+
+  if(bf->bf_size != -1)
+    end = MIN(end, bf->bf_size);
+
+  while(pos < end) {
+    int cs = resolve_zone(bf, pos, end - pos, &mpos);
+    if(cs <= 0)
+      return pos == bf->bf_pf_stall_pos ? -1 : pos;
+    pos += cs;
+  }
+  return -1;
+}
+
+
+/**
+ * Keeps bf_pf_window bytes ahead of the read position in the cache so
+ * reads from the demuxer are served from memory
+ */
+static void *
+fab_prefetch_thread(void *aux)
+{
+  buffered_file_t *bf = aux;
+  const int chunk = bf->bf_min_request;
+  void *tmp = malloc(chunk);
+  int mpos;
+
+  hts_mutex_lock(&bf->bf_mutex);
+
+  while(!bf->bf_pf_stop &&
+        !cancellable_is_cancelled(bf->bf_outbound_cancellable)) {
+
+    int64_t pos = prefetch_pos(bf);
+    int size = pos == -1 ? 0 : need_to_fill(bf, pos, chunk);
+
+    if(size > 0 && bf->bf_size != -1)
+      size = MIN(size, bf->bf_size - pos);
+
+    if(size <= 0) {
+      hts_cond_wait(&bf->bf_cond, &bf->bf_mutex);
+      continue;
+    }
+
+    bf->bf_pf_inflight_pos = pos;
+    bf->bf_pf_inflight_size = size;
+    hts_mutex_unlock(&bf->bf_mutex);
+
+    int eof;
+    int r = src_read_fully(bf, pos, tmp, size, &eof);
+
+    hts_mutex_lock(&bf->bf_mutex);
+    bf->bf_pf_inflight_pos = -1;
+
+    if(r > 0 && resolve_zone(bf, pos, 1, &mpos) == -1)
+      store_in_cache(bf, pos, tmp, need_to_fill(bf, pos, r));
+
+    if(r < 0)
+      bf->bf_pf_stall_pos = pos;
+    else if(eof)
+      bf->bf_size = pos + r;
+
+    hts_cond_broadcast(&bf->bf_cond);
+  }
+
+  hts_mutex_unlock(&bf->bf_mutex);
+  free(tmp);
+  return NULL;
+}
+
+
 /**
  *
  */
 static int
-fab_read(fa_handle_t *handle, void *buf, size_t size)
+fab_read0(buffered_file_t *bf, void *buf, size_t size)
 {
-  buffered_file_t *bf = (buffered_file_t *)handle;
-  fa_handle_t *src = bf->bf_src;
-
   if(bf->bf_mem == NULL) {
     bf->bf_mem = halloc(bf->bf_mem_size);
     if(bf->bf_mem == NULL)
       return -1;
   }
 
+  if(bf->bf_pf_window && !bf->bf_pf_running) {
+    bf->bf_pf_running = 1;
+    hts_thread_create_joinable("fa prefetch", &bf->bf_pf_thread,
+                               fab_prefetch_thread, bf,
+                               THREAD_PRIO_FILESYSTEM);
+  }
+
   if(bf->bf_size != -1 && bf->bf_fpos + size > bf->bf_size)
     size = bf->bf_size - bf->bf_fpos;
 
@@ -449,15 +646,20 @@ fab_read(fa_handle_t *handle, void *buf, size_t size)
       continue;
     }
 
+    if(bf->bf_pf_inflight_pos != -1 &&
+       bf->bf_fpos >= bf->bf_pf_inflight_pos &&
+       bf->bf_fpos < bf->bf_pf_inflight_pos + bf->bf_pf_inflight_size) {
+      // Prefetcher is already reading this, wait for it
+      hts_cond_wait(&bf->bf_cond, &bf->bf_mutex);
+      continue;
+    }
+
     int rreq = need_to_fill(bf, bf->bf_fpos, size);
     if(rreq >= bf->bf_min_request) {
 
-      if(src->fh_proto->fap_seek(src, bf->bf_fpos, SEEK_SET, 0) != bf->bf_fpos)
-	return -1;
-
-      int r = src->fh_proto->fap_read(src, buf, rreq);
+      int r = src_read(bf, bf->bf_fpos, buf, rreq);
       if(r > 0) {
-	store_in_cache(bf, buf, r);
+	store_in_cache(bf, bf->bf_fpos, buf, r);
 	rval += r;
 	buf += r;
 	bf->bf_fpos += r;
@@ -475,11 +677,8 @@ fab_read(fa_handle_t *handle, void *buf, size_t size)
     
     erase_zone(bf, bf->bf_mem_ptr, bf->bf_min_request);
 
-    if(src->fh_proto->fap_seek(src, bf->bf_fpos, SEEK_SET, 0) != bf->bf_fpos)
-      return -1;
-
-    int r = src->fh_proto->fap_read(src, bf->bf_mem + bf->bf_mem_ptr,
-				    bf->bf_min_request);
+    int r = src_read(bf, bf->bf_fpos, bf->bf_mem + bf->bf_mem_ptr,
+                     bf->bf_min_request);
     if(r < 1) {
       bf->bf_size = bf->bf_fpos;
       return r < 0 ? r : rval;
@@ -508,6 +707,23 @@ fab_read(fa_handle_t *handle, void *buf, size_t size)
 }
 
 
+/**
+ *
+ */
+static int
+fab_read(fa_handle_t *handle, void *buf, size_t size)
+{
+  buffered_file_t *bf = (buffered_file_t *)handle;
+
+  hts_mutex_lock(&bf->bf_mutex);
+  int r = fab_read0(bf, buf, size);
+  // Read position moved, wake up prefetcher
+  hts_cond_broadcast(&bf->bf_cond);
+  hts_mutex_unlock(&bf->bf_mutex);
+  return r;
+}
+
+
 #if BF_CHK
 static int
 fab_read_chk(fa_handle_t *handle, void *buf, size_t size)
@@ -556,8 +772,11 @@ fab_set_read_timeout(fa_handle_t *handle, int ms)
 {
   buffered_file_t *bf = (buffered_file_t *)handle;
   fa_handle_t *fh = bf->bf_src;
-  if(fh->fh_proto->fap_set_read_timeout != NULL)
+  if(fh->fh_proto->fap_set_read_timeout != NULL) {
+    hts_mutex_lock(&bf->bf_src_mutex);
     fh->fh_proto->fap_set_read_timeout(fh, ms);
+    hts_mutex_unlock(&bf->bf_src_mutex);
+  }
 }
 
 
@@ -669,9 +888,20 @@ fa_buffered_open(const char *url, char *errbuf, size_t errsize, int flags,
   }
 
   bf->bf_url = strdup(url);
-  if(!(mflags & FA_BUFFERED_NO_PREFETCH))
+  if(!(mflags & FA_BUFFERED_NO_PREFETCH)) {
     bf->bf_min_request = mflags & FA_BUFFERED_BIG ? 256 * 1024 : 64 * 1024;
-  bf->bf_mem_size = 1024 * 1024;
+
+    if(mflags & FA_BUFFERED_BIG && gconf.read_ahead_kb >= 0)
+      bf->bf_pf_window = (gconf.read_ahead_kb ?: 2048) * 1024;
+  }
+  // Leave room for what's been read behind the window
+  bf->bf_mem_size = MAX(1024 * 1024, bf->bf_pf_window * 2);
+
+  hts_mutex_init(&bf->bf_mutex);
+  hts_mutex_init(&bf->bf_src_mutex);
+  hts_cond_init(&bf->bf_cond, &bf->bf_mutex);
+  bf->bf_pf_inflight_pos = -1;
+  bf->bf_pf_stall_pos = -1;
   bf->bf_flags = flags;
 
   bf->bf_src = fh;
@@ -83,13 +83,40 @@ static int http_tokenize(char *buf, char **vec, int vecsize, int delimiter);
 
 /**
  * Connection parking
+ *
+ * Idle connections are kept in a pool per host (hostname, port, ssl).
+ * Each pool holds at most gconf.http_pool_size idle connections and
+ * there is a global cap of HTTP_MAX_PARKED on top of that. Parked
+ * connections are also on http_parked_connections in the order they
+ * were parked so we can close the oldest one when hitting the global
+ * cap.
  */
+#define HTTP_MAX_PARKED 32
+
 TAILQ_HEAD(http_connection_queue ,http_connection);
+LIST_HEAD(http_pool_list, http_pool);
 
 static struct http_connection_queue http_parked_connections;
 static struct http_connection_queue http_active_connections;
+static struct http_pool_list http_pools;
 static int http_num_parked_connections;
 
+typedef struct http_pool {
+  LIST_ENTRY(http_pool) hp_link;
+  struct http_connection_queue hp_parked;
+  int hp_num_parked;
+
+  char *hp_hostname;
+  int hp_port;
+  char hp_ssl;
+
+  // Statistics
+  int hp_hits;      // Request got a parked connection
+  int hp_misses;    // Request had to connect
+  int hp_evicted;   // Parked connection closed due to pool limits
+  int hp_expired;   // Parked connection closed due to keep-alive timeout
+} http_pool_t;
+
 static hts_mutex_t http_connections_mutex;
 static hts_cond_t http_connections_cond;
 static atomic_t http_connection_tally;
@@ -105,6 +132,9 @@ typedef struct http_connection {
 
   TAILQ_ENTRY(http_connection) hc_link;
 
+  http_pool_t *hc_pool;
+  TAILQ_ENTRY(http_connection) hc_pool_link;
+
   char hc_ssl;
   char hc_reused;
 
@@ -303,6 +333,44 @@ http_connection_destroy(http_connection_t *hc, int dbg, const char *reason)
 
 
 
+/**
+ * Must be called with http_connections_mutex locked
+ */
+static http_pool_t *
+http_pool_get(const char *hostname, int port, int ssl)
+{
+  http_pool_t *hp;
+
+  LIST_FOREACH(hp, &http_pools, hp_link)
+    if(hp->hp_port == port && hp->hp_ssl == ssl &&
+       !strcmp(hp->hp_hostname, hostname))
+      return hp;
+
+  hp = calloc(1, sizeof(http_pool_t));
+  hp->hp_hostname = strdup(hostname);
+  hp->hp_port = port;
+  hp->hp_ssl = ssl;
+  TAILQ_INIT(&hp->hp_parked);
+  LIST_INSERT_HEAD(&http_pools, hp, hp_link);
+  return hp;
+}
+
+
+/**
+ * Remove connection from the parked queues.
+ * Must be called with http_connections_mutex locked
+ */
+static void
+http_connection_unpark(http_connection_t *hc)
+{
+  http_pool_t *hp = hc->hc_pool;
+  TAILQ_REMOVE(&http_parked_connections, hc, hc_link);
+  TAILQ_REMOVE(&hp->hp_parked, hc, hc_pool_link);
+  hp->hp_num_parked--;
+  http_num_parked_connections--;
+}
+
+
 /**
  *
  */
@@ -336,36 +404,32 @@ http_connection_get(const char *hostname, int port, int ssl,
     }
   }
 
-  if(allow_reuse) {
-
-    time_t now;
+  http_pool_t *hp = http_pool_get(hostname, port, ssl);
 
-    time(&now);
-
-    TAILQ_FOREACH(hc, &http_parked_connections, hc_link) {
-
-      if(!strcmp(hc->hc_hostname, hostname) && hc->hc_port == port &&
-         hc->hc_ssl == ssl) {
-        TAILQ_REMOVE(&http_parked_connections, hc, hc_link);
-        http_num_parked_connections--;
-        TAILQ_INSERT_TAIL(&http_active_connections, hc, hc_link);
-        callout_disarm(&hc->hc_callout);
-        hts_mutex_unlock(&http_connections_mutex);
-        HTTP_TRACE(dbg, "Reusing connection to %s:%d (cid=%d)",
-                   hc->hc_hostname, hc->hc_port, hc->hc_id);
-        hc->hc_reused = 1;
-        tcp_set_cancellable(hc->hc_tc, c);
-        return hc;
-      }
-    }
+  // Most recently parked connection is least likely to have been
+  // closed by the server
+  if(allow_reuse &&
+     (hc = TAILQ_LAST(&hp->hp_parked, http_connection_queue)) != NULL) {
+    http_connection_unpark(hc);
+    hp->hp_hits++;
+    TAILQ_INSERT_TAIL(&http_active_connections, hc, hc_link);
+    callout_disarm(&hc->hc_callout);
+    hts_mutex_unlock(&http_connections_mutex);
+    HTTP_TRACE(dbg, "Reusing connection to %s:%d (cid=%d)",
+               hc->hc_hostname, hc->hc_port, hc->hc_id);
+    hc->hc_reused = 1;
+    tcp_set_cancellable(hc->hc_tc, c);
+    return hc;
   }
 
+  hp->hp_misses++;
 
   hc = calloc(1, sizeof(http_connection_t));
   atomic_set(&hc->hc_refcount, 1);
   hc->hc_hostname = strdup(hostname);
   hc->hc_port = port;
   hc->hc_ssl = ssl;
+  hc->hc_pool = hp;
   TAILQ_INSERT_TAIL(&http_active_connections, hc, hc_link);
 
   hts_mutex_unlock(&http_connections_mutex);
@@ -427,9 +491,22 @@ static void
 http_connection_ka_expired(struct callout *c, void *opaque)
 {
   http_connection_t *hc = opaque;
-  TAILQ_REMOVE(&http_parked_connections, hc, hc_link);
+  hc->hc_pool->hp_expired++;
+  http_connection_unpark(hc);
   http_connection_destroy(hc, gconf.enable_http_debug, "Keep alive expired");
-  http_num_parked_connections--;
+}
+
+
+/**
+ * Must be called with http_connections_mutex locked
+ */
+static void
+http_connection_evict(http_connection_t *hc, int dbg, const char *reason)
+{
+  hc->hc_pool->hp_evicted++;
+  http_connection_unpark(hc);
+  callout_disarm(&hc->hc_callout);
+  http_connection_destroy(hc, dbg, reason);
 }
 
 
@@ -457,22 +534,68 @@ http_connection_park(http_connection_t *hc, int dbg, int max_age,
 
   TAILQ_REMOVE(&http_active_connections, hc, hc_link);
   hts_cond_broadcast(&http_connections_cond);
+
+  http_pool_t *hp = hc->hc_pool;
   TAILQ_INSERT_TAIL(&http_parked_connections, hc, hc_link);
+  TAILQ_INSERT_TAIL(&hp->hp_parked, hc, hc_pool_link);
+  hp->hp_num_parked++;
+  http_num_parked_connections++;
 
-  while(http_num_parked_connections > 5) {
-    hc = TAILQ_FIRST(&http_parked_connections);
-    assert(hc != NULL);
-    TAILQ_REMOVE(&http_parked_connections, hc, hc_link);
-    http_connection_destroy(hc, dbg, "Too many idle connections");
-    http_num_parked_connections--;
-    callout_disarm(&hc->hc_callout);
-  }
+  const int pool_size = MAX(gconf.http_pool_size, 1);
+
+  while(hp->hp_num_parked > pool_size)
+    http_connection_evict(TAILQ_FIRST(&hp->hp_parked), dbg,
+                          "Too many idle connections to host");
+
+  while(http_num_parked_connections > HTTP_MAX_PARKED)
+    http_connection_evict(TAILQ_FIRST(&http_parked_connections), dbg,
+                          "Too many idle connections");
 
   hts_mutex_unlock(&http_connections_mutex);
 }
 
 
 
+/**
+ *
+ */
+void
+http_client_pool_stats(htsbuf_queue_t *out)
+{
+  http_pool_t *hp;
+  http_connection_t *hc;
+  int active;
+
+  hts_mutex_lock(&http_connections_mutex);
+
+  htsbuf_qprintf(out, "%d idle connections (max %d per host, %d total)\n\n",
+                 http_num_parked_connections,
+                 MAX(gconf.http_pool_size, 1), HTTP_MAX_PARKED);
+
+  htsbuf_qprintf(out, "%-40s %6s %6s %8s %8s %8s %8s\n",
+                 "Host", "Active", "Idle", "Hits", "Misses",
+                 "Evicted", "Expired");
+
+  LIST_FOREACH(hp, &http_pools, hp_link) {
+    active = 0;
+    TAILQ_FOREACH(hc, &http_active_connections, hc_link)
+      if(hc->hc_pool == hp)
+        active++;
+
+    char host[256];
+    snprintf(host, sizeof(host), "%s://%s:%d",
+             hp->hp_ssl ? "https" : "http", hp->hp_hostname, hp->hp_port);
+
+    htsbuf_qprintf(out, "%-40s %6d %6d %8d %8d %8d %8d\n",
+                   host, active, hp->hp_num_parked,
+                   hp->hp_hits, hp->hp_misses,
+                   hp->hp_evicted, hp->hp_expired);
+  }
+
+  hts_mutex_unlock(&http_connections_mutex);
+}
+
+
 /**
  *
  */
@@ -2387,6 +2510,7 @@ http_init(void)
 {
   TAILQ_INIT(&http_active_connections);
   TAILQ_INIT(&http_parked_connections);
+  LIST_INIT(&http_pools);
   hts_mutex_init(&http_connections_mutex);
   hts_cond_init(&http_connections_cond, &http_connections_mutex);
   hts_mutex_init(&http_redirects_mutex);
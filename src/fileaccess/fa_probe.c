@@ -440,7 +440,7 @@ fa_lavf_load_meta(metadata_t *md, AVFormatContext *fctx,
 
   md->md_album = libav_metadata_rstr(fctx->metadata, "album");
 
-  md->md_format = rstr_alloc(fctx->iformat->long_name);
+  md->md_format = rstr_intern(fctx->iformat->long_name);
 
   if(fctx->duration != AV_NOPTS_VALUE)
     md->md_duration = (float)fctx->duration / 1000000;
@@ -1685,7 +1685,7 @@ fa_load(const char *url, ...)
     }
 
     if(cache_control == BYPASS_CACHE)
-      blobcache_get_meta(url, FA_LOAD_CACHE_STASH, &etag, &mtime);
+      blobcache_get_meta(url, FA_LOAD_CACHE_STASH, &etag, &mtime, NULL);
 
     data2 = fap->fap_load(fap, filename, errbuf, errlen,
 			  &etag, &mtime, &max_age, flags, cb, opaque, c,
@@ -1989,6 +1989,19 @@ fa_get_title(const char *url)
 }
 
 
+/**
+ * Return the validators of the copy of 'url' that fa_load() keeps in
+ * its cache. Returns -1 if nothing is cached
+ */
+int
+fa_load_cache_get_meta(const char *url, char **etag, time_t *mtime,
+                       int *is_expired)
+{
+  return blobcache_get_meta(url, FA_LOAD_CACHE_STASH, etag, mtime,
+                            is_expired);
+}
+
+
 /**
  *
  */
@@ -334,6 +334,9 @@ buf_t *fa_load(const char *url, ...) attribute_null_sentinel;
 
 buf_t *fa_load_and_close(fa_handle_t *fh);
 
+int fa_load_cache_get_meta(const char *url, char **etag, time_t *mtime,
+                           int *is_expired);
+
 int fa_parent(char *dst, size_t dstlen, const char *url)
   attribute_unused_result;
 
@@ -135,6 +135,10 @@ typedef struct http_request_inspector {
 
 void http_request_inspector_register(http_request_inspector_t *hri);
 
+struct htsbuf_queue;
+
+void http_client_pool_stats(struct htsbuf_queue *out);
+
 
 #define REGISTER_HTTP_REQUEST_INSPECTOR(a)			   \
   static http_request_inspector_t http_request_inspector = {       \
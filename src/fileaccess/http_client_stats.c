@@ -0,0 +1,54 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include "main.h"
+#include "networking/http_server.h"
+#include "http_client.h"
+
+#if ENABLE_HTTPSERVER
+
+/**
+ *
+ */
+static int
+dumpstats(http_connection_t *hc, const char *remain, void *opaque,
+          http_cmd_t method)
+{
+  htsbuf_queue_t out;
+  htsbuf_queue_init(&out, 0);
+
+  http_client_pool_stats(&out);
+
+  return http_send_reply(hc, 0,
+                         "text/plain; charset=utf-8", NULL, NULL, 0, &out);
+}
+
+
+/**
+ *
+ */
+static void
+http_client_stats_init(void)
+{
+  http_path_add("/api/httpclient/stats", NULL, dumpstats, 1);
+}
+
+INITME(INIT_GROUP_API, http_client_stats_init, NULL, 0);
+
+#endif // ENABLE_HTTPSERVER
@@ -66,6 +66,7 @@ typedef enum image_component_type {
   IMAGE_CODED,
   IMAGE_VECTOR,
   IMAGE_TEXT_INFO,
+  IMAGE_GLYPHS,
 } image_component_type_t;
 
 
@@ -120,6 +121,29 @@ typedef struct image_component_text_info {
 } image_component_text_info_t;
 
 
+/**
+ * A single positioned glyph. Coverage bitmaps (PIXMAP_I) are shared
+ * between all users of the same rasterized glyph and 'ig_id' uniquely
+ * identifies the bitmap so consumers can cache it (in a texture atlas)
+ */
+typedef struct image_glyph {
+  struct pixmap *ig_pm;
+  uint32_t ig_id;
+  uint32_t ig_color;  // ABGR
+  int16_t ig_x;       // Top left corner in image (including margin)
+  int16_t ig_y;
+} image_glyph_t;
+
+
+/**
+ *
+ */
+typedef struct image_component_glyphs {
+  image_glyph_t *igs_glyphs;
+  int igs_count;
+} image_component_glyphs_t;
+
+
 /**
  *
  */
@@ -131,6 +155,7 @@ typedef struct image_component {
     image_component_coded_t coded;
     image_component_vector_t vector;
     image_component_text_info_t text_info;
+    image_component_glyphs_t glyphs;
   };
 
 } image_component_t;
@@ -186,6 +211,11 @@ image_t *image_create_vector(int width, int height, int margin);
 image_t *image_decode(image_t *img, const image_meta_t *im,
                       char *errbuf, size_t errlen);
 
+image_t *image_cache_load(const char *url, const image_meta_t *im);
+
+void image_cache_store(const char *url, const image_meta_t *im,
+                       const image_t *img);
+
 image_t *image_rasterize_ft(const image_component_t *ic,
                             int with, int height, int margin);
 
@@ -0,0 +1,278 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "image.h"
+#include "pixmap.h"
+#include "blobcache.h"
+#include "misc/buf.h"
+#include "fileaccess/fileaccess.h"
+
+/**
+ * Cache of decoded and post-processed images
+ *
+ * The blobcache only holds the coded source image, so every time an
+ * image is shown again it must be decoded, scaled and have corners and
+ * shadows applied. For small images (ie, thumbnails in grids and lists)
+ * we store the final pixmap keyed by the URL and all image_meta_t
+ * parameters that affect the result, turning a revisit into a single
+ * small read.
+ *
+ * Each entry carries the etag / modification time of the source it
+ * was decoded from and is only used as long as the source still
+ * matches.
+ */
+
+#define IMAGE_CACHE_STASH     "decodedimage"
+#define IMAGE_CACHE_MAGIC     0x31434449 // IDC1
+#define IMAGE_CACHE_MAXAGE    (86400 * 7)
+#define IMAGE_CACHE_MAX_BYTES (1024 * 1024)
+
+typedef struct image_cache_hdr {
+  uint32_t ich_magic;
+  uint16_t ich_width;
+  uint16_t ich_height;
+  uint16_t ich_margin;
+  uint16_t ich_flags;
+  uint8_t ich_type;
+  uint8_t ich_origin_coded_type;
+  uint8_t ich_orientation;
+  uint8_t ich_pad;
+  float ich_aspect;
+  float ich_intensity;
+  float ich_primary_color[3];
+} image_cache_hdr_t;
+
+
+/**
+ *
+ */
+static void
+image_cache_key(char *key, size_t keylen, const char *url,
+                const image_meta_t *im)
+{
+  snprintf(key, keylen, "%s|%s|%d|%d|%d|%d|%f|%d%d%d%d%d|%d|%d|%d|%d",
+           appversion, url,
+           im->im_req_width, im->im_req_height,
+           im->im_max_width, im->im_max_height,
+           im->im_req_aspect,
+           im->im_can_mono, im->im_32bit_swizzle, im->im_want_thumb,
+           im->im_intensity_analysis, im->im_primary_color_analysis,
+           im->im_corner_selection, im->im_corner_radius,
+           im->im_shadow, im->im_margin);
+}
+
+
+/**
+ * Get validators for what 'url' currently refers to.
+ *
+ * Images loaded over HTTP are checked against the copy fa_load() keeps
+ * in its cache. If that copy is gone or expired we report nothing so
+ * the regular load path gets to revalidate it. Anything else is
+ * checked against the modification time of the file.
+ *
+ * Returns -1 if the source can't be validated
+ */
+static int
+image_cache_source_validator(const char *url, char **etag, time_t *mtime)
+{
+  struct fa_stat fs;
+  char errbuf[64];
+  int expired = 0;
+
+  *etag = NULL;
+  *mtime = 0;
+
+  if(!fa_load_cache_get_meta(url, etag, mtime, &expired)) {
+    if(!expired && (*etag != NULL || *mtime != 0))
+      return 0;
+    free(*etag);
+    *etag = NULL;
+    return -1;
+  }
+
+  if(!strncmp(url, "http://", 7) || !strncmp(url, "https://", 8))
+    return -1;
+
+  if(fa_stat_ex(url, &fs, errbuf, sizeof(errbuf), FA_NON_INTERACTIVE) ||
+     fs.fs_mtime == 0)
+    return -1;
+
+  *mtime = fs.fs_mtime;
+  return 0;
+}
+
+
+/**
+ * Returns 1 if the result of decoding with the given parameters can't
+ * fit in the cache. Only known when both dimensions are requested as
+ * that is the size the decoders will produce
+ */
+static int
+image_cache_too_big(const image_meta_t *im)
+{
+  int w = im->im_req_width;
+  int h = im->im_req_height;
+
+  if(w <= 0 || h <= 0)
+    return 0;
+
+  if(im->im_max_width && w > im->im_max_width) {
+    h = h * im->im_max_width / w;
+    w = im->im_max_width;
+  }
+
+  if(im->im_max_height && h > im->im_max_height) {
+    w = w * im->im_max_height / h;
+    h = im->im_max_height;
+  }
+
+  // Smallest pixel format a decoder may hand back
+  const int bpp = im->im_can_mono ? 1 : 3;
+  return (int64_t)(w + im->im_margin * 2) * (h + im->im_margin * 2) * bpp >
+    IMAGE_CACHE_MAX_BYTES;
+}
+
+
+/**
+ * Returns a cached copy of the image as it would look after being
+ * loaded and decoded using the given parameters, or NULL
+ */
+image_t *
+image_cache_load(const char *url, const image_meta_t *im)
+{
+  char key[2048];
+  image_cache_hdr_t ich;
+  char *etag = NULL, *src_etag = NULL;
+  time_t mtime = 0, src_mtime;
+  image_t *img = NULL;
+
+  if(im->im_no_decoding || image_cache_too_big(im))
+    return NULL;
+
+  image_cache_key(key, sizeof(key), url, im);
+
+  buf_t *b = blobcache_get(key, IMAGE_CACHE_STASH, 0, NULL, &etag, &mtime);
+  if(b == NULL)
+    return NULL;
+
+  if(image_cache_source_validator(url, &src_etag, &src_mtime) ||
+     mtime != src_mtime || strcmp(etag ?: "", src_etag ?: ""))
+    goto done;
+
+  if(buf_size(b) < sizeof(ich))
+    goto done;
+
+  memcpy(&ich, buf_c8(b), sizeof(ich));
+
+  if(ich.ich_magic != IMAGE_CACHE_MAGIC)
+    goto done;
+
+  const int bpp = bytes_per_pixel(ich.ich_type);
+  const int rowsize = ich.ich_width * bpp;
+
+  if(bpp == 0 || buf_size(b) != sizeof(ich) + rowsize * ich.ich_height)
+    goto done;
+
+  pixmap_t *pm = pixmap_create(ich.ich_width, ich.ich_height,
+                               ich.ich_type, 0);
+  if(pm == NULL)
+    goto done;
+
+  const uint8_t *src = buf_c8(b) + sizeof(ich);
+  for(int y = 0; y < ich.ich_height; y++)
+    memcpy(pm->pm_data + y * pm->pm_linesize, src + y * rowsize, rowsize);
+
+  pm->pm_margin = ich.ich_margin;
+  pm->pm_flags = ich.ich_flags;
+  pm->pm_aspect = ich.ich_aspect;
+  pm->pm_intensity = ich.ich_intensity;
+  memcpy(pm->pm_primary_color, ich.ich_primary_color,
+         sizeof(pm->pm_primary_color));
+
+  img = image_create_from_pixmap(pm);
+  pixmap_release(pm);
+  img->im_origin_coded_type = ich.ich_origin_coded_type;
+  img->im_orientation = ich.ich_orientation;
+
+ done:
+  buf_release(b);
+  free(etag);
+  free(src_etag);
+  return img;
+}
+
+
+/**
+ * Store a decoded image. Only pixmaps small enough to be cheap to read
+ * back are stored, anything else is better off being decoded again
+ */
+void
+image_cache_store(const char *url, const image_meta_t *im,
+                  const image_t *img)
+{
+  char key[2048];
+  image_cache_hdr_t ich = {};
+  char *etag;
+  time_t mtime;
+
+  if(img->im_num_components != 1 ||
+     img->im_components[0].type != IMAGE_PIXMAP)
+    return;
+
+  const pixmap_t *pm = img->im_components[0].pm;
+  const int bpp = bytes_per_pixel(pm->pm_type);
+  const int rowsize = pm->pm_width * bpp;
+
+  if(bpp == 0 || rowsize * pm->pm_height > IMAGE_CACHE_MAX_BYTES)
+    return;
+
+  if(image_cache_source_validator(url, &etag, &mtime))
+    return;
+
+  ich.ich_magic = IMAGE_CACHE_MAGIC;
+  ich.ich_width = pm->pm_width;
+  ich.ich_height = pm->pm_height;
+  ich.ich_margin = pm->pm_margin;
+  ich.ich_flags = pm->pm_flags;
+  ich.ich_type = pm->pm_type;
+  ich.ich_origin_coded_type = img->im_origin_coded_type;
+  ich.ich_orientation = img->im_orientation;
+  ich.ich_aspect = pm->pm_aspect;
+  ich.ich_intensity = pm->pm_intensity;
+  memcpy(ich.ich_primary_color, pm->pm_primary_color,
+         sizeof(ich.ich_primary_color));
+
+  buf_t *b = buf_create(sizeof(ich) + rowsize * pm->pm_height);
+  uint8_t *dst = (uint8_t *)buf_str(b);
+  memcpy(dst, &ich, sizeof(ich));
+  dst += sizeof(ich);
+
+  for(int y = 0; y < pm->pm_height; y++)
+    memcpy(dst + y * rowsize, pm->pm_data + y * pm->pm_linesize, rowsize);
+
+  image_cache_key(key, sizeof(key), url, im);
+  blobcache_put(key, IMAGE_CACHE_STASH, b, IMAGE_CACHE_MAXAGE, etag, mtime, 0);
+  buf_release(b);
+  free(etag);
+}
@@ -310,6 +310,7 @@ libav_video_eof(media_codec_t *mc, video_decoder_t *vd,
 
     if(!got_pic)
       break;
+    video_decoder_account_decode_time(vd, vd->vd_decode_time.last);
     const media_buf_meta_t *mbm = &vd->vd_reorder[frame->reordered_opaque];
     if(!mbm->mbm_skip)
       libav_deliver_frame(vd, mp, mq, ctx, frame, mbm, t, mc);
@@ -350,6 +351,7 @@ libav_decode_video(struct media_codec *mc, struct video_decoder *vd,
 
   t = avgtime_stop(&vd->vd_decode_time, mq->mq_prop_decode_avg,
 		   mq->mq_prop_decode_peak);
+  video_decoder_account_decode_time(vd, vd->vd_decode_time.last);
 
   mp_set_mq_meta(mq, ctx->codec, ctx);
 
@@ -395,6 +397,72 @@ get_buffer2_wrapper(struct AVCodecContext *s, AVFrame *frame, int flags)
   return mc->get_buffer2(s, frame, flags);
 }
 
+/**
+ * Pick decoder threading based on codec, resolution and whether the
+ * source is live.
+ *
+ * Frame threading scales best but delays output by one frame per
+ * thread. Slice threading adds no delay but only helps if the stream
+ * has multiple slices per picture. For small pictures the threads
+ * mostly add synchronization overhead so we cap the thread count.
+ */
+static void
+libav_setup_threading(media_codec_t *cw, const AVCodec *codec,
+                      const media_codec_params_t *mcp)
+{
+  AVCodecContext *ctx = cw->ctx;
+  int width = ctx->width;
+  int height = ctx->height;
+  int threads = gconf.concurrency;
+  int type = 0;
+
+  if(mcp != NULL && mcp->width && mcp->height) {
+    width = mcp->width;
+    height = mcp->height;
+  }
+
+  if(codec->capabilities & CODEC_CAP_FRAME_THREADS)
+    type |= FF_THREAD_FRAME;
+  if(codec->capabilities & CODEC_CAP_SLICE_THREADS)
+    type |= FF_THREAD_SLICE;
+
+  if(mcp != NULL && mcp->low_latency && type & FF_THREAD_FRAME) {
+    if(type & FF_THREAD_SLICE) {
+      // Codec can do both, avoid the frame threading delay
+      type = FF_THREAD_SLICE;
+    } else {
+      // Frame threading only (VP8, etc), keep delay to a single frame
+      threads = MIN(threads, 2);
+    }
+  }
+
+  const int pixels = width * height;
+  if(pixels > 0) {
+    if(pixels <= 352 * 288)
+      threads = 1;
+    else if(pixels <= 720 * 576)
+      threads = MIN(threads, 2);
+    else if(pixels <= 1280 * 720)
+      threads = MIN(threads, 4);
+  }
+
+  if(type == 0)
+    threads = 1;
+
+  threads = MAX(threads, 1);
+
+  ctx->thread_count = threads;
+  if(type)
+    ctx->thread_type = type;
+
+  TRACE(TRACE_DEBUG, "libav", "%s %dx%d: %d thread%s%s%s%s",
+        codec->name, width, height, threads, threads == 1 ? "" : "s",
+        threads > 1 && type & FF_THREAD_FRAME ? " frame" : "",
+        threads > 1 && type & FF_THREAD_SLICE ? " slice" : "",
+        mcp != NULL && mcp->low_latency ? " (low latency)" : "");
+}
+
+
 /**
  *
  */
@@ -430,7 +498,7 @@ media_codec_create_lavc(media_codec_t *cw, const media_codec_params_t *mcp,
     // If we run with vdpau and h264 libav will crash when going
     // back and forth between accelerated and non-accelerated mode
     if(!(video_settings.vdpau && cw->codec_id == AV_CODEC_ID_H264))
-      cw->ctx->thread_count = gconf.concurrency;
+      libav_setup_threading(cw, codec, mcp);
 
     cw->ctx->opaque = cw;
     cw->ctx->refcounted_frames = 1;
@@ -526,6 +526,22 @@ parse_opts(int argc, char **argv)
 	     "   --disable-upnp    - Disable UPNP/DLNA stack.\n"
 #endif
 	     "   --disable-sd      - Disable service discovery (mDNS, etc).\n"
+	     "   --disable-cache-packs - Store each cached object in a file\n"
+	     "                       of its own.\n"
+	     "   --read-ahead <kb> - Size of read-ahead window for media files,\n"
+	     "                       0 disables background read-ahead.\n"
+	     "   --disable-glw-batching - Issue one draw call per UI render job.\n"
+	     "   --disable-view-cache - Always lex and preprocess view files.\n"
+	     "   --disable-persistent-pbo - Map and unmap video upload buffers\n"
+	     "                       for every frame.\n"
+	     "   --glw-layout-threads <n> - Lay out large lists and grids using\n"
+	     "                       <n> worker threads.\n"
+	     "   --bench <name>    - Run micro benchmark and exit. One of\n"
+	     "                       timerheap, prop, glwrenderer.\n"
+#if ENABLE_GLW_FRONTEND_HEADLESS
+	     "   --headless-script <file> - Commands to drive the UI with.\n"
+	     "   --headless-stats <file> - Write per frame timing to <file>.\n"
+#endif
 	     "   -p                - Path to plugin directory to load\n"
 	     "                       Intended for plugin development\n"
 	     "   --plugin-repo     - URL to plugin repository\n"
@@ -588,6 +604,22 @@ parse_opts(int argc, char **argv)
       gconf.disable_sd = 1;
       argc -= 1; argv += 1;
       continue;
+    } else if(!strcmp(argv[0], "--disable-cache-packs")) {
+      gconf.disable_blobcache_packs = 1;
+      argc -= 1; argv += 1;
+      continue;
+    } else if(!strcmp(argv[0], "--disable-glw-batching")) {
+      gconf.disable_glw_batching = 1;
+      argc -= 1; argv += 1;
+      continue;
+    } else if(!strcmp(argv[0], "--disable-view-cache")) {
+      gconf.disable_view_cache = 1;
+      argc -= 1; argv += 1;
+      continue;
+    } else if(!strcmp(argv[0], "--disable-persistent-pbo")) {
+      gconf.disable_persistent_pbo = 1;
+      argc -= 1; argv += 1;
+      continue;
     } else if(!strcmp(argv[0], "--disable-upgrades")) {
       gconf.disable_upgrades = 1;
       argc -= 1; argv += 1;
@@ -650,6 +682,21 @@ parse_opts(int argc, char **argv)
     } else if (!strcmp(argv[0], "--skin") && argc > 1) {
       mystrset(&gconf.skin, argv[1]);
       argc -= 2; argv += 2;
+    } else if (!strcmp(argv[0], "--read-ahead") && argc > 1) {
+      gconf.read_ahead_kb = atoi(argv[1]) ?: -1;
+      argc -= 2; argv += 2;
+    } else if (!strcmp(argv[0], "--glw-layout-threads") && argc > 1) {
+      gconf.glw_layout_threads = atoi(argv[1]);
+      argc -= 2; argv += 2;
+    } else if (!strcmp(argv[0], "--bench") && argc > 1) {
+      mystrset(&gconf.bench, argv[1]);
+      argc -= 2; argv += 2;
+    } else if (!strcmp(argv[0], "--headless-script") && argc > 1) {
+      mystrset(&gconf.headless_script, argv[1]);
+      argc -= 2; argv += 2;
+    } else if (!strcmp(argv[0], "--headless-stats") && argc > 1) {
+      mystrset(&gconf.headless_stats, argv[1]);
+      argc -= 2; argv += 2;
     } else if (!strcmp(argv[0], "--upgrade-path") && argc > 1) {
       mystrset(&gconf.upgrade_path, argv[1]);
       argc -= 2; argv += 2;
@@ -228,6 +228,18 @@ typedef struct gconf {
   int disable_upnp;
   int disable_upgrades;
   int disable_sd;
+  int disable_blobcache_packs;
+  int read_ahead_kb;  // 0 = default, -1 = disabled
+  int disable_glw_batching;
+  int glw_glyph_atlas;
+  int disable_view_cache;
+  int disable_persistent_pbo;
+  int glw_layout_threads;
+  int glw_retained_render;
+  int glw_texture_budget;  // MB, 0 = unlimited
+  char *headless_script;
+  char *headless_stats;
+  char *bench;  // Run the named micro benchmark and exit
   int convert_pointer_to_touch;
 
   int disable_analytics;
@@ -235,10 +247,12 @@ typedef struct gconf {
   int enable_omnigrade;
   int enable_http_debug;
   int disable_http_reuse;
+  int http_pool_size;  // Idle HTTP connections kept per host
   int enable_experimental;
   int enable_indexer;
   int enable_detailed_avdiff;
   int enable_hls_debug;
+  int enable_hls_abr;
   int enable_ftp_client_debug;
   int enable_ftp_server_debug;
   int enable_cec_debug;
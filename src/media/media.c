@@ -114,6 +114,9 @@ mp_create(const char *name, int flags)
   mp->mp_mb_pool = pool_create("packet headers",
 			       sizeof(media_buf_t),
 			       POOL_ZERO_MEM);
+#if ENABLE_LIBAV
+  mp->mp_pkt_pool = media_pkt_pool_create();
+#endif
 
   mp->mp_flags = flags;
 
@@ -409,6 +412,9 @@ mp_release(media_pipe_t *mp)
   hts_mutex_destroy(&mp->mp_overlay_mutex);
 
   pool_destroy(mp->mp_mb_pool);
+#if ENABLE_LIBAV
+  media_pkt_pool_close(mp->mp_pkt_pool, mp->mp_name);
+#endif
 
   if(mp->mp_satisfied == 0)
     atomic_dec(&media_buffer_hungry);
@@ -208,6 +208,7 @@ typedef struct media_pipe {
 
 
   pool_t *mp_mb_pool;
+  media_pkt_pool_t *mp_pkt_pool;  // Packet payloads, see media_buf.c
 
 
   unsigned int mp_buffer_current; // Bytes current queued (total for all queues)
@@ -355,6 +356,20 @@ typedef struct media_pipe {
   void (*mp_hold_changed)(struct media_pipe *mp);
   void (*mp_clock_setup)(struct media_pipe *mp, int has_audio);
 
+  /**
+   * Called by audio players when demuxing reached end of file, ie. the
+   * last few seconds of the track are in the queues. Must not block,
+   * the player is still handling events for the current track
+   */
+  void (*mp_track_ending)(struct media_pipe *mp);
+
+  /**
+   * Set when the previous track drained the queues, used to measure
+   * the gap until the next track delivers data. Cleared whenever the
+   * next track is not started by the same player
+   */
+  int64_t mp_track_drained;
+
 
   /**
    * Volume control
@@ -17,6 +17,10 @@
  *  This program is also available under a commercial proprietary license.
  *  For more information, contact andreas@lonelycoder.com
  */
+#include <string.h>
+#include <stdlib.h>
+
+#include "main.h"
 #include "media.h"
 
 #if ENABLE_LIBAV
@@ -42,12 +46,217 @@ media_buf_dtor_avpacket(media_buf_t *mb)
 
 #define BUF_PAD 32
 
+
+/**
+ * Packet payload pool
+ *
+ * Instead of having av_new_packet() malloc() the payload of every
+ * demuxed packet we keep free lists of payload buffers in power of two
+ * size classes (1kB - 512kB). The buffers are handed out wrapped in an
+ * AVBufferRef so they return to the pool when the last reference to
+ * the packet goes away, wherever that happens.
+ *
+ * Since the decoders may hold on to packets after the media_pipe is
+ * gone the pool is refcounted by the pipe and by each buffer handed
+ * out.
+ */
+
+#define PKT_POOL_MIN_SHIFT      10
+#define PKT_POOL_CLASSES        10
+#define PKT_POOL_MAX_FREE_BYTES (4 * 1024 * 1024)
+#define PKT_SLAB_HEADER_SIZE    64  // Keeps payload nicely aligned
+
+#define pkt_pool_class_size(c) (1 << (PKT_POOL_MIN_SHIFT + (c)))
+
+typedef struct media_pkt_slab {
+  struct media_pkt_slab *mps_next;
+  struct media_pkt_pool *mps_pool;
+  int mps_class;
+} media_pkt_slab_t;
+
+
+struct media_pkt_pool {
+  hts_mutex_t mpp_mutex;
+  atomic_t mpp_refcount;
+  int mpp_closed;
+
+  media_pkt_slab_t *mpp_free[PKT_POOL_CLASSES];
+  int64_t mpp_free_bytes;
+
+  int64_t mpp_bytes;       // Allocated, both free and in use
+  int64_t mpp_peak_bytes;
+  int mpp_allocs;
+  int mpp_reuses;          // Allocations avoided
+};
+
+
+/**
+ *
+ */
+media_pkt_pool_t *
+media_pkt_pool_create(void)
+{
+  media_pkt_pool_t *mpp = calloc(1, sizeof(media_pkt_pool_t));
+  hts_mutex_init(&mpp->mpp_mutex);
+  atomic_set(&mpp->mpp_refcount, 1);
+  return mpp;
+}
+
+
+/**
+ *
+ */
+static void
+media_pkt_pool_flush_locked(media_pkt_pool_t *mpp)
+{
+  media_pkt_slab_t *mps;
+
+  for(int i = 0; i < PKT_POOL_CLASSES; i++) {
+    while((mps = mpp->mpp_free[i]) != NULL) {
+      mpp->mpp_free[i] = mps->mps_next;
+      mpp->mpp_bytes -= pkt_pool_class_size(i);
+      free(mps);
+    }
+  }
+  mpp->mpp_free_bytes = 0;
+}
+
+
+/**
+ *
+ */
+static void
+media_pkt_pool_release(media_pkt_pool_t *mpp)
+{
+  if(atomic_dec(&mpp->mpp_refcount))
+    return;
+
+  media_pkt_pool_flush_locked(mpp);
+  hts_mutex_destroy(&mpp->mpp_mutex);
+  free(mpp);
+}
+
+
+/**
+ * Called by the owning media_pipe when it's destroyed
+ */
+void
+media_pkt_pool_close(media_pkt_pool_t *mpp, const char *name)
+{
+  hts_mutex_lock(&mpp->mpp_mutex);
+  TRACE(TRACE_DEBUG, "media",
+        "%s: Packet pool: %d allocations avoided, %d allocated, "
+        "peak %d kB", name, mpp->mpp_reuses, mpp->mpp_allocs,
+        (int)(mpp->mpp_peak_bytes / 1024));
+  mpp->mpp_closed = 1;
+  media_pkt_pool_flush_locked(mpp);
+  hts_mutex_unlock(&mpp->mpp_mutex);
+  media_pkt_pool_release(mpp);
+}
+
+
+/**
+ * AVBuffer free callback, may be invoked from any thread
+ */
+static void
+media_pkt_slab_free(void *opaque, uint8_t *data)
+{
+  media_pkt_slab_t *mps = opaque;
+  media_pkt_pool_t *mpp = mps->mps_pool;
+  const int size = pkt_pool_class_size(mps->mps_class);
+
+  hts_mutex_lock(&mpp->mpp_mutex);
+  if(!mpp->mpp_closed &&
+     mpp->mpp_free_bytes + size <= PKT_POOL_MAX_FREE_BYTES) {
+    mps->mps_next = mpp->mpp_free[mps->mps_class];
+    mpp->mpp_free[mps->mps_class] = mps;
+    mpp->mpp_free_bytes += size;
+    mps = NULL;
+  } else {
+    mpp->mpp_bytes -= size;
+  }
+  hts_mutex_unlock(&mpp->mpp_mutex);
+
+  free(mps);
+  media_pkt_pool_release(mpp);
+}
+
+
+/**
+ * Setup 'pkt' with a payload of 'size' bytes from the pool.
+ * Returns -1 if the packet is too big for any of the size classes or
+ * if we're out of memory
+ */
+static int
+media_pkt_pool_alloc(media_pkt_pool_t *mpp, AVPacket *pkt, size_t size)
+{
+  const size_t total = size + FF_INPUT_BUFFER_PADDING_SIZE;
+  media_pkt_slab_t *mps;
+  int c;
+
+  for(c = 0; c < PKT_POOL_CLASSES; c++)
+    if(total <= pkt_pool_class_size(c))
+      break;
+
+  if(c == PKT_POOL_CLASSES)
+    return -1;
+
+  hts_mutex_lock(&mpp->mpp_mutex);
+  mps = mpp->mpp_free[c];
+  if(mps != NULL) {
+    mpp->mpp_free[c] = mps->mps_next;
+    mpp->mpp_free_bytes -= pkt_pool_class_size(c);
+    mpp->mpp_reuses++;
+  } else {
+    mpp->mpp_allocs++;
+    mpp->mpp_bytes += pkt_pool_class_size(c);
+    mpp->mpp_peak_bytes = MAX(mpp->mpp_peak_bytes, mpp->mpp_bytes);
+  }
+  hts_mutex_unlock(&mpp->mpp_mutex);
+
+  if(mps == NULL) {
+    mps = malloc(PKT_SLAB_HEADER_SIZE + pkt_pool_class_size(c));
+    if(mps == NULL) {
+      hts_mutex_lock(&mpp->mpp_mutex);
+      mpp->mpp_allocs--;
+      mpp->mpp_bytes -= pkt_pool_class_size(c);
+      hts_mutex_unlock(&mpp->mpp_mutex);
+      return -1;
+    }
+    mps->mps_pool = mpp;
+    mps->mps_class = c;
+  }
+
+  uint8_t *data = (uint8_t *)mps + PKT_SLAB_HEADER_SIZE;
+
+  atomic_inc(&mpp->mpp_refcount);
+
+  AVBufferRef *buf = av_buffer_create(data, total, media_pkt_slab_free,
+                                      mps, 0);
+  if(buf == NULL) {
+    media_pkt_slab_free(mps, data);
+    return -1;
+  }
+
+  av_init_packet(pkt);
+  pkt->buf = buf;
+  pkt->data = data;
+  pkt->size = size;
+  memset(data + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+  return 0;
+}
+
+
+/**
+ *
+ */
 media_buf_t *
 media_buf_alloc_locked(media_pipe_t *mp, size_t size)
 {
   hts_mutex_assert(&mp->mp_mutex);
   media_buf_t *mb = pool_get(mp->mp_mb_pool);
-  av_new_packet(&mb->mb_pkt, size);
+  if(media_pkt_pool_alloc(mp->mp_pkt_pool, &mb->mb_pkt, size))
+    av_new_packet(&mb->mb_pkt, size);
   mb->mb_dtor = media_buf_dtor_avpacket;
   return mb;
 }
@@ -24,6 +24,7 @@
 struct AVPacket;
 struct media_pipe;
 struct media_queue;
+typedef struct media_pkt_pool media_pkt_pool_t;
 
 /**
  *
@@ -170,3 +171,7 @@ media_buf_t *media_buf_from_avpkt_unlocked(struct media_pipe *mp,
                                            struct AVPacket *pkt);
 
 void media_buf_dtor_frame_info(media_buf_t *mb);
+
+media_pkt_pool_t *media_pkt_pool_create(void);
+
+void media_pkt_pool_close(media_pkt_pool_t *mpp, const char *name);
@@ -73,6 +73,7 @@ typedef struct media_codec_params {
   int profile;
   int level;
   int cheat_for_speed : 1;
+  int low_latency : 1;  // Live source, avoid decoder induced delay
   int broken_aud_placement : 1;
   unsigned int sar_num;
   unsigned int sar_den;
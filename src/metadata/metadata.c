@@ -140,8 +140,8 @@ metadata_add_stream(metadata_t *md, const char *codec, int type,
   metadata_stream_t *ms = malloc(sizeof(metadata_stream_t));
   ms->ms_title = rstr_alloc(title);
   ms->ms_info = rstr_alloc(info);
-  ms->ms_isolang = rstr_alloc(isolang);
-  ms->ms_codec = rstr_alloc(codec);
+  ms->ms_isolang = rstr_intern(isolang);
+  ms->ms_codec = rstr_intern(codec);
   ms->ms_type = type;
   ms->ms_disposition = disposition;
   ms->ms_streamindex = streamindex;
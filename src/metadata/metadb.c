@@ -750,7 +750,7 @@ metadb_construct_list(sqlite3_stmt *sel, int col)
       continue;
     cnt += snprintf(buf + cnt, sizeof(buf) - cnt, "%s%s", cnt ? ", ": "", str);
   }
-  return rstr_alloc(buf);
+  return rstr_intern(buf);
 }
 
 
@@ -1363,7 +1363,7 @@ metadb_metadata_get_artist(sqlite3 *db, get_cache_t *gc, int64_t id)
   gc->gc_artist_id = id;
 
   rstr_release(gc->gc_artist_title);
-  gc->gc_artist_title = rstr_alloc((void *)sqlite3_column_text(sel, 0));
+  gc->gc_artist_title = rstr_intern((void *)sqlite3_column_text(sel, 0));
   sqlite3_finalize(sel);
   return 0;
 }
@@ -1403,7 +1403,7 @@ metadb_metadata_get_album(sqlite3 *db, get_cache_t *gc, int64_t id)
 
   gc->gc_album_id = id;
   rstr_release(gc->gc_album_title);
-  gc->gc_album_title = rstr_alloc((void *)sqlite3_column_text(sel, 0));
+  gc->gc_album_title = rstr_intern((void *)sqlite3_column_text(sel, 0));
   sqlite3_finalize(sel);
   return 0;
 }
@@ -1487,7 +1487,7 @@ metadb_metadata_get_video(sqlite3 *db, metadata_t *md, int64_t item_id,
 
   md->md_title = rstr_alloc((void *)sqlite3_column_text(sel, 1));
   md->md_duration = sqlite3_column_int(sel, 2) / 1000.0f;
-  md->md_format = rstr_alloc((void *)sqlite3_column_text(sel, 3));
+  md->md_format = rstr_intern((void *)sqlite3_column_text(sel, 3));
   md->md_year = sqlite3_column_int(sel, 4);
 
   sqlite3_finalize(sel);
@@ -2121,8 +2121,8 @@ metadb_metadata_get_image(sqlite3 *db, metadata_t *md, int64_t item_id)
   }
 
   md->md_time = sqlite3_column_int(sel, 0);
-  md->md_manufacturer = rstr_alloc((void *)sqlite3_column_text(sel, 1));
-  md->md_equipment = rstr_alloc((void *)sqlite3_column_text(sel, 2));
+  md->md_manufacturer = rstr_intern((void *)sqlite3_column_text(sel, 1));
+  md->md_equipment = rstr_intern((void *)sqlite3_column_text(sel, 2));
   sqlite3_finalize(sel);
   return 0;
 }
@@ -31,6 +31,7 @@ typedef struct avgtime {
 
   int peak;
   int avg;
+  int last;
 } avgtime_t;
 
 static __inline void avgtime_start(avgtime_t *a)
@@ -49,6 +50,7 @@ static __inline int avgtime_stop(avgtime_t *a, prop_t *avg, prop_t *peak)
     a->ptr = 0;
   
   a->samples[a->ptr] = d;
+  a->last = d;
   
   if(d > a->peak)
     a->peak = d;
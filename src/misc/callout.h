@@ -21,17 +21,17 @@
 
 #include <stdint.h>
 #include "queue.h"
+#include "timerheap.h"
 #include "lockmgr.h"
 
 struct callout;
 typedef void (callout_callback_t)(struct callout *c, void *opaque);
 
 typedef struct callout {
-  LIST_ENTRY(callout) c_link;
+  timerheap_entry_t c_entry;
   callout_callback_t *c_callback;
   lockmgr_fn_t *c_lockmgr;
   void *c_opaque;
-  uint64_t c_deadline;
   int64_t c_delta;
   const char *c_armed_by_file;
   int c_armed_by_line;
@@ -121,6 +121,9 @@ pool_init(pool_t *p, const char *name, size_t item_size, int flags)
 
   p->p_item_size = item_size;
   p->p_flags = flags;
+
+  if(flags & POOL_THREAD_SAFE)
+    hts_mutex_init(&p->p_mutex);
 }
 
 
@@ -225,6 +228,9 @@ pool_destroy(pool_t *p)
     TRACE(TRACE_INFO, "pool", "Destroying pool '%s', %d items out",
 	  p->p_name, p->p_num_out);
 
+  if(p->p_flags & POOL_THREAD_SAFE)
+    hts_mutex_destroy(&p->p_mutex);
+
   free(p);
 }
 
@@ -242,16 +248,21 @@ pool_get_ex(pool_t *p, const char *file, int line)
 pool_get(pool_t *p)
 #endif
 {
+  void *r;
+
+  if(p->p_flags & POOL_THREAD_SAFE)
+    hts_mutex_lock(&p->p_mutex);
+
   p->p_num_out++;
 #if defined(POOL_BY_MMAP)
-  return mmap(NULL, p->p_item_size_req, PROT_WRITE | PROT_READ,
-              MAP_ANON | MAP_PRIVATE, -1, 0);
+  r = mmap(NULL, p->p_item_size_req, PROT_WRITE | PROT_READ,
+           MAP_ANON | MAP_PRIVATE, -1, 0);
 
 #elif defined(POOL_BY_MALLOC)
   if(p->p_flags & POOL_ZERO_MEM)
-    return calloc(1, p->p_item_size_req);
+    r = calloc(1, p->p_item_size_req);
   else
-    return malloc(p->p_item_size_req);
+    r = malloc(p->p_item_size_req);
 #else
   pool_item_t *pi = p->p_item;
   if(pi == NULL) {
@@ -269,12 +280,15 @@ pool_get(pool_t *p)
   pool_item_dbg_t *pid = (void *)pi;
   pid->file = file;
   pid->line = line;
-  return (void *)pi + sizeof(pool_item_dbg_t);
+  r = (void *)pi + sizeof(pool_item_dbg_t);
 #else
-  return pi;
+  r = pi;
 #endif
 #endif
 
+  if(p->p_flags & POOL_THREAD_SAFE)
+    hts_mutex_unlock(&p->p_mutex);
+  return r;
 }
 
 /**
@@ -283,6 +297,9 @@ pool_get(pool_t *p)
 void
 pool_put(pool_t *p, void *ptr)
 {
+  if(p->p_flags & POOL_THREAD_SAFE)
+    hts_mutex_lock(&p->p_mutex);
+
 #if defined(POOL_BY_MMAP)
 
 #if defined(MADV_FREE)
@@ -328,6 +345,9 @@ pool_put(pool_t *p, void *ptr)
   p->p_item = pi;
 #endif
   p->p_num_out--;
+
+  if(p->p_flags & POOL_THREAD_SAFE)
+    hts_mutex_unlock(&p->p_mutex);
 }
 
 
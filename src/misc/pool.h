@@ -47,7 +47,8 @@ typedef struct pool {
 } pool_t;
 
 
-#define POOL_ZERO_MEM  0x2
+#define POOL_ZERO_MEM     0x2
+#define POOL_THREAD_SAFE  0x4  // Serialize get/put on the pool's own mutex
 
 pool_t *pool_create(const char *name, size_t item_size, int flags);
 
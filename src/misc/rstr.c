@@ -23,6 +23,7 @@
 #include <stddef.h>
 
 #include "rstr.h"
+#include "arch/threads.h"
 
 #ifdef RSTR_STATS
 int rstr_allocs;
@@ -133,3 +134,150 @@ rstr_vec_free(rstr_vec_t *rv)
   free(rv);
 }
 
+
+
+/**
+ * String interning
+ *
+ * rstr_intern() returns a reference to the single rstr_t holding a
+ * given string, so equal interned strings are stored once and can be
+ * compared by pointer.
+ *
+ * The table is split in shards, selected by the top bits of the hash,
+ * each with its own lock so concurrent lookups of different names
+ * rarely contend.
+ *
+ * Each shard holds a reference of its own. Entries nobody else refers
+ * to (refcnt == 1) are swept before the shard grows. New references to
+ * an entry are only handed out by rstr_intern() while holding the
+ * shard's mutex, so an entry can not be revived while we sweep.
+ */
+#define RSTR_INTERN_SHARD_BITS 5
+#define RSTR_INTERN_SHARDS     (1 << RSTR_INTERN_SHARD_BITS)
+
+typedef struct rstr_intern_shard {
+  hts_mutex_t ris_mutex;
+  rstr_t **ris_table;
+  unsigned int ris_size;  // Power of 2
+  unsigned int ris_used;
+} rstr_intern_shard_t;
+
+static rstr_intern_shard_t rstr_intern_shards[RSTR_INTERN_SHARDS];
+
+
+/**
+ *
+ */
+static void __attribute__((constructor))
+rstr_intern_init(void)
+{
+  for(int i = 0; i < RSTR_INTERN_SHARDS; i++)
+    hts_mutex_init(&rstr_intern_shards[i].ris_mutex);
+}
+
+
+/**
+ * FNV-1a
+ */
+static uint32_t
+rstr_intern_hash(const char *str)
+{
+  const unsigned char *s = (const unsigned char *)str;
+  uint32_t v = 2166136261U;
+  while(*s) {
+    v ^= *s++;
+    v *= 16777619U;
+  }
+  return v;
+}
+
+
+/**
+ *
+ */
+static void
+rstr_intern_rehash(rstr_intern_shard_t *ris, unsigned int size)
+{
+  rstr_t **old = ris->ris_table;
+  const unsigned int oldsize = ris->ris_size;
+  unsigned int i;
+
+  ris->ris_table = calloc(size, sizeof(rstr_t *));
+  ris->ris_size = size;
+  ris->ris_used = 0;
+
+  for(i = 0; i < oldsize; i++) {
+    rstr_t *r = old[i];
+    if(r == NULL)
+      continue;
+#ifdef USE_RSTR_REFCOUNTING
+    if(atomic_get(&r->refcnt) == 1) {
+      rstr_release(r);
+      continue;
+    }
+#endif
+    unsigned int j = rstr_intern_hash(r->str);
+    while(ris->ris_table[j & (size - 1)] != NULL)
+      j++;
+    ris->ris_table[j & (size - 1)] = r;
+    ris->ris_used++;
+  }
+  free(old);
+}
+
+
+/**
+ *
+ */
+rstr_t *
+rstr_intern(const char *str)
+{
+  if(str == NULL)
+    return NULL;
+
+#ifndef USE_RSTR_REFCOUNTING
+  return rstr_alloc(str);
+#else
+  const uint32_t hash = rstr_intern_hash(str);
+  rstr_intern_shard_t *ris =
+    &rstr_intern_shards[hash >> (32 - RSTR_INTERN_SHARD_BITS)];
+
+  hts_mutex_lock(&ris->ris_mutex);
+
+  if((ris->ris_used + 1) * 4 > ris->ris_size * 3) {
+    // Sweep unreferenced entries first, only grow if that's not enough
+    rstr_intern_rehash(ris, ris->ris_size ?: 64);
+    if((ris->ris_used + 1) * 2 > ris->ris_size)
+      rstr_intern_rehash(ris, ris->ris_size * 2);
+  }
+
+  const unsigned int mask = ris->ris_size - 1;
+  unsigned int i = hash & mask;
+  rstr_t *r;
+
+  while((r = ris->ris_table[i]) != NULL) {
+    if(!strcmp(r->str, str)) {
+      r = rstr_dup(r);
+      hts_mutex_unlock(&ris->ris_mutex);
+      return r;
+    }
+    i = (i + 1) & mask;
+  }
+
+  r = rstr_alloc(str);
+  ris->ris_table[i] = rstr_dup(r);
+  ris->ris_used++;
+  hts_mutex_unlock(&ris->ris_mutex);
+  return r;
+#endif
+}
+
+
+/**
+ *
+ */
+rstr_t *
+rstr_intern_rstr(rstr_t *rs)
+{
+  return rstr_intern(rstr_get(rs));
+}
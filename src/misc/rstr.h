@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stddef.h>
 #include "config.h"
 #include "arch/atomic.h"
 #include "compiler.h"
@@ -102,9 +103,22 @@ static __inline void rstr_set(rstr_t **p, rstr_t *r)
 
 rstr_t *rstr_spn(rstr_t *s, const char *set, int offset);
 
+/**
+ * Return a reference to the shared copy of 'str'. Two interned rstrs
+ * with equal content are always the same pointer
+ */
+rstr_t *rstr_intern(const char *str);
+
+rstr_t *rstr_intern_rstr(rstr_t *rs);
+
+static __inline rstr_t *rstr_from_data(const char *str)
+{
+  return (rstr_t *)(str - offsetof(rstr_t, str));
+}
+
 static __inline int rstr_eq(const rstr_t *a, const rstr_t *b)
 {
-  if(a == NULL && b == NULL)
+  if(a == b)
     return 1;
   if(a == NULL || b == NULL)
     return 0;
@@ -0,0 +1,234 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "timerheap.h"
+#include "main.h"
+
+/**
+ * Merge two heaps, both 'a' and 'b' must be roots without siblings
+ */
+static timerheap_entry_t *
+meld(timerheap_entry_t *a, timerheap_entry_t *b)
+{
+  if(b->the_deadline < a->the_deadline) {
+    timerheap_entry_t *t = a;
+    a = b;
+    b = t;
+  }
+
+  // 'b' becomes first child of 'a'
+  b->the_prev = a;
+  b->the_next = a->the_child;
+  if(a->the_child != NULL)
+    a->the_child->the_prev = b;
+  a->the_child = b;
+  return a;
+}
+
+
+/**
+ * Combine a list of siblings into a single heap using the standard
+ * two pass pairing (left to right, then melding right to left)
+ */
+static timerheap_entry_t *
+merge_pairs(timerheap_entry_t *first)
+{
+  timerheap_entry_t *acc = NULL, *a, *b, *r;
+
+  while((a = first) != NULL) {
+    b = a->the_next;
+    a->the_prev = a->the_next = NULL;
+
+    if(b != NULL) {
+      first = b->the_next;
+      b->the_prev = b->the_next = NULL;
+      a = meld(a, b);
+    } else {
+      first = NULL;
+    }
+
+    // Build list of pairs in reverse order
+    a->the_next = acc;
+    acc = a;
+  }
+
+  if(acc == NULL)
+    return NULL;
+
+  r = acc;
+  acc = acc->the_next;
+  r->the_next = NULL;
+
+  while(acc != NULL) {
+    a = acc;
+    acc = acc->the_next;
+    a->the_next = NULL;
+    r = meld(r, a);
+  }
+  return r;
+}
+
+
+/**
+ * Unlink a (non root) entry and its subtree from the heap
+ */
+static void
+detach(timerheap_entry_t *the)
+{
+  if(the->the_prev->the_child == the)
+    the->the_prev->the_child = the->the_next;
+  else
+    the->the_prev->the_next = the->the_next;
+
+  if(the->the_next != NULL)
+    the->the_next->the_prev = the->the_prev;
+
+  the->the_prev = the->the_next = NULL;
+}
+
+
+/**
+ *
+ */
+void
+timerheap_insert(timerheap_t *th, timerheap_entry_t *the, int64_t deadline)
+{
+  if(the->the_queued) {
+    timerheap_update(th, the, deadline);
+    return;
+  }
+
+  the->the_deadline = deadline;
+  the->the_child = the->the_next = the->the_prev = NULL;
+  the->the_queued = 1;
+
+  th->th_root = th->th_root != NULL ? meld(th->th_root, the) : the;
+}
+
+
+/**
+ *
+ */
+void
+timerheap_remove(timerheap_t *th, timerheap_entry_t *the)
+{
+  if(!the->the_queued)
+    return;
+
+  the->the_queued = 0;
+
+  timerheap_entry_t *sub = merge_pairs(the->the_child);
+  the->the_child = NULL;
+
+  if(the == th->th_root) {
+    th->th_root = sub;
+    return;
+  }
+
+  detach(the);
+  if(sub != NULL)
+    th->th_root = meld(th->th_root, sub);
+}
+
+
+/**
+ *
+ */
+void
+timerheap_update(timerheap_t *th, timerheap_entry_t *the, int64_t deadline)
+{
+  if(!the->the_queued) {
+    timerheap_insert(th, the, deadline);
+    return;
+  }
+
+  if(deadline > the->the_deadline) {
+    timerheap_remove(th, the);
+    timerheap_insert(th, the, deadline);
+    return;
+  }
+
+  the->the_deadline = deadline;
+
+  if(the != th->th_root) {
+    // Decrease key: Cut out the subtree and meld it with the root
+    detach(the);
+    th->th_root = meld(th->th_root, the);
+  }
+}
+
+
+/**
+ * Arm, rearm and disarm count timers with pseudo random deadlines and
+ * verify that they expire in order
+ */
+void
+timerheap_bench(int count)
+{
+  timerheap_t th = {0};
+  timerheap_entry_t *v = calloc(count, sizeof(timerheap_entry_t));
+  uint32_t seed = 1;
+  int i;
+
+#define BENCH_RAND() (seed = seed * 1664525 + 1013904223)
+
+  int64_t ts0 = arch_get_ts();
+
+  for(i = 0; i < count; i++)
+    timerheap_insert(&th, &v[i], BENCH_RAND() % 1000000);
+
+  int64_t ts1 = arch_get_ts();
+
+  for(i = 0; i < count; i++)
+    timerheap_update(&th, &v[i], BENCH_RAND() % 1000000);
+
+  int64_t ts2 = arch_get_ts();
+
+  for(i = 0; i < count; i += 2)
+    timerheap_remove(&th, &v[i]);
+
+  int64_t ts3 = arch_get_ts();
+
+  int64_t prev = INT64_MIN;
+  int expired = 0;
+  timerheap_entry_t *the;
+  while((the = timerheap_first(&th)) != NULL) {
+    if(the->the_deadline < prev) {
+      printf("timerheap: Order violated at %d\n", expired);
+      abort();
+    }
+    prev = the->the_deadline;
+    timerheap_remove(&th, the);
+    expired++;
+  }
+
+  int64_t ts4 = arch_get_ts();
+
+#undef BENCH_RAND
+
+  printf("timerheap: %d timers: arm %"PRId64"us rearm %"PRId64"us "
+         "disarm(half) %"PRId64"us expire(%d) %"PRId64"us\n",
+         count, ts1 - ts0, ts2 - ts1, ts3 - ts2, expired, ts4 - ts3);
+
+  free(v);
+}
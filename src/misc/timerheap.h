@@ -0,0 +1,68 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Pairing heap of deadlines, used for timers.
+ *
+ * The entry is embedded in the timer and links directly to its
+ * parent, siblings and children so arming never needs to allocate
+ * and can't fail. Arm and the first expiry are O(1), disarm and rearm
+ * are O(log n) amortized. A zeroed entry is not queued.
+ */
+typedef struct timerheap_entry {
+  int64_t the_deadline;
+  struct timerheap_entry *the_child;
+  struct timerheap_entry *the_next;  // Next sibling
+  struct timerheap_entry *the_prev;  // Previous sibling or parent
+  int the_queued;
+} timerheap_entry_t;
+
+typedef struct timerheap {
+  timerheap_entry_t *th_root;
+} timerheap_t;
+
+void timerheap_insert(timerheap_t *th, timerheap_entry_t *the,
+                      int64_t deadline);
+
+void timerheap_remove(timerheap_t *th, timerheap_entry_t *the);
+
+void timerheap_update(timerheap_t *th, timerheap_entry_t *the,
+                      int64_t deadline);
+
+void timerheap_bench(int count);
+
+static __inline timerheap_entry_t *
+timerheap_first(const timerheap_t *th)
+{
+  return th->th_root;
+}
+
+static __inline int
+timerheap_entry_queued(const timerheap_entry_t *the)
+{
+  return the->the_queued;
+}
+
+#define timerheap_item(the, type, field) \
+  ((type *)((char *)(the) - offsetof(type, field)))
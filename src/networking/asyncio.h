@@ -20,11 +20,11 @@
 #pragma once
 #include "net.h"
 #include "misc/redblack.h"
+#include "misc/timerheap.h"
 
 
 typedef struct asyncio_timer {
-  LIST_ENTRY(asyncio_timer) at_link;
-  int64_t at_expire;
+  timerheap_entry_t at_entry;
   void (*at_fn)(void *opaque);
   void *at_opaque;
 } asyncio_timer_t;
@@ -167,7 +167,7 @@ void asyncio_timer_disarm(asyncio_timer_t *at);
 
 static __inline int asyncio_timer_is_armed(const asyncio_timer_t *at)
 {
-  return at->at_expire != 0;
+  return timerheap_entry_queued(&at->at_entry);
 }
 
 /*************************************************************************
@@ -34,6 +34,13 @@
 #include "prop/prop.h"
 #include "misc/minmax.h"
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define ASYNCIO_USE_EPOLL 1
+#define ASYNCIO_EPOLL_EVENTS 64
+#else
+#define ASYNCIO_USE_EPOLL 0
+#endif
 
 /**
  *
@@ -48,6 +55,7 @@
 static void asyncio_ssl_write(asyncio_fd_t *af);
 static void asyncio_ssl_read(asyncio_fd_t *af);
 static int asyncio_ssl_events(asyncio_fd_t *af);
+static void asyncio_ssl_kick(asyncio_fd_t *af);
 static void asyncio_ssl_handshake(asyncio_fd_t *af);
 
 #endif
@@ -56,13 +64,12 @@ static void asyncio_ssl_handshake(asyncio_fd_t *af);
 
 LIST_HEAD(asyncio_fd_list, asyncio_fd);
 LIST_HEAD(asyncio_worker_list, asyncio_worker);
-LIST_HEAD(asyncio_timer_list, asyncio_timer);
 TAILQ_HEAD(asyncio_dns_req_queue, asyncio_dns_req);
 TAILQ_HEAD(asyncio_task_queue, asyncio_task);
 
 static hts_thread_t asyncio_thread_id;
 
-static struct asyncio_timer_list asyncio_timers;
+static timerheap_t asyncio_timers;
 
 static hts_mutex_t asyncio_worker_mutex;
 static struct asyncio_worker_list asyncio_workers;
@@ -71,6 +78,10 @@ static int asyncio_pipe[2];
 static struct asyncio_fd_list asyncio_fds;
 static int asyncio_num_fds;
 
+#if ASYNCIO_USE_EPOLL
+static int asyncio_epfd = -1;
+#endif
+
 struct prop_courier *asyncio_courier;
 
 static hts_mutex_t asyncio_dns_mutex;
@@ -120,13 +131,17 @@ struct asyncio_fd {
   htsbuf_queue_t af_sendq;
   htsbuf_queue_t af_recvq;
 
-  int64_t af_timeout;
+  asyncio_timer_t af_timer;  // Timeout and delivery of af_pending_errno
 
   int af_refcount;
   int af_fd;
   int af_poll_events;
   int af_pending_errno;
 
+#if ASYNCIO_USE_EPOLL
+  int af_epoll_events;   // poll events registered with epoll, -1 if none
+#endif
+
   uint16_t af_ext_events;
   uint8_t af_connected;
 
@@ -273,19 +288,7 @@ asyncio_timer_init(asyncio_timer_t *at, void (*fn)(void *opaque),
 {
   at->at_fn = fn;
   at->at_opaque = opaque;
-  at->at_expire = 0;
-}
-
-
-/**
- *
- */
-static int
-at_compar(const asyncio_timer_t *a, const asyncio_timer_t *b)
-{
-  if(a->at_expire < b->at_expire)
-    return -1;
-  return 1;
+  at->at_entry.the_queued = 0;
 }
 
 
@@ -296,11 +299,7 @@ void
 asyncio_timer_arm(asyncio_timer_t *at, int64_t expire)
 {
   asyncio_verify_thread();
-  if(at->at_expire)
-    LIST_REMOVE(at, at_link);
-
-  at->at_expire = expire;
-  LIST_INSERT_SORTED(&asyncio_timers, at, at_link, at_compar, asyncio_timer_t);
+  timerheap_update(&asyncio_timers, &at->at_entry, expire);
 }
 
 
@@ -321,10 +320,7 @@ void
 asyncio_timer_disarm(asyncio_timer_t *at)
 {
   asyncio_verify_thread();
-  if(at->at_expire) {
-    LIST_REMOVE(at, at_link);
-    at->at_expire = 0;
-  }
+  timerheap_remove(&asyncio_timers, &at->at_entry);
 }
 
 
@@ -365,119 +361,289 @@ events_to_poll(int events)
 }
 
 /**
- *
+ * Deliver poll(2) style revents to an fd
  */
 static void
-asyncio_dopoll(void)
+asyncio_dispatch(asyncio_fd_t *af, int revents, int poll_failed)
 {
-  asyncio_timer_t *at;
+  if(af->af_callback == NULL)
+    return;
 
-  while((at = LIST_FIRST(&asyncio_timers)) != NULL &&
-        at->at_expire <= async_now) {
-    LIST_REMOVE(at, at_link);
-    at->at_expire = 0;
-    at->at_fn(at->at_opaque);
+  if(revents & POLLHUP) {
+    af->af_callback(af, af->af_opaque, ASYNCIO_ERROR, ECONNRESET);
+    return;
   }
 
-  asyncio_fd_t *af;
-  struct pollfd *fds = alloca(asyncio_num_fds * sizeof(struct pollfd));
-  asyncio_fd_t **afds  = alloca(asyncio_num_fds * sizeof(asyncio_fd_t *));
-  int n = 0;
-
-  int timeout = INT32_MAX;
-
-  LIST_FOREACH(af, &asyncio_fds, af_link) {
-    if(af->af_pending_errno) {
-      af->af_callback(af, af->af_opaque, ASYNCIO_ERROR, af->af_pending_errno);
-      goto release;
-    }
+  if(revents & POLLERR || poll_failed) {
+    int err;
+    socklen_t errlen = sizeof(int);
 
-    if(af->af_timeout) {
-      if(af->af_timeout <= async_now) {
-        af->af_timeout = 0;
-        af->af_callback(af, af->af_opaque, ASYNCIO_TIMEOUT, 0);
-        goto release;
+    if(getsockopt(af->af_fd, SOL_SOCKET, SO_ERROR, (void *)&err, &errlen)) {
+      TRACE(TRACE_ERROR, "ASYNCIO", "getsockopt failed for %s 0x%x -- %s",
+            af->af_name, af->af_fd, strerror(errno));
+      af->af_callback(af, af->af_opaque, ASYNCIO_ERROR, ENOBUFS);
+    } else {
+      if(err) {
+        af->af_callback(af, af->af_opaque, ASYNCIO_ERROR, err);
+        return;
       }
-      timeout = MIN(timeout, (af->af_timeout - async_now + 999) / 1000);
     }
+  }
 
-    if(af->af_fd == -1) {
-      continue;
-    }
-    
-    fds[n].fd = af->af_fd;
+  const int events =
+    (revents & POLLIN  ? ASYNCIO_READ  : 0) |
+    (revents & POLLOUT ? ASYNCIO_WRITE : 0);
+
+  if(events)
+    af->af_callback(af, af->af_opaque, events, 0);
+}
 
+
+/**
+ *
+ */
+static int
+asyncio_poll_events(asyncio_fd_t *af)
+{
 #if ENABLE_OPENSSL
-    if(af->af_ssl != NULL)
-      fds[n].events = asyncio_ssl_events(af);
-    else
+  if(af->af_ssl != NULL)
+    return asyncio_ssl_events(af);
 #endif
-      fds[n].events = af->af_poll_events;
+  return af->af_poll_events;
+}
 
-    fds[n].revents = 0;
-    afds[n] = af;
 
-    af->af_refcount++;
-    n++;
+#if ASYNCIO_USE_EPOLL
+
+/**
+ * Bring the epoll registration of an fd in line with what we want to
+ * wait for. Called whenever the interest set may have changed
+ */
+static void
+asyncio_epoll_update(asyncio_fd_t *af)
+{
+  if(asyncio_epfd == -1 || af->af_fd == -1)
+    return;
+
+  const int events = asyncio_poll_events(af);
+
+  if(af->af_epoll_events == events)
+    return;
+
+  struct epoll_event ev = {0};
+  ev.events =
+    (events & POLLIN  ? EPOLLIN  : 0) |
+    (events & POLLOUT ? EPOLLOUT : 0) |
+    (events & POLLHUP ? EPOLLHUP : 0) |
+    (events & POLLERR ? EPOLLERR : 0);
+  ev.data.ptr = af;
+
+  const int op = af->af_epoll_events == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+
+  if(epoll_ctl(asyncio_epfd, op, af->af_fd, &ev)) {
+    TRACE(TRACE_ERROR, "ASYNCIO", "epoll_ctl failed for %s -- %s",
+          af->af_name, strerror(errno));
+    return;
   }
+  af->af_epoll_events = events;
+}
 
-  if((at = LIST_FIRST(&asyncio_timers)) != NULL)
-    timeout = MIN(timeout, (at->at_expire - async_now + 999) / 1000);
 
-  if(timeout == INT32_MAX)
-    timeout = -1;
+/**
+ * Must be called before af_fd is closed
+ */
+static void
+asyncio_epoll_remove(asyncio_fd_t *af)
+{
+  if(af->af_epoll_events == -1)
+    return;
 
-  int err = poll(fds, n, timeout);
+  if(epoll_ctl(asyncio_epfd, EPOLL_CTL_DEL, af->af_fd, NULL))
+    TRACE(TRACE_ERROR, "ASYNCIO", "epoll_ctl(DEL) failed for %s -- %s",
+          af->af_name, strerror(errno));
+  af->af_epoll_events = -1;
+}
+
+
+/**
+ *
+ */
+static void
+asyncio_doepoll(int timeout)
+{
+  struct epoll_event evs[ASYNCIO_EPOLL_EVENTS];
+  asyncio_fd_t *afds[ASYNCIO_EPOLL_EVENTS];
+
+  int n = epoll_wait(asyncio_epfd, evs, ASYNCIO_EPOLL_EVENTS, timeout);
 
   async_now = arch_get_ts();
 
+  if(n < 0)
+    return;
+
+  // Callbacks may delete other fds, hold on to all of them first
   for(int i = 0; i < n; i++) {
-    af = afds[i];
+    afds[i] = evs[i].data.ptr;
+    afds[i]->af_refcount++;
+  }
 
-    if(af->af_callback == NULL)
-      continue;
+  for(int i = 0; i < n; i++) {
+    const uint32_t e = evs[i].events;
+    asyncio_dispatch(afds[i],
+                     (e & EPOLLIN  ? POLLIN  : 0) |
+                     (e & EPOLLOUT ? POLLOUT : 0) |
+                     (e & EPOLLHUP ? POLLHUP : 0) |
+                     (e & EPOLLERR ? POLLERR : 0), 0);
+  }
 
-    if(fds[i].revents & POLLHUP) {
-      af->af_callback(af, af->af_opaque, ASYNCIO_ERROR, ECONNRESET);
-      continue;
+  for(int i = 0; i < n; i++) {
+#if ENABLE_OPENSSL
+    // SSL decides what to wait for based on what happened above
+    if(afds[i]->af_ssl != NULL) {
+      asyncio_ssl_kick(afds[i]);
+      asyncio_epoll_update(afds[i]);
     }
+#endif
+    af_release(afds[i]);
+  }
+}
 
-    if(fds[i].revents & POLLERR || err < 0) {
-      int err;
-      socklen_t errlen = sizeof(int);
+#else
 
-      if(getsockopt(af->af_fd, SOL_SOCKET, SO_ERROR, (void *)&err, &errlen)) {
-        TRACE(TRACE_ERROR, "ASYNCIO", "getsockopt failed for %s 0x%x -- %s",
-              af->af_name, af->af_fd, strerror(errno));
-        af->af_callback(af, af->af_opaque, ASYNCIO_ERROR, ENOBUFS);
-      } else {
-        if(err) {
-          af->af_callback(af, af->af_opaque, ASYNCIO_ERROR, err);
-          continue;
-        }
-      }
-    }
+static void
+asyncio_epoll_update(asyncio_fd_t *af)
+{
+}
 
-    const int events =
-      (fds[i].revents & POLLIN  ? ASYNCIO_READ  : 0) |
-      (fds[i].revents & POLLOUT ? ASYNCIO_WRITE : 0);
+static void
+asyncio_epoll_remove(asyncio_fd_t *af)
+{
+}
 
-    if(events)
-      af->af_callback(af, af->af_opaque, events, 0);
+#endif
 
-    if(0) {
-      int64_t now = arch_get_ts();
 
-      if(now - async_now > 10000) {
-        TRACE(TRACE_ERROR, "ASYNCIO", "Long callback on socktet %s (%d µs)",
-              af->af_name, (int) (now - async_now));
-      }
-      async_now = now;
+/**
+ *
+ */
+static void
+asyncio_close_fd(asyncio_fd_t *af)
+{
+  if(af->af_fd == -1)
+    return;
+  asyncio_epoll_remove(af);
+  close(af->af_fd);
+  af->af_fd = -1;
+}
+
+
+/**
+ * Arm (or disarm if deadline is 0) the fd timeout
+ */
+static void
+asyncio_fd_set_timeout(asyncio_fd_t *af, int64_t deadline)
+{
+  if(af->af_pending_errno)
+    return; // Timer is busy delivering the error
+
+  if(deadline)
+    asyncio_timer_arm(&af->af_timer, deadline);
+  else
+    asyncio_timer_disarm(&af->af_timer);
+}
+
+
+/**
+ * Report an error to the fd callback from the main loop rather than
+ * from the current call stack
+ */
+static void
+asyncio_fd_set_error(asyncio_fd_t *af, int err)
+{
+  af->af_pending_errno = err;
+  asyncio_timer_arm(&af->af_timer, async_now);
+}
+
+
+/**
+ *
+ */
+static void
+asyncio_fd_timer(void *aux)
+{
+  asyncio_fd_t *af = aux;
+  const int err = af->af_pending_errno;
+
+  if(af->af_callback == NULL)
+    return;
+
+  if(err) {
+    af->af_pending_errno = 0;
+    af->af_callback(af, af->af_opaque, ASYNCIO_ERROR, err);
+  } else {
+    af->af_callback(af, af->af_opaque, ASYNCIO_TIMEOUT, 0);
+  }
+}
+
+
+/**
+ *
+ */
+static void
+asyncio_dopoll(void)
+{
+  timerheap_entry_t *the;
+
+  while((the = timerheap_first(&asyncio_timers)) != NULL &&
+        the->the_deadline <= async_now) {
+    asyncio_timer_t *at = timerheap_item(the, asyncio_timer_t, at_entry);
+    timerheap_remove(&asyncio_timers, the);
+    at->at_fn(at->at_opaque);
+  }
+
+  asyncio_fd_t *af;
+  int timeout = INT32_MAX;
+
+  if((the = timerheap_first(&asyncio_timers)) != NULL)
+    timeout = MIN(timeout, (the->the_deadline - async_now + 999) / 1000);
+
+  if(timeout == INT32_MAX)
+    timeout = -1;
+
+#if ASYNCIO_USE_EPOLL
+  if(asyncio_epfd != -1) {
+    asyncio_doepoll(timeout);
+    return;
+  }
+#endif
+
+  struct pollfd *fds = alloca(asyncio_num_fds * sizeof(struct pollfd));
+  asyncio_fd_t **afds  = alloca(asyncio_num_fds * sizeof(asyncio_fd_t *));
+  int n = 0;
+
+  LIST_FOREACH(af, &asyncio_fds, af_link) {
+    if(af->af_fd == -1) {
+      continue;
     }
+
+#if ENABLE_OPENSSL
+    asyncio_ssl_kick(af);
+#endif
+    fds[n].fd = af->af_fd;
+    fds[n].events = asyncio_poll_events(af);
+    fds[n].revents = 0;
+    afds[n] = af;
+
+    af->af_refcount++;
+    n++;
   }
 
+  int err = poll(fds, n, timeout);
 
- release:
+  async_now = arch_get_ts();
+
+  for(int i = 0; i < n; i++)
+    asyncio_dispatch(afds[i], fds[i].revents, err < 0);
 
   for(int i = 0; i < n; i++)
     af_release(afds[i]);
@@ -494,6 +660,7 @@ asyncio_set_events(asyncio_fd_t *af, int events)
   af->af_ext_events = events;
 
   af->af_poll_events = events_to_poll(events);
+  asyncio_epoll_update(af);
 }
 
 
@@ -531,6 +698,10 @@ asyncio_add_fd(int fd, int events, asyncio_fd_callback_t *cb, void *opaque,
   af->af_refcount = 1;
   af->af_fd = fd;
   af->af_name = strdup(name);
+#if ASYNCIO_USE_EPOLL
+  af->af_epoll_events = -1;
+#endif
+  asyncio_timer_init(&af->af_timer, asyncio_fd_timer, af);
   asyncio_set_events(af, events);
   af->af_callback = cb;
   af->af_opaque = opaque;
@@ -559,9 +730,8 @@ asyncio_del_fd(asyncio_fd_t *af)
   }
 #endif
 
-  if(af->af_fd != -1)
-    close(af->af_fd);
-  af->af_fd = -1;
+  asyncio_timer_disarm(&af->af_timer);
+  asyncio_close_fd(af);
   LIST_REMOVE(af, af_link);
   asyncio_num_fds--;
   af->af_callback = NULL;
@@ -575,7 +745,7 @@ asyncio_del_fd(asyncio_fd_t *af)
 void
 asyncio_set_timeout_delta_sec(asyncio_fd_t *af, int delta)
 {
-  af->af_timeout = delta * 1000000LL + async_now;
+  asyncio_fd_set_timeout(af, delta * 1000000LL + async_now);
 }
 
 /**
@@ -707,6 +877,13 @@ asyncio_init_early(void)
 
   arch_pipe(asyncio_pipe);
 
+#if ASYNCIO_USE_EPOLL
+  asyncio_epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(asyncio_epfd == -1)
+    TRACE(TRACE_ERROR, "ASYNCIO", "Unable to create epoll fd -- %s, "
+          "falling back to poll()", strerror(errno));
+#endif
+
   asyncio_dns_worker = asyncio_add_worker(adr_deliver_cb);
 }
 
@@ -894,7 +1071,11 @@ do_write(asyncio_fd_t *af)
 {
 #if ENABLE_OPENSSL
   if(af->af_ssl != NULL) {
+    // The write may end up in a callback that deletes the fd
+    af->af_refcount++;
     asyncio_ssl_write(af);
+    asyncio_epoll_update(af);
+    af_release(af);
     return;
   }
 #endif
@@ -922,7 +1103,7 @@ do_write(asyncio_fd_t *af)
 
     if(r == -1) {
       asyncio_rem_events(af, ASYNCIO_WRITE);
-      af->af_pending_errno = errno;
+      asyncio_fd_set_error(af, errno);
       return;
     }
 
@@ -980,13 +1161,13 @@ asyncio_tcp_connected(asyncio_fd_t *af, void *opaque, int events, int error)
   if(events & ASYNCIO_ERROR) {
     char buf[256];
     snprintf(buf, sizeof(buf), "%s", strerror(error));
-    af->af_timeout = 0;
+    asyncio_fd_set_timeout(af, 0);
     af->af_error_callback(af->af_opaque, buf);
     return 0;
   }
 
   if(events & ASYNCIO_READ) {
-    af->af_timeout = 0;
+    asyncio_fd_set_timeout(af, 0);
 #if ENABLE_OPENSSL
     if(af->af_ssl != NULL) {
       asyncio_ssl_read(af);
@@ -1010,7 +1191,7 @@ asyncio_tcp_connected(asyncio_fd_t *af, void *opaque, int events, int error)
       return 0;
     }
 
-    af->af_timeout = 0;
+    asyncio_fd_set_timeout(af, 0);
 
     asyncio_rem_events(af, ASYNCIO_WRITE);
     int err;
@@ -1111,7 +1292,7 @@ asyncio_connect(const char *name, const net_addr_t *addr,
 
   af->af_error_callback = error_cb;
   af->af_read_callback  = read_cb;
-  af->af_timeout = arch_get_ts() + timeout * 1000;
+  asyncio_fd_set_timeout(af, arch_get_ts() + timeout * 1000);
   af->af_hostname = hostname ? strdup(hostname) : NULL;
 
 #if ENABLE_OPENSSL
@@ -1130,7 +1311,7 @@ asyncio_connect(const char *name, const net_addr_t *addr,
     } else {
       // Got fail directly, but we still want to notify the user about
       // the error asynchronously. Just to make things easier
-      af->af_pending_errno = errno;
+      asyncio_fd_set_error(af, errno);
     }
   } else {
     asyncio_add_events(af, ASYNCIO_WRITE);
@@ -1167,9 +1348,9 @@ asyncio_attach(const char *name, int fd,
 #endif
 
   af->af_connected = 1;
-  af->af_fd = fd;
   af->af_error_callback = error_cb;
   af->af_read_callback  = read_cb;
+  asyncio_epoll_update(af);
   return af;
 }
 
@@ -1403,8 +1584,7 @@ asyncio_udp_event(asyncio_fd_t *af, void *opaque, int events, int error)
   static uint8_t udp_recv_buf[8192];
 
   if(events & ASYNCIO_ERROR) {
-    close(af->af_fd);
-    af->af_fd = -1;
+    asyncio_close_fd(af);
     af->af_suspended = 1;
     return 0;
   }
@@ -1568,8 +1748,7 @@ asyncio_do_suspend(void *aux)
     if(af->af_fd == -1)
       continue;
     af->af_suspended = 1;
-    close(af->af_fd);
-    af->af_fd = -1;
+    asyncio_close_fd(af);
   }
 }
 
@@ -1659,6 +1838,23 @@ asyncio_ssl_handshake(asyncio_fd_t *af)
   }
 }
 
+
+/**
+ * Retry a write that SSL put on hold, must be done before
+ * asyncio_ssl_events() is asked what to wait for
+ */
+static void
+asyncio_ssl_kick(asyncio_fd_t *af)
+{
+  if(af->af_ssl != NULL && af->af_connected && af->af_ssl_established &&
+     af->af_ssl_read_status != SSL_ERROR_WANT_WRITE)
+    asyncio_ssl_write(af);
+}
+
+
+/**
+ *
+ */
 static int
 asyncio_ssl_events(asyncio_fd_t *af)
 {
@@ -1671,9 +1867,6 @@ asyncio_ssl_events(asyncio_fd_t *af)
     events |= POLLOUT;
   } else {
     events |= POLLIN;
-    if(af->af_ssl_established) {
-      asyncio_ssl_write(af);
-    }
   }
 
   if(af->af_ssl_write_status == SSL_ERROR_WANT_WRITE) {
@@ -32,6 +32,10 @@
 #include "media/media.h"
 #include "event.h"
 #include "usage.h"
+#include "task.h"
+#if ENABLE_LIBAV
+#include "fileaccess/fa_audio.h"
+#endif
 
 /**
  *
@@ -131,6 +135,11 @@ static prop_t *playqueue_nodes;
 
 static void *player_thread(void *aux);
 
+#if ENABLE_LIBAV
+static void playqueue_track_ending(media_pipe_t *mp);
+static hts_cond_t playqueue_preopen_cond;
+#endif
+
 static media_pipe_t *playqueue_mp;
 
 
@@ -836,6 +845,10 @@ playqueue_init(void)
   hts_mutex_init(&playqueue_mutex);
 
   playqueue_mp = mp_create("playqueue", MP_PRIMABLE);
+#if ENABLE_LIBAV
+  hts_cond_init(&playqueue_preopen_cond, &playqueue_mutex);
+  playqueue_mp->mp_track_ending = playqueue_track_ending;
+#endif
 
   TAILQ_INIT(&playqueue_entries);
   TAILQ_INIT(&playqueue_source_entries);
@@ -1035,6 +1048,239 @@ playqueue_advance(playqueue_entry_t *pqe, int reverse)
 }
 
 
+#if ENABLE_LIBAV
+/**
+ * Next entry being opened ahead of time to shorten the gap between
+ * tracks. The open runs as a task so the player thread can keep
+ * handling events for the current track.
+ *
+ * playqueue_preopen is only accessed from the player thread,
+ * pp_ap, pp_done and pp_abandoned are protected by playqueue_mutex
+ */
+typedef struct playqueue_preopen {
+  playqueue_entry_t *pp_pqe;
+  char *pp_url;
+  media_pipe_t *pp_mp;
+  cancellable_t *pp_cancellable;
+  audio_preopen_t *pp_ap;
+  int pp_done;
+  int pp_abandoned;
+} playqueue_preopen_t;
+
+static playqueue_preopen_t *playqueue_preopen;
+
+
+/**
+ *
+ */
+static void
+playqueue_preopen_destroy(playqueue_preopen_t *pp)
+{
+  if(pp->pp_ap != NULL)
+    fa_audio_preopen_free(pp->pp_ap, pp->pp_mp);
+
+  hts_mutex_lock(&playqueue_mutex);
+  pqe_unref(pp->pp_pqe);
+  hts_mutex_unlock(&playqueue_mutex);
+
+  cancellable_release(pp->pp_cancellable);
+  free(pp->pp_url);
+  free(pp);
+}
+
+
+/**
+ *
+ */
+static void
+playqueue_preopen_task(void *aux)
+{
+  playqueue_preopen_t *pp = aux;
+  char errbuf[256];
+  const int64_t ts = arch_get_ts();
+
+  audio_preopen_t *ap = fa_audio_preopen(pp->pp_url, pp->pp_mp,
+                                         errbuf, sizeof(errbuf),
+                                         pp->pp_cancellable);
+  if(ap != NULL) {
+    TRACE(TRACE_DEBUG, "playqueue", "Pre-opened %s in %d ms",
+          pp->pp_url, (int)((arch_get_ts() - ts) / 1000));
+  } else {
+    TRACE(TRACE_DEBUG, "playqueue", "Unable to pre-open %s -- %s",
+          pp->pp_url, errbuf);
+  }
+
+  hts_mutex_lock(&playqueue_mutex);
+  pp->pp_ap = ap;
+  pp->pp_done = 1;
+  const int abandoned = pp->pp_abandoned;
+  hts_cond_broadcast(&playqueue_preopen_cond);
+  hts_mutex_unlock(&playqueue_mutex);
+
+  if(abandoned)
+    playqueue_preopen_destroy(pp);
+}
+
+
+/**
+ * Drop the pre-opened entry. If it's still being opened the task will
+ * clean up once done
+ */
+static void
+playqueue_preopen_discard(void)
+{
+  playqueue_preopen_t *pp = playqueue_preopen;
+
+  if(pp == NULL)
+    return;
+
+  playqueue_preopen = NULL;
+  cancellable_cancel(pp->pp_cancellable);
+
+  hts_mutex_lock(&playqueue_mutex);
+  const int done = pp->pp_done;
+  pp->pp_abandoned = 1;
+  hts_mutex_unlock(&playqueue_mutex);
+
+  if(done)
+    playqueue_preopen_destroy(pp);
+}
+
+
+/**
+ * Called from be_file_playaudio() on the player thread once the
+ * current track has been demuxed to the end. Start opening, probing
+ * and demuxing the head of the next entry while the tail of the
+ * current one is still playing so it can be fed to the audio decoder
+ * right after
+ */
+static void
+playqueue_track_ending(media_pipe_t *mp)
+{
+  playqueue_entry_t *nxt;
+
+  playqueue_preopen_discard();
+
+  hts_mutex_lock(&playqueue_mutex);
+  nxt = pqe_current != NULL ? playqueue_advance0(pqe_current, 0) : NULL;
+  if(nxt != NULL && nxt->pqe_url != NULL)
+    pqe_ref(nxt);
+  else
+    nxt = NULL;
+  hts_mutex_unlock(&playqueue_mutex);
+
+  if(nxt == NULL)
+    return;
+
+  backend_t *be = backend_resolve(nxt->pqe_url);
+  const int is_file = be != NULL && be->be_play_audio == be_file_playaudio;
+  backend_release(be);
+
+  if(!is_file) {
+    hts_mutex_lock(&playqueue_mutex);
+    pqe_unref(nxt);
+    hts_mutex_unlock(&playqueue_mutex);
+    return;
+  }
+
+  playqueue_preopen_t *pp = calloc(1, sizeof(playqueue_preopen_t));
+  pp->pp_pqe = nxt;
+  pp->pp_url = strdup(nxt->pqe_url);
+  pp->pp_mp = mp;
+  pp->pp_cancellable = cancellable_create();
+  playqueue_preopen = pp;
+  task_run(playqueue_preopen_task, pp);
+}
+
+
+/**
+ * If 'pqe' is the entry being pre-opened, wait for it to finish and
+ * take ownership of the result.
+ *
+ * While waiting we keep an eye on the media pipe. If the user skips,
+ * jumps or stops the pre-open is abandoned and the event is returned
+ * in '*ep' so the player thread can act on it
+ */
+static audio_preopen_t *
+playqueue_preopen_get(playqueue_entry_t *pqe, media_pipe_t *mp,
+                      event_t **ep)
+{
+  playqueue_preopen_t *pp = playqueue_preopen;
+  audio_preopen_t *ap;
+  event_t *e;
+
+  if(pp == NULL || pp->pp_pqe != pqe) {
+    playqueue_preopen_discard();
+    return NULL;
+  }
+
+  hts_mutex_lock(&playqueue_mutex);
+  while(!pp->pp_done) {
+    hts_cond_wait_timeout(&playqueue_preopen_cond, &playqueue_mutex, 100);
+    if(pp->pp_done)
+      break;
+
+    hts_mutex_unlock(&playqueue_mutex);
+
+    while((e = mp_dequeue_event_deadline(mp, 0)) != NULL) {
+      if(event_is_type(e, EVENT_PLAYQUEUE_JUMP) ||
+         event_is_type(e, EVENT_PLAYQUEUE_JUMP_AND_PAUSE) ||
+         event_is_action(e, ACTION_SKIP_BACKWARD) ||
+         event_is_action(e, ACTION_SKIP_FORWARD) ||
+         event_is_action(e, ACTION_STOP) ||
+         event_is_action(e, ACTION_EJECT)) {
+        playqueue_preopen_discard();
+        *ep = e;
+        return NULL;
+      }
+      event_release(e);
+    }
+
+    hts_mutex_lock(&playqueue_mutex);
+  }
+  playqueue_preopen = NULL;
+  ap = pp->pp_ap;
+  pp->pp_ap = NULL;
+  hts_mutex_unlock(&playqueue_mutex);
+
+  playqueue_preopen_destroy(pp);
+  return ap;
+}
+#endif
+
+
+/**
+ *
+ */
+static event_t *
+player_play_entry(playqueue_entry_t *pqe, media_pipe_t *mp,
+                  char *errbuf, size_t errlen, int startpaused)
+{
+  // Inter-track gap is only measured when we end up in audio_play()
+  const int64_t drained = mp->mp_track_drained;
+  mp->mp_track_drained = 0;
+
+#if ENABLE_LIBAV
+  event_t *e = NULL;
+  audio_preopen_t *ap = playqueue_preopen_get(pqe, mp, &e);
+  if(e != NULL)
+    return e;
+
+  if(ap != NULL) {
+    mp->mp_track_drained = drained;
+    return fa_audio_play_preopened(ap, pqe->pqe_url, mp, startpaused);
+  }
+
+  backend_t *be = backend_resolve(pqe->pqe_url);
+  if(be != NULL && be->be_play_audio == be_file_playaudio)
+    mp->mp_track_drained = drained;
+  backend_release(be);
+#endif
+  return backend_play_audio(pqe->pqe_url, mp, errbuf, errlen,
+                            startpaused, NULL);
+}
+
+
 /**
  * Thread for actual playback
  */
@@ -1052,6 +1298,10 @@ player_thread(void *aux)
     
     while(pqe == NULL) {
       /* Got nothing to play, enter STOP mode */
+#if ENABLE_LIBAV
+      playqueue_preopen_discard();
+#endif
+      mp->mp_track_drained = 0;
 
       hts_mutex_lock(&playqueue_mutex);
       pqe_current = NULL;
@@ -1142,8 +1392,7 @@ player_thread(void *aux)
     else
       mp_unhold(mp, MP_HOLD_PAUSE);
 
-    e = backend_play_audio(pqe->pqe_url, mp, errbuf, sizeof(errbuf),
-			   startpaused, NULL);
+    e = player_play_entry(pqe, mp, errbuf, sizeof(errbuf), startpaused);
     prop_ref_dec(sm);
     startpaused = 0;
 
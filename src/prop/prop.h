@@ -423,6 +423,13 @@ void prop_request_delete(prop_t *p);
 void prop_request_delete_multi(prop_vec_t *pv);
 
 #define PROP_COURIER_TRACE_TIMES 0x1
+#define PROP_COURIER_COALESCE    0x2 // Merge pending notifications per sub
+
+typedef struct prop_courier_stats {
+  unsigned int enqueued;       // Notifications offered to the courier
+  unsigned int merged_values;  // Value updates replaced by a later one
+  unsigned int merged_childs;  // Child additions folded into a vector
+} prop_courier_stats_t;
 
 prop_courier_t *prop_courier_create_thread(hts_mutex_t *entrymutex,
 					   const char *name,
@@ -430,6 +437,12 @@ prop_courier_t *prop_courier_create_thread(hts_mutex_t *entrymutex,
 
 prop_courier_t *prop_courier_create_passive(void);
 
+void prop_courier_set_flags(prop_courier_t *pc, int flags);
+
+void prop_courier_clr_flags(prop_courier_t *pc, int flags);
+
+void prop_courier_get_stats(prop_courier_t *pc, prop_courier_stats_t *pcs);
+
 prop_courier_t *prop_courier_create_notify(void (*notify)(void *opaque),
 					   void *opaque);
 
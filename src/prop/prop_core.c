@@ -72,6 +72,9 @@ static void prop_flood_flag(prop_t *p, int set, int clr);
 
 static void prop_destroy_childs0(prop_t *p);
 
+static void prop_set_rstring_exl(prop_t *p, prop_sub_t *skipme, rstr_t *rstr,
+                                 prop_str_type_t type);
+
 #define PROPTRACE(fmt, ...) \
   tracelog(TRACE_NO_PROP, TRACE_DEBUG, "prop", fmt, ##__VA_ARGS__)
 
@@ -119,7 +122,23 @@ propname(prop_t *p)
 rstr_t *
 prop_get_name0(prop_t *p)
 {
-  return p->hp_name ? rstr_alloc(p->hp_name) : NULL;
+  if(p->hp_name == NULL)
+    return NULL;
+  if(p->hp_flags & PROP_NAME_NOT_ALLOCATED)
+    return rstr_alloc(p->hp_name);
+  return rstr_dup(rstr_from_data(p->hp_name));
+}
+
+
+/**
+ * Non-constant names are interned rstrs, hp_name points to the
+ * string payload
+ */
+static void
+prop_name_release(prop_t *p)
+{
+  if(p->hp_name != NULL && !(p->hp_flags & PROP_NAME_NOT_ALLOCATED))
+    rstr_release(rstr_from_data(p->hp_name));
 }
 
 
@@ -256,17 +275,14 @@ prop_ref_dec_traced(prop_t *p, const char *file, int line)
     printf("Prop %p was finalized by %s:%d\n", p, file, line);
   assert(p->hp_type == PROP_ZOMBIE);
 
-  if(!(p->hp_flags & PROP_NAME_NOT_ALLOCATED))
-    free((void *)p->hp_name);
+  prop_name_release(p);
 
   extern void prop_tag_dump(prop_t *p);
   prop_tag_dump(p);
 
-  hts_mutex_lock(&prop_mutex);
   assert(p->hp_tags == NULL);
   memset(p, 0xdd, sizeof(prop_t));
   pool_put(prop_pool, p);
-  hts_mutex_unlock(&prop_mutex);
 }
 
 
@@ -298,8 +314,7 @@ prop_ref_dec_traced_locked(prop_t *p, const char *file, int line)
     printf("Prop %p was finalized by %s:%d\n", p, file, line);
   assert(p->hp_type == PROP_ZOMBIE);
 
-  if(!(p->hp_flags & PROP_NAME_NOT_ALLOCATED))
-    free((void *)p->hp_name);
+  prop_name_release(p);
 
   extern void prop_tag_dump(prop_t *p);
   prop_tag_dump(p);
@@ -374,16 +389,13 @@ prop_ref_dec(prop_t *p)
   assert(p->hp_type == PROP_ZOMBIE);
   assert(p->hp_tags == NULL);
 
-  if(!(p->hp_flags & PROP_NAME_NOT_ALLOCATED))
-    free((void *)p->hp_name);
+  prop_name_release(p);
 
 #ifdef PROP_DEBUG
   assert(p->hp_magic == PROP_MAGIC);
   memset(p, 0xdd, sizeof(prop_t));
 #endif
-  hts_mutex_lock(&prop_mutex);
   pool_put(prop_pool, p);
-  hts_mutex_unlock(&prop_mutex);
 }
 
 
@@ -398,8 +410,7 @@ prop_ref_dec_locked(prop_t *p)
   assert(p->hp_type == PROP_ZOMBIE);
   assert(p->hp_tags == NULL);
 
-  if(!(p->hp_flags & PROP_NAME_NOT_ALLOCATED))
-    free((void *)p->hp_name);
+  prop_name_release(p);
 
 #ifdef PROP_DEBUG
   assert(p->hp_magic == PROP_MAGIC);
@@ -457,11 +468,9 @@ prop_psd_release(prop_sub_dispatch_t *psd)
 /**
  *
  */
-void
-prop_sub_ref_dec_locked(prop_sub_t *s)
+static void
+prop_sub_release_locked(prop_sub_t *s)
 {
-  if(atomic_dec(&s->hps_refcount))
-    return;
   s->hps_lockmgr(s->hps_lock, LOCKMGR_RELEASE);
 
   if(s->hps_dispatch_mode == PROP_SUB_DISPATCH_MODE_GROUP) {
@@ -472,6 +481,33 @@ prop_sub_ref_dec_locked(prop_sub_t *s)
 }
 
 
+/**
+ *
+ */
+void
+prop_sub_ref_dec_locked(prop_sub_t *s)
+{
+  if(atomic_dec(&s->hps_refcount))
+    return;
+  prop_sub_release_locked(s);
+}
+
+
+/**
+ * Same as prop_sub_ref_dec_locked() but only grabs prop_mutex
+ * when the last reference goes away
+ */
+static void
+prop_sub_ref_dec(prop_sub_t *s)
+{
+  if(atomic_dec(&s->hps_refcount))
+    return;
+  hts_mutex_lock(&prop_mutex);
+  prop_sub_release_locked(s);
+  hts_mutex_unlock(&prop_mutex);
+}
+
+
 /**
  *
  */
@@ -979,15 +1015,15 @@ prop_notify_dispatch(struct prop_notify_queue *q, const char *trace_name)
       prop_dispatch_one(n, LOCKMGR_LOCK);
   }
 
-  hts_mutex_lock(&prop_mutex);
+  // notify_pool is thread safe so there is no need to hold
+  // prop_mutex here unless we drop the last ref on a subscription
 
   for(n = TAILQ_FIRST(q); n != NULL; n = next) {
     next = TAILQ_NEXT(n, hpn_link);
 
-    prop_sub_ref_dec_locked(n->hpn_sub);
+    prop_sub_ref_dec(n->hpn_sub);
     pool_put(notify_pool, n);
   }
-  hts_mutex_unlock(&prop_mutex);
 }
 
 
@@ -1188,6 +1224,96 @@ courier_notify(prop_courier_t *pc)
 }
 
 
+/**
+ * Value updates that can replace each other in the queue.
+ * PROP_SET_DIR is left alone as it changes how subsequent child
+ * events are interpreted
+ */
+static int
+notify_is_value(prop_event_t e)
+{
+  switch(e) {
+  case PROP_SET_VOID:
+  case PROP_SET_RSTRING:
+  case PROP_SET_CSTRING:
+  case PROP_SET_INT:
+  case PROP_SET_FLOAT:
+  case PROP_SET_URI:
+  case PROP_SET_PROP:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+/**
+ * Try to merge 'n' into the notification at the tail of the queue
+ *
+ * Consecutive value updates for the same subscription collapse into the
+ * last one and consecutive child additions are turned into a single
+ * PROP_ADD_CHILD_VECTOR. Returns 1 if 'n' was consumed (and freed)
+ */
+static int
+courier_coalesce(prop_courier_t *pc, struct prop_notify_queue *q,
+                 prop_notify_t *n)
+{
+  prop_notify_t *l = TAILQ_LAST(q, prop_notify_queue);
+  prop_vec_t *pv;
+  int i;
+
+  if(l == NULL || l->hpn_sub != n->hpn_sub)
+    return 0;
+
+  if(notify_is_value(l->hpn_event) && notify_is_value(n->hpn_event)) {
+    prop_notify_free_payload(l);
+    l->hpn_event      = n->hpn_event;
+    l->u              = n->u;
+    l->hpn_prop_extra = n->hpn_prop_extra;
+    l->hpn_flags      = n->hpn_flags;
+    pc->pc_stats.merged_values++;
+
+  } else if(l->hpn_event == PROP_ADD_CHILD && l->hpn_flags == 0 &&
+            n->hpn_event == PROP_ADD_CHILD && n->hpn_flags == 0) {
+
+    pv = prop_vec_create(16);
+    pv = prop_vec_append(pv, l->hpn_prop);
+    pv = prop_vec_append(pv, n->hpn_prop);
+    prop_ref_dec_locked(l->hpn_prop);
+    prop_ref_dec_locked(n->hpn_prop);
+    l->hpn_event = PROP_ADD_CHILD_VECTOR;
+    l->hpn_propv = pv;
+    pc->pc_stats.merged_childs++;
+
+  } else if(l->hpn_event == PROP_ADD_CHILD_VECTOR &&
+            atomic_get(&l->hpn_propv->pv_refcount) == 1 &&
+            ((n->hpn_event == PROP_ADD_CHILD && n->hpn_flags == 0) ||
+             n->hpn_event == PROP_ADD_CHILD_VECTOR)) {
+
+    // We are the only holder of the vector so it can be extended in place
+
+    pv = l->hpn_propv;
+    if(n->hpn_event == PROP_ADD_CHILD) {
+      pv = prop_vec_append(pv, n->hpn_prop);
+      prop_ref_dec_locked(n->hpn_prop);
+    } else {
+      for(i = 0; i < n->hpn_propv->pv_length; i++)
+        pv = prop_vec_append(pv, n->hpn_propv->pv_vec[i]);
+      prop_vec_release(n->hpn_propv);
+    }
+    l->hpn_propv = pv;
+    pc->pc_stats.merged_childs++;
+
+  } else {
+    return 0;
+  }
+
+  prop_sub_ref_dec_locked(n->hpn_sub);
+  pool_put(notify_pool, n);
+  return 1;
+}
+
+
 /**
  *
  */
@@ -1196,16 +1322,18 @@ courier_enqueue0(prop_sub_t *s, prop_notify_t *n, int expedite)
 {
   prop_courier_t *pc;
   prop_sub_dispatch_t *psd;
+  struct prop_notify_queue *q;
 
   switch(s->hps_dispatch_mode) {
   case PROP_SUB_DISPATCH_MODE_COURIER:
     pc = s->hps_dispatch;
+    q = expedite ? &pc->pc_queue_exp : &pc->pc_queue_nor;
+    pc->pc_stats.enqueued++;
 
-    if(expedite)
-      TAILQ_INSERT_TAIL(&pc->pc_queue_exp, n, hpn_link);
-    else
-      TAILQ_INSERT_TAIL(&pc->pc_queue_nor, n, hpn_link);
+    if(pc->pc_flags & PROP_COURIER_COALESCE && courier_coalesce(pc, q, n))
+      break; // Already pending, no need to wakeup courier
 
+    TAILQ_INSERT_TAIL(q, n, hpn_link);
     courier_notify(pc);
     break;
 
@@ -1866,6 +1994,231 @@ prop_clean(prop_t *p)
 }
 
 
+/**
+ * Name index for wide directories
+ *
+ * Finding a child by name is a linear walk over hp_childs. When such a
+ * walk passes PROP_CHILD_INDEX_THRESHOLD childs the directory is flagged
+ * with PROP_CHILD_INDEXED and all its named childs are entered into a
+ * global open addressing hash keyed on (parent, name). hp_childs is
+ * still the one and only ordering, the index is only used for lookups.
+ *
+ * A directory with duplicate child names is never indexed since a
+ * lookup must return the first matching child in order.
+ *
+ * Protected by prop_mutex
+ */
+#define PROP_CHILD_INDEX_THRESHOLD 32
+
+#define PROP_CHILD_INDEX_TOMBSTONE ((prop_t *)1)
+
+static prop_t **prop_child_index;
+static unsigned int prop_child_index_size;  // Power of 2
+static unsigned int prop_child_index_used;  // Live entries
+static unsigned int prop_child_index_fill;  // Live entries + tombstones
+
+
+/**
+ *
+ */
+static unsigned int
+prop_child_index_hash(const prop_t *parent, const char *name)
+{
+  return mystrhash(name) ^ ((uintptr_t)parent >> 4) * 2654435761U;
+}
+
+
+/**
+ *
+ */
+static prop_t *
+prop_child_index_find(prop_t *parent, const char *name)
+{
+  if(prop_child_index_size == 0)
+    return NULL;
+
+  const unsigned int mask = prop_child_index_size - 1;
+  unsigned int i = prop_child_index_hash(parent, name) & mask;
+  prop_t *c;
+
+  while((c = prop_child_index[i]) != NULL) {
+    if(c != PROP_CHILD_INDEX_TOMBSTONE && c->hp_parent == parent &&
+       !strcmp(c->hp_name, name))
+      return c;
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+
+/**
+ *
+ */
+static void
+prop_child_index_resize(unsigned int size)
+{
+  prop_t **old = prop_child_index;
+  const unsigned int oldsize = prop_child_index_size;
+  unsigned int i;
+
+  prop_child_index = calloc(size, sizeof(prop_t *));
+  prop_child_index_size = size;
+  prop_child_index_fill = prop_child_index_used;
+
+  for(i = 0; i < oldsize; i++) {
+    prop_t *c = old[i];
+    if(c == NULL || c == PROP_CHILD_INDEX_TOMBSTONE)
+      continue;
+    unsigned int j = prop_child_index_hash(c->hp_parent, c->hp_name);
+    while(prop_child_index[j & (size - 1)] != NULL)
+      j++;
+    prop_child_index[j & (size - 1)] = c;
+  }
+  free(old);
+}
+
+
+/**
+ * Returns -1 if the parent already have a child with the same name
+ */
+static int
+prop_child_index_insert(prop_t *c)
+{
+  if((prop_child_index_fill + 1) * 4 > prop_child_index_size * 3) {
+    unsigned int size = 256;
+    while(size < (prop_child_index_used + 1) * 4)
+      size *= 2;
+    prop_child_index_resize(size);
+  }
+
+  const unsigned int mask = prop_child_index_size - 1;
+  unsigned int i = prop_child_index_hash(c->hp_parent, c->hp_name) & mask;
+  int slot = -1;
+  prop_t *e;
+
+  while((e = prop_child_index[i]) != NULL) {
+    if(e == PROP_CHILD_INDEX_TOMBSTONE) {
+      if(slot == -1)
+        slot = i;
+    } else if(e->hp_parent == c->hp_parent && !strcmp(e->hp_name, c->hp_name)) {
+      return -1;
+    }
+    i = (i + 1) & mask;
+  }
+
+  if(slot == -1) {
+    slot = i;
+    prop_child_index_fill++;
+  }
+  prop_child_index[slot] = c;
+  prop_child_index_used++;
+  return 0;
+}
+
+
+/**
+ *
+ */
+static void
+prop_child_index_remove(prop_t *c)
+{
+  if(c->hp_name == NULL || prop_child_index_size == 0)
+    return;
+
+  const unsigned int mask = prop_child_index_size - 1;
+  unsigned int i = prop_child_index_hash(c->hp_parent, c->hp_name) & mask;
+  prop_t *e;
+
+  while((e = prop_child_index[i]) != NULL) {
+    if(e == c) {
+      prop_child_index[i] = PROP_CHILD_INDEX_TOMBSTONE;
+      prop_child_index_used--;
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+
+  if(prop_child_index_used == 0) {
+    free(prop_child_index);
+    prop_child_index = NULL;
+    prop_child_index_size = 0;
+    prop_child_index_fill = 0;
+  }
+}
+
+
+/**
+ *
+ */
+static void
+prop_child_index_drop(prop_t *parent)
+{
+  prop_t *c;
+
+  if(!(parent->hp_flags & PROP_CHILD_INDEXED))
+    return;
+
+  parent->hp_flags &= ~PROP_CHILD_INDEXED;
+  TAILQ_FOREACH(c, &parent->hp_childs, hp_parent_link)
+    prop_child_index_remove(c);
+}
+
+
+/**
+ *
+ */
+static void
+prop_child_index_build(prop_t *parent)
+{
+  prop_t *c;
+
+  parent->hp_flags |= PROP_CHILD_INDEXED;
+
+  TAILQ_FOREACH(c, &parent->hp_childs, hp_parent_link) {
+    if(c->hp_name != NULL && prop_child_index_insert(c)) {
+      prop_child_index_drop(parent);
+      return;
+    }
+  }
+}
+
+
+/**
+ * Must be called after a child has been linked into an indexed parent
+ */
+static void
+prop_child_index_add(prop_t *parent, prop_t *c)
+{
+  // On duplicate name, fall back to linear search for this directory
+  if(c->hp_name != NULL && prop_child_index_insert(c))
+    prop_child_index_drop(parent);
+}
+
+
+/**
+ * Find first child of 'parent' with the given name
+ */
+prop_t *
+prop_find_child0(prop_t *parent, const char *name)
+{
+  prop_t *c;
+  int n = 0;
+
+  if(parent->hp_flags & PROP_CHILD_INDEXED)
+    return prop_child_index_find(parent, name);
+
+  TAILQ_FOREACH(c, &parent->hp_childs, hp_parent_link) {
+    if(c->hp_name != NULL && !strcmp(c->hp_name, name))
+      break;
+    n++;
+  }
+
+  if(n > PROP_CHILD_INDEX_THRESHOLD)
+    prop_child_index_build(parent);
+  return c;
+}
+
+
 /**
  *
  */
@@ -1895,11 +2248,17 @@ prop_insert(prop_t *p, prop_t *parent, prop_t *before, prop_sub_t *skipme)
   if(before != NULL) {
     assert(before->hp_parent == parent);
     TAILQ_INSERT_BEFORE(before, p, hp_parent_link);
-    prop_notify_child2(p, parent, before, PROP_ADD_CHILD_BEFORE, skipme, 0);
   } else {
     TAILQ_INSERT_TAIL(&parent->hp_childs, p, hp_parent_link);
-    prop_notify_child(p, parent, PROP_ADD_CHILD, skipme, 0);
   }
+
+  if(parent->hp_flags & PROP_CHILD_INDEXED)
+    prop_child_index_add(parent, p);
+
+  if(before != NULL)
+    prop_notify_child2(p, parent, before, PROP_ADD_CHILD_BEFORE, skipme, 0);
+  else
+    prop_notify_child(p, parent, PROP_ADD_CHILD, skipme, 0);
 }
 
 
@@ -1922,7 +2281,7 @@ prop_make(const char *name, int noalloc, prop_t *parent)
   if(noalloc)
     hp->hp_name = name;
   else
-    hp->hp_name = name ? strdup(name) : NULL;
+    hp->hp_name = name ? rstr_get(rstr_intern(name)) : NULL;
 
   hp->hp_tags = NULL;
   LIST_INIT(&hp->hp_targets);
@@ -1949,19 +2308,18 @@ prop_create0(prop_t *parent, const char *name, prop_sub_t *skipme, int noalloc)
   prop_make_dir(parent, skipme, "prop_create()");
 
   if(name != NULL) {
-    TAILQ_FOREACH(hp, &parent->hp_childs, hp_parent_link) {
-      if(hp->hp_name != NULL && !strcmp(hp->hp_name, name)) {
-
-	if(!(hp->hp_flags & PROP_NAME_NOT_ALLOCATED) && noalloc) {
-	  // Trick: We have a pointer to a compile time constant string
-	  // and the current prop does not have that, we could switch to
-	  // it and thus save some memory allocation
-	  free((void *)hp->hp_name);
-	  hp->hp_name = name;
-	  hp->hp_flags |= PROP_NAME_NOT_ALLOCATED;
-	}
-	return hp;
+    hp = prop_find_child0(parent, name);
+    if(hp != NULL) {
+
+      if(!(hp->hp_flags & PROP_NAME_NOT_ALLOCATED) && noalloc) {
+        // Trick: We have a pointer to a compile time constant string
+        // and the current prop does not have that, we could switch to
+        // it and thus save some memory allocation
+        prop_name_release(hp);
+        hp->hp_name = name;
+        hp->hp_flags |= PROP_NAME_NOT_ALLOCATED;
       }
+      return hp;
     }
   }
 
@@ -2054,9 +2412,7 @@ prop_create_after(prop_t *parent, const char *name, prop_t *after,
 
     prop_make_dir(parent, skipme, "prop_create_after()");
 
-    TAILQ_FOREACH(p, &parent->hp_childs, hp_parent_link)
-      if(p->hp_name != NULL && !strcmp(p->hp_name, name))
-	break;
+    p = prop_find_child0(parent, name);
 
     if(p == NULL) {
 
@@ -2068,6 +2424,9 @@ prop_create_after(prop_t *parent, const char *name, prop_t *after,
 	TAILQ_INSERT_AFTER(&parent->hp_childs, after, p, hp_parent_link);
       }
 
+      if(parent->hp_flags & PROP_CHILD_INDEXED)
+        prop_child_index_add(parent, p);
+
       prop_t *next = TAILQ_NEXT(p, hp_parent_link);
       if(next == NULL) {
 	prop_notify_child2(p, parent, next, PROP_ADD_CHILD_BEFORE, skipme, 0);
@@ -2181,6 +2540,9 @@ prop_set_parent_vector(prop_vec_t *pv, prop_t *parent, prop_t *before,
       } else {
 	TAILQ_INSERT_TAIL(&parent->hp_childs, p, hp_parent_link);
       }
+
+      if(parent->hp_flags & PROP_CHILD_INDEXED)
+        prop_child_index_add(parent, p);
     }
     prop_notify_childv(pv, parent, before ? PROP_ADD_CHILD_VECTOR_BEFORE : 
 		       PROP_ADD_CHILD_VECTOR, skipme, before);
@@ -2202,7 +2564,10 @@ prop_unparent0(prop_t *p, prop_sub_t *skipme)
   assert((p->hp_flags & PROP_MULTI_NOTIFY) == 0); // fixme
 
   prop_notify_child(p, parent, PROP_DEL_CHILD, NULL, 0);
-  
+
+  if(parent->hp_flags & PROP_CHILD_INDEXED)
+    prop_child_index_remove(p);
+
   TAILQ_REMOVE(&parent->hp_childs, p, hp_parent_link);
   p->hp_parent = NULL;
   
@@ -2247,6 +2612,8 @@ prop_destroy_child(prop_t *p, prop_t *c)
 {
   if(!prop_destroy0(c)) {
     prop_notify_child(c, p, PROP_DEL_CHILD, NULL, 0);
+    if(p->hp_flags & PROP_CHILD_INDEXED)
+      prop_child_index_remove(c);
     TAILQ_REMOVE(&p->hp_childs, c, hp_parent_link);
     c->hp_parent = NULL;
   }
@@ -2311,6 +2678,7 @@ prop_destroy0(prop_t *p)
     abort();
 
   case PROP_DIR:
+    prop_child_index_drop(p);
     for(c = TAILQ_FIRST(&p->hp_childs); c != NULL; c = next) {
       next = TAILQ_NEXT(c, hp_parent_link);
       prop_destroy_child(p, c);
@@ -2385,6 +2753,9 @@ prop_destroy0(prop_t *p)
       if(!(s->hps_flags & PROP_SUB_EARLY_DEL_CHILD))
         prop_build_notify_child(s, p, PROP_DEL_CHILD, 0, 0);
 
+    if(parent->hp_flags & PROP_CHILD_INDEXED)
+      prop_child_index_remove(p);
+
     TAILQ_REMOVE(&parent->hp_childs, p, hp_parent_link);
     p->hp_parent = NULL;
 
@@ -2423,6 +2794,7 @@ prop_destroy_childs0(prop_t *p)
   prop_sub_t *s;
 
   struct prop_queue childs;
+  prop_child_index_drop(p);
   TAILQ_MOVE(&childs, &p->hp_childs, hp_parent_link);
   TAILQ_INIT(&p->hp_childs);
 
@@ -2510,12 +2882,9 @@ prop_destroy_by_name(prop_t *p, const char *name)
 	  prop_destroy_child(p, c);
       }
     } else {
-      TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link) {
-	if(c->hp_name != NULL && !strcmp(c->hp_name, name)) {
-	  prop_destroy_child(p, c);
-	  break;
-	}
-      }
+      c = prop_find_child0(p, name);
+      if(c != NULL)
+        prop_destroy_child(p, c);
     }
   }
   hts_mutex_unlock(&prop_mutex);
@@ -2721,11 +3090,7 @@ prop_subfind(prop_t *p, const char **name, int follow_symlinks,
 	return NULL;
       }
     } else {
-
-      TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link) {
-	if(c->hp_name != NULL && !strcmp(c->hp_name, name[0]))
-	  break;
-      }
+      c = prop_find_child0(p, name[0]);
     }
     p = c ?: prop_create0(p, name[0], NULL, 0);    
     name++;
@@ -3512,8 +3877,11 @@ prop_init(void)
   TAILQ_INIT(&prop_global_dispatch_dispatching_queue);
 
 
-  prop_pool   = pool_create("prop", sizeof(prop_t), 0);
-  notify_pool = pool_create("notify", sizeof(prop_notify_t), 0);
+  // These two are thread safe on their own so props and notifications
+  // can be returned without holding prop_mutex
+  prop_pool   = pool_create("prop", sizeof(prop_t), POOL_THREAD_SAFE);
+  notify_pool = pool_create("notify", sizeof(prop_notify_t),
+                            POOL_THREAD_SAFE);
   sub_pool    = pool_create("subs", sizeof(prop_sub_t), 0);
   pot_pool    = pool_create("pots", sizeof(prop_originator_tracking_t), 0);
   psd_pool    = pool_create("psds", sizeof(prop_sub_dispatch_t), 0);
@@ -3591,9 +3959,12 @@ prop_set_string_ex(prop_t *p, prop_sub_t *skipme, const char *str,
     return;
   }
 
+  // Do the allocation and copy before grabbing the global lock
+  rstr_t *rstr = rstr_alloc(str);
   hts_mutex_lock(&prop_mutex);
-  prop_set_string_exl(p, skipme, str, type);
+  prop_set_rstring_exl(p, skipme, rstr, type);
   hts_mutex_unlock(&prop_mutex);
+  rstr_release(rstr);
 }
 
 
@@ -4998,10 +5369,7 @@ prop_select_by_value_ex(prop_t *p, const char *name, prop_sub_t *skipme)
   hts_mutex_lock(&prop_mutex);
 
   if(p->hp_type == PROP_DIR) {
-    prop_t *c;
-    TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link)
-      if(c->hp_name != NULL && !strcmp(c->hp_name, name))
-        break;
+    prop_t *c = prop_find_child0(p, name);
 
     prop_notify_child2(c, p, NULL, PROP_SELECT_CHILD, skipme, 0);
     p->hp_selected = c;
@@ -5063,9 +5431,7 @@ prop_findv(prop_t *p, char **names)
       break;
     }
 
-    TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link)
-      if(c->hp_name != NULL && !strcmp(c->hp_name, n))
-	break;
+    c = prop_find_child0(p, n);
     if(c == NULL)
       break;
 
@@ -5095,9 +5461,7 @@ prop_find0(prop_t *p, va_list ap)
       break;
     }
 
-    TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link)
-      if(c->hp_name != NULL && !strcmp(c->hp_name, n))
-	break;
+    c = prop_find_child0(p, n);
     if(c == NULL)
 	return NULL;
     p = c;
@@ -5243,6 +5607,42 @@ prop_courier_create_passive(void)
 }
 
 
+/**
+ *
+ */
+void
+prop_courier_set_flags(prop_courier_t *pc, int flags)
+{
+  hts_mutex_lock(&prop_mutex);
+  pc->pc_flags |= flags;
+  hts_mutex_unlock(&prop_mutex);
+}
+
+
+/**
+ *
+ */
+void
+prop_courier_clr_flags(prop_courier_t *pc, int flags)
+{
+  hts_mutex_lock(&prop_mutex);
+  pc->pc_flags &= ~flags;
+  hts_mutex_unlock(&prop_mutex);
+}
+
+
+/**
+ *
+ */
+void
+prop_courier_get_stats(prop_courier_t *pc, prop_courier_stats_t *pcs)
+{
+  hts_mutex_lock(&prop_mutex);
+  *pcs = pc->pc_stats;
+  hts_mutex_unlock(&prop_mutex);
+}
+
+
 /**
  *
  */
@@ -5605,9 +6005,7 @@ prop_setv_ex(prop_sub_t *skipme, prop_t *p, ...)
     if(p->hp_type == PROP_ZOMBIE)
       goto bad;
     if(p->hp_type == PROP_DIR) {
-      TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link)
-	if(c->hp_name != NULL && !strcmp(c->hp_name, n))
-	  break;
+      c = prop_find_child0(p, n);
     } else 
       c = NULL;
     if(c == NULL)
@@ -5657,9 +6055,7 @@ prop_setdn(prop_sub_t *skipme, prop_t *p, const char *str, ...)
 
 
     if(p->hp_type == PROP_DIR) {
-      TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link)
-	if(c->hp_name != NULL && !strcmp(c->hp_name, str))
-	  break;
+      c = prop_find_child0(p, str);
     } else 
       c = NULL;
     if(c == NULL)
@@ -6056,6 +6452,7 @@ prop_report_stats(callout_t *c, void *aux)
 #endif
 
 extern void prop_test(void);
+extern void prop_test_bench(int max_writers);
 
 void
 prop_init_late(void)
@@ -6068,6 +6465,11 @@ prop_init_late(void)
   prop_test();
   exit(0);
 #endif
+
+  if(gconf.bench != NULL && !strcmp(gconf.bench, "prop")) {
+    prop_test_bench(8);
+    exit(0);
+  }
 }
 
 
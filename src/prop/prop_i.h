@@ -72,6 +72,8 @@ struct prop_courier {
 
   int pc_refcount;
   char *pc_name;
+
+  prop_courier_stats_t pc_stats;
 };
 
 
@@ -162,7 +164,8 @@ struct prop {
   atomic_t hp_refcount;
 
   /**
-   * Property name. Protected by mutex
+   * Property name. Protected by mutex. Unless PROP_NAME_NOT_ALLOCATED
+   * is set this is the payload of an interned rstr_t
    */
   const char *hp_name;
 
@@ -247,8 +250,8 @@ struct prop {
 #define PROP_CLIPPED_VALUE         0x1
 
   /**
-   * hp_name is not malloc()ed but rather points to a compile const string
-   * that should not be free()d upon prop finalization
+   * hp_name is not an interned rstr but rather points to a compile
+   * const string that should not be released upon prop finalization
    */
 #define PROP_NAME_NOT_ALLOCATED    0x2
 
@@ -313,6 +316,12 @@ struct prop {
 #define PROP_HAVE_MORE               0x1000
 #define PROP_HAVE_MORE_YES           0x2000
 
+  /**
+   * The named childs of this directory are entered in the child name
+   * index. See prop_find_child0()
+   */
+#define PROP_CHILD_INDEXED           0x4000
+
   /**
    * Tags. Protected by prop_tag_mutex
    */
@@ -559,6 +568,8 @@ prop_t *prop_create0(prop_t *parent, const char *name, prop_sub_t *skipme,
 
 prop_t *prop_make(const char *name, int noalloc, prop_t *parent);
 
+prop_t *prop_find_child0(prop_t *parent, const char *name);
+
 void prop_make_dir(prop_t *p, prop_sub_t *skipme, const char *origin);
 
 void prop_move0(prop_t *p, prop_t *before, prop_sub_t *skipme);
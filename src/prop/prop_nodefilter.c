@@ -114,7 +114,7 @@ typedef struct prop_nf_pred {
 
   char pnp_enabled;
 
-  char *pnp_str;
+  rstr_t *pnp_str;  // Interned
   int pnp_int;
 
   struct prop_nf *pnp_nf;
@@ -411,7 +411,8 @@ nf_update_egress(prop_nf_t *nf, nfnode_t *nfn)
 
   if(en) {
     assert(nfn->out == NULL);
-    nfn->out = prop_make(nfn->in->hp_name, 1, NULL);
+    nfn->out = prop_make(nfn->in->hp_name,
+                         nfn->in->hp_flags & PROP_NAME_NOT_ALLOCATED, NULL);
     prop_link0(nfn->in, nfn->out, NULL, 0, 0);
 
     b = nfn;
@@ -475,19 +476,23 @@ nf_update_multisub(prop_nf_t *nf, nfnode_t *nfn)
  *
  */
 static void
-nfnp_update_str(void *opaque, const char *str)
+nfnp_update_str(void *opaque, rstr_t *str)
 {
   nfn_pred_t *nfnp = opaque;
   prop_nf_pred_t *pnp = nfnp->nfnp_conf;
   nfnode_t *nfn = nfnp->nfnp_nfn;
   int s = 0;
 
+  // Interned values (metadata formats, genres, etc) match by pointer
+  const int eq = str == pnp->pnp_str ||
+    !strcmp(rstr_get(str) ?: "", rstr_get(pnp->pnp_str));
+
   switch(pnp->pnp_cf) {
   case PROP_NF_CMP_EQ:
-    s = !strcmp(str?:"", pnp->pnp_str);
+    s = eq;
     break;
   case PROP_NF_CMP_NEQ:
-    s = !!strcmp(str?:"", pnp->pnp_str);
+    s = !eq;
     break;
   }
   if(nfnp->nfnp_set == s)
@@ -541,7 +546,7 @@ nfn_insert_pred(prop_nf_t *nf, nfnode_t *nfn, prop_nf_pred_t *pnp)
   if(pnp->pnp_str != NULL) {
     nfnp->nfnp_sub =
       prop_subscribe(PROP_SUB_INTERNAL | PROP_SUB_DONTLOCK,
-		     PROP_TAG_CALLBACK_STRING, nfnp_update_str, nfnp,
+		     PROP_TAG_CALLBACK_RSTR, nfnp_update_str, nfnp,
 		     PROP_TAG_NAMED_ROOT, nfn->in, "node",
 		     PROP_TAG_NAME_VECTOR, pnp->pnp_path,
 		     NULL);
@@ -858,7 +863,7 @@ nf_destroy_pred(struct prop_nf_pred *pnp)
   strvec_free(pnp->pnp_path);
   if(pnp->pnp_enable_sub != NULL)
     prop_unsubscribe0(pnp->pnp_enable_sub);
-  free(pnp->pnp_str);
+  rstr_release(pnp->pnp_str);
   free(pnp);
 }
 
@@ -1279,7 +1284,7 @@ prop_nf_pred_str_add(struct prop_nf *nf,
 		     prop_nf_mode_t mode)
 {
   struct prop_nf_pred *pnp = calloc(1, sizeof(struct prop_nf_pred));
-  pnp->pnp_str = strdup(str);
+  pnp->pnp_str = rstr_intern(str);
   hts_mutex_lock(&prop_mutex);
   int id = prop_nf_pred_add(nf, path, cf, enable, mode, pnp);
   hts_mutex_unlock(&prop_mutex);
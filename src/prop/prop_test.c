@@ -25,11 +25,14 @@
 #include <unistd.h>
 #include <math.h>
 #include <sys/time.h>
+#include <inttypes.h>
 
 #include "arch/atomic.h"
 
 #include "prop.h"
 #include "prop_i.h"
+#include "main.h"
+#include "misc/minmax.h"
 
 #ifdef PROP_DEBUG
 
@@ -318,6 +321,139 @@ prop_test2(void)
 
 
 
+/**
+ * Tests lookups in directories wide enough to get a child name index
+ */
+static void
+prop_test3(void)
+{
+  printf("Running test 3\n");
+  char name[32];
+  int i;
+
+#define NUM_CHILDS 1000
+
+  prop_t *r = prop_create_root(NULL);
+  prop_t *c[NUM_CHILDS];
+
+  for(i = 0; i < NUM_CHILDS; i++) {
+    snprintf(name, sizeof(name), "child%d", i);
+    c[i] = prop_create(r, name);
+  }
+
+  for(i = NUM_CHILDS - 1; i >= 0; i--) {
+    snprintf(name, sizeof(name), "child%d", i);
+    assert(prop_create(r, name) == c[i]);
+  }
+
+  // Ordering must be kept
+  prop_t *p;
+  i = 0;
+  hts_mutex_lock(&prop_mutex);
+  TAILQ_FOREACH(p, &r->hp_childs, hp_parent_link)
+    assert(p == c[i++]);
+  hts_mutex_unlock(&prop_mutex);
+  assert(i == NUM_CHILDS);
+
+  prop_destroy_by_name(r, "child500");
+  assert(prop_find(r, "child500", NULL) == NULL);
+
+  p = prop_find(r, "child501", NULL);
+  assert(p == c[501]);
+  prop_ref_dec(p);
+
+  // Recreated child goes last
+  p = prop_create(r, "child500");
+  hts_mutex_lock(&prop_mutex);
+  assert(TAILQ_LAST(&r->hp_childs, prop_queue) == p);
+  hts_mutex_unlock(&prop_mutex);
+
+  // Duplicate name must resolve to the first child in order
+  prop_t *dup = prop_create_root("child10");
+  if(prop_set_parent(dup, r))
+    abort();
+  assert(prop_create(r, "child10") == c[10]);
+
+  prop_destroy(r);
+}
+
+
+/**
+ * Interned names
+ */
+static void
+prop_test4(void)
+{
+  printf("Running test 4\n");
+  char name[32];
+
+  prop_t *a = prop_create_root(NULL);
+  prop_t *b = prop_create_root(NULL);
+
+  snprintf(name, sizeof(name), "interned%d", 1);
+  prop_t *x = prop_create(a, name);
+  snprintf(name, sizeof(name), "interned%d", 1);
+  prop_t *y = prop_create(b, name);
+
+  hts_mutex_lock(&prop_mutex);
+  assert(x->hp_name == y->hp_name);
+  hts_mutex_unlock(&prop_mutex);
+
+  rstr_t *n1 = prop_get_name(x);
+  rstr_t *n2 = rstr_intern("interned1");
+  assert(n1 == n2);
+  assert(rstr_eq(n1, n2));
+  rstr_release(n1);
+  rstr_release(n2);
+
+  prop_destroy(a);
+  prop_destroy(b);
+}
+
+
+/**
+ * Courier coalescing
+ */
+static void
+test5_int(void *opaque, int v)
+{
+  int *p = opaque;
+  p[0]++;
+  p[1] = v;
+}
+
+static void
+prop_test5(void)
+{
+  printf("Running test 5\n");
+  prop_courier_t *pc = prop_courier_create_passive();
+  prop_courier_set_flags(pc, PROP_COURIER_COALESCE);
+  prop_t *r = prop_create_root(NULL);
+  int res[2] = {0, 0};
+  int i;
+
+  prop_sub_t *s = prop_subscribe(PROP_SUB_NO_INITIAL_UPDATE,
+                                 PROP_TAG_CALLBACK_INT, test5_int, res,
+                                 PROP_TAG_ROOT, r,
+                                 PROP_TAG_COURIER, pc,
+                                 NULL);
+  for(i = 1; i <= 100; i++)
+    prop_set_int(r, i);
+  prop_courier_poll(pc);
+  assert(res[0] == 1);
+  assert(res[1] == 100);
+
+  prop_courier_stats_t pcs;
+  prop_courier_get_stats(pc, &pcs);
+  assert(pcs.enqueued == 100);
+  assert(pcs.merged_values == 99);
+
+  prop_unsubscribe(s);
+  prop_courier_destroy(pc);
+  prop_destroy(r);
+}
+
+
 /**
  *
  */
@@ -326,5 +462,180 @@ prop_test(void)
 {
   prop_test1();
   prop_test2();
+  prop_test3();
+  prop_test4();
+  prop_test5();
 }
 #endif
+
+
+
+/**
+ * Throughput benchmark for set/notify under contention
+ *
+ * Each writer thread hammers its own subtree with int and string sets
+ * and occasionally adds a child. Every subtree has a subscriber
+ * dispatched by its own courier thread so both the producer and the
+ * dispatch side of prop_mutex are exercised.
+ */
+
+#define PROP_BENCH_ITERATIONS 100000
+
+void prop_test_bench(int max_writers);
+
+typedef struct prop_bench_writer {
+  prop_t *pbw_root;
+  prop_t *pbw_value;
+  prop_t *pbw_title;
+  prop_t *pbw_items;
+  prop_courier_t *pbw_pc;
+  prop_sub_t *pbw_subs[3];
+  atomic_t pbw_notifications;
+  hts_thread_t pbw_tid;
+} prop_bench_writer_t;
+
+
+static void
+prop_bench_notify(void *opaque, prop_event_t event, ...)
+{
+  prop_bench_writer_t *pbw = opaque;
+  atomic_inc(&pbw->pbw_notifications);
+}
+
+
+static void *
+prop_bench_writer(void *aux)
+{
+  prop_bench_writer_t *pbw = aux;
+  char buf[32];
+  int i;
+
+  for(i = 0; i < PROP_BENCH_ITERATIONS; i++) {
+    prop_set_int(pbw->pbw_value, i);
+    snprintf(buf, sizeof(buf), "title%d", i);
+    prop_set_string(pbw->pbw_title, buf);
+    if((i & 63) == 0)
+      prop_create(pbw->pbw_items, NULL);
+  }
+  return NULL;
+}
+
+
+static void
+prop_bench_run(int writers, int courier_flags)
+{
+  prop_bench_writer_t *pbw = calloc(writers, sizeof(prop_bench_writer_t));
+  prop_t *root = prop_create_root(NULL);
+  int i, j, notifications = 0;
+  prop_courier_stats_t pcs;
+  unsigned int enqueued = 0, merged = 0;
+
+  for(i = 0; i < writers; i++) {
+    pbw[i].pbw_root  = prop_create(root, NULL);
+    pbw[i].pbw_value = prop_create(pbw[i].pbw_root, "value");
+    pbw[i].pbw_title = prop_create(pbw[i].pbw_root, "title");
+    pbw[i].pbw_items = prop_create(pbw[i].pbw_root, "items");
+    pbw[i].pbw_pc = prop_courier_create_thread(NULL, "propbench",
+                                               courier_flags);
+
+    prop_t *targets[3] = {pbw[i].pbw_value, pbw[i].pbw_title,
+                          pbw[i].pbw_items};
+    for(j = 0; j < 3; j++)
+      pbw[i].pbw_subs[j] =
+        prop_subscribe(0,
+                       PROP_TAG_CALLBACK, prop_bench_notify, &pbw[i],
+                       PROP_TAG_ROOT, targets[j],
+                       PROP_TAG_COURIER, pbw[i].pbw_pc,
+                       NULL);
+  }
+
+  int64_t ts = arch_get_ts();
+
+  for(i = 0; i < writers; i++)
+    hts_thread_create_joinable("propbench", &pbw[i].pbw_tid,
+                               prop_bench_writer, &pbw[i],
+                               THREAD_PRIO_MODEL);
+
+  for(i = 0; i < writers; i++)
+    hts_thread_join(&pbw[i].pbw_tid);
+
+  ts = arch_get_ts() - ts;
+
+  for(i = 0; i < writers; i++) {
+    for(j = 0; j < 3; j++)
+      prop_unsubscribe(pbw[i].pbw_subs[j]);
+    prop_courier_get_stats(pbw[i].pbw_pc, &pcs);
+    enqueued += pcs.enqueued;
+    merged += pcs.merged_values + pcs.merged_childs;
+    prop_courier_destroy(pbw[i].pbw_pc);
+    notifications += atomic_get(&pbw[i].pbw_notifications);
+  }
+
+  prop_destroy(root);
+  free(pbw);
+
+  int64_t sets = (int64_t)writers * PROP_BENCH_ITERATIONS * 2;
+  printf("%d writer(s)%s: %"PRId64" sets in %d ms, %d sets/s, "
+         "%d notifications delivered (%u enqueued, %u merged)\n",
+         writers, courier_flags & PROP_COURIER_COALESCE ? " coalesced" : "",
+         sets, (int)(ts / 1000),
+         (int)(sets * 1000000 / MAX(ts, 1)), notifications,
+         enqueued, merged);
+}
+
+
+/**
+ * Add a burst of children to a directory the way a backend populating
+ * a page does and count the callbacks it takes to deliver them
+ */
+static void
+prop_bench_child_storm(int courier_flags)
+{
+  prop_bench_writer_t pbw = {};
+  prop_courier_stats_t pcs;
+  prop_t *root = prop_create_root(NULL);
+  prop_courier_t *pc = prop_courier_create_passive();
+  int i;
+
+  prop_courier_set_flags(pc, courier_flags);
+
+  prop_sub_t *s = prop_subscribe(PROP_SUB_NO_INITIAL_UPDATE,
+                                 PROP_TAG_CALLBACK, prop_bench_notify, &pbw,
+                                 PROP_TAG_ROOT, root,
+                                 PROP_TAG_COURIER, pc,
+                                 NULL);
+
+  int64_t ts = arch_get_ts();
+  for(i = 0; i < 5000; i++)
+    prop_set(prop_create(root, NULL), "title", PROP_SET_INT, i);
+  prop_courier_poll(pc);
+  ts = arch_get_ts() - ts;
+
+  prop_courier_get_stats(pc, &pcs);
+  prop_unsubscribe(s);
+  prop_courier_destroy(pc);
+  prop_destroy(root);
+
+  printf("5000 children%s: %d callbacks in %d ms "
+         "(%u enqueued, %u merged)\n",
+         courier_flags & PROP_COURIER_COALESCE ? " coalesced" : "",
+         atomic_get(&pbw.pbw_notifications), (int)(ts / 1000),
+         pcs.enqueued, pcs.merged_values + pcs.merged_childs);
+}
+
+
+/**
+ *
+ */
+void
+prop_test_bench(int max_writers)
+{
+  int writers;
+  for(writers = 1; writers <= max_writers; writers *= 2) {
+    prop_bench_run(writers, 0);
+    prop_bench_run(writers, PROP_COURIER_COALESCE);
+  }
+
+  prop_bench_child_storm(0);
+  prop_bench_child_storm(PROP_COURIER_COALESCE);
+}
@@ -47,7 +47,7 @@ prop_vec_t *prop_vec_append(prop_vec_t *pv, prop_t *p)
   assert(atomic_get(&pv->pv_refcount) == 1);
 
   if(pv->pv_length == pv->pv_capacity) {
-    pv->pv_capacity++;
+    pv->pv_capacity = pv->pv_capacity * 2 + 1;
     pv = realloc(pv, sizeof(prop_vec_t) + sizeof(prop_t *) * pv->pv_capacity);
   }
   assert(pv->pv_length < pv->pv_capacity);
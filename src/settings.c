@@ -1568,6 +1568,31 @@ init_dev_settings(void)
   add_dev_bool("Disable HTTP connection reuse",
 	       "nohttpreuse", &gconf.disable_http_reuse);
 
+  setting_create(SETTING_INT, gconf.settings_dev, SETTINGS_INITIAL_UPDATE,
+                 SETTING_TITLE_CSTR("Idle HTTP connections per host"),
+                 SETTING_VALUE(4),
+                 SETTING_RANGE(1, 16),
+                 SETTING_WRITE_INT(&gconf.http_pool_size),
+                 SETTING_STORE("dev", "httppoolsize"),
+                 NULL);
+
+  add_dev_bool("Render text using a shared glyph atlas",
+	       "glyphatlas", &gconf.glw_glyph_atlas);
+
+  add_dev_bool("Reuse rendering of unchanged list and grid items",
+	       "retainedrender", &gconf.glw_retained_render);
+
+  setting_create(SETTING_INT, gconf.settings_dev, SETTINGS_INITIAL_UPDATE,
+                 SETTING_TITLE_CSTR("Texture memory budget"),
+                 SETTING_VALUE(0),
+                 SETTING_RANGE(0, 1024),
+                 SETTING_STEP(16),
+                 SETTING_UNIT_CSTR("MB"),
+                 SETTING_ZERO_TEXT(_p("Unlimited")),
+                 SETTING_WRITE_INT(&gconf.glw_texture_budget),
+                 SETTING_STORE("dev", "texturebudget"),
+                 NULL);
+
   add_dev_bool("Enable indexer option",
 	       "enable_indexer", &gconf.enable_indexer);
 
@@ -1603,6 +1628,9 @@ init_dev_settings(void)
   add_dev_bool("Debug HLS",
 	       "hlsdebug", &gconf.enable_hls_debug);
 
+  add_dev_bool("Throughput and buffer based HLS bitrate selection",
+	       "hlsabr", &gconf.enable_hls_abr);
+
   add_dev_bool("Debug FTP Client",
 	       "ftpdebug", &gconf.enable_ftp_client_debug);
 
@@ -29,6 +29,7 @@
 #include "glw.h"
 #include "glw_settings.h"
 #include "glw_text_bitmap.h"
+#include "glw_glyph_atlas.h"
 #include "glw_texture.h"
 #include "glw_view.h"
 #include "glw_event.h"
@@ -221,6 +222,9 @@ glw_init4(glw_root_t *gr,
 
   gr->gr_prop_dispatcher = dispatcher;
   gr->gr_courier = courier;
+  // All view subscriptions deal with child vectors so we can let the
+  // courier fold additions and collapse repeated value updates
+  prop_courier_set_flags(courier, PROP_COURIER_COALESCE);
   gr->gr_init_flags = flags;
   gr->gr_prop_maxtime = -1;
 
@@ -301,6 +305,8 @@ glw_init4(glw_root_t *gr,
 
   glw_tex_init(gr);
 
+  glw_layout_pool_init(gr);
+
   gr->gr_frontface = GLW_CCW;
 
 
@@ -310,6 +316,11 @@ glw_init4(glw_root_t *gr,
   gr->gr_frame_start = gr->gr_ui_start;
   glw_register_activity(gr);
   gr->gr_open_osk = glw_osk_open_default;
+
+  if(gconf.bench != NULL && !strcmp(gconf.bench, "glwrenderer")) {
+    glw_renderer_bench(10000);
+    exit(0);
+  }
   return 0;
 }
 
@@ -329,7 +340,9 @@ glw_fini(glw_root_t *gr)
   gr->gr_view_loader_run = 0;
   hts_cond_signal(&gr->gr_view_loader_cond);
 
+  glw_layout_pool_fini(gr);
   glw_text_bitmap_fini(gr);
+  glw_glyph_atlas_fini(gr);
   rstr_release(gr->gr_default_font);
   glw_tex_fini(gr);
   prop_unsubscribe(gr->gr_evsub);
@@ -362,8 +375,10 @@ glw_fini(glw_root_t *gr)
   pool_destroy(gr->gr_style_binding_pool);
 
   free(gr->gr_vtmp_buffer);
+  free(gr->gr_tess_buffer);
   free(gr->gr_render_jobs);
   free(gr->gr_render_order);
+  free(gr->gr_batch_jobs);
   free(gr->gr_vertex_buffer);
   free(gr->gr_index_buffer);
   rstr_release(gr->gr_pending_focus);
@@ -444,8 +459,32 @@ update_in_path(glw_t *w)
 /**
  *
  */
-void
-glw_layout0(glw_t *w, const glw_rctx_t *rc)
+static void
+glw_layout_widget(glw_t *w, const glw_rctx_t *rc)
+{
+  if(unlikely(w->glw_flags & GLW_HAVE_MARGINS)) {
+    glw_rctx_t rc0 = *rc;
+    glw_reposition(&rc0,
+                   w->glw_margin[0],
+                   rc->rc_height - w->glw_margin[1],
+                   rc->rc_width - w->glw_margin[2],
+                   w->glw_margin[3]);
+
+    if(rc0.rc_width < 1 || rc0.rc_height < 1)
+      return;
+
+    w->glw_class->gc_layout(w, &rc0);
+  } else {
+    w->glw_class->gc_layout(w, rc);
+  }
+}
+
+
+/**
+ *
+ */
+static void
+glw_layout_ui(glw_t *w, const glw_rctx_t *rc)
 {
   glw_root_t *gr = w->glw_root;
   int mask = GLW_VIEW_EVAL_LAYOUT;
@@ -474,21 +513,53 @@ glw_layout0(glw_t *w, const glw_rctx_t *rc)
   if(unlikely(w->glw_dynamic_eval & mask))
     glw_view_eval_layout(w, rc, mask);
 
-  if(unlikely(w->glw_flags & GLW_HAVE_MARGINS)) {
-    glw_rctx_t rc0 = *rc;
-    glw_reposition(&rc0,
-                   w->glw_margin[0],
-                   rc->rc_height - w->glw_margin[1],
-                   rc->rc_width - w->glw_margin[2],
-                   w->glw_margin[3]);
+  glw_layout_widget(w, rc);
+}
 
-    if(rc0.rc_width < 1 || rc0.rc_height < 1)
-      return;
 
-    w->glw_class->gc_layout(w, &rc0);
-  } else {
-    w->glw_class->gc_layout(w, rc);
+/**
+ *
+ */
+static void
+glw_layout1(glw_t *w, const glw_rctx_t *rc)
+{
+  glw_root_t *gr = w->glw_root;
+
+  if(unlikely(rc->rc_layout_worker != NULL)) {
+    // Running on a layout worker, anything that needs the UI thread
+    // is handed back to it
+    if(!glw_layout_worker_enter(rc->rc_layout_worker, w, rc))
+      glw_layout_widget(w, rc);
+    return;
+  }
+
+  if(unlikely(w == gr->gr_universe)) {
+    const int64_t ts = arch_get_ts();
+    glw_retained_frame_begin(gr);
+    glw_layout_ui(w, rc);
+    glw_retained_frame_end(gr);
+    gr->gr_stats_layout_time = arch_get_ts() - ts;
+    return;
   }
+
+  glw_layout_ui(w, rc);
+}
+
+
+/**
+ *
+ */
+void
+glw_layout0(glw_t *w, const glw_rctx_t *rc)
+{
+  if(unlikely(w->glw_retained != NULL)) {
+    // Track if anything in the subtree asked for a redraw
+    const int serial = atomic_get(&w->glw_root->gr_render_serial);
+    glw_layout1(w, rc);
+    glw_retained_layout_done(w, serial);
+    return;
+  }
+  glw_layout1(w, rc);
 }
 
 
@@ -689,6 +760,25 @@ glw_prepare_frame(glw_root_t *gr, int flags)
       double hz = 16000000.0 / d;
       prop_set(gr->gr_prop_ui, "framerate", PROP_SET_FLOAT, hz);
       gr->gr_framerate = hz;
+
+      if(gconf.debug_glw) {
+        prop_set(gr->gr_prop_ui, "renderjobs", PROP_SET_INT,
+                 gr->gr_stats_jobs_in);
+        prop_set(gr->gr_prop_ui, "drawcalls", PROP_SET_INT,
+                 gr->gr_stats_draws_out);
+        prop_set(gr->gr_prop_ui, "layouttime", PROP_SET_INT,
+                 gr->gr_stats_layout_time);
+        prop_set(gr->gr_prop_ui, "layoutitems", PROP_SET_INT,
+                 gr->gr_stats_layout_items);
+        prop_set(gr->gr_prop_ui, "retained", PROP_SET_INT,
+                 gr->gr_stats_retained);
+        prop_set(gr->gr_prop_ui, "uploadtime", PROP_SET_INT,
+                 gr->gr_stats_upload_time);
+        prop_set(gr->gr_prop_ui, "videocopy", PROP_SET_INT,
+                 gr->gr_stats_video_copy / 1024);
+        prop_set(gr->gr_prop_ui, "texturememory", PROP_SET_INT,
+                 (int)(gr->gr_tex_resident / 1024));
+      }
     }
 
     gr->gr_framerate_avg[gr->gr_frames & 0xf] = gr->gr_frame_start;
@@ -698,6 +788,11 @@ glw_prepare_frame(glw_root_t *gr, int flags)
   gr->gr_num_render_jobs = 0;
   gr->gr_vertex_offset = 0;
   gr->gr_index_offset = 0;
+  gr->gr_stats_layout_items = 0;
+  gr->gr_stats_retained = 0;
+  gr->gr_stats_upload_time = 0;
+
+  glw_glyph_atlas_prepare(gr);
 
   prop_set_int(gr->gr_screensaver_active, glw_screensaver_is_active(gr));
   prop_set_int(gr->gr_prop_width, gr->gr_width);
@@ -748,6 +843,7 @@ glw_prepare_frame(glw_root_t *gr, int flags)
   if(gr->gr_scheduled_refresh <= gr->gr_frame_start) {
     gr->gr_need_refresh = GLW_REFRESH_FLAG_LAYOUT | GLW_REFRESH_FLAG_RENDER;
     gr->gr_scheduled_refresh = INT64_MAX;
+    atomic_inc(&gr->gr_render_serial);
   }
 
   if(gr->gr_rec)
@@ -863,6 +959,8 @@ glw_destroy(glw_t *w)
   free(w->glw_matrix);
   w->glw_matrix = NULL;
 
+  glw_retained_free(w);
+
   if(w->glw_class->gc_newframe != NULL)
     LIST_REMOVE(w, glw_every_frame_link);
 
@@ -3412,13 +3510,15 @@ glw_need_refresh0(glw_root_t *gr, int how, const char *file, int line)
 {
   int flags = GLW_REFRESH_FLAG_LAYOUT;
 
-  if(how != GLW_REFRESH_LAYOUT_ONLY)
+  if(how != GLW_REFRESH_LAYOUT_ONLY) {
     flags |= GLW_REFRESH_FLAG_RENDER;
+    atomic_inc(&gr->gr_render_serial);
+  }
 
   if((gr->gr_need_refresh & flags) == flags)
     return;
 
-  gr->gr_need_refresh |= flags;
+  atomic_or_int(&gr->gr_need_refresh, flags);
   tracelog(TRACE_NO_PROP, TRACE_DEBUG,
            "GLW", "%s%srefresh requested by %s:%d",
            flags & GLW_REFRESH_FLAG_LAYOUT ? "layout " : "",
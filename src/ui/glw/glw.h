@@ -443,6 +443,8 @@ typedef struct glw_class {
 #define GLW_CAN_HIDE_CHILDS            0x2
 #define GLW_UNCONSTRAINED              0x4
 #define GLW_DRIVE_PAGINATION           0x8
+#define GLW_PARALLEL_LAYOUT            0x10 // gc_layout only touches the
+                                            // widget and its own subtree
 
   /**
    * Constructor
@@ -824,6 +826,15 @@ typedef struct glw_root {
   struct glw_head gr_active_dummy_list;
   struct glw_head gr_every_frame_list;
 
+  struct glw_layout_pool *gr_layout_pool;
+  int gr_stats_layout_time;   // Microseconds spent in layout last frame
+  int gr_stats_layout_items;  // Subtrees laid out on workers last frame
+
+  atomic_t gr_render_serial;  // Bumped by every render refresh request
+  int gr_retained_serial;     // gr_render_serial after last layout
+  int gr_retained_gen;        // Bumping this drops all retained renders
+  int gr_stats_retained;      // Subtrees replayed from retained renders
+
   int gr_width;
   int gr_height;
 
@@ -885,6 +896,8 @@ typedef struct glw_root {
   rstr_t *gr_default_font;
   int gr_font_domain;
 
+  struct glw_glyph_atlas *gr_glyph_atlas;
+
   /**
    * Image/Texture loader
    */
@@ -914,6 +927,10 @@ typedef struct glw_root {
     int limit;
   } gr_tex_stash[2];
 
+  int64_t gr_tex_resident;  // Bytes of loaded textures
+  int gr_tex_over_budget;
+  LIST_ENTRY(glw_root) gr_tex_root_link;
+
   struct glw_loadable_texture_list gr_tex_list;
 
   /**
@@ -1016,6 +1033,15 @@ typedef struct glw_root {
   int gr_index_buffer_capacity;
   int gr_index_offset;
 
+  // Jobs synthesized by merging compatible render jobs
+  struct glw_render_job *gr_batch_jobs;
+  int gr_batch_jobs_capacity;
+
+  int gr_stats_jobs_in;    // Render jobs submitted last frame
+  int gr_stats_draws_out;  // Draw calls after batching
+  int gr_stats_upload_time; // Microseconds spent uploading textures
+  int gr_stats_video_copy;  // Bytes copied by CPU for last video frame
+
   int gr_blendmode;
   int gr_frontface;
 
@@ -1023,6 +1049,9 @@ typedef struct glw_root {
   int gr_vtmp_cur;
   int gr_vtmp_capacity;
 
+  float *gr_tess_buffer;  // Transformed vertices and clip plane distances
+  int gr_tess_capacity;
+
   int gr_random;
 
   int gr_zmax;
@@ -1093,6 +1122,9 @@ typedef struct glw_rctx {
   uint8_t rc_preloaded : 1;
 
   uint8_t rc_segwayed : 1;
+
+  // Set when laying out on one of the layout workers
+  struct glw_layout_worker *rc_layout_worker;
 } glw_rctx_t;
 
 
@@ -1175,6 +1207,8 @@ typedef struct glw {
 
   Mtx *glw_matrix;
 
+  struct glw_retained *glw_retained;
+
   struct glw_clone *glw_clone;
 
   /**
@@ -1550,6 +1584,36 @@ glw_bubble_event2(glw_t *w, event_t *e)
 
 void glw_layout0(glw_t *w, const glw_rctx_t *rc);
 
+/**
+ * Parallel layout of child widgets, see glw_layout_pool.c
+ */
+typedef struct glw_layout_item {
+  glw_t *gli_widget;
+  glw_rctx_t gli_rc;
+} glw_layout_item_t;
+
+typedef struct glw_layout_batch {
+  glw_layout_item_t *glb_items;
+  int glb_num_items;
+  int glb_capacity;
+  int glb_enabled;
+} glw_layout_batch_t;
+
+void glw_layout_batch_init(glw_layout_batch_t *glb, glw_root_t *gr,
+                           const glw_rctx_t *rc);
+
+void glw_layout_batch_add(glw_layout_batch_t *glb, glw_t *w,
+                          const glw_rctx_t *rc);
+
+void glw_layout_batch_run(glw_layout_batch_t *glb, glw_root_t *gr);
+
+int glw_layout_worker_enter(struct glw_layout_worker *lw, glw_t *w,
+                            const glw_rctx_t *rc);
+
+void glw_layout_pool_init(glw_root_t *gr);
+
+void glw_layout_pool_fini(glw_root_t *gr);
+
 void glw_rctx_init(glw_rctx_t *rc, int width, int height, int overscan,
                    int *zmax);
 
@@ -1574,6 +1638,8 @@ void glw_line(glw_root_t *root, const glw_rctx_t *rc,
 
 void glw_renderer_render(glw_root_t *gr);
 
+void glw_renderer_bench(int num_quads);
+
 void glw_render_zoffset(glw_t *w, const glw_rctx_t *rc);
 
 static inline int glw_debug(glw_t *w)
@@ -1583,6 +1649,21 @@ static inline int glw_debug(glw_t *w)
 
 void glw_render0(glw_t *w, const glw_rctx_t *rc);
 
+/**
+ * Retained rendering of unchanged subtrees, see glw_retained.c
+ */
+void glw_render_retained(glw_t *w, const glw_rctx_t *rc);
+
+void glw_retained_layout_done(glw_t *w, int serial);
+
+void glw_retained_invalidate_parents(glw_t *w);
+
+void glw_retained_frame_begin(glw_root_t *gr);
+
+void glw_retained_frame_end(glw_root_t *gr);
+
+void glw_retained_free(glw_t *w);
+
 static inline void glw_zinc(glw_rctx_t *rc)
 {
   rc->rc_zindex++;
@@ -1714,9 +1795,12 @@ glw_need_refresh(glw_root_t *gr, int how)
 {
   int flags = GLW_REFRESH_FLAG_LAYOUT;
 
-  if(how != GLW_REFRESH_LAYOUT_ONLY)
+  if(how != GLW_REFRESH_LAYOUT_ONLY) {
     flags |= GLW_REFRESH_FLAG_RENDER;
-  gr->gr_need_refresh |= flags;
+    atomic_inc(&gr->gr_render_serial);
+  }
+  // May be called from layout workers, see glw_layout_pool.c
+  atomic_or_int(&gr->gr_need_refresh, flags);
 }
 
 #endif
@@ -70,7 +70,7 @@ typedef struct glw_array_item {
  *
  */
 static int
-grid_layout_row(glw_array_t *a, glw_rctx_t *rc,
+grid_layout_row(glw_array_t *a, glw_rctx_t *rc, glw_layout_batch_t *glb,
                 glw_t **rowvector, int *num_columnsp,
                 int *req_row_heightp, int height)
 {
@@ -115,7 +115,7 @@ grid_layout_row(glw_array_t *a, glw_rctx_t *rc,
        cd->pos_fy - a->gsc.rounded_pos <  height * 2) {
       rc->rc_width = cd->width;
       rc->rc_height = cd->height;
-      glw_layout0(c, rc);
+      glw_layout_batch_add(glb, c, rc);
     }
   }
   *num_columnsp = 0;
@@ -211,6 +211,9 @@ glw_array_layout(glw_t *w, const glw_rctx_t *rc)
   int column = 0;
   int req_row_height = 0;
 
+  glw_layout_batch_t glb;
+  glw_layout_batch_init(&glb, w->glw_root, rc);
+
   TAILQ_FOREACH(c, &w->glw_childs, glw_parent_link) {
     if(c->glw_flags & GLW_HIDDEN)
       continue;
@@ -218,7 +221,7 @@ glw_array_layout(glw_t *w, const glw_rctx_t *rc)
     glw_array_item_t *cd = glw_parent_data(c, glw_array_item_t);
 
     if(c->glw_flags & GLW_CONSTRAINT_D) {
-      ypos += grid_layout_row(a, &rc0, rowvector, &column,
+      ypos += grid_layout_row(a, &rc0, &glb, rowvector, &column,
                               &req_row_height, height);
 
       cd->width = width;
@@ -231,7 +234,8 @@ glw_array_layout(glw_t *w, const glw_rctx_t *rc)
 
       if(column == a->xentries) {
 
-        ypos += a->yspacing + grid_layout_row(a, &rc0, rowvector, &column,
+        ypos += a->yspacing + grid_layout_row(a, &rc0, &glb,
+                                              rowvector, &column,
                                               &req_row_height, height);
         req_row_height = 0;
         column = 0;
@@ -273,15 +277,17 @@ glw_array_layout(glw_t *w, const glw_rctx_t *rc)
     column++;
 
     if(c->glw_flags & GLW_CONSTRAINT_D) {
-      ypos += grid_layout_row(a, &rc0, rowvector, &column,
+      ypos += grid_layout_row(a, &rc0, &glb, rowvector, &column,
                               &req_row_height, height);
     }
 
   }
 
-  ypos += grid_layout_row(a, &rc0, rowvector, &column,
+  ypos += grid_layout_row(a, &rc0, &glb, rowvector, &column,
                           &req_row_height, height);
 
+  glw_layout_batch_run(&glb, w->glw_root);
+
   if(a->gsc.total_size != ypos) {
     a->gsc.total_size = ypos;
     a->w.glw_flags |= GLW_UPDATE_METRICS;
@@ -335,7 +341,7 @@ glw_array_render_one(glw_array_t *a, glw_t *c, int width, int height,
 		 cd->pos_fx + cw,
 		 height - cd->pos_fy - ch);
 
-  glw_render0(c, &rc3);
+  glw_render_retained(c, &rc3);
 
   if(ct != -1)
     glw_clip_disable(gr, ct);
@@ -996,7 +996,7 @@ static glw_class_t glw_container_x = {
   .gc_name2 = "hbox",
   .gc_instance_size = sizeof(glw_container_t),
   .gc_parent_data_size = sizeof(glw_container_item_t),
-  .gc_flags = GLW_CAN_HIDE_CHILDS,
+  .gc_flags = GLW_CAN_HIDE_CHILDS | GLW_PARALLEL_LAYOUT,
   .gc_set_int = glw_container_set_int,
   .gc_layout = glw_container_x_layout,
   .gc_render = glw_container_x_render,
@@ -1012,7 +1012,7 @@ static glw_class_t glw_container_y = {
   .gc_name2 = "vbox",
   .gc_instance_size = sizeof(glw_container_t),
   .gc_parent_data_size = sizeof(glw_container_item_t),
-  .gc_flags = GLW_CAN_HIDE_CHILDS,
+  .gc_flags = GLW_CAN_HIDE_CHILDS | GLW_PARALLEL_LAYOUT,
   .gc_set_int = glw_container_set_int,
   .gc_layout = glw_container_y_layout,
   .gc_render = glw_container_y_render,
@@ -1026,7 +1026,7 @@ static glw_class_t glw_container_y = {
 static glw_class_t glw_container_z = {
   .gc_name = "container_z",
   .gc_name2 = "zbox",
-  .gc_flags = GLW_CAN_HIDE_CHILDS,
+  .gc_flags = GLW_CAN_HIDE_CHILDS | GLW_PARALLEL_LAYOUT,
   .gc_instance_size = sizeof(glw_t),
   .gc_layout = glw_container_z_layout,
   .gc_render = glw_container_z_render,
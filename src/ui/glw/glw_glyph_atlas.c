@@ -0,0 +1,270 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+
+#include "glw.h"
+#include "glw_texture.h"
+#include "glw_glyph_atlas.h"
+#include "image/image.h"
+#include "misc/pool.h"
+
+#define GLYPH_ATLAS_HASH_SIZE 256
+#define GLYPH_ATLAS_HASH_MASK (GLYPH_ATLAS_HASH_SIZE - 1)
+
+LIST_HEAD(glw_glyph_atlas_entry_list, glw_glyph_atlas_entry);
+
+/**
+ * Glyphs are packed into horizontal shelves. When the atlas is full
+ * it's flagged as such and cleared at the start of the next frame.
+ * Users compare the generation to know when to look up their glyphs
+ * again. Text whose glyphs did not make it falls back to being
+ * rendered as a bitmap (see glw_text_bitmap.c) so the atlas settles
+ * after a clear instead of overflowing again.
+ *
+ * The atlas is an intensity+alpha texture with intensity fixed to 255
+ * so the glyph color comes from the vertex color. Only the rows that
+ * received new glyphs since last frame are uploaded
+ */
+typedef struct glw_glyph_atlas {
+  pixmap_t *gga_pm;
+  glw_backend_texture_t gga_texture;
+
+  struct glw_glyph_atlas_entry_list gga_hash[GLYPH_ATLAS_HASH_SIZE];
+  pool_t *gga_entry_pool;
+
+  int gga_generation;
+  int gga_num_entries;
+
+  int16_t gga_shelf_x;
+  int16_t gga_shelf_y;
+  int16_t gga_shelf_height;
+
+  int16_t gga_dirty_y1;  // Rows [y1, y2) need to be uploaded
+  int16_t gga_dirty_y2;
+
+  uint8_t gga_dirty : 1; // Everything needs to be uploaded
+  uint8_t gga_full : 1;
+
+} glw_glyph_atlas_t;
+
+
+/**
+ *
+ */
+void
+glw_glyph_atlas_init(glw_root_t *gr)
+{
+  glw_glyph_atlas_t *gga = calloc(1, sizeof(glw_glyph_atlas_t));
+
+  gga->gga_pm = pixmap_create(GLW_GLYPH_ATLAS_SIZE, GLW_GLYPH_ATLAS_SIZE,
+                              PIXMAP_IA, 0);
+  gga->gga_entry_pool = pool_create("glyphatlas",
+                                    sizeof(glw_glyph_atlas_entry_t), 0);
+  gga->gga_dirty = 1;
+  gr->gr_glyph_atlas = gga;
+}
+
+
+/**
+ *
+ */
+static void
+glw_glyph_atlas_clear(glw_glyph_atlas_t *gga)
+{
+  glw_glyph_atlas_entry_t *gae;
+
+  for(int i = 0; i < GLYPH_ATLAS_HASH_SIZE; i++) {
+    while((gae = LIST_FIRST(&gga->gga_hash[i])) != NULL) {
+      LIST_REMOVE(gae, gae_link);
+      pool_put(gga->gga_entry_pool, gae);
+    }
+  }
+
+  pixmap_t *pm = gga->gga_pm;
+  memset(pm->pm_data, 0, pm->pm_linesize * pm->pm_height);
+
+  gga->gga_num_entries = 0;
+  gga->gga_shelf_x = 0;
+  gga->gga_shelf_y = 0;
+  gga->gga_shelf_height = 0;
+  gga->gga_dirty = 1;
+  gga->gga_dirty_y1 = gga->gga_dirty_y2 = 0;
+  gga->gga_full = 0;
+  gga->gga_generation++;
+}
+
+
+/**
+ *
+ */
+void
+glw_glyph_atlas_fini(glw_root_t *gr)
+{
+  glw_glyph_atlas_t *gga = gr->gr_glyph_atlas;
+  if(gga == NULL)
+    return;
+
+  glw_glyph_atlas_clear(gga);
+  glw_tex_destroy(gr, &gga->gga_texture);
+  pool_destroy(gga->gga_entry_pool);
+  pixmap_release(gga->gga_pm);
+  free(gga);
+  gr->gr_glyph_atlas = NULL;
+}
+
+
+/**
+ * Called at start of each frame
+ */
+void
+glw_glyph_atlas_prepare(glw_root_t *gr)
+{
+  glw_glyph_atlas_t *gga = gr->gr_glyph_atlas;
+
+  if(gga == NULL || !gga->gga_full)
+    return;
+
+  GLW_TRACE("Glyph atlas full with %d glyphs, clearing",
+            gga->gga_num_entries);
+  glw_glyph_atlas_clear(gga);
+}
+
+
+/**
+ *
+ */
+int
+glw_glyph_atlas_generation(glw_root_t *gr)
+{
+  glw_glyph_atlas_t *gga = gr->gr_glyph_atlas;
+  return gga ? gga->gga_generation : 0;
+}
+
+
+/**
+ * Copy coverage into the alpha channel of the atlas
+ */
+static void
+glw_glyph_atlas_blit(pixmap_t *dst, int x, int y, const pixmap_t *src)
+{
+  for(int j = 0; j < src->pm_height; j++) {
+    const uint8_t *s = src->pm_data + j * src->pm_linesize;
+    uint8_t *d = dst->pm_data + (y + j) * dst->pm_linesize + x * 2;
+    for(int i = 0; i < src->pm_width; i++) {
+      *d++ = 0xff;
+      *d++ = *s++;
+    }
+  }
+}
+
+
+/**
+ * Return atlas entry for the given glyph, inserting it if needed.
+ *
+ * Returns NULL if the glyph does not fit
+ */
+const glw_glyph_atlas_entry_t *
+glw_glyph_atlas_get(glw_root_t *gr, const image_glyph_t *ig)
+{
+  glw_glyph_atlas_t *gga = gr->gr_glyph_atlas;
+  glw_glyph_atlas_entry_t *gae;
+  const pixmap_t *pm = ig->ig_pm;
+
+  if(gga == NULL) {
+    glw_glyph_atlas_init(gr);
+    gga = gr->gr_glyph_atlas;
+  }
+
+  struct glw_glyph_atlas_entry_list *l =
+    &gga->gga_hash[ig->ig_id & GLYPH_ATLAS_HASH_MASK];
+
+  LIST_FOREACH(gae, l, gae_link)
+    if(gae->gae_id == ig->ig_id)
+      return gae;
+
+  if(gga->gga_full)
+    return NULL;
+
+  // One pixel of padding to avoid bleeding when sampling
+  const int w = pm->pm_width + 1;
+  const int h = pm->pm_height + 1;
+
+  if(w > GLW_GLYPH_ATLAS_SIZE || h > GLW_GLYPH_ATLAS_SIZE)
+    return NULL;
+
+  if(gga->gga_shelf_x + w > GLW_GLYPH_ATLAS_SIZE) {
+    // Start a new shelf
+    gga->gga_shelf_y += gga->gga_shelf_height;
+    gga->gga_shelf_x = 0;
+    gga->gga_shelf_height = 0;
+  }
+
+  if(gga->gga_shelf_y + h > GLW_GLYPH_ATLAS_SIZE) {
+    gga->gga_full = 1;
+    return NULL;
+  }
+
+  gae = pool_get(gga->gga_entry_pool);
+  gae->gae_id = ig->ig_id;
+  gae->gae_x = gga->gga_shelf_x;
+  gae->gae_y = gga->gga_shelf_y;
+  gae->gae_width = pm->pm_width;
+  gae->gae_height = pm->pm_height;
+  LIST_INSERT_HEAD(l, gae, gae_link);
+
+  glw_glyph_atlas_blit(gga->gga_pm, gae->gae_x, gae->gae_y, pm);
+
+  gga->gga_shelf_x += w;
+  gga->gga_shelf_height = MAX(gga->gga_shelf_height, h);
+  gga->gga_num_entries++;
+
+  if(gga->gga_dirty_y1 == gga->gga_dirty_y2) {
+    gga->gga_dirty_y1 = gae->gae_y;
+    gga->gga_dirty_y2 = gae->gae_y + gae->gae_height;
+  } else {
+    gga->gga_dirty_y1 = MIN(gga->gga_dirty_y1, gae->gae_y);
+    gga->gga_dirty_y2 = MAX(gga->gga_dirty_y2, gae->gae_y + gae->gae_height);
+  }
+  return gae;
+}
+
+
+/**
+ * Return the atlas texture, uploading pending glyphs first
+ */
+const glw_backend_texture_t *
+glw_glyph_atlas_texture(glw_root_t *gr)
+{
+  glw_glyph_atlas_t *gga = gr->gr_glyph_atlas;
+
+  if(gga == NULL)
+    return NULL;
+
+  if(gga->gga_dirty) {
+    glw_tex_upload(gr, &gga->gga_texture, gga->gga_pm, 0);
+    gga->gga_dirty = 0;
+  } else if(gga->gga_dirty_y1 != gga->gga_dirty_y2) {
+    glw_tex_upload_rows(gr, &gga->gga_texture, gga->gga_pm,
+                        gga->gga_dirty_y1,
+                        gga->gga_dirty_y2 - gga->gga_dirty_y1);
+  }
+  gga->gga_dirty_y1 = gga->gga_dirty_y2 = 0;
+  return &gga->gga_texture;
+}
@@ -0,0 +1,52 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#ifndef GLW_GLYPH_ATLAS_H
+#define GLW_GLYPH_ATLAS_H
+
+#define GLW_GLYPH_ATLAS_SIZE 1024  // Width and height of atlas texture
+
+struct image_glyph;
+
+/**
+ * A glyph coverage bitmap stored in the atlas
+ */
+typedef struct glw_glyph_atlas_entry {
+  LIST_ENTRY(glw_glyph_atlas_entry) gae_link;
+  uint32_t gae_id;
+  int16_t gae_x;
+  int16_t gae_y;
+  int16_t gae_width;
+  int16_t gae_height;
+} glw_glyph_atlas_entry_t;
+
+void glw_glyph_atlas_init(glw_root_t *gr);
+
+void glw_glyph_atlas_fini(glw_root_t *gr);
+
+void glw_glyph_atlas_prepare(glw_root_t *gr);
+
+int glw_glyph_atlas_generation(glw_root_t *gr);
+
+const glw_glyph_atlas_entry_t *glw_glyph_atlas_get(glw_root_t *gr,
+                                                   const struct image_glyph *ig);
+
+const glw_backend_texture_t *glw_glyph_atlas_texture(glw_root_t *gr);
+
+#endif /* GLW_GLYPH_ATLAS_H */
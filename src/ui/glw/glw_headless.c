@@ -0,0 +1,484 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+
+#include "glw.h"
+
+#include <GL/osmesa.h>
+
+#include "main.h"
+#include "event.h"
+#include "navigator.h"
+#include "arch/arch.h"
+#include "arch/linux/linux.h"
+
+/**
+ * Headless GLW frontend
+ *
+ * Renders the UI into an offscreen buffer using OSMesa, ie. the regular
+ * OpenGL backend on top of a software rasterizer. No display or GPU is
+ * required which makes it possible to measure UI performance on build
+ * machines.
+ *
+ * The UI is driven by a script (--headless-script) with one command
+ * per line:
+ *
+ *   open <url>       Open URL
+ *   action <name>    Send action event, ie. Down, Activate, NavBack
+ *   frames <n>       Run <n> frames before next command
+ *   sleep <ms>       Run frames for <ms> milliseconds before next command
+ *   size <w> <h>     Change size of the output
+ *   mark <label>     Label following frames in the statistics
+ *   quit             Shut down the application
+ *
+ * The application is shut down when the script ends. Per frame timing
+ * is written as CSV to the file given with --headless-stats and a
+ * summary is logged on exit.
+ */
+
+typedef struct glw_headless_samples {
+  int *samples;
+  int num_samples;
+  int capacity;
+} glw_headless_samples_t;
+
+
+typedef struct glw_headless {
+
+  glw_root_t gr;
+
+  int running;
+  hts_thread_t thread;
+
+  OSMesaContext ctx;
+  void *framebuffer;
+
+  FILE *script;
+  int script_line;
+  int wait_frames;
+  int64_t wait_until;
+  int shutdown_requested;
+
+  FILE *stats;
+  char *mark;
+  int frames;
+
+  glw_headless_samples_t layout_time;
+  glw_headless_samples_t render_time;
+  glw_headless_samples_t upload_time;
+
+} glw_headless_t;
+
+
+/**
+ *
+ */
+static int
+headless_set_size(glw_headless_t *gh, int width, int height)
+{
+  void *fb = realloc(gh->framebuffer, width * height * 4);
+  if(fb == NULL)
+    return -1;
+  gh->framebuffer = fb;
+
+  if(!OSMesaMakeCurrent(gh->ctx, fb, GL_UNSIGNED_BYTE, width, height)) {
+    TRACE(TRACE_ERROR, "GLW", "Unable to bind %d x %d offscreen buffer",
+          width, height);
+    return -1;
+  }
+
+  glViewport(0, 0, width, height);
+  gh->gr.gr_width  = width;
+  gh->gr.gr_height = height;
+  return 0;
+}
+
+
+/**
+ *
+ */
+static int
+headless_init(glw_headless_t *gh)
+{
+  gh->ctx = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+  if(gh->ctx == NULL) {
+    TRACE(TRACE_ERROR, "GLW", "Unable to create OSMesa context");
+    return -1;
+  }
+
+  if(headless_set_size(gh, 1280, 720))
+    return -1;
+
+  return glw_opengl_init_context(&gh->gr);
+}
+
+
+/**
+ *
+ */
+static void
+headless_fini(glw_headless_t *gh)
+{
+  glw_opengl_fini_context(&gh->gr);
+  OSMesaDestroyContext(gh->ctx);
+  free(gh->framebuffer);
+}
+
+
+/**
+ *
+ */
+static void
+samples_add(glw_headless_samples_t *ghs, int v)
+{
+  if(ghs->num_samples == ghs->capacity) {
+    ghs->capacity = 2 * ghs->capacity + 1024;
+    ghs->samples = realloc(ghs->samples, ghs->capacity * sizeof(int));
+  }
+  ghs->samples[ghs->num_samples++] = v;
+}
+
+
+/**
+ *
+ */
+static int
+samples_cmp(const void *A, const void *B)
+{
+  const int *a = A;
+  const int *b = B;
+  return *a - *b;
+}
+
+
+/**
+ *
+ */
+static void
+samples_report(glw_headless_samples_t *ghs, const char *title)
+{
+  const int n = ghs->num_samples;
+  int64_t sum = 0;
+
+  if(n == 0)
+    return;
+
+  qsort(ghs->samples, n, sizeof(int), samples_cmp);
+
+  for(int i = 0; i < n; i++)
+    sum += ghs->samples[i];
+
+  TRACE(TRACE_INFO, "GLW",
+        "%-7s avg:%6d p50:%6d p95:%6d max:%6d us over %d frames",
+        title, (int)(sum / n), ghs->samples[n / 2],
+        ghs->samples[n * 95 / 100], ghs->samples[n - 1], n);
+
+  free(ghs->samples);
+  memset(ghs, 0, sizeof(glw_headless_samples_t));
+}
+
+
+/**
+ *
+ */
+static void
+headless_script_end(glw_headless_t *gh)
+{
+  if(gh->script != NULL) {
+    fclose(gh->script);
+    gh->script = NULL;
+  }
+
+  if(!gh->shutdown_requested) {
+    gh->shutdown_requested = 1;
+    app_shutdown(0);
+  }
+}
+
+
+/**
+ *
+ */
+static void
+headless_script_command(glw_headless_t *gh, char *cmd)
+{
+  glw_root_t *gr = &gh->gr;
+  char *arg = strchr(cmd, ' ');
+
+  if(arg != NULL) {
+    *arg++ = 0;
+    while(*arg == ' ')
+      arg++;
+  }
+
+  if(!strcmp(cmd, "open") && arg != NULL) {
+    glw_inject_event(gr, event_create_openurl(arg));
+
+  } else if(!strcmp(cmd, "action") && arg != NULL) {
+    glw_inject_event(gr, event_create_action_str(arg));
+
+  } else if(!strcmp(cmd, "frames") && arg != NULL) {
+    gh->wait_frames = atoi(arg);
+
+  } else if(!strcmp(cmd, "sleep") && arg != NULL) {
+    gh->wait_until = arch_get_ts() + atoi(arg) * 1000LL;
+
+  } else if(!strcmp(cmd, "size") && arg != NULL) {
+    int width, height;
+    if(sscanf(arg, "%d %d", &width, &height) != 2 ||
+       width < 1 || height < 1 || headless_set_size(gh, width, height))
+      TRACE(TRACE_ERROR, "GLW", "Script line %d: Invalid size %s",
+            gh->script_line, arg);
+
+  } else if(!strcmp(cmd, "mark") && arg != NULL) {
+    mystrset(&gh->mark, arg);
+
+  } else if(!strcmp(cmd, "quit")) {
+    headless_script_end(gh);
+
+  } else {
+    TRACE(TRACE_ERROR, "GLW", "Script line %d: Unknown command %s",
+          gh->script_line, cmd);
+  }
+}
+
+
+/**
+ * Execute script commands until we need to wait for frames or time
+ */
+static void
+headless_script_run(glw_headless_t *gh)
+{
+  char line[1024];
+
+  if(gh->wait_frames > 0 && --gh->wait_frames > 0)
+    return;
+
+  if(gh->wait_until > arch_get_ts())
+    return;
+
+  while(gh->script != NULL && gh->wait_frames == 0 &&
+        gh->wait_until <= arch_get_ts()) {
+
+    if(fgets(line, sizeof(line), gh->script) == NULL) {
+      headless_script_end(gh);
+      break;
+    }
+    gh->script_line++;
+
+    char *s = line;
+    while(*s == ' ' || *s == '\t')
+      s++;
+
+    size_t len = strlen(s);
+    while(len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r' ||
+                      s[len - 1] == ' '))
+      s[--len] = 0;
+
+    if(*s == 0 || *s == '#')
+      continue;
+
+    headless_script_command(gh, s);
+  }
+}
+
+
+/**
+ *
+ */
+static void
+headless_mainloop(glw_headless_t *gh)
+{
+  glw_root_t *gr = &gh->gr;
+  int64_t deadline = arch_get_ts();
+
+  while(gh->running) {
+
+    headless_script_run(gh);
+
+    glw_lock(gr);
+
+    gr->gr_screensaver_reset_at = gr->gr_frame_start;
+    glw_prepare_frame(gr, 0);
+    int refresh = gr->gr_need_refresh;
+    gr->gr_need_refresh = 0;
+
+    int64_t render_start = 0;
+
+    if(refresh) {
+      glw_rctx_t rc;
+      int zmax = 0;
+      glw_rctx_init(&rc, gr->gr_width, gr->gr_height, 1, &zmax);
+
+      glw_layout0(gr->gr_universe, &rc);
+
+      if(refresh & GLW_REFRESH_FLAG_RENDER) {
+        render_start = arch_get_ts();
+        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        glw_render0(gr->gr_universe, &rc);
+      }
+    }
+    glw_unlock(gr);
+
+    int render_time = 0;
+    if(refresh & GLW_REFRESH_FLAG_RENDER) {
+      glw_post_scene(gr);
+      glFinish();
+      render_time = arch_get_ts() - render_start;
+    }
+
+    if(refresh) {
+      samples_add(&gh->layout_time, gr->gr_stats_layout_time);
+      samples_add(&gh->render_time, render_time);
+      samples_add(&gh->upload_time, gr->gr_stats_upload_time);
+
+      if(gh->stats != NULL)
+        fprintf(gh->stats, "%d,%s,%d,%d,%d,%d,%d\n",
+                gh->frames, gh->mark ?: "",
+                gr->gr_stats_layout_time, render_time,
+                gr->gr_stats_upload_time,
+                gr->gr_stats_jobs_in, gr->gr_stats_draws_out);
+    }
+    gh->frames++;
+
+    deadline += gr->gr_frameduration;
+    const int64_t now = arch_get_ts();
+    if(deadline > now) {
+      struct timespec req;
+      req.tv_sec  =  (deadline - now) / 1000000;
+      req.tv_nsec = ((deadline - now) % 1000000) * 1000;
+      nanosleep(&req, NULL);
+    } else {
+      deadline = now;
+    }
+  }
+}
+
+
+/**
+ *
+ */
+static void *
+glw_headless_thread(void *aux)
+{
+  glw_headless_t *gh = aux;
+  glw_root_t *gr = &gh->gr;
+
+  if(headless_init(gh)) {
+    app_shutdown(1);
+    return NULL;
+  }
+
+  if(glw_init(gr)) {
+    headless_fini(gh);
+    app_shutdown(1);
+    return NULL;
+  }
+
+  if(gconf.headless_script != NULL) {
+    gh->script = fopen(gconf.headless_script, "r");
+    if(gh->script == NULL)
+      TRACE(TRACE_ERROR, "GLW", "Unable to open script %s -- %s",
+            gconf.headless_script, strerror(errno));
+  }
+
+  if(gconf.headless_stats != NULL) {
+    gh->stats = fopen(gconf.headless_stats, "w");
+    if(gh->stats == NULL)
+      TRACE(TRACE_ERROR, "GLW", "Unable to open %s -- %s",
+            gconf.headless_stats, strerror(errno));
+    else
+      fprintf(gh->stats, "frame,mark,layout_us,render_us,upload_us,"
+              "renderjobs,drawcalls\n");
+  }
+
+  glw_lock(gr);
+  glw_load_universe(gr);
+  glw_unlock(gr);
+
+  headless_mainloop(gh);
+
+  glw_lock(gr);
+  glw_unload_universe(gr);
+  glw_unlock(gr);
+  glw_reap(gr);
+  glw_reap(gr);
+
+  samples_report(&gh->layout_time, "Layout");
+  samples_report(&gh->render_time, "Render");
+  samples_report(&gh->upload_time, "Upload");
+
+  if(gh->script != NULL)
+    fclose(gh->script);
+  if(gh->stats != NULL)
+    fclose(gh->stats);
+  free(gh->mark);
+
+  glw_fini(gr);
+  headless_fini(gh);
+  return NULL;
+}
+
+
+/**
+ *
+ */
+static void *
+glw_headless_start(struct prop *nav)
+{
+  glw_headless_t *gh = calloc(1, sizeof(glw_headless_t));
+
+  gh->gr.gr_prop_ui = prop_create_root("ui");
+  gh->gr.gr_prop_nav = nav ?: nav_spawn();
+  gh->running = 1;
+
+  hts_thread_create_joinable("glw", &gh->thread,
+			     glw_headless_thread, gh, 0);
+
+  return gh;
+}
+
+
+/**
+ *
+ */
+static prop_t *
+glw_headless_stop(void *aux)
+{
+  glw_headless_t *gh = aux;
+  glw_root_t *gr = &gh->gr;
+  prop_t *nav = gr->gr_prop_nav;
+  gh->running = 0;
+  hts_thread_join(&gh->thread);
+  prop_destroy(gr->gr_prop_ui);
+  glw_release_root(gr);
+  return nav;
+}
+
+
+
+const linux_ui_t ui_glw = {
+  .start = glw_headless_start,
+  .stop  = glw_headless_stop,
+};
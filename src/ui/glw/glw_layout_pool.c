@@ -0,0 +1,348 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+
+#include "main.h"
+#include "glw.h"
+#include "arch/atomic.h"
+
+#define GLW_LAYOUT_MAX_THREADS   8
+#define GLW_LAYOUT_MIN_PARALLEL  8  // Smaller batches are not worth it
+
+/**
+ * Parallel layout
+ *
+ * Widgets that lay out many independent children (list, array) can
+ * collect them in a glw_layout_batch and have them laid out by a small
+ * pool of worker threads. The UI thread takes part as well and holds
+ * gr_mutex during the entire run.
+ *
+ * On a worker only classes flagged with GLW_PARALLEL_LAYOUT are laid
+ * out. Anything else, as well as widgets that need to be activated,
+ * change preload state or evaluate dynamic view expressions, is
+ * recorded together with its render context and laid out on the UI
+ * thread once the workers are done. Moving widgets to the head of
+ * gr_active_list is recorded in the same way.
+ *
+ * Classes flagged with GLW_PARALLEL_LAYOUT may only modify their own
+ * widget and parent data of their children (autofading containers are
+ * always laid out on the UI thread since they destroy retired
+ * children). The one exception is glw_need_refresh() (directly or via
+ * glw_lp()) which sets gr_need_refresh with an atomic OR.
+ */
+typedef struct glw_layout_worker {
+  glw_layout_item_t *lw_deferred;
+  int lw_num_deferred;
+  int lw_deferred_capacity;
+
+  glw_t **lw_active;
+  int lw_num_active;
+  int lw_active_capacity;
+
+  struct glw_layout_pool *lw_pool;
+  hts_thread_t lw_thread;
+} glw_layout_worker_t;
+
+
+typedef struct glw_layout_pool {
+  hts_mutex_t lp_mutex;
+  hts_cond_t lp_work_cond;
+  hts_cond_t lp_done_cond;
+
+  int lp_run;
+  int lp_generation;
+  int lp_busy;
+
+  const glw_layout_item_t *lp_items;
+  int lp_num_items;
+  atomic_t lp_next_item;
+
+  int lp_num_threads;
+  glw_layout_worker_t lp_workers[GLW_LAYOUT_MAX_THREADS + 1];
+} glw_layout_pool_t;
+
+
+/**
+ *
+ */
+int
+glw_layout_worker_enter(glw_layout_worker_t *lw, glw_t *w,
+                        const glw_rctx_t *rc)
+{
+  if(w->glw_class->gc_flags & GLW_PARALLEL_LAYOUT &&
+     (rc->rc_invisible || w->glw_flags & GLW_ACTIVE) &&
+     rc->rc_preloaded == !!(w->glw_flags & GLW_PRELOADED) &&
+     !(w->glw_dynamic_eval & GLW_VIEW_EVAL_LAYOUT) &&
+     !(w->glw_flags2 & GLW2_AUTOFADE)) { // May destroy retired children
+
+    if(!rc->rc_invisible) {
+      if(lw->lw_num_active == lw->lw_active_capacity) {
+        lw->lw_active_capacity = 2 * lw->lw_active_capacity + 64;
+        lw->lw_active = realloc(lw->lw_active,
+                                lw->lw_active_capacity * sizeof(glw_t *));
+      }
+      lw->lw_active[lw->lw_num_active++] = w;
+    }
+    return 0;
+  }
+
+  if(lw->lw_num_deferred == lw->lw_deferred_capacity) {
+    lw->lw_deferred_capacity = 2 * lw->lw_deferred_capacity + 16;
+    lw->lw_deferred = realloc(lw->lw_deferred,
+                              lw->lw_deferred_capacity *
+                              sizeof(glw_layout_item_t));
+  }
+  glw_layout_item_t *gli = &lw->lw_deferred[lw->lw_num_deferred++];
+  gli->gli_widget = w;
+  gli->gli_rc = *rc;
+  gli->gli_rc.rc_layout_worker = NULL;
+  return 1;
+}
+
+
+/**
+ *
+ */
+static void
+glw_layout_worker_drain(glw_layout_pool_t *lp, glw_layout_worker_t *lw)
+{
+  int i;
+  while((i = atomic_add_and_fetch(&lp->lp_next_item, 1) - 1) <
+        lp->lp_num_items) {
+    const glw_layout_item_t *gli = &lp->lp_items[i];
+    glw_rctx_t rc = gli->gli_rc;
+    rc.rc_layout_worker = lw;
+    glw_layout0(gli->gli_widget, &rc);
+  }
+}
+
+
+/**
+ *
+ */
+static void *
+glw_layout_worker_thread(void *aux)
+{
+  glw_layout_worker_t *lw = aux;
+  glw_layout_pool_t *lp = lw->lw_pool;
+  int generation = 0;
+
+  hts_mutex_lock(&lp->lp_mutex);
+
+  while(lp->lp_run) {
+
+    if(generation == lp->lp_generation) {
+      hts_cond_wait(&lp->lp_work_cond, &lp->lp_mutex);
+      continue;
+    }
+    generation = lp->lp_generation;
+
+    hts_mutex_unlock(&lp->lp_mutex);
+    glw_layout_worker_drain(lp, lw);
+    hts_mutex_lock(&lp->lp_mutex);
+
+    if(--lp->lp_busy == 0)
+      hts_cond_signal(&lp->lp_done_cond);
+  }
+  hts_mutex_unlock(&lp->lp_mutex);
+  return NULL;
+}
+
+
+/**
+ * Apply what the workers handed back to the UI thread
+ */
+static void
+glw_layout_worker_finish(glw_root_t *gr, glw_layout_worker_t *lw)
+{
+  for(int i = 0; i < lw->lw_num_active; i++) {
+    glw_t *w = lw->lw_active[i];
+    LIST_REMOVE(w, glw_active_link);
+    LIST_INSERT_HEAD(&gr->gr_active_list, w, glw_active_link);
+  }
+  lw->lw_num_active = 0;
+
+  if(lw->lw_num_deferred == 0)
+    return;
+
+  // Laying out deferred widgets may start new batches which will
+  // reuse this worker, so detach the vector first
+
+  glw_layout_item_t *items = lw->lw_deferred;
+  const int num_items = lw->lw_num_deferred;
+
+  lw->lw_deferred = NULL;
+  lw->lw_num_deferred = 0;
+  lw->lw_deferred_capacity = 0;
+
+  for(int i = 0; i < num_items; i++) {
+    // Retained renders of ancestors were already checked on the worker
+    const int serial = atomic_get(&gr->gr_render_serial);
+    glw_layout0(items[i].gli_widget, &items[i].gli_rc);
+    if(atomic_get(&gr->gr_render_serial) != serial)
+      glw_retained_invalidate_parents(items[i].gli_widget);
+  }
+
+  free(items);
+}
+
+
+/**
+ *
+ */
+void
+glw_layout_batch_init(glw_layout_batch_t *glb, glw_root_t *gr,
+                      const glw_rctx_t *rc)
+{
+  memset(glb, 0, sizeof(glw_layout_batch_t));
+  glb->glb_enabled = gr->gr_layout_pool != NULL &&
+    rc->rc_layout_worker == NULL;
+}
+
+
+/**
+ *
+ */
+void
+glw_layout_batch_add(glw_layout_batch_t *glb, glw_t *w,
+                     const glw_rctx_t *rc)
+{
+  if(!glb->glb_enabled) {
+    glw_layout0(w, rc);
+    return;
+  }
+
+  if(glb->glb_num_items == glb->glb_capacity) {
+    glb->glb_capacity = 2 * glb->glb_capacity + 16;
+    glb->glb_items = realloc(glb->glb_items,
+                             glb->glb_capacity * sizeof(glw_layout_item_t));
+  }
+
+  glw_layout_item_t *gli = &glb->glb_items[glb->glb_num_items++];
+  gli->gli_widget = w;
+  gli->gli_rc = *rc;
+}
+
+
+/**
+ *
+ */
+void
+glw_layout_batch_run(glw_layout_batch_t *glb, glw_root_t *gr)
+{
+  glw_layout_pool_t *lp = gr->gr_layout_pool;
+  const int num_items = glb->glb_num_items;
+
+  if(num_items < GLW_LAYOUT_MIN_PARALLEL) {
+    for(int i = 0; i < num_items; i++)
+      glw_layout0(glb->glb_items[i].gli_widget, &glb->glb_items[i].gli_rc);
+    free(glb->glb_items);
+    return;
+  }
+
+  hts_mutex_lock(&lp->lp_mutex);
+  lp->lp_items = glb->glb_items;
+  lp->lp_num_items = num_items;
+  atomic_set(&lp->lp_next_item, 0);
+  lp->lp_busy = lp->lp_num_threads;
+  lp->lp_generation++;
+  hts_cond_broadcast(&lp->lp_work_cond);
+  hts_mutex_unlock(&lp->lp_mutex);
+
+  // Last worker slot belongs to the UI thread
+  glw_layout_worker_drain(lp, &lp->lp_workers[lp->lp_num_threads]);
+
+  hts_mutex_lock(&lp->lp_mutex);
+  while(lp->lp_busy)
+    hts_cond_wait(&lp->lp_done_cond, &lp->lp_mutex);
+  lp->lp_items = NULL;
+  lp->lp_num_items = 0;
+  hts_mutex_unlock(&lp->lp_mutex);
+
+  gr->gr_stats_layout_items += num_items;
+
+  for(int i = 0; i <= lp->lp_num_threads; i++)
+    glw_layout_worker_finish(gr, &lp->lp_workers[i]);
+
+  free(glb->glb_items);
+}
+
+
+/**
+ *
+ */
+void
+glw_layout_pool_init(glw_root_t *gr)
+{
+  const int num_threads = MIN(gconf.glw_layout_threads,
+                              GLW_LAYOUT_MAX_THREADS);
+  if(num_threads <= 0)
+    return;
+
+  glw_layout_pool_t *lp = calloc(1, sizeof(glw_layout_pool_t));
+  hts_mutex_init(&lp->lp_mutex);
+  hts_cond_init(&lp->lp_work_cond, &lp->lp_mutex);
+  hts_cond_init(&lp->lp_done_cond, &lp->lp_mutex);
+  lp->lp_run = 1;
+  lp->lp_num_threads = num_threads;
+
+  for(int i = 0; i <= num_threads; i++)
+    lp->lp_workers[i].lw_pool = lp;
+
+  for(int i = 0; i < num_threads; i++)
+    hts_thread_create_joinable("GLW layout", &lp->lp_workers[i].lw_thread,
+                               glw_layout_worker_thread, &lp->lp_workers[i],
+                               THREAD_PRIO_UI_WORKER_HIGH);
+
+  gr->gr_layout_pool = lp;
+  TRACE(TRACE_DEBUG, "GLW", "Parallel layout using %d worker threads",
+        num_threads);
+}
+
+
+/**
+ *
+ */
+void
+glw_layout_pool_fini(glw_root_t *gr)
+{
+  glw_layout_pool_t *lp = gr->gr_layout_pool;
+  if(lp == NULL)
+    return;
+
+  hts_mutex_lock(&lp->lp_mutex);
+  lp->lp_run = 0;
+  hts_cond_broadcast(&lp->lp_work_cond);
+  hts_mutex_unlock(&lp->lp_mutex);
+
+  for(int i = 0; i < lp->lp_num_threads; i++)
+    hts_thread_join(&lp->lp_workers[i].lw_thread);
+
+  for(int i = 0; i <= lp->lp_num_threads; i++) {
+    free(lp->lp_workers[i].lw_deferred);
+    free(lp->lp_workers[i].lw_active);
+  }
+
+  hts_cond_destroy(&lp->lp_work_cond);
+  hts_cond_destroy(&lp->lp_done_cond);
+  hts_mutex_destroy(&lp->lp_mutex);
+  free(lp);
+  gr->gr_layout_pool = NULL;
+}
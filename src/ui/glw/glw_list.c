@@ -109,6 +109,9 @@ glw_list_layout_y(glw_t *w, const glw_rctx_t *rc)
 
   glw_scroll_layout(&l->gsc, w, rc->rc_height);
 
+  glw_layout_batch_t glb;
+  glw_layout_batch_init(&glb, w->glw_root, rc);
+
   ypos = l->gsc.scroll_threshold_pre;
   TAILQ_FOREACH(c, &w->glw_childs, glw_parent_link) {
     if(c->glw_flags & GLW_HIDDEN)
@@ -135,12 +138,14 @@ glw_list_layout_y(glw_t *w, const glw_rctx_t *rc)
 
     if(ypos - l->gsc.rounded_pos > -rc->rc_height &&
        ypos - l->gsc.rounded_pos <  rc->rc_height * 2)
-      glw_layout0(c, &rc0);
+      glw_layout_batch_add(&glb, c, &rc0);
 
     ypos += rc0.rc_height;
     ypos += l->spacing;
   }
 
+  glw_layout_batch_run(&glb, w->glw_root);
+
   if(l->gsc.total_size != ypos) {
     l->gsc.total_size = ypos;
     l->w.glw_flags |= GLW_UPDATE_METRICS;
@@ -189,6 +194,9 @@ glw_list_layout_x(glw_t *w, const glw_rctx_t *rc)
 
   l->gsc.rounded_pos = l->gsc.filtered_pos;
 
+  glw_layout_batch_t glb;
+  glw_layout_batch_init(&glb, w->glw_root, rc);
+
   TAILQ_FOREACH(c, &w->glw_childs, glw_parent_link) {
     if(c->glw_flags & GLW_HIDDEN)
       continue;
@@ -208,7 +216,7 @@ glw_list_layout_x(glw_t *w, const glw_rctx_t *rc)
 
     if(xpos - l->gsc.rounded_pos > -width0 &&
        xpos - l->gsc.rounded_pos <  width0 * 2) {
-      glw_layout0(c, &rc0);
+      glw_layout_batch_add(&glb, c, &rc0);
     }
 
     if(c == l->gsc.scroll_to_me) {
@@ -228,6 +236,8 @@ glw_list_layout_x(glw_t *w, const glw_rctx_t *rc)
     xpos += l->spacing;
   }
 
+  glw_layout_batch_run(&glb, w->glw_root);
+
   xpos += l->gsc.scroll_threshold_post;
 
   if(l->gsc.total_size != xpos) {
@@ -283,7 +293,7 @@ glw_list_y_render_one(glw_list_t *l, glw_t *c, int width, int height,
                  width,
                  height - cd->pos - cd->height);
 
-  glw_render0(c, &rc2);
+  glw_render_retained(c, &rc2);
 
   if(ct != -1)
     glw_clip_disable(gr, ct);
@@ -400,7 +410,7 @@ glw_list_render_x(glw_t *w, const glw_rctx_t *rc)
 		   cd->pos + cd->width,
 		   0);
     
-    glw_render0(c, &rc2);
+    glw_render_retained(c, &rc2);
 
     if(lc != -1)
       glw_clip_disable(w->glw_root, lc);
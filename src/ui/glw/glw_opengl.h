@@ -132,6 +132,8 @@ typedef struct glw_backend_root {
 
   GLuint gbr_vbo;
 
+  int gbr_persistent_pbo; // Video frames via persistently mapped PBOs
+
 #if ENABLE_VDPAU
 
   PFNGLVDPAUUNREGISTERSURFACENVPROC     gbr_glVDPAUUnregisterSurfaceNV;
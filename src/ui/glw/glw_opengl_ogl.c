@@ -17,6 +17,8 @@
  *  This program is also available under a commercial proprietary license.
  *  For more information, contact andreas@lonelycoder.com
  */
+#include <string.h>
+
 #include "glw.h"
 
 
@@ -151,6 +153,17 @@ glw_opengl_init_context(glw_root_t *gr)
   const char *renderer = (const char *)glGetString(GL_RENDERER);
   TRACE(TRACE_INFO, "GLW", "OpenGL Renderer: '%s' by '%s'", renderer, vendor);
 
+#ifdef GL_MAP_PERSISTENT_BIT
+  const char *ext = (const char *)glGetString(GL_EXTENSIONS);
+  if(ext != NULL && !gconf.disable_persistent_pbo &&
+     strstr(ext, "GL_ARB_buffer_storage") != NULL &&
+     strstr(ext, "GL_ARB_sync") != NULL) {
+    gr->gr_be.gbr_persistent_pbo = 1;
+    TRACE(TRACE_DEBUG, "GLW",
+          "Using persistently mapped buffers for video upload");
+  }
+#endif
+
   gr->gr_br_read_pixels = opengl_read_pixels;
 
   return glw_opengl_shaders_init(gr);
@@ -348,9 +348,10 @@ render_unlocked(glw_root_t *gr)
 
   int t = avg/16;
 
-  printf("tt:%-5d  jobs:%-4d vertices:%-4d ps:%-3d uniforms:%-4d (%-4d) tpv:%2.2f\n",
+  printf("tt:%-5d  jobs:%-4d draws:%-4d vertices:%-4d ps:%-3d uniforms:%-4d (%-4d) tpv:%2.2f\n",
          t,
-         gr->gr_num_render_jobs,
+         gr->gr_stats_jobs_in,
+         gr->gr_stats_draws_out,
          gr->gr_vertex_offset,
          rs.program_switches,
          uni_calls,
@@ -20,6 +20,16 @@
 #include "glw.h"
 #include "glw_renderer.h"
 
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#define GLW_RENDERER_SSE 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GLW_RENDERER_NEON 1
+#endif
+
+static int glw_renderer_simd = 1; // Only cleared by glw_renderer_bench()
+
 static const glw_rgb_t white = {.r = 1,.g = 1,.b = 1};
 
 
@@ -772,6 +782,128 @@ stenciler(glw_root_t *gr, glw_renderer_cache_t *grc,
 #endif
 
 
+/**
+ * Transform the position of all vertices in a renderer.
+ *
+ * Output is packed as four floats per vertex. Like glw_pmtx_mul_vec4_i()
+ * the fourth component (sharpness) is passed through untouched.
+ */
+static void
+xform_vertices_c(float *dst, const Mtx *m, const float *src, int num)
+{
+  PMtx pmtx;
+  glw_pmtx_mul_prepare(&pmtx, m);
+
+  for(int i = 0; i < num; i++)
+    glw_pmtx_mul_vec4_i(dst + i * 4, &pmtx, src + i * VERTEX_SIZE);
+}
+
+
+/**
+ *
+ */
+static void
+xform_vertices(float *dst, const Mtx *m, const float *src, int num)
+{
+#if defined(GLW_RENDERER_SSE)
+  if(glw_renderer_simd) {
+    const __m128 r0 = _mm_loadu_ps(m->r[0]);
+    const __m128 r1 = _mm_loadu_ps(m->r[1]);
+    const __m128 r2 = _mm_loadu_ps(m->r[2]);
+    const __m128 r3 = _mm_loadu_ps(m->r[3]);
+
+    for(int i = 0; i < num; i++) {
+      const float *v = src + i * VERTEX_SIZE;
+      __m128 o = _mm_mul_ps(r0, _mm_set1_ps(v[0]));
+      o = _mm_add_ps(o, _mm_mul_ps(r1, _mm_set1_ps(v[1])));
+      o = _mm_add_ps(o, _mm_mul_ps(r2, _mm_set1_ps(v[2])));
+      o = _mm_add_ps(o, r3);
+      _mm_storeu_ps(dst + i * 4, o);
+      dst[i * 4 + 3] = v[3];
+    }
+    return;
+  }
+#elif defined(GLW_RENDERER_NEON)
+  if(glw_renderer_simd) {
+    const float32x4_t r0 = vld1q_f32(m->r[0]);
+    const float32x4_t r1 = vld1q_f32(m->r[1]);
+    const float32x4_t r2 = vld1q_f32(m->r[2]);
+    const float32x4_t r3 = vld1q_f32(m->r[3]);
+
+    for(int i = 0; i < num; i++) {
+      const float *v = src + i * VERTEX_SIZE;
+      float32x4_t o = vmulq_n_f32(r0, v[0]);
+      o = vaddq_f32(o, vmulq_n_f32(r1, v[1]));
+      o = vaddq_f32(o, vmulq_n_f32(r2, v[2]));
+      o = vaddq_f32(o, r3);
+      vst1q_f32(dst + i * 4, vsetq_lane_f32(v[3], o, 3));
+    }
+    return;
+  }
+#endif
+  xform_vertices_c(dst, m, src, num);
+}
+
+
+/**
+ * Distance from a plane for vertices transformed by xform_vertices().
+ * 'num' must be a multiple of four
+ */
+static void
+plane_distances_c(float *dst, const float *v, int num, const Vec4 plane)
+{
+  for(int i = 0; i < num; i++)
+    dst[i] = glw_vec34_dot(v + i * 4, plane);
+}
+
+
+/**
+ *
+ */
+static void
+plane_distances(float *dst, const float *v, int num, const Vec4 plane)
+{
+#if defined(GLW_RENDERER_SSE)
+  if(glw_renderer_simd) {
+    const __m128 px = _mm_set1_ps(plane[0]);
+    const __m128 py = _mm_set1_ps(plane[1]);
+    const __m128 pz = _mm_set1_ps(plane[2]);
+    const __m128 pw = _mm_set1_ps(plane[3]);
+
+    for(int i = 0; i < num; i += 4) {
+      __m128 x = _mm_loadu_ps(v + i * 4);
+      __m128 y = _mm_loadu_ps(v + i * 4 + 4);
+      __m128 z = _mm_loadu_ps(v + i * 4 + 8);
+      __m128 w = _mm_loadu_ps(v + i * 4 + 12);
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+
+      __m128 d = _mm_mul_ps(x, px);
+      d = _mm_add_ps(d, _mm_mul_ps(y, py));
+      d = _mm_add_ps(d, _mm_mul_ps(z, pz));
+      d = _mm_add_ps(d, pw);
+      _mm_storeu_ps(dst + i, d);
+    }
+    return;
+  }
+#elif defined(GLW_RENDERER_NEON)
+  if(glw_renderer_simd) {
+    const float32x4_t pw = vdupq_n_f32(plane[3]);
+
+    for(int i = 0; i < num; i += 4) {
+      const float32x4x4_t xyzw = vld4q_f32(v + i * 4);
+      float32x4_t d = vmulq_n_f32(xyzw.val[0], plane[0]);
+      d = vaddq_f32(d, vmulq_n_f32(xyzw.val[1], plane[1]));
+      d = vaddq_f32(d, vmulq_n_f32(xyzw.val[2], plane[2]));
+      d = vaddq_f32(d, pw);
+      vst1q_f32(dst + i, d);
+    }
+    return;
+  }
+#endif
+  plane_distances_c(dst, v, num, plane);
+}
+
+
 /**
  *
  */
@@ -782,7 +914,6 @@ glw_renderer_tesselate(glw_renderer_t *gr, glw_root_t *root,
   int i;
   uint16_t *ip = gr->gr_indices;
   const float *a = gr->gr_vertices;
-  PMtx pmtx;
 
   root->gr_vtmp_cur = 0;
 
@@ -824,18 +955,42 @@ glw_renderer_tesselate(glw_renderer_t *gr, glw_root_t *root,
   }
 #endif
 
-  glw_pmtx_mul_prepare(&pmtx, &rc->rc_mtx);
+  /*
+   * Transform each vertex once and compute its distance to all active
+   * clip planes up front. Triangles that are on the inside of every
+   * plane (which is most of them) skip the recursive clipper entirely
+   * and triangles that are fully clipped away are dropped right here.
+   * The kernels use the same operation order as the scalar code so the
+   * outcome is identical to clipping every triangle.
+   */
+  const int nv = (gr->gr_num_vertices + 3) & ~3;
+  const int tess_size = nv * (4 + NUM_CLIPPLANES);
+
+  if(root->gr_tess_capacity < tess_size) {
+    root->gr_tess_capacity = tess_size * 2;
+    root->gr_tess_buffer = realloc(root->gr_tess_buffer,
+                                   root->gr_tess_capacity * sizeof(float));
+  }
+
+  float *xv = root->gr_tess_buffer;
+  float *dist = xv + nv * 4;
+
+  xform_vertices(xv, &rc->rc_mtx, a, gr->gr_num_vertices);
+  memset(xv + gr->gr_num_vertices * 4, 0,
+         (nv - gr->gr_num_vertices) * 4 * sizeof(float));
+
+  for(i = 0; i < NUM_CLIPPLANES; i++)
+    if((1 << i) & grc->grc_active_clippers)
+      plane_distances(dist + i * nv, xv, nv, grc->grc_clip[i]);
 
   for(i = 0; i < gr->gr_num_triangles; i++) {
     int v1 = *ip++;
     int v2 = *ip++;
     int v3 = *ip++;
 
-    Vec4 V1, V2, V3;
-
-    glw_pmtx_mul_vec4_i(V1, &pmtx, glw_vec4_get(a + v1*VERTEX_SIZE));
-    glw_pmtx_mul_vec4_i(V2, &pmtx, glw_vec4_get(a + v2*VERTEX_SIZE));
-    glw_pmtx_mul_vec4_i(V3, &pmtx, glw_vec4_get(a + v3*VERTEX_SIZE));
+    const float *V1 = xv + v1 * 4;
+    const float *V2 = xv + v2 * 4;
+    const float *V3 = xv + v3 * 4;
 
 #if NUM_STENCILERS > 0
     stenciler(root, grc,
@@ -848,6 +1003,27 @@ glw_renderer_tesselate(glw_renderer_t *gr, glw_root_t *root,
 	      glw_vec4_get(a + v3 * VERTEX_SIZE + 8),
 	      0);
 #else
+    int inside = 1;
+    int plane;
+
+    for(plane = 0; plane < NUM_CLIPPLANES; plane++) {
+      if(!((1 << plane) & grc->grc_active_clippers))
+        continue;
+
+      const float *d = dist + plane * nv;
+      if(d[v1] >= 0 && d[v2] >= 0 && d[v3] >= 0)
+        continue;
+
+      if(d[v1] < 0 && d[v2] < 0 && d[v3] < 0 &&
+         root->gr_clip_alpha_out[plane] < GLW_ALPHA_EPSILON)
+        break;
+
+      inside = 0;
+    }
+
+    if(plane < NUM_CLIPPLANES)
+      continue; // Entirely outside a plane that does not let anything thru
+
     clipper(root, grc, V1, V2, V3,
             glw_vec4_get(a + v1 * VERTEX_SIZE + 4),
             glw_vec4_get(a + v2 * VERTEX_SIZE + 4),
@@ -855,7 +1031,7 @@ glw_renderer_tesselate(glw_renderer_t *gr, glw_root_t *root,
             glw_vec4_get(a + v1 * VERTEX_SIZE + 8),
             glw_vec4_get(a + v2 * VERTEX_SIZE + 8),
             glw_vec4_get(a + v3 * VERTEX_SIZE + 8),
-            0);
+            inside ? NUM_CLIPPLANES : 0);
 #endif
   }
 
@@ -871,6 +1047,85 @@ glw_renderer_tesselate(glw_renderer_t *gr, glw_root_t *root,
 }
 
 
+/**
+ * Tesselate a synthetic frame of 'num_quads' quads spread over a
+ * scrolling list with two clip planes active and compare the SIMD
+ * kernels with the scalar ones
+ */
+void
+glw_renderer_bench(int num_quads)
+{
+  glw_root_t *root = calloc(1, sizeof(glw_root_t));
+  glw_renderer_t *r = calloc(num_quads, sizeof(glw_renderer_t));
+  glw_renderer_cache_t *c[2];
+  glw_rctx_t *rc = calloc(num_quads, sizeof(glw_rctx_t));
+  int64_t ts[2];
+  const int rounds = 20;
+  int i, j, k;
+
+  c[0] = calloc(num_quads, sizeof(glw_renderer_cache_t));
+  c[1] = calloc(num_quads, sizeof(glw_renderer_cache_t));
+
+  // Clip everything above y = 0.5 and below y = -0.5 in eye space
+  root->gr_active_clippers = 3;
+  memcpy(root->gr_clip[0], glw_vec4_make(0, -1, 0, 0.5), sizeof(Vec4));
+  memcpy(root->gr_clip[1], glw_vec4_make(0, 1, 0, 0.5), sizeof(Vec4));
+
+  for(i = 0; i < num_quads; i++) {
+    glw_renderer_init_quad(&r[i]);
+    glw_renderer_vtx_pos(&r[i], 0, -1, -1, 0);
+    glw_renderer_vtx_pos(&r[i], 1,  1, -1, 0);
+    glw_renderer_vtx_pos(&r[i], 2,  1,  1, 0);
+    glw_renderer_vtx_pos(&r[i], 3, -1,  1, 0);
+    glw_renderer_vtx_st(&r[i], 0, 0, 1);
+    glw_renderer_vtx_st(&r[i], 1, 1, 1);
+    glw_renderer_vtx_st(&r[i], 2, 1, 0);
+    glw_renderer_vtx_st(&r[i], 3, 0, 0);
+
+    glw_rctx_init(&rc[i], 100, 100, 0, NULL);
+    glw_Translatef(&rc[i], 0, 2.0f * i / num_quads - 1, 0);
+    glw_Scalef(&rc[i], 0.1, 1.0f / num_quads, 1);
+  }
+
+  for(k = 0; k < 2; k++) {
+    glw_renderer_simd = !k;
+    ts[k] = arch_get_ts();
+    for(j = 0; j < rounds; j++)
+      for(i = 0; i < num_quads; i++)
+        glw_renderer_tesselate(&r[i], root, &rc[i], &c[k][i]);
+    ts[k] = arch_get_ts() - ts[k];
+  }
+  glw_renderer_simd = 1;
+
+  int mismatch = 0, vertices = 0;
+  for(i = 0; i < num_quads; i++) {
+    vertices += c[0][i].grc_num_vertices;
+    if(c[0][i].grc_num_vertices != c[1][i].grc_num_vertices ||
+       memcmp(c[0][i].grc_vertices, c[1][i].grc_vertices,
+              c[0][i].grc_num_vertices * VERTEX_SIZE * sizeof(float)))
+      mismatch++;
+  }
+
+  printf("glw_renderer: %d quads, %d vertices out, %d mismatches\n",
+         num_quads, vertices, mismatch);
+  printf("glw_renderer: simd:%d us scalar:%d us per frame\n",
+         (int)(ts[0] / rounds), (int)(ts[1] / rounds));
+
+  for(i = 0; i < num_quads; i++) {
+    free(c[0][i].grc_vertices);
+    free(c[1][i].grc_vertices);
+    glw_renderer_free(&r[i]);
+  }
+  free(c[0]);
+  free(c[1]);
+  free(rc);
+  free(r);
+  free(root->gr_vtmp_buffer);
+  free(root->gr_tess_buffer);
+  free(root);
+}
+
+
 /**
  *
  */
@@ -961,33 +1216,19 @@ glw_renderer_get_cache(glw_root_t *root, glw_renderer_t *gr)
 
 
 /**
- *
+ * Make room for additional render jobs, indices and vertices
  */
-static void
-add_job(glw_root_t *gr,
-        const Mtx *m,
-        const struct glw_backend_texture *t0,
-        const struct glw_backend_texture *t1,
-        const struct glw_rgb *rgb_mul,
-        const struct glw_rgb *rgb_off,
-        float alpha, float blur,
-        const float *vertices,
-        int num_vertices,
-        const uint16_t *indices,
-        int num_indices,
-        int flags,
-        glw_program_args_t *gpa,
-        const glw_rctx_t *rc,
-        int16_t primitive_type,
-        int zoffset)
+void
+glw_renderer_reserve(glw_root_t *gr, int num_jobs, int num_vertices,
+                     int num_indices)
 {
-
-  if(gr->gr_num_render_jobs >= gr->gr_render_jobs_capacity) {
+  if(gr->gr_num_render_jobs + num_jobs > gr->gr_render_jobs_capacity) {
     // Need more space
     glw_render_job_t *old_jobs = gr->gr_render_jobs;
     int old_capacity = gr->gr_render_jobs_capacity;
 
-    gr->gr_render_jobs_capacity = 100 + gr->gr_render_jobs_capacity * 2;
+    gr->gr_render_jobs_capacity = 100 + num_jobs +
+      gr->gr_render_jobs_capacity * 2;
 
 
     gr->gr_render_jobs = realloc(gr->gr_render_jobs,
@@ -1003,9 +1244,53 @@ add_job(glw_root_t *gr,
     gr->gr_render_order = realloc(gr->gr_render_order,
                                   sizeof(glw_render_order_t) *
                                   gr->gr_render_jobs_capacity);
+  }
+
+  if(gr->gr_index_offset + num_indices > gr->gr_index_buffer_capacity) {
+    gr->gr_index_buffer_capacity = 100 + num_indices +
+      gr->gr_index_buffer_capacity * 2;
+
+    gr->gr_index_buffer = realloc(gr->gr_index_buffer,
+                                  sizeof(uint16_t) *
+                                  gr->gr_index_buffer_capacity);
+  }
 
+  if(gr->gr_vertex_offset + num_vertices > gr->gr_vertex_buffer_capacity) {
+    gr->gr_vertex_buffer_capacity = 100 + num_vertices +
+      gr->gr_vertex_buffer_capacity * 2;
 
+    gr->gr_vertex_buffer = realloc(gr->gr_vertex_buffer,
+				     sizeof(float) * VERTEX_SIZE *
+				     gr->gr_vertex_buffer_capacity);
   }
+}
+
+
+/**
+ *
+ */
+static void
+add_job(glw_root_t *gr,
+        const Mtx *m,
+        const struct glw_backend_texture *t0,
+        const struct glw_backend_texture *t1,
+        const struct glw_rgb *rgb_mul,
+        const struct glw_rgb *rgb_off,
+        float alpha, float blur,
+        const float *vertices,
+        int num_vertices,
+        const uint16_t *indices,
+        int num_indices,
+        int flags,
+        glw_program_args_t *gpa,
+        const glw_rctx_t *rc,
+        int16_t primitive_type,
+        int zoffset)
+{
+  if(indices == NULL)
+    num_indices = num_vertices;
+
+  glw_renderer_reserve(gr, 1, num_vertices, num_indices);
 
   struct glw_render_job   *rj = gr->gr_render_jobs  + gr->gr_num_render_jobs;
   struct glw_render_order *ro = gr->gr_render_order + gr->gr_num_render_jobs;
@@ -1056,17 +1341,6 @@ add_job(glw_root_t *gr,
 
 
   // -------- Copy indices ---------------
-  if(indices == NULL)
-    num_indices = num_vertices;
-
-  if(gr->gr_index_offset + num_indices > gr->gr_index_buffer_capacity) {
-    gr->gr_index_buffer_capacity = 100 + num_indices +
-      gr->gr_index_buffer_capacity * 2;
-
-    gr->gr_index_buffer = realloc(gr->gr_index_buffer,
-                                  sizeof(uint16_t) *
-                                  gr->gr_index_buffer_capacity);
-  }
 
   uint16_t *idst = gr->gr_index_buffer + gr->gr_index_offset;
 
@@ -1088,15 +1362,6 @@ add_job(glw_root_t *gr,
 
   // -------- Copy vertices ---------------
 
-  if(gr->gr_vertex_offset + num_vertices > gr->gr_vertex_buffer_capacity) {
-    gr->gr_vertex_buffer_capacity = 100 + num_vertices +
-      gr->gr_vertex_buffer_capacity * 2;
-
-    gr->gr_vertex_buffer = realloc(gr->gr_vertex_buffer,
-				     sizeof(float) * VERTEX_SIZE *
-				     gr->gr_vertex_buffer_capacity);
-  }
-
   float *vdst = gr->gr_vertex_buffer + gr->gr_vertex_offset * VERTEX_SIZE;
   memcpy(vdst, vertices, num_vertices * VERTEX_SIZE * sizeof(float));
 
@@ -1421,6 +1686,167 @@ render_order_cmp(const void *A, const void *B)
 }
 
 
+/**
+ * Indices are absolute offsets into the frame's vertex buffer and only
+ * 16 bit wide. Jobs with vertices past that are left alone
+ */
+static int
+render_job_indexable(const glw_render_job_t *rj)
+{
+  return rj->vertex_offset + rj->num_vertices <= UINT16_MAX + 1;
+}
+
+
+/**
+ * Return true if job 'b' can be drawn in the same draw call as job 'a'
+ *
+ * Jobs with custom programs (gpa) are never merged since their uniform
+ * loaders may depend on per-job state
+ */
+static int
+render_job_can_batch(const glw_render_order_t *a, const glw_render_order_t *b)
+{
+  const glw_render_job_t *aj = a->job;
+  const glw_render_job_t *bj = b->job;
+
+  return
+    a->zindex == b->zindex &&
+    bj->gpa == NULL &&
+    bj->num_vertices > 0 &&
+    render_job_indexable(bj) &&
+    bj->primitive_type == GLW_DRAW_TRIANGLES &&
+    aj->t0 == bj->t0 &&
+    aj->t1 == bj->t1 &&
+    aj->blur == bj->blur &&
+    aj->flags == bj->flags &&
+    aj->blendmode == bj->blendmode &&
+    aj->frontface == bj->frontface &&
+    glw_rgb_cmp(&aj->rgb_off, &bj->rgb_off);
+}
+
+
+/**
+ * Move the modelview matrix and color multiplier of a job into its
+ * (private) vertices so it can be drawn with identity state
+ */
+static void
+render_job_bake(glw_root_t *gr, const glw_render_job_t *rj)
+{
+  float *v = gr->gr_vertex_buffer + rj->vertex_offset * VERTEX_SIZE;
+  const float r = rj->rgb_mul.r;
+  const float g = rj->rgb_mul.g;
+  const float b = rj->rgb_mul.b;
+  const float a = rj->alpha;
+  const int colorize = r != 1.0f || g != 1.0f || b != 1.0f || a != 1.0f;
+  PMtx pmtx;
+
+  if(!rj->eyespace)
+    glw_pmtx_mul_prepare(&pmtx, &rj->m);
+
+  for(int i = 0; i < rj->num_vertices; i++, v += VERTEX_SIZE) {
+    if(!rj->eyespace) {
+      Vec4 V;
+      glw_pmtx_mul_vec4_i(V, &pmtx, glw_vec4_get(v));
+      glw_vec4_store(v, V);
+    }
+    if(colorize) {
+      v[4] *= r;
+      v[5] *= g;
+      v[6] *= b;
+      v[7] *= a;
+    }
+  }
+}
+
+
+/**
+ * Merge runs of consecutive (after sorting) jobs that share texture,
+ * program, blending and stencil state into a single draw call
+ *
+ * The index lists of the merged jobs are appended to the end of the
+ * index buffer and the render order is compacted in place
+ */
+static void
+glw_renderer_batch(glw_root_t *gr)
+{
+  const int num_jobs = gr->gr_num_render_jobs;
+  glw_render_order_t *order = gr->gr_render_order;
+  int w = 0;
+
+  // Each batch consumes at least two jobs so this is an upper bound
+  const int max_batches = num_jobs / 2;
+  if(max_batches > gr->gr_batch_jobs_capacity) {
+    // Safe to relocate, no render order entry points here yet this frame
+    gr->gr_batch_jobs_capacity = 32 + max_batches * 2;
+    gr->gr_batch_jobs = realloc(gr->gr_batch_jobs,
+                                sizeof(glw_render_job_t) *
+                                gr->gr_batch_jobs_capacity);
+  }
+  int num_batches = 0;
+
+  for(int r = 0; r < num_jobs;) {
+    const glw_render_order_t *first = order + r;
+    const glw_render_job_t *fj = first->job;
+    int num_indices = fj->num_indices;
+    int num_vertices = fj->num_vertices;
+    int e = r + 1;
+
+    if(fj->gpa == NULL && fj->num_vertices > 0 &&
+       render_job_indexable(fj) &&
+       fj->primitive_type == GLW_DRAW_TRIANGLES) {
+      while(e < num_jobs && render_job_can_batch(first, order + e) &&
+            num_indices + order[e].job->num_indices <= INT16_MAX &&
+            num_vertices + order[e].job->num_vertices <= INT16_MAX) {
+        num_indices  += order[e].job->num_indices;
+        num_vertices += order[e].job->num_vertices;
+        e++;
+      }
+    }
+
+    if(e - r == 1) {
+      order[w++] = order[r++];
+      continue;
+    }
+
+    glw_render_job_t *bj = gr->gr_batch_jobs + num_batches++;
+    *bj = *fj;
+    bj->eyespace = 1;
+    bj->rgb_mul.r = 1;
+    bj->rgb_mul.g = 1;
+    bj->rgb_mul.b = 1;
+    bj->alpha = 1;
+    bj->num_vertices = num_vertices;
+    bj->num_indices = num_indices;
+
+    if(gr->gr_index_offset + num_indices > gr->gr_index_buffer_capacity) {
+      gr->gr_index_buffer_capacity = 100 + num_indices +
+        gr->gr_index_buffer_capacity * 2;
+
+      gr->gr_index_buffer = realloc(gr->gr_index_buffer,
+                                    sizeof(uint16_t) *
+                                    gr->gr_index_buffer_capacity);
+    }
+
+    bj->index_offset = gr->gr_index_offset;
+
+    for(int i = r; i < e; i++) {
+      const glw_render_job_t *rj = order[i].job;
+      render_job_bake(gr, rj);
+      memcpy(gr->gr_index_buffer + gr->gr_index_offset,
+             gr->gr_index_buffer + rj->index_offset,
+             rj->num_indices * sizeof(uint16_t));
+      gr->gr_index_offset += rj->num_indices;
+    }
+
+    order[w].job = bj;
+    order[w].zindex = first->zindex;
+    w++;
+    r = e;
+  }
+  gr->gr_num_render_jobs = w;
+}
+
+
 /**
  *
  */
@@ -1435,5 +1861,12 @@ glw_renderer_render(glw_root_t *gr)
   qsort(gr->gr_render_order, gr->gr_num_render_jobs,
         sizeof(glw_render_order_t), render_order_cmp);
 
+  gr->gr_stats_jobs_in = gr->gr_num_render_jobs;
+
+  if(!gconf.disable_glw_batching)
+    glw_renderer_batch(gr);
+
+  gr->gr_stats_draws_out = gr->gr_num_render_jobs;
+
   gr->gr_be_render_unlocked(gr);
 }
@@ -156,6 +156,9 @@ int glw_renderer_initialized(glw_renderer_t *gr);
 
 void glw_renderer_free(glw_renderer_t *gr);
 
+void glw_renderer_reserve(struct glw_root *gr, int num_jobs, int num_vertices,
+                          int num_indices);
+
 void glw_renderer_vtx_pos(glw_renderer_t *gr, int vertex,
 			  float x, float y, float z);
 
@@ -0,0 +1,385 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+
+#include "main.h"
+#include "glw.h"
+#include "glw_renderer.h"
+#include "glw_glyph_atlas.h"
+
+/**
+ * Retained rendering
+ *
+ * Items in lists and grids are rendered via glw_render_retained() which
+ * records the render jobs, vertices and indices their subtree emits.
+ * Next frame the recording is appended to the render queue as is,
+ * instead of walking the subtree again, if all of the following holds:
+ *
+ *  - Nothing requested a render refresh while the subtree was laid out
+ *    this frame (or any frame since the recording was made).
+ *
+ *  - Nothing requested a render refresh outside of layout, ie. from
+ *    prop callbacks, events or during rendering. This is tracked
+ *    globally and drops every recording, so it's very conservative.
+ *
+ *  - Render context and clip planes are identical to when recorded.
+ *
+ *  - The subtree is not part of the focus, hover or pressed path as
+ *    the cursor focus tracker must see those when matrices are stored.
+ *
+ * Widget matrices stored while recording stay valid since they only
+ * depend on the render context.
+ */
+typedef struct glw_retained {
+  int glr_valid;
+  int glr_gen;
+  int glr_layout_frame;
+  int glr_atlas_gen;
+
+  glw_rctx_t glr_rc;
+  int glr_active_clippers;
+  Vec4 glr_clip[NUM_CLIPPLANES];
+  float glr_clip_alpha_out[NUM_CLIPPLANES];
+  float glr_clip_sharpness_out[NUM_CLIPPLANES];
+  int glr_blendmode;
+  int glr_frontface;
+
+  int glr_zmax;   // Highest zindex emitted, 0 if it didn't raise zmax
+
+  glw_render_job_t *glr_jobs;
+  int16_t *glr_zindex;
+  int glr_num_jobs;
+  int glr_jobs_capacity;
+
+  float *glr_vertices;
+  int glr_num_vertices;
+  int glr_vertices_capacity;
+
+  uint16_t *glr_indices;
+  int glr_num_indices;
+  int glr_indices_capacity;
+
+} glw_retained_t;
+
+
+/**
+ *
+ */
+static int
+glw_retained_rctx_cmp(const glw_rctx_t *a, const glw_rctx_t *b)
+{
+  return
+    memcmp(&a->rc_mtx, &b->rc_mtx, sizeof(Mtx))           ||
+    a->rc_alpha                 != b->rc_alpha                 ||
+    a->rc_sharpness             != b->rc_sharpness             ||
+    a->rc_width                 != b->rc_width                 ||
+    a->rc_height                != b->rc_height                ||
+    a->rc_zindex                != b->rc_zindex                ||
+    a->rc_layer                 != b->rc_layer                 ||
+    a->rc_inhibit_shadows       != b->rc_inhibit_shadows       ||
+    a->rc_inhibit_matrix_store  != b->rc_inhibit_matrix_store  ||
+    a->rc_overscanning          != b->rc_overscanning          ||
+    a->rc_invisible             != b->rc_invisible             ||
+    a->rc_preloaded             != b->rc_preloaded             ||
+    a->rc_segwayed              != b->rc_segwayed;
+}
+
+
+/**
+ *
+ */
+static int
+glw_retained_clippers_cmp(const glw_retained_t *glr, const glw_root_t *gr)
+{
+  if(glr->glr_active_clippers != gr->gr_active_clippers)
+    return 1;
+
+  for(int i = 0; i < NUM_CLIPPLANES; i++) {
+    if(!((1 << i) & gr->gr_active_clippers))
+      continue;
+
+    if(memcmp(&glr->glr_clip[i], &gr->gr_clip[i], sizeof(Vec4)) ||
+       glr->glr_clip_alpha_out[i] != gr->gr_clip_alpha_out[i] ||
+       glr->glr_clip_sharpness_out[i] != gr->gr_clip_sharpness_out[i])
+      return 1;
+  }
+  return 0;
+}
+
+
+/**
+ * Stencils and faders are rare enough that we don't bother
+ */
+static int
+glw_retained_can_record(const glw_root_t *gr)
+{
+#if NUM_STENCILERS > 0
+  if(gr->gr_stencil_width)
+    return 0;
+#endif
+#if NUM_FADERS > 0
+  if(gr->gr_active_faders)
+    return 0;
+#endif
+  return 1;
+}
+
+
+/**
+ *
+ */
+static int
+glw_retained_can_replay(const glw_retained_t *glr, const glw_t *w,
+                        const glw_rctx_t *rc)
+{
+  glw_root_t *gr = w->glw_root;
+
+  return glr->glr_valid &&
+    glr->glr_gen == gr->gr_retained_gen &&
+    glr->glr_layout_frame == gr->gr_frames &&
+    glr->glr_blendmode == gr->gr_blendmode &&
+    glr->glr_frontface == gr->gr_frontface &&
+    glr->glr_atlas_gen == glw_glyph_atlas_generation(gr) &&
+    !glw_retained_clippers_cmp(glr, gr) &&
+    !glw_retained_rctx_cmp(&glr->glr_rc, rc);
+}
+
+
+/**
+ *
+ */
+static void
+glw_retained_record(glw_retained_t *glr, glw_root_t *gr, const glw_rctx_t *rc,
+                    int j0, int v0, int i0, int zmax0)
+{
+  const int num_jobs     = gr->gr_num_render_jobs - j0;
+  const int num_vertices = gr->gr_vertex_offset   - v0;
+  const int num_indices  = gr->gr_index_offset    - i0;
+
+  if(num_jobs > glr->glr_jobs_capacity) {
+    glr->glr_jobs_capacity = num_jobs;
+    glr->glr_jobs = realloc(glr->glr_jobs,
+                            num_jobs * sizeof(glw_render_job_t));
+    glr->glr_zindex = realloc(glr->glr_zindex, num_jobs * sizeof(int16_t));
+  }
+
+  if(num_vertices > glr->glr_vertices_capacity) {
+    glr->glr_vertices_capacity = num_vertices;
+    glr->glr_vertices = realloc(glr->glr_vertices,
+                                num_vertices * VERTEX_SIZE * sizeof(float));
+  }
+
+  if(num_indices > glr->glr_indices_capacity) {
+    glr->glr_indices_capacity = num_indices;
+    glr->glr_indices = realloc(glr->glr_indices,
+                               num_indices * sizeof(uint16_t));
+  }
+
+  // Render order is not sorted until the end of the frame so job N
+  // is still at position N
+
+  for(int i = 0; i < num_jobs; i++) {
+    glw_render_job_t *rj = &glr->glr_jobs[i];
+    *rj = gr->gr_render_jobs[j0 + i];
+    rj->vertex_offset -= v0;
+    rj->index_offset  -= i0;
+    glr->glr_zindex[i] = gr->gr_render_order[j0 + i].zindex;
+  }
+
+  memcpy(glr->glr_vertices, gr->gr_vertex_buffer + v0 * VERTEX_SIZE,
+         num_vertices * VERTEX_SIZE * sizeof(float));
+
+  const uint16_t *isrc = gr->gr_index_buffer + i0;
+  for(int i = 0; i < num_indices; i++)
+    glr->glr_indices[i] = isrc[i] - v0;
+
+  glr->glr_num_jobs     = num_jobs;
+  glr->glr_num_vertices = num_vertices;
+  glr->glr_num_indices  = num_indices;
+
+  glr->glr_zmax = *rc->rc_zmax > zmax0 ? *rc->rc_zmax : 0;
+
+  glr->glr_rc = *rc;
+  glr->glr_active_clippers = gr->gr_active_clippers;
+  for(int i = 0; i < NUM_CLIPPLANES; i++) {
+    if(!((1 << i) & gr->gr_active_clippers))
+      continue;
+    glw_vec4_copy(glr->glr_clip[i], gr->gr_clip[i]);
+    glr->glr_clip_alpha_out[i]     = gr->gr_clip_alpha_out[i];
+    glr->glr_clip_sharpness_out[i] = gr->gr_clip_sharpness_out[i];
+  }
+  glr->glr_blendmode = gr->gr_blendmode;
+  glr->glr_frontface = gr->gr_frontface;
+  glr->glr_atlas_gen = glw_glyph_atlas_generation(gr);
+  glr->glr_gen = gr->gr_retained_gen;
+  glr->glr_valid = 1;
+}
+
+
+/**
+ *
+ */
+static void
+glw_retained_replay(const glw_retained_t *glr, glw_root_t *gr,
+                    const glw_rctx_t *rc)
+{
+  glw_renderer_reserve(gr, glr->glr_num_jobs, glr->glr_num_vertices,
+                       glr->glr_num_indices);
+
+  const int v0 = gr->gr_vertex_offset;
+  const int i0 = gr->gr_index_offset;
+
+  for(int i = 0; i < glr->glr_num_jobs; i++) {
+    glw_render_job_t *rj = gr->gr_render_jobs + gr->gr_num_render_jobs;
+    glw_render_order_t *ro = gr->gr_render_order + gr->gr_num_render_jobs;
+    *rj = glr->glr_jobs[i];
+    rj->vertex_offset += v0;
+    rj->index_offset  += i0;
+    ro->job = rj;
+    ro->zindex = glr->glr_zindex[i];
+    gr->gr_num_render_jobs++;
+  }
+
+  memcpy(gr->gr_vertex_buffer + v0 * VERTEX_SIZE, glr->glr_vertices,
+         glr->glr_num_vertices * VERTEX_SIZE * sizeof(float));
+  gr->gr_vertex_offset += glr->glr_num_vertices;
+
+  uint16_t *idst = gr->gr_index_buffer + i0;
+  for(int i = 0; i < glr->glr_num_indices; i++)
+    idst[i] = glr->glr_indices[i] + v0;
+  gr->gr_index_offset += glr->glr_num_indices;
+
+  if(glr->glr_zmax)
+    *rc->rc_zmax = MAX(*rc->rc_zmax, glr->glr_zmax);
+
+  gr->gr_stats_retained++;
+}
+
+
+/**
+ *
+ */
+void
+glw_render_retained(glw_t *w, const glw_rctx_t *rc)
+{
+  glw_root_t *gr = w->glw_root;
+  glw_retained_t *glr = w->glw_retained;
+
+  if(!gconf.glw_retained_render) {
+    glw_render0(w, rc);
+    return;
+  }
+
+  if(glr == NULL)
+    glr = w->glw_retained = calloc(1, sizeof(glw_retained_t));
+
+  if(w->glw_flags & (GLW_IN_FOCUS_PATH | GLW_IN_HOVER_PATH |
+                     GLW_IN_PRESSED_PATH) ||
+     !glw_retained_can_record(gr)) {
+    glr->glr_valid = 0;
+    glw_render0(w, rc);
+    return;
+  }
+
+  if(glw_retained_can_replay(glr, w, rc)) {
+    glw_retained_replay(glr, gr, rc);
+    return;
+  }
+
+  const int j0 = gr->gr_num_render_jobs;
+  const int v0 = gr->gr_vertex_offset;
+  const int i0 = gr->gr_index_offset;
+  const int zmax0 = *rc->rc_zmax;
+
+  glw_render0(w, rc);
+
+  glw_retained_record(glr, gr, rc, j0, v0, i0, zmax0);
+}
+
+
+/**
+ * Called after a widget with a retained render has been laid out
+ */
+void
+glw_retained_layout_done(glw_t *w, int serial)
+{
+  glw_root_t *gr = w->glw_root;
+  glw_retained_t *glr = w->glw_retained;
+
+  glr->glr_layout_frame = gr->gr_frames;
+  if(atomic_get(&gr->gr_render_serial) != serial)
+    glr->glr_valid = 0;
+}
+
+
+/**
+ * Used when a widget was laid out after its parents were done
+ */
+void
+glw_retained_invalidate_parents(glw_t *w)
+{
+  for(; w != NULL; w = w->glw_parent)
+    if(w->glw_retained != NULL)
+      w->glw_retained->glr_valid = 0;
+}
+
+
+/**
+ *
+ */
+void
+glw_retained_frame_begin(glw_root_t *gr)
+{
+  // Anything asking for a redraw between frames (prop updates, events,
+  // during rendering, etc) might affect any widget
+
+  if(atomic_get(&gr->gr_render_serial) != gr->gr_retained_serial ||
+     !gconf.glw_retained_render)
+    gr->gr_retained_gen++;
+}
+
+
+/**
+ *
+ */
+void
+glw_retained_frame_end(glw_root_t *gr)
+{
+  gr->gr_retained_serial = atomic_get(&gr->gr_render_serial);
+}
+
+
+/**
+ *
+ */
+void
+glw_retained_free(glw_t *w)
+{
+  glw_retained_t *glr = w->glw_retained;
+  if(glr == NULL)
+    return;
+
+  free(glr->glr_jobs);
+  free(glr->glr_zindex);
+  free(glr->glr_vertices);
+  free(glr->glr_indices);
+  free(glr);
+  w->glw_retained = NULL;
+}
@@ -33,6 +33,7 @@
 #include "glw_texture.h"
 #include "glw_renderer.h"
 #include "glw_text_bitmap.h"
+#include "glw_glyph_atlas.h"
 #include "misc/str.h"
 #include "text/text.h"
 #include "event.h"
@@ -66,6 +67,9 @@ typedef struct glw_text_bitmap {
   glw_renderer_t gtb_text_renderer;
   glw_renderer_t gtb_cursor_renderer;
   glw_renderer_t gtb_background_renderer;
+  glw_renderer_t gtb_glyph_renderer;  // Quads sampling from glyph atlas
+
+  int gtb_glyph_generation;
 
 
   uint32_t *gtb_uc_buffer; /* unicode buffer */
@@ -112,6 +116,7 @@ typedef struct glw_text_bitmap {
   uint8_t gtb_need_layout : 1;
   uint8_t gtb_deferred_realize : 1;
   uint8_t gtb_caption_dirty : 1;
+  uint8_t gtb_no_atlas : 1;  // Glyphs did not fit in atlas, use bitmap
 
 } glw_text_bitmap_t;
 
@@ -122,6 +127,128 @@ static void gtb_caption_refresh(glw_text_bitmap_t *gtb);
 static glw_class_t glw_text, glw_label;
 
 
+/**
+ * Emit one textured quad per glyph, mapped the same way as the bitmap
+ * would have been. Everything outside text_width x text_height (in
+ * image pixels) is cut
+ *
+ * Returns the number of visible glyphs that could not be found in or
+ * added to the atlas
+ */
+static int
+gtb_layout_glyphs(glw_text_bitmap_t *gtb, const image_component_glyphs_t *igs,
+                  float x1, float y1, float x2, float y2,
+                  int text_width, int text_height)
+{
+  glw_root_t *gr = gtb->w.glw_root;
+  glw_renderer_t *r = &gtb->gtb_glyph_renderer;
+  const glw_glyph_atlas_entry_t **entries;
+  const int count = MIN(igs->igs_count, UINT16_MAX / 4);
+  const float as = 1.0f / GLW_GLYPH_ATLAS_SIZE;
+  int n = 0;
+  int missed = 0;
+
+  glw_renderer_free(r);
+  gtb->gtb_glyph_generation = glw_glyph_atlas_generation(gr);
+
+  if(text_width <= 0 || text_height <= 0 || count == 0)
+    return 0;
+
+  const float xs = (x2 - x1) / text_width;
+  const float ys = (y2 - y1) / text_height;
+
+  entries = malloc(count * sizeof(glw_glyph_atlas_entry_t *));
+
+  for(int i = 0; i < count; i++) {
+    const image_glyph_t *ig = &igs->igs_glyphs[i];
+    if(ig->ig_x >= text_width || ig->ig_y >= text_height) {
+      entries[i] = NULL;
+      continue;
+    }
+    entries[i] = glw_glyph_atlas_get(gr, ig);
+    if(entries[i] != NULL)
+      n++;
+    else
+      missed++;
+  }
+
+  if(n == 0) {
+    free(entries);
+    return missed;
+  }
+
+  glw_renderer_init(r, n * 4, n * 2, NULL);
+
+  int q = 0;
+  for(int i = 0; i < count; i++) {
+    const glw_glyph_atlas_entry_t *gae = entries[i];
+    if(gae == NULL)
+      continue;
+
+    const image_glyph_t *ig = &igs->igs_glyphs[i];
+
+    int gx1 = ig->ig_x;
+    int gy1 = ig->ig_y;
+    int gx2 = gx1 + gae->gae_width;
+    int gy2 = gy1 + gae->gae_height;
+    int s1 = gae->gae_x;
+    int t1 = gae->gae_y;
+    int s2 = s1 + gae->gae_width;
+    int t2 = t1 + gae->gae_height;
+
+    if(gx1 < 0) {
+      s1 -= gx1;
+      gx1 = 0;
+    }
+    if(gy1 < 0) {
+      t1 -= gy1;
+      gy1 = 0;
+    }
+    if(gx2 > text_width) {
+      s2 -= gx2 - text_width;
+      gx2 = text_width;
+    }
+    if(gy2 > text_height) {
+      t2 -= gy2 - text_height;
+      gy2 = text_height;
+    }
+
+    const float left   = x1 + gx1 * xs;
+    const float right  = x1 + gx2 * xs;
+    const float top    = y2 - gy1 * ys;
+    const float bottom = y2 - gy2 * ys;
+
+    const float cr = ( ig->ig_color        & 0xff) / 255.0f;
+    const float cg = ((ig->ig_color >> 8)  & 0xff) / 255.0f;
+    const float cb = ((ig->ig_color >> 16) & 0xff) / 255.0f;
+    const float ca = ((ig->ig_color >> 24) & 0xff) / 255.0f;
+
+    const int v = q * 4;
+
+    glw_renderer_vtx_pos(r, v + 0, left,  bottom, 0);
+    glw_renderer_vtx_st (r, v + 0, s1 * as, t2 * as);
+
+    glw_renderer_vtx_pos(r, v + 1, right, bottom, 0);
+    glw_renderer_vtx_st (r, v + 1, s2 * as, t2 * as);
+
+    glw_renderer_vtx_pos(r, v + 2, right, top, 0);
+    glw_renderer_vtx_st (r, v + 2, s2 * as, t1 * as);
+
+    glw_renderer_vtx_pos(r, v + 3, left,  top, 0);
+    glw_renderer_vtx_st (r, v + 3, s1 * as, t1 * as);
+
+    for(int j = 0; j < 4; j++)
+      glw_renderer_vtx_col(r, v + j, cr, cg, cb, ca);
+
+    glw_renderer_triangle(r, q * 2 + 0, v, v + 1, v + 2);
+    glw_renderer_triangle(r, q * 2 + 1, v, v + 2, v + 3);
+    q++;
+  }
+  free(entries);
+  return missed;
+}
+
+
 /**
  *
  */
@@ -161,8 +288,31 @@ glw_text_bitmap_layout(glw_t *w, const glw_rctx_t *rc)
     gtb->gtb_need_layout = 1;
   }
 
-  const int tex_width  = glw_tex_width(&gtb->gtb_texture);
-  const int tex_height = glw_tex_height(&gtb->gtb_texture);
+  ic = image_find_component(gtb->gtb_image, IMAGE_GLYPHS);
+  const image_component_glyphs_t *igs = ic ? &ic->glyphs : NULL;
+
+  if(igs != NULL) {
+    // Text is drawn from the glyph atlas
+    glw_tex_destroy(gr, &gtb->gtb_texture);
+    gtb->gtb_margin = gtb->gtb_image->im_margin;
+
+    if(gtb->gtb_glyph_generation != glw_glyph_atlas_generation(gr))
+      gtb->gtb_need_layout = 1;
+
+  } else if(gtb->gtb_no_atlas &&
+            gtb->gtb_glyph_generation != glw_glyph_atlas_generation(gr)) {
+    // Atlas has been cleared since we fell back to a bitmap, try again
+    gtb->gtb_no_atlas = 0;
+    if(gtb->gtb_state == GTB_VALID)
+      gtb->gtb_state = GTB_NEED_RENDER;
+    else
+      gtb->gtb_deferred_realize = 1;
+  }
+
+  const int tex_width  = igs ? gtb->gtb_image->im_width :
+    glw_tex_width(&gtb->gtb_texture);
+  const int tex_height = igs ? gtb->gtb_image->im_height :
+    glw_tex_height(&gtb->gtb_texture);
 
   ic = image_find_component(gtb->gtb_image, IMAGE_TEXT_INFO);
   image_component_text_info_t *ti = ic ? &ic->text_info : NULL;
@@ -327,6 +477,20 @@ glw_text_bitmap_layout(glw_t *w, const glw_rctx_t *rc)
 
     glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 3, x1, y2, 0.0);
     glw_renderer_vtx_st (&gtb->gtb_text_renderer, 3, 0, 0);
+
+    if(igs != NULL &&
+       gtb_layout_glyphs(gtb, igs, x1, y1, x2, y2, text_width, text_height)) {
+      /*
+       * Atlas is full (or glyph is too large). Render this text as a
+       * bitmap instead so it does not go missing and so we don't keep
+       * clearing and refilling the atlas every frame
+       */
+      gtb->gtb_no_atlas = 1;
+      if(gtb->gtb_state == GTB_VALID)
+        gtb->gtb_state = GTB_NEED_RENDER;
+      else
+        gtb->gtb_deferred_realize = 1;
+    }
   }
 
   if(w->glw_class == &glw_text && gtb->gtb_update_cursor) {
@@ -423,6 +587,11 @@ glw_text_bitmap_render(glw_t *w, const glw_rctx_t *rc)
     glw_renderer_draw(&gtb->gtb_text_renderer, w->glw_root, &rc0,
 		      &gtb->gtb_texture, NULL,
 		      &gtb->gtb_color, NULL, alpha, blur, NULL);
+  } else if(glw_renderer_initialized(&gtb->gtb_glyph_renderer) &&
+            image_find_component(gtb->gtb_image, IMAGE_GLYPHS) != NULL) {
+    glw_renderer_draw(&gtb->gtb_glyph_renderer, w->glw_root, &rc0,
+		      glw_glyph_atlas_texture(w->glw_root), NULL,
+		      &gtb->gtb_color, NULL, alpha, blur, NULL);
   }
 
   if(gtb->gtb_paint_cursor) {
@@ -460,6 +629,7 @@ glw_text_bitmap_dtor(glw_t *w)
   glw_renderer_free(&gtb->gtb_text_renderer);
   glw_renderer_free(&gtb->gtb_cursor_renderer);
   glw_renderer_free(&gtb->gtb_background_renderer);
+  glw_renderer_free(&gtb->gtb_glyph_renderer);
 
   switch(gtb->gtb_state) {
   case GTB_IDLE:
@@ -1220,6 +1390,9 @@ do_render(glw_text_bitmap_t *gtb, glw_root_t *gr, int no_output)
   if(gtb->w.glw_class == &glw_text)
     flags |= TR_RENDER_CHARACTER_POS;
 
+  if(gconf.glw_glyph_atlas && !gtb->gtb_no_atlas)
+    flags |= TR_RENDER_GLYPHS;
+
   tr_align = TR_ALIGN_JUSTIFIED;
 
   if(gtb->w.glw_flags2 & GLW2_SHADOW)
@@ -1293,6 +1466,7 @@ do_render(glw_text_bitmap_t *gtb, glw_root_t *gr, int no_output)
     image_release(gtb->gtb_image);
     gtb->gtb_image = im;
     gtb->gtb_update_cursor = 1;
+    gtb->gtb_need_layout = 1;
     if(im != NULL && gtb->gtb_maxlines > 1) {
       gtb_set_constraints(gr, gtb, im);
     }
@@ -79,6 +79,7 @@ typedef struct glw_loadable_texture {
   uint8_t glt_stash;
   uint8_t glt_origin_type;
   uint8_t glt_opaque;
+  uint8_t glt_downscaled; // Loaded at reduced size while over budget
 
   int glt_format;
   int glt_internal_format;
@@ -91,6 +92,8 @@ typedef struct glw_loadable_texture {
   int16_t glt_shadow;
 
   int glt_size;
+  int glt_resident;   // Bytes accounted in gr_tex_resident
+  int glt_last_used;  // gr_frames when last laid out
 
   float glt_intensity;
 
@@ -123,6 +126,8 @@ void glw_tex_autoflush(glw_root_t *gr);
 
 void glw_tex_flush_all(glw_root_t *gr);
 
+void glw_tex_enforce_budget(glw_root_t *gr);
+
 
 /**
  * Backend interface
@@ -140,6 +145,9 @@ void glw_tex_backend_layout(glw_root_t *gr, glw_loadable_texture_t *glt);
 void glw_tex_upload(glw_root_t *gr, glw_backend_texture_t *tex,
 		    const pixmap_t *pm, int flags);
 
+void glw_tex_upload_rows(glw_root_t *gr, glw_backend_texture_t *tex,
+                         const pixmap_t *pm, int y, int height);
+
 void glw_tex_destroy(glw_root_t *gr, glw_backend_texture_t *tex);
 
 #endif /* GLW_TEXTURE_H */
@@ -28,6 +28,12 @@
 
 #include "backend/backend.h"
 #include "fileaccess/fileaccess.h"
+#include "networking/http_server.h"
+
+static LIST_HEAD(, glw_root) glw_tex_roots;
+static hts_mutex_t glw_tex_roots_mutex;
+
+static void glt_enqueue(glw_root_t *gr, glw_loadable_texture_t *glt, int q);
 
 #if 0
 /**
@@ -59,6 +65,28 @@ glt_destroy(glw_loadable_texture_t *glt)
   free(glt);
 }
 
+/**
+ * Account for the bytes held by the render resources of a texture
+ */
+static void
+glt_set_resident(glw_root_t *gr, glw_loadable_texture_t *glt, int size)
+{
+  gr->gr_tex_resident += size - glt->glt_resident;
+  glt->glt_resident = size;
+}
+
+
+/**
+ *
+ */
+static void
+glt_free_render_resources(glw_root_t *gr, glw_loadable_texture_t *glt)
+{
+  glw_tex_backend_free_render_resources(gr, glt);
+  glt_set_resident(gr, glt, 0);
+}
+
+
 /**
  *
  */
@@ -69,33 +97,87 @@ glt_cancel(glw_loadable_texture_t *glt)
 }
 
 
+/**
+ * Evict the texture at the head (least recently used) of a stash
+ */
+static void
+glw_tex_evict_stashed(glw_root_t *gr, int stash)
+{
+  glw_loadable_texture_t *glt = TAILQ_FIRST(&gr->gr_tex_stash[stash].q);
+
+  assert(glt->glt_q == &gr->gr_tex_stash[stash].q);
+
+  TAILQ_REMOVE(glt->glt_q, glt, glt_work_link);
+  gr->gr_tex_stash[stash].size -= glt->glt_size;
+
+  glw_tex_backend_free_loader_resources(glt);
+  glt_free_render_resources(gr, glt);
+  glt_set_state(glt, GLT_STATE_INACTIVE);
+  if(glt->glt_refcnt == 0) {
+
+    if(glt->glt_url != NULL) {
+      rstr_release(glt->glt_url);
+      glt->glt_url = NULL;
+      LIST_REMOVE(glt, glt_global_link);
+    }
+    glt_destroy(glt);
+  }
+}
+
+
 /**
  *
  */
 static void
 glw_tex_purge_stash(glw_root_t *gr, int stash)
 {
-  while(gr->gr_tex_stash[stash].size > gr->gr_tex_stash[stash].limit) {
-    glw_loadable_texture_t *glt = TAILQ_FIRST(&gr->gr_tex_stash[stash].q);
-    if(glt == NULL)
-      break;
+  while(gr->gr_tex_stash[stash].size > gr->gr_tex_stash[stash].limit &&
+        TAILQ_FIRST(&gr->gr_tex_stash[stash].q) != NULL)
+    glw_tex_evict_stashed(gr, stash);
+}
 
-    assert(glt->glt_q == &gr->gr_tex_stash[stash].q);
 
-    TAILQ_REMOVE(glt->glt_q, glt, glt_work_link);
-    gr->gr_tex_stash[stash].size -= glt->glt_size;
+/**
+ * Keep resident texture memory within the configured budget by
+ * evicting stashed (ie, not laid out) textures, least recently used
+ * first across both stashes. Textures that are on screen are never
+ * evicted, if they alone exceed the budget we flag it so the loader
+ * holds back on revalidation and loads new textures downscaled.
+ * Once we are back within budget the downscaled ones are reloaded.
+ */
+void
+glw_tex_enforce_budget(glw_root_t *gr)
+{
+  const int64_t budget = (int64_t)gconf.glw_texture_budget * 1024 * 1024;
 
-    glw_tex_backend_free_loader_resources(glt);
-    glw_tex_backend_free_render_resources(gr, glt);
-    glt_set_state(glt, GLT_STATE_INACTIVE);
-    if(glt->glt_refcnt == 0) {
+  if(budget == 0) {
+    gr->gr_tex_over_budget = 0;
+    return;
+  }
 
-      if(glt->glt_url != NULL) {
-        rstr_release(glt->glt_url);
-        glt->glt_url = NULL;
-        LIST_REMOVE(glt, glt_global_link);
-      }
-      glt_destroy(glt);
+  while(gr->gr_tex_resident > budget) {
+    glw_loadable_texture_t *a = TAILQ_FIRST(&gr->gr_tex_stash[0].q);
+    glw_loadable_texture_t *b = TAILQ_FIRST(&gr->gr_tex_stash[1].q);
+
+    if(a == NULL && b == NULL)
+      break;
+
+    if(b == NULL || (a != NULL && a->glt_last_used <= b->glt_last_used))
+      glw_tex_evict_stashed(gr, 0);
+    else
+      glw_tex_evict_stashed(gr, 1);
+  }
+
+  int over = gr->gr_tex_resident > budget;
+  if(over != gr->gr_tex_over_budget) {
+    gr->gr_tex_over_budget = over;
+    if(!over) {
+      glw_loadable_texture_t *glt;
+      LIST_FOREACH(glt, &gr->gr_tex_list, glt_global_link)
+        if(glt->glt_downscaled && glt->glt_state == GLT_STATE_VALID)
+          glt_enqueue(gr, glt, LQ_REFRESH);
+
+      hts_cond_broadcast(&gr->gr_tex_load_cond);
     }
   }
 }
@@ -147,7 +229,7 @@ glw_tex_autoflush(glw_root_t *gr)
     switch(glt->glt_state) {
     case GLT_STATE_VALID:
       if(glw_tex_stash(gr, glt, 0)) {
-        glw_tex_backend_free_render_resources(gr, glt);
+        glt_free_render_resources(gr, glt);
         glt_set_state(glt, GLT_STATE_INACTIVE);
       }
       break;
@@ -175,6 +257,8 @@ glw_tex_autoflush(glw_root_t *gr)
 
   LIST_MOVE(&gr->gr_tex_flush_list, &gr->gr_tex_active_list, glt_flush_link);
   LIST_INIT(&gr->gr_tex_active_list);
+
+  glw_tex_enforce_budget(gr);
 }
 
 
@@ -196,11 +280,19 @@ loader_get_work(loaderaux_t *la)
   glw_root_t *gr = la->la_gr;
   int i;
   glw_loadable_texture_t *glt;
-  int last_queue = la->la_only_fast ? LQ_TENTATIVE : LQ_REFRESH;
-  
+  int last_queue;
+
   while(1) {
     if(gr->gr_tex_threads_running == 0)
       return NULL;
+
+    if(la->la_only_fast)
+      last_queue = LQ_TENTATIVE;
+    else if(gr->gr_tex_over_budget)
+      last_queue = LQ_OTHER; // Revalidation can wait until we have room
+    else
+      last_queue = LQ_REFRESH;
+
     for(i = 0; i <= last_queue; i++)
       if((glt = TAILQ_FIRST(&gr->gr_tex_load_queue[i])) != NULL)
 	return glt;
@@ -249,6 +341,7 @@ glt_incremental_update(void *opaque, pixmap_t *pm)
   glt->glt_intensity     = pm->pm_intensity;
 
   glt->glt_size          = glw_tex_backend_load(gr, glt, pm);
+  glt_set_resident(gr, glt, glt->glt_size);
   glw_need_refresh(gr, 0);
 
   glw_unlock(gr);
@@ -281,11 +374,24 @@ loader_thread(void *aux)
 
     if(glt->glt_refcnt > 1) {
       rstr_t *url = rstr_dup(glt->glt_url);
+      int downscaled = 0;
 
       im.im_req_width  = glt->glt_req_xs;
       im.im_req_height = glt->glt_req_ys;
       im.im_max_width  = gr->gr_width;
       im.im_max_height = gr->gr_height;
+
+      if(gr->gr_tex_over_budget &&
+         glt->glt_q != &gr->gr_tex_load_queue[LQ_SKIN]) {
+        // Out of texture memory, trade resolution for a quarter the size
+        im.im_max_width  /= 2;
+        im.im_max_height /= 2;
+        if(im.im_req_width > 0)
+          im.im_req_width = MAX(im.im_req_width / 2, 1);
+        if(im.im_req_height > 0)
+          im.im_req_height = MAX(im.im_req_height / 2, 1);
+        downscaled = 1;
+      }
       im.im_can_mono = 1;
       im.im_corner_radius = glt->glt_radius;
       im.im_force_local_load =
@@ -310,7 +416,8 @@ loader_thread(void *aux)
 	ccptr = &cache_control;
 
       } else if(glt->glt_q == &gr->gr_tex_load_queue[LQ_REFRESH]) {
-	ccptr = BYPASS_CACHE;
+        // A reload to restore full resolution can come from the cache
+	ccptr = glt->glt_downscaled && !downscaled ? NULL : BYPASS_CACHE;
       } else {
 	ccptr = NULL;
       }
@@ -412,6 +519,7 @@ loader_thread(void *aux)
             glt->glt_primary_color[1] = pm->pm_primary_color[1];
             glt->glt_primary_color[2] = pm->pm_primary_color[2];
             glt->glt_opaque = !!(pm->pm_flags & PIXMAP_OPAQUE);
+            glt->glt_downscaled = downscaled;
 
             if(gconf.enable_image_debug)
               TRACE(TRACE_DEBUG, "GLW",
@@ -420,6 +528,7 @@ loader_thread(void *aux)
 
 
 	    glt->glt_size          = glw_tex_backend_load(gr, glt, pm);
+            glt_set_resident(gr, glt, glt->glt_size);
 	    glw_need_refresh(gr, 0);
 	  }
 	}
@@ -471,6 +580,10 @@ glw_tex_init(glw_root_t *gr)
 
   for(i = 0; i < GLW_TEXTURE_THREADS; i++)
     spawn_loader(gr, i >= 4, i);
+
+  hts_mutex_lock(&glw_tex_roots_mutex);
+  LIST_INSERT_HEAD(&glw_tex_roots, gr, gr_tex_root_link);
+  hts_mutex_unlock(&glw_tex_roots_mutex);
 }
 
 
@@ -481,6 +594,11 @@ void
 glw_tex_fini(glw_root_t *gr)
 {
   int i;
+
+  hts_mutex_lock(&glw_tex_roots_mutex);
+  LIST_REMOVE(gr, gr_tex_root_link);
+  hts_mutex_unlock(&glw_tex_roots_mutex);
+
   glw_lock(gr);
   gr->gr_tex_threads_running = 0;
   hts_cond_broadcast(&gr->gr_tex_load_cond);
@@ -506,12 +624,12 @@ glw_tex_flush_all(glw_root_t *gr)
 
     case GLT_STATE_STASHED:
       glw_tex_unstash(gr, glt);
-      glw_tex_backend_free_render_resources(gr, glt);
+      glt_free_render_resources(gr, glt);
       break;
 
     case GLT_STATE_VALID:
       LIST_REMOVE(glt, glt_flush_link);
-      glw_tex_backend_free_render_resources(gr, glt);
+      glt_free_render_resources(gr, glt);
       break;
 
     case GLT_STATE_QUEUED:
@@ -555,7 +673,7 @@ glw_tex_purge(glw_root_t *gr)
 
   while((glt = TAILQ_FIRST(&gr->gr_tex_rel_queue)) != NULL) {
     TAILQ_REMOVE(&gr->gr_tex_rel_queue, glt, glt_work_link);
-    glw_tex_backend_free_render_resources(gr, glt);
+    glt_free_render_resources(gr, glt);
     glt_destroy(glt);
   }
 }
@@ -685,6 +803,8 @@ gl_tex_req_load(glw_root_t *gr, glw_loadable_texture_t *glt)
 void
 glw_tex_layout(glw_root_t *gr, glw_loadable_texture_t *glt)
 {
+  glt->glt_last_used = gr->gr_frames;
+
   if(glt->glt_pixmap != NULL)
     glw_tex_backend_layout(gr, glt);
 
@@ -696,6 +816,8 @@ glw_tex_layout(glw_root_t *gr, glw_loadable_texture_t *glt)
   case GLT_STATE_STASHED:
     glw_tex_unstash(gr, glt);
     glt_set_state(glt, GLT_STATE_VALID);
+    if(glt->glt_downscaled && !gr->gr_tex_over_budget)
+      glt_enqueue(gr, glt, LQ_REFRESH);
     break;
 
   case GLT_STATE_VALID:
@@ -713,3 +835,112 @@ glw_tex_layout(glw_root_t *gr, glw_loadable_texture_t *glt)
   }
   LIST_INSERT_HEAD(&gr->gr_tex_active_list, glt, glt_flush_link);
 }
+
+
+#if ENABLE_HTTPSERVER
+
+static const char *origin_names[] = {
+  [IMAGE_coded_none] = "Other",
+  [IMAGE_PNG]        = "PNG",
+  [IMAGE_JPEG]       = "JPEG",
+  [IMAGE_GIF]        = "GIF",
+  [IMAGE_SVG]        = "SVG",
+  [IMAGE_BMP]        = "BMP",
+};
+
+#define NUM_ORIGINS (sizeof(origin_names) / sizeof(origin_names[0]))
+
+/**
+ *
+ */
+static void
+dump_root(htsbuf_queue_t *out, glw_root_t *gr, int idx)
+{
+  int64_t active[NUM_ORIGINS] = {0};
+  int64_t stashed[NUM_ORIGINS] = {0};
+  int count[NUM_ORIGINS] = {0};
+  glw_loadable_texture_t *glt;
+
+  glw_lock(gr);
+
+  LIST_FOREACH(glt, &gr->gr_tex_list, glt_global_link) {
+    if(glt->glt_resident == 0)
+      continue;
+    int o = glt->glt_origin_type < NUM_ORIGINS ? glt->glt_origin_type : 0;
+    if(glt->glt_state == GLT_STATE_STASHED)
+      stashed[o] += glt->glt_resident;
+    else
+      active[o] += glt->glt_resident;
+    count[o]++;
+  }
+
+  htsbuf_qprintf(out, "UI #%d\n", idx);
+  htsbuf_qprintf(out, "  Resident: %"PRId64" kB, budget: ",
+                 gr->gr_tex_resident / 1024);
+  if(gconf.glw_texture_budget)
+    htsbuf_qprintf(out, "%d kB%s\n", gconf.glw_texture_budget * 1024,
+                   gr->gr_tex_over_budget ? " (exceeded)" : "");
+  else
+    htsbuf_qprintf(out, "unlimited\n");
+
+  htsbuf_qprintf(out, "  Stash: %d kB / %d kB (other), "
+                 "%d kB / %d kB (JPEG)\n",
+                 gr->gr_tex_stash[0].size / 1024,
+                 gr->gr_tex_stash[0].limit / 1024,
+                 gr->gr_tex_stash[1].size / 1024,
+                 gr->gr_tex_stash[1].limit / 1024);
+
+  htsbuf_qprintf(out, "  %-8s %8s %12s %12s\n",
+                 "Origin", "Textures", "Active kB", "Stashed kB");
+
+  for(int i = 0; i < NUM_ORIGINS; i++) {
+    if(count[i] == 0)
+      continue;
+    htsbuf_qprintf(out, "  %-8s %8d %12"PRId64" %12"PRId64"\n",
+                   origin_names[i], count[i],
+                   active[i] / 1024, stashed[i] / 1024);
+  }
+
+  glw_unlock(gr);
+}
+
+
+/**
+ *
+ */
+static int
+dumpstats(http_connection_t *hc, const char *remain, void *opaque,
+          http_cmd_t method)
+{
+  glw_root_t *gr;
+  int idx = 0;
+  htsbuf_queue_t out;
+  htsbuf_queue_init(&out, 0);
+
+  hts_mutex_lock(&glw_tex_roots_mutex);
+  LIST_FOREACH(gr, &glw_tex_roots, gr_tex_root_link)
+    dump_root(&out, gr, idx++);
+  hts_mutex_unlock(&glw_tex_roots_mutex);
+
+  htsbuf_qprintf(&out, "\n");
+
+  return http_send_reply(hc, 0,
+                         "text/plain; charset=utf-8", NULL, NULL, 0, &out);
+}
+
+#endif // ENABLE_HTTPSERVER
+
+
+/**
+ *
+ */
+static void
+glw_tex_stats_init(void)
+{
+  hts_mutex_init(&glw_tex_roots_mutex);
+#if ENABLE_HTTPSERVER
+  http_path_add("/api/glw/textures", NULL, dumpstats, 1);
+#endif
+}
+
+INITME(INIT_GROUP_GRAPHICS, glw_tex_stats_init, NULL, 0);
@@ -63,6 +63,8 @@ glw_tex_backend_layout(glw_root_t *gr, glw_loadable_texture_t *glt)
   if(glt->glt_pixmap == NULL)
     return;
 
+  const int64_t ts = arch_get_ts();
+
   if(glt->glt_texture.textures[0] == 0)
     glGenTextures(1, glt->glt_texture.textures);
 
@@ -108,6 +110,7 @@ glw_tex_backend_layout(glw_root_t *gr, glw_loadable_texture_t *glt)
   glBindTexture(m, 0);
 
   glw_tex_backend_free_loader_resources(glt);
+  gr->gr_stats_upload_time += arch_get_ts() - ts;
 }
 
 
@@ -176,6 +179,7 @@ glw_tex_upload(glw_root_t *gr, glw_backend_texture_t *tex,
 {
   int format, int_format;
   int m = GL_TEXTURE_2D;
+  const int64_t ts = arch_get_ts();
 
   if(tex->textures[0] == 0) {
     glGenTextures(1, tex->textures);
@@ -224,6 +228,41 @@ glw_tex_upload(glw_root_t *gr, glw_backend_texture_t *tex,
 
   glTexImage2D(m, 0, int_format, pm->pm_width, pm->pm_height,
 	       0, format, GL_UNSIGNED_BYTE, pm->pm_data);
+  gr->gr_stats_upload_time += arch_get_ts() - ts;
+}
+
+
+/**
+ * Update rows [y, y + height) of a texture previously uploaded from 'pm'
+ */
+void
+glw_tex_upload_rows(glw_root_t *gr, glw_backend_texture_t *tex,
+                    const pixmap_t *pm, int y, int height)
+{
+  int format;
+  const int64_t ts = arch_get_ts();
+
+  if(tex->textures[0] == 0 ||
+     tex->width != pm->pm_width || tex->height != pm->pm_height) {
+    glw_tex_upload(gr, tex, pm, 0);
+    return;
+  }
+
+  switch(pm->pm_type) {
+  case PIXMAP_IA:
+    format = GL_LUMINANCE_ALPHA;
+    break;
+
+  default:
+    glw_tex_upload(gr, tex, pm, 0);
+    return;
+  }
+
+  glBindTexture(GL_TEXTURE_2D, tex->textures[0]);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, pm->pm_width, height,
+                  format, GL_UNSIGNED_BYTE,
+                  pm->pm_data + y * pm->pm_linesize);
+  gr->gr_stats_upload_time += arch_get_ts() - ts;
 }
 
 
@@ -310,6 +310,18 @@ glw_tex_upload(glw_root_t *gr, glw_backend_texture_t *tex,
 }
 
 
+/**
+ * Partial updates are not worth the trouble here, textures live in
+ * RSX memory and are rewritten in full
+ */
+void
+glw_tex_upload_rows(glw_root_t *gr, glw_backend_texture_t *tex,
+                    const pixmap_t *pm, int y, int height)
+{
+  glw_tex_upload(gr, tex, pm, 0);
+}
+
+
 /**
  *
  */
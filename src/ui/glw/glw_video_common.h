@@ -74,6 +74,10 @@ typedef struct glw_video_surface {
 #if CONFIG_GLW_BACKEND_OPENGL
   GLuint gvs_pbo[3];
   int gvs_size[3];
+  int gvs_persistent;
+#ifdef GL_MAP_PERSISTENT_BIT
+  GLsync gvs_fence;   // Signalled when GPU is done reading the PBOs
+#endif
 #endif
 
 #if CONFIG_GLW_BACKEND_RSX
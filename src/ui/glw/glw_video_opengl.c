@@ -52,6 +52,9 @@ typedef struct reap_task {
   
   GLuint pbo[3];
   GLuint tex[3];
+#ifdef GL_MAP_PERSISTENT_BIT
+  GLsync fence;
+#endif
 
   int planes;
 
@@ -63,6 +66,10 @@ typedef struct reap_task {
 static void
 do_reap(glw_video_t *gv, reap_task_t *t)
 {
+#ifdef GL_MAP_PERSISTENT_BIT
+  if(t->fence != NULL)
+    glDeleteSync(t->fence);
+#endif
   for(int i = 0; i < t->planes; i++) {
     if(t->pbo[i] != 0) {
       glBindBuffer(GL_PIXEL_UNPACK_BUFFER, t->pbo[i]);
@@ -91,6 +98,9 @@ surface_reset(glw_video_t *gv, glw_video_surface_t *gvs)
     t->pbo[i] = gvs->gvs_pbo[i];
     t->tex[i] = gvs->gvs_texture.textures[i];
   }
+#ifdef GL_MAP_PERSISTENT_BIT
+  t->fence = gvs->gvs_fence;
+#endif
   memset(gvs, 0, sizeof(glw_video_surface_t));
 }
 
@@ -122,6 +132,14 @@ surface_init(glw_video_t *gv, glw_video_surface_t *gvs)
   if(!gvs->gvs_texture.textures[0])
     glGenTextures(gv->gv_planes, gvs->gvs_texture.textures);
 
+#ifdef GL_MAP_PERSISTENT_BIT
+  if(gvs->gvs_fence != NULL) {
+    glDeleteSync(gvs->gvs_fence);
+    gvs->gvs_fence = NULL;
+  }
+  gvs->gvs_persistent = gv->w.glw_root->gr_be.gbr_persistent_pbo;
+#endif
+
   gvs->gvs_uploaded = 0;
   for(i = 0; i < gv->gv_planes; i++) {
 
@@ -131,6 +149,24 @@ surface_init(glw_video_t *gv, glw_video_surface_t *gvs)
     assert(gvs->gvs_size[i] > 0);
 
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gvs->gvs_pbo[i]);
+
+#ifdef GL_MAP_PERSISTENT_BIT
+    if(gvs->gvs_persistent) {
+      /*
+       * Buffer stays mapped for its entire lifetime. The decoder writes
+       * straight into it and we only need to make sure the GPU is done
+       * with the previous frame (gvs_fence) before handing it out again
+       */
+      const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, gvs->gvs_size[i], NULL, flags);
+      gvs->gvs_data[i] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                          gvs->gvs_size[i], flags);
+      assert(gvs->gvs_data[i] != NULL);
+      continue;
+    }
+#endif
+
     glBufferData(GL_PIXEL_UNPACK_BUFFER,gvs->gvs_size[i], NULL, GL_STREAM_DRAW);
     gvs->gvs_data[i] = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
     assert(gvs->gvs_data[i] != NULL);
@@ -259,16 +295,23 @@ gv_surface_pixmap_upload(glw_video_surface_t *gvs,
 
   for(int i = 0; i < gv->gv_planes; i++) {
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gvs->gvs_pbo[i]);
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    if(!gvs->gvs_persistent)
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
     glBindTexture(GL_TEXTURE_2D, gv_tex_get(gvs, i));
     gv_set_tex_meta();
     glTexImage2D(GL_TEXTURE_2D, 0, gv->gv_tex_internal_format,
                  gvs->gvs_width[i], gvs->gvs_height[i],
                  0, gv->gv_tex_format, gv->gv_tex_type, NULL);
-    gvs->gvs_data[i] = NULL;
+    if(!gvs->gvs_persistent)
+      gvs->gvs_data[i] = NULL;
   }
 
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+#ifdef GL_MAP_PERSISTENT_BIT
+  if(gvs->gvs_persistent)
+    gvs->gvs_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
 }
 
 
@@ -286,7 +329,18 @@ gv_surface_pixmap_release(glw_video_t *gv, glw_video_surface_t *gvs,
 
   TAILQ_REMOVE(fromqueue, gvs, gvs_link);
 
-  if(gvs->gvs_uploaded) {
+  if(gvs->gvs_uploaded && gvs->gvs_persistent) {
+    gvs->gvs_uploaded = 0;
+#ifdef GL_MAP_PERSISTENT_BIT
+    if(gvs->gvs_fence != NULL) {
+      // Typically signalled long ago as the surface has been displayed
+      glClientWaitSync(gvs->gvs_fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                       100000000);
+      glDeleteSync(gvs->gvs_fence);
+      gvs->gvs_fence = NULL;
+    }
+#endif
+  } else if(gvs->gvs_uploaded) {
     gvs->gvs_uploaded = 0;
 
     for(i = 0; i < gv->gv_planes; i++) {
@@ -460,6 +514,29 @@ video_opengl_render(glw_video_t *gv, glw_rctx_t *rc)
 }
 
 
+/**
+ * Copy a plane into surface memory. If the source rows are laid out
+ * the same way as ours (common as decoders align their lines) it's
+ * done in one go. Returns number of bytes copied
+ */
+static int
+copy_plane(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_pitch,
+           int w, int h)
+{
+  if(src_pitch == dst_linesize && h > 0) {
+    memcpy(dst, src, dst_linesize * (h - 1) + w);
+    return dst_linesize * (h - 1) + w;
+  }
+
+  for(int y = 0; y < h; y++) {
+    memcpy(dst, src, w);
+    dst += dst_linesize;
+    src += src_pitch;
+  }
+  return w * h;
+}
+
+
 /**
  *
  */
@@ -477,9 +554,8 @@ static int
 yuvp_deliver(const frame_info_t *fi, glw_video_t *gv, glw_video_engine_t *gve)
 {
   int hvec[3], wvec[3];
-  int i, h, w;
-  const uint8_t *src;
-  uint8_t *dst;
+  int i;
+  int copied = 0;
   int tff;
   int hshift = fi->fi_hshift, vshift = fi->fi_vshift;
   glw_video_surface_t *s;
@@ -503,19 +579,10 @@ yuvp_deliver(const frame_info_t *fi, glw_video_t *gv, glw_video_engine_t *gve)
   if(!fi->fi_interlaced) {
 
     for(i = 0; i < 3; i++) {
-      w = wvec[i];
-      h = hvec[i];
-      src = fi->fi_data[i];
-      dst = s->gvs_data[i];
-      assert(dst != NULL);
-
-      const int linesize = LINESIZE(w, 1);
-
-      while(h--) {
-	memcpy(dst, src, w);
-	dst += linesize;
-	src += fi->fi_pitch[i];
-      }
+      assert(s->gvs_data[i] != NULL);
+      copied += copy_plane(s->gvs_data[i], LINESIZE(wvec[i], 1),
+                           fi->fi_data[i], fi->fi_pitch[i],
+                           wvec[i], hvec[i]);
     }
 
     glw_video_put_surface(gv, s, pts, fi->fi_epoch, fi->fi_duration, 0, 0);
@@ -526,43 +593,27 @@ yuvp_deliver(const frame_info_t *fi, glw_video_t *gv, glw_video_engine_t *gve)
 
     tff = fi->fi_tff ^ parity;
 
-    for(i = 0; i < 3; i++) {
-      w = wvec[i];
-      h = hvec[i];
-      
-      src = fi->fi_data[i]; 
-      dst = s->gvs_data[i];
-      const int linesize = LINESIZE(w, 1);
-      while(h--) {
-	memcpy(dst, src, w);
-	dst += linesize;
-	src += fi->fi_pitch[i] * 2;
-      }
-    }
+    for(i = 0; i < 3; i++)
+      copied += copy_plane(s->gvs_data[i], LINESIZE(wvec[i], 1),
+                           fi->fi_data[i], fi->fi_pitch[i] * 2,
+                           wvec[i], hvec[i]);
     glw_video_put_surface(gv, s, pts, fi->fi_epoch, duration, 1, !tff);
 
     if((s = glw_video_get_surface(gv, wvec, hvec)) == NULL)
       return -1;
 
-    for(i = 0; i < 3; i++) {
-      w = wvec[i];
-      h = hvec[i];
-      
-      src = fi->fi_data[i] + fi->fi_pitch[i];
-      dst = s->gvs_data[i];
-      const int linesize = LINESIZE(w, 1);
-      while(h--) {
-	memcpy(dst, src, w);
-	dst += linesize;
-	src += fi->fi_pitch[i] * 2;
-      }
-    }
+    for(i = 0; i < 3; i++)
+      copied += copy_plane(s->gvs_data[i], LINESIZE(wvec[i], 1),
+                           fi->fi_data[i] + fi->fi_pitch[i],
+                           fi->fi_pitch[i] * 2,
+                           wvec[i], hvec[i]);
 
     if(pts != PTS_UNSET)
       pts += duration;
 
     glw_video_put_surface(gv, s, pts, fi->fi_epoch, duration, 1, tff);
   }
+  gv->w.glw_root->gr_stats_video_copy = copied;
   return 0;
 }
 
@@ -625,13 +676,9 @@ bgr_deliver(const frame_info_t *fi, glw_video_t *gv, glw_video_engine_t *gve)
 
   int linesize = LINESIZE(fi->fi_width, 3);
 
-  const uint8_t *src = fi->fi_data[0];
-  uint8_t *dst = s->gvs_data[0];
-  for(int y = 0; y < fi->fi_height; y++) {
-    memcpy(dst, src, linesize);
-    src += fi->fi_pitch[0];
-    dst += linesize;
-  }
+  gv->w.glw_root->gr_stats_video_copy =
+    copy_plane(s->gvs_data[0], linesize, fi->fi_data[0], fi->fi_pitch[0],
+               linesize, fi->fi_height);
 
   glw_video_put_surface(gv, s, pts, fi->fi_epoch, fi->fi_duration, 0, 0);
   return 0;
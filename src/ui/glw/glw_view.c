@@ -218,6 +218,25 @@ gcv_load(glw_root_t *gr, glw_cached_view_t *gcv, int may_unlock)
   char errbuf[512];
   buf_t *buf;
   errorinfo_t ei;
+  token_t *sof;
+  int64_t ts = arch_get_ts();
+
+  if(!gconf.disable_view_cache &&
+     (sof = glw_view_cache_load(gr, gcv->gcv_url, may_unlock)) != NULL) {
+
+    if(!glw_view_parse(sof, &ei, gr)) {
+      TRACE(TRACE_DEBUG, "GLW", "View %s loaded from cache in %d us",
+            rstr_get(gcv->gcv_url), (int)(arch_get_ts() - ts));
+      gcv->gcv_sof = sof;
+      gcv->gcv_loaded = 1;
+      return;
+    }
+
+    // Cached copy is no good, treat as a miss and parse the source
+    TRACE(TRACE_DEBUG, "GLW", "Unable to use cached copy of view %s -- %s",
+          rstr_get(gcv->gcv_url), ei.error);
+    glw_view_free_chain(gr, sof);
+  }
 
   if(may_unlock)
     glw_unlock(gr);
@@ -246,7 +265,7 @@ gcv_load(glw_root_t *gr, glw_cached_view_t *gcv, int may_unlock)
     return;
   }
 
-  token_t *sof = glw_view_token_alloc(gr);
+  sof = glw_view_token_alloc(gr);
   sof->type = TOKEN_START;
   sof->file = rstr_dup(file);
 
@@ -262,12 +281,25 @@ gcv_load(glw_root_t *gr, glw_cached_view_t *gcv, int may_unlock)
   eof->file = rstr_dup(file);
   l->next = eof;
 
-  if(glw_view_preproc(gr, sof, &ei, may_unlock) ||
-     glw_view_parse(sof, &ei, gr)) {
+  // Collect all files read by preprocessor (#include, #import)
+  rstr_vec_t *deps = NULL;
+  rstr_vec_append(&deps, file);
+
+  int err = glw_view_preproc(gr, sof, &ei, may_unlock, &deps);
+
+  if(!err && !gconf.disable_view_cache && file == gcv->gcv_url)
+    glw_view_cache_store(gr, file, sof, deps, may_unlock);
+
+  rstr_vec_free(deps);
+
+  if(err || glw_view_parse(sof, &ei, gr)) {
     glw_view_free_chain(gr, sof);
     goto bad;
   }
 
+  TRACE(TRACE_DEBUG, "GLW", "View %s loaded from source in %d us",
+        rstr_get(file), (int)(arch_get_ts() - ts));
+
   gcv->gcv_sof = sof;
   gcv->gcv_loaded = 1;
   return;
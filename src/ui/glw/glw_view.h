@@ -293,11 +293,16 @@ void glw_view_token_free(glw_root_t *gr, token_t *t);
 token_t *glw_view_token_copy(glw_root_t *gr, token_t *src);
 
 token_t *glw_view_load1(glw_root_t *gr, rstr_t *url, errorinfo_t *ei,
-                        token_t *prev, int may_unlock);
+                        token_t *prev, int may_unlock, rstr_vec_t **deps);
 
 token_t *glw_view_lexer(glw_root_t *gr, const char *src, errorinfo_t *ei,
                         rstr_t *file, token_t *prev);
 
+token_t *glw_view_cache_load(glw_root_t *gr, rstr_t *url, int may_unlock);
+
+void glw_view_cache_store(glw_root_t *gr, rstr_t *url, token_t *sof,
+                          const rstr_vec_t *deps, int may_unlock);
+
 int glw_view_parse(token_t *sof, errorinfo_t *ei, glw_root_t *gr);
 
 void glw_view_free_chain(glw_root_t *gr, token_t *t);
@@ -324,7 +329,7 @@ int glw_view_eval_block(token_t *t, glw_view_eval_context_t *ec,
 int glw_view_eval_rpn(token_t *t, glw_view_eval_context_t *pec, int *copyp);
 
 int glw_view_preproc(glw_root_t *gr, token_t *p, errorinfo_t *ei,
-                     int may_unlock);
+                     int may_unlock, rstr_vec_t **deps);
 
 token_t *glw_view_clone_chain(glw_root_t *gr, token_t *src, token_t **lp);
 
@@ -382,8 +382,10 @@ attr_need_refresh(glw_root_t *gr, const token_t *t,
 
   int flags = GLW_REFRESH_FLAG_LAYOUT;
 
-  if(how != GLW_REFRESH_LAYOUT_ONLY)
+  if(how != GLW_REFRESH_LAYOUT_ONLY) {
     flags |= GLW_REFRESH_FLAG_RENDER;
+    atomic_inc(&gr->gr_render_serial);
+  }
 
   if((gr->gr_need_refresh & flags) == flags)
     return;
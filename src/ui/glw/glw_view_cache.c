@@ -0,0 +1,401 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+#include <stdio.h>
+
+#include "glw.h"
+#include "glw_view.h"
+#include "fileaccess/fileaccess.h"
+#include "htsmsg/htsbuf.h"
+#include "blobcache.h"
+
+/**
+ * Cache of preprocessed view files
+ *
+ * After lexing and preprocessing (includes, imports and macro expansion)
+ * a view is just a flat chain of simple tokens. That chain is serialized
+ * into the blobcache together with the modification time of every file
+ * that was read to produce it. Next time the view is loaded (typically
+ * after a restart) the chain is restored directly, skipping file loading,
+ * lexing and preprocessing, as long as none of the files have changed.
+ */
+
+#define VIEW_CACHE_STASH  "glwview"
+#define VIEW_CACHE_MAGIC  0x32435647 // GVC2
+#define VIEW_CACHE_MAXAGE (86400 * 365)
+
+
+/**
+ *
+ */
+static void
+vc_append_str(htsbuf_queue_t *hq, const char *str)
+{
+  const int len = str ? strlen(str) : 0;
+  htsbuf_append_le32(hq, len);
+  htsbuf_append(hq, str, len);
+}
+
+
+/**
+ *
+ */
+static void
+vc_append_float(htsbuf_queue_t *hq, float f)
+{
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  htsbuf_append_le32(hq, u);
+}
+
+
+/**
+ *
+ */
+static int
+vc_file_index(rstr_t **files, int *num_files, int max_files, rstr_t *f)
+{
+  for(int i = 0; i < *num_files; i++)
+    if(files[i] == f || rstr_eq(files[i], f))
+      return i;
+
+  if(*num_files == max_files)
+    return -1;
+
+  files[*num_files] = f;
+  return (*num_files)++;
+}
+
+
+/**
+ * Only tokens produced by the lexer can be stored
+ */
+static int
+vc_token_cacheable(const token_t *t)
+{
+  switch(t->type) {
+  case TOKEN_START ... TOKEN_COLON:
+  case TOKEN_RSTRING:
+  case TOKEN_IDENTIFIER:
+  case TOKEN_FLOAT:
+  case TOKEN_INT:
+  case TOKEN_VOID:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+/**
+ *
+ */
+static void
+vc_key(char *key, size_t keylen, glw_root_t *gr, rstr_t *url)
+{
+  snprintf(key, keylen, "%s|%s", gr->gr_skin ?: "", rstr_get(url));
+}
+
+
+/**
+ * Store the chain of tokens starting at 'sof'. It must only contain
+ * tokens produced by the lexer (ie, it must not have been parsed)
+ */
+void
+glw_view_cache_store(glw_root_t *gr, rstr_t *url, token_t *sof,
+                     const rstr_vec_t *deps, int may_unlock)
+{
+  htsbuf_queue_t hq;
+  char errbuf[256];
+  char key[1024];
+  token_t *t;
+  int num_tokens = 0;
+  int num_files = 0;
+  const int max_files = 256;
+  rstr_t *files[max_files];
+
+  for(t = sof; t != NULL; t = t->next) {
+    if(!vc_token_cacheable(t) ||
+       vc_file_index(files, &num_files, max_files, t->file) == -1)
+      return;
+    num_tokens++;
+  }
+
+  htsbuf_queue_init(&hq, 0);
+  htsbuf_append_le32(&hq, VIEW_CACHE_MAGIC);
+  vc_append_str(&hq, appversion);
+
+  if(may_unlock)
+    glw_unlock(gr);
+
+  htsbuf_append_le32(&hq, deps ? deps->size : 0);
+  for(int i = 0; deps != NULL && i < deps->size; i++) {
+    fa_stat_t fs;
+    const char *dep = rstr_get(deps->v[i]);
+    if(fa_stat(dep, &fs, errbuf, sizeof(errbuf))) {
+      if(may_unlock)
+        glw_lock(gr);
+      htsbuf_queue_flush(&hq);
+      return;
+    }
+    vc_append_str(&hq, dep);
+    htsbuf_append_le32(&hq, fs.fs_mtime);
+    htsbuf_append_le32(&hq, (uint64_t)fs.fs_mtime >> 32);
+  }
+
+  if(may_unlock)
+    glw_lock(gr);
+
+  htsbuf_append_le32(&hq, num_files);
+  for(int i = 0; i < num_files; i++)
+    vc_append_str(&hq, rstr_get(files[i]));
+
+  htsbuf_append_le32(&hq, num_tokens);
+  for(t = sof; t != NULL; t = t->next) {
+    htsbuf_append_byte(&hq, t->type);
+    htsbuf_append_byte(&hq, vc_file_index(files, &num_files, max_files,
+                                          t->file));
+    htsbuf_append_le32(&hq, t->line);
+
+    switch(t->type) {
+    case TOKEN_RSTRING:
+      htsbuf_append_byte(&hq, t->t_rstrtype);
+      // FALLTHRU
+    case TOKEN_IDENTIFIER:
+      vc_append_str(&hq, rstr_get(t->t_rstring));
+      break;
+    case TOKEN_FLOAT:
+      vc_append_float(&hq, t->t_float);
+      break;
+    case TOKEN_INT:
+      htsbuf_append_le32(&hq, t->t_int);
+      break;
+    default:
+      break;
+    }
+  }
+
+  buf_t *b = buf_create(hq.hq_size);
+  htsbuf_read(&hq, buf_str(b), hq.hq_size);
+  htsbuf_queue_flush(&hq);
+
+  vc_key(key, sizeof(key), gr, url);
+
+  if(may_unlock)
+    glw_unlock(gr);
+
+  blobcache_put(key, VIEW_CACHE_STASH, b, VIEW_CACHE_MAXAGE, NULL, 0, 0);
+
+  if(may_unlock)
+    glw_lock(gr);
+
+  buf_release(b);
+}
+
+
+/**
+ * Bounds checked reader
+ */
+typedef struct vc_reader {
+  const uint8_t *ptr;
+  const uint8_t *end;
+  int err;
+} vc_reader_t;
+
+
+/**
+ *
+ */
+static uint32_t
+vc_read_le32(vc_reader_t *r)
+{
+  if(r->end - r->ptr < 4) {
+    r->err = 1;
+    return 0;
+  }
+  const uint8_t *p = r->ptr;
+  r->ptr += 4;
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/**
+ *
+ */
+static uint8_t
+vc_read_byte(vc_reader_t *r)
+{
+  if(r->ptr == r->end) {
+    r->err = 1;
+    return 0;
+  }
+  return *r->ptr++;
+}
+
+
+/**
+ *
+ */
+static rstr_t *
+vc_read_rstr(vc_reader_t *r)
+{
+  const uint32_t len = vc_read_le32(r);
+  if(r->err || r->end - r->ptr < len) {
+    r->err = 1;
+    return NULL;
+  }
+  rstr_t *rs = rstr_allocl((const char *)r->ptr, len);
+  r->ptr += len;
+  return rs;
+}
+
+
+/**
+ * Returns a token chain (from TOKEN_START to TOKEN_END) or NULL if
+ * there is no valid cached copy of the view
+ */
+token_t *
+glw_view_cache_load(glw_root_t *gr, rstr_t *url, int may_unlock)
+{
+  char errbuf[256];
+  char key[1024];
+  vc_reader_t r = {};
+  rstr_t **files = NULL;
+  uint32_t num_files = 0;
+  token_t *sof = NULL, *prev = NULL;
+
+  vc_key(key, sizeof(key), gr, url);
+
+  if(may_unlock)
+    glw_unlock(gr);
+
+  buf_t *b = blobcache_get(key, VIEW_CACHE_STASH, 0, NULL, NULL, NULL);
+
+  if(b == NULL)
+    goto out_locked;
+
+  r.ptr = buf_c8(b);
+  r.end = r.ptr + buf_size(b);
+
+  if(vc_read_le32(&r) != VIEW_CACHE_MAGIC)
+    goto out_locked;
+
+  rstr_t *version = vc_read_rstr(&r);
+  const int same_version = !strcmp(rstr_get(version) ?: "", appversion);
+  rstr_release(version);
+  if(r.err || !same_version)
+    goto out_locked;
+
+  // Make sure none of the files that made up the view has changed
+
+  const uint32_t num_deps = vc_read_le32(&r);
+  for(int i = 0; i < num_deps && !r.err; i++) {
+    rstr_t *dep = vc_read_rstr(&r);
+    uint64_t mtime = vc_read_le32(&r);
+    mtime |= (uint64_t)vc_read_le32(&r) << 32;
+    fa_stat_t fs;
+
+    if(r.err || fa_stat(rstr_get(dep), &fs, errbuf, sizeof(errbuf)) ||
+       (uint64_t)fs.fs_mtime != mtime)
+      r.err = 1;
+    rstr_release(dep);
+  }
+
+ out_locked:
+  if(may_unlock)
+    glw_lock(gr);
+
+  if(b == NULL)
+    return NULL;
+
+  if(r.ptr == NULL || r.err)
+    goto bad;
+
+  num_files = vc_read_le32(&r);
+  if(num_files > 256)
+    goto bad;
+
+  files = calloc(num_files, sizeof(rstr_t *));
+  for(int i = 0; i < num_files; i++)
+    files[i] = vc_read_rstr(&r);
+
+  const uint32_t num_tokens = vc_read_le32(&r);
+
+  for(int i = 0; i < num_tokens && !r.err; i++) {
+    token_t *t = glw_view_token_alloc(gr);
+    uint32_t u;
+
+    t->type = vc_read_byte(&r);
+    if(!vc_token_cacheable(t)) {
+      // Corrupt, make sure the chain can be freed safely
+      t->type = TOKEN_VOID;
+      r.err = 1;
+    }
+    const uint8_t fileidx = vc_read_byte(&r);
+    t->line = vc_read_le32(&r);
+
+    if(fileidx < num_files)
+      t->file = rstr_dup(files[fileidx]);
+    else
+      r.err = 1;
+
+    if(prev != NULL)
+      prev->next = t;
+    else
+      sof = t;
+    prev = t;
+
+    switch(t->type) {
+    case TOKEN_RSTRING:
+      t->t_rstrtype = vc_read_byte(&r);
+      // FALLTHRU
+    case TOKEN_IDENTIFIER:
+      t->t_rstring = vc_read_rstr(&r);
+      break;
+    case TOKEN_FLOAT:
+      u = vc_read_le32(&r);
+      memcpy(&t->t_float, &u, sizeof(float));
+      break;
+    case TOKEN_INT:
+      t->t_int = vc_read_le32(&r);
+      break;
+    default:
+      break;
+    }
+  }
+
+  if(r.err || sof == NULL || sof->type != TOKEN_START ||
+     prev->type != TOKEN_END) {
+    if(sof != NULL)
+      glw_view_free_chain(gr, sof);
+    sof = NULL;
+  }
+
+ bad:
+  if(sof == NULL)
+    TRACE(TRACE_DEBUG, "GLW", "Cached copy of view %s is stale or corrupt",
+          rstr_get(url));
+
+  for(int i = 0; i < num_files; i++)
+    rstr_release(files[i]);
+  free(files);
+  buf_release(b);
+  return sof;
+}
@@ -389,10 +389,12 @@ glw_view_lexer(glw_root_t *gr, const char *src, errorinfo_t *ei,
  *
  * Returns pointer to last token, or NULL if an error occured.
  * If an error occured 'ei' will be filled with data
+ *
+ * The path of the loaded file is appended to 'deps'
  */
 token_t *
 glw_view_load1(glw_root_t *gr, rstr_t *url, errorinfo_t *ei, token_t *prev,
-               int may_unlock)
+               int may_unlock, rstr_vec_t **deps)
 {
   token_t *last;
   char errbuf[256];
@@ -418,6 +420,8 @@ glw_view_load1(glw_root_t *gr, rstr_t *url, errorinfo_t *ei, token_t *prev,
     return NULL;
   }
 
+  rstr_vec_append(deps, p);
+
   last = glw_view_lexer(gr, buf_cstr(b), ei, p, prev);
   buf_release(b);
   rstr_release(p);
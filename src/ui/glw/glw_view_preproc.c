@@ -95,7 +95,7 @@ macro_add_arg(macro_t *m, rstr_t *name)
 static int
 glw_view_preproc0(glw_root_t *gr, token_t *p, errorinfo_t *ei,
 		  struct macro_list *ml, struct import_list *il,
-                  int may_unlock)
+                  int may_unlock, rstr_vec_t **deps)
 {
   token_t *t, *n, *x, *a, *b, *c, *d, *e;
   macro_t *m;
@@ -304,7 +304,8 @@ glw_view_preproc0(glw_root_t *gr, token_t *p, errorinfo_t *ei,
 	  return glw_view_seterr(ei, t, "Invalid filename after include");
 
 	x = t->next;
-	if((n = glw_view_load1(gr, t->t_rstring, ei, t, may_unlock)) == NULL)
+	if((n = glw_view_load1(gr, t->t_rstring, ei, t, may_unlock,
+                               deps)) == NULL)
 	  return -1;
 
 	n->next = x;
@@ -335,7 +336,8 @@ glw_view_preproc0(glw_root_t *gr, token_t *p, errorinfo_t *ei,
 	  LIST_INSERT_HEAD(il, i, link);
 
 	  x = t->next;
-	  if((n = glw_view_load1(gr, t->t_rstring, ei, t, may_unlock)) == NULL)
+	  if((n = glw_view_load1(gr, t->t_rstring, ei, t, may_unlock,
+                                 deps)) == NULL)
 	    return -1;
 	  
 	  n->next = x;
@@ -476,7 +478,8 @@ glw_view_preproc0(glw_root_t *gr, token_t *p, errorinfo_t *ei,
  *
  */
 int
-glw_view_preproc(glw_root_t *gr, token_t *p, errorinfo_t *ei, int may_unlock)
+glw_view_preproc(glw_root_t *gr, token_t *p, errorinfo_t *ei, int may_unlock,
+                 rstr_vec_t **deps)
 {
   struct macro_list ml;
   macro_t *m;
@@ -487,7 +490,7 @@ glw_view_preproc(glw_root_t *gr, token_t *p, errorinfo_t *ei, int may_unlock)
   LIST_INIT(&ml);
   LIST_INIT(&il);
   
-  r = glw_view_preproc0(gr, p, ei, &ml, &il, may_unlock);
+  r = glw_view_preproc0(gr, p, ei, &ml, &il, may_unlock, deps);
   
   while((m = LIST_FIRST(&ml)) != NULL)
     macro_destroy(gr, m);
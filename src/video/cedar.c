@@ -219,6 +219,7 @@ cedar_decode(struct media_codec *mc, struct video_decoder *vd,
   vresult_e res = libve_decode(0, 0, 0, cd->cd_ve);
   avgtime_stop(&vd->vd_decode_time, mq->mq_prop_decode_avg,
 	       mq->mq_prop_decode_peak);
+  video_decoder_account_decode_time(vd, vd->vd_decode_time.last);
 
 
   if(res < 0) {
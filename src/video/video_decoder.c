@@ -497,8 +497,46 @@ vd_thread(void *aux)
 }
 
 
+/**
+ * Decode time histogram, upper limit of each bucket in µs
+ */
+static const int vd_decode_histogram_limits[VD_DECODE_HISTOGRAM_SIZE - 1] = {
+  1000, 2000, 4000, 8000, 16000, 33000, 66000
+};
+
+static const char *vd_decode_histogram_names[VD_DECODE_HISTOGRAM_SIZE] = {
+  "upto1ms", "upto2ms", "upto4ms", "upto8ms",
+  "upto16ms", "upto33ms", "upto66ms", "over66ms"
+};
+
+
+/**
+ * Called by decoders with the time it took to decode a frame.
+ * Props are only updated every 16th frame to keep the cost down
+ */
+void
+video_decoder_account_decode_time(video_decoder_t *vd, int usec)
+{
+  int i;
+
+  for(i = 0; i < VD_DECODE_HISTOGRAM_SIZE - 1; i++)
+    if(usec <= vd_decode_histogram_limits[i])
+      break;
+
+  vd->vd_decode_histogram[i]++;
+
+  if(++vd->vd_decode_histogram_cnt & 15)
+    return;
+
+  for(i = 0; i < VD_DECODE_HISTOGRAM_SIZE; i++)
+    prop_set_int(vd->vd_prop_decode_histogram[i],
+                 vd->vd_decode_histogram[i]);
+}
 
 
+/**
+ *
+ */
 video_decoder_t *
 video_decoder_create(media_pipe_t *mp)
 {
@@ -508,6 +546,13 @@ video_decoder_create(media_pipe_t *mp)
 
   vd_init_timings(vd);
 
+  prop_t *h = prop_create(mp->mp_prop_video, "decodetime_histogram");
+  for(int i = 0; i < VD_DECODE_HISTOGRAM_SIZE; i++) {
+    vd->vd_prop_decode_histogram[i] =
+      prop_create(h, vd_decode_histogram_names[i]);
+    prop_set_int(vd->vd_prop_decode_histogram[i], 0);
+  }
+
   hts_thread_create_joinable("video decoder", 
 			     &vd->vd_decoder_thread, vd_thread, vd,
 			     THREAD_PRIO_VIDEO);
@@ -126,6 +126,14 @@ typedef struct video_decoder {
   media_discontinuity_aux_t vd_debug_discont_in;
   media_discontinuity_aux_t vd_debug_discont_out;
 
+  /**
+   * Histogram of time spent decoding each frame
+   */
+#define VD_DECODE_HISTOGRAM_SIZE 8
+  int vd_decode_histogram[VD_DECODE_HISTOGRAM_SIZE];
+  int vd_decode_histogram_cnt;
+  prop_t *vd_prop_decode_histogram[VD_DECODE_HISTOGRAM_SIZE];
+
 } video_decoder_t;
 
 video_decoder_t *video_decoder_create(media_pipe_t *mp);
@@ -134,6 +142,8 @@ void video_decoder_stop(video_decoder_t *vd);
 
 void video_decoder_destroy(video_decoder_t *vd);
 
+void video_decoder_account_decode_time(video_decoder_t *vd, int usec);
+
 int video_deliver_frame(video_decoder_t *vd, const frame_info_t *info);
 
 int64_t  video_decoder_infer_pts(const media_buf_meta_t *mbm,
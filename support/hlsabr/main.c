@@ -0,0 +1,283 @@
+/*
+ * Offline replay of HLS bitrate selection policies
+ *
+ * Reads a throughput trace and simulates playback of a stream with a
+ * given bitrate ladder using each selection policy in
+ * src/backend/hls/hls_abr.c, printing quality / stability / stall
+ * figures for each of them.
+ *
+ * The trace is either a Movian log with "HLS debug" and "Throughput and
+ * buffer based HLS bitrate selection" enabled (the "ABR sample:" lines
+ * are picked up) or a plain file with one "<bytes> <microseconds>"
+ * pair per line. Samples are replayed as link throughput in a loop
+ * until the simulated duration is reached.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "hls_abr.h"
+
+#define MAX_LADDER 32
+
+static int *trace;
+static int trace_len;
+
+static int ladder[MAX_LADDER];
+static int ladder_len;
+
+
+/**
+ *
+ */
+static void
+load_trace(const char *path)
+{
+  FILE *fp = fopen(path, "r");
+  char line[1024];
+  int capacity = 0;
+
+  if(fp == NULL) {
+    perror(path);
+    exit(1);
+  }
+
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    int64_t bytes, us;
+    const char *s = strstr(line, "ABR sample: ");
+    if(s != NULL) {
+      if(sscanf(s + 12, "%"SCNd64" bytes in %"SCNd64, &bytes, &us) != 2)
+        continue;
+    } else if(sscanf(line, "%"SCNd64" %"SCNd64, &bytes, &us) != 2) {
+      continue;
+    }
+
+    if(us <= 1000 || bytes <= 0)
+      continue;
+
+    if(trace_len == capacity) {
+      capacity = capacity * 2 + 64;
+      trace = realloc(trace, capacity * sizeof(int));
+    }
+    trace[trace_len++] = 8000000LL * bytes / us;
+  }
+  fclose(fp);
+
+  if(trace_len == 0) {
+    fprintf(stderr, "%s: No samples found\n", path);
+    exit(1);
+  }
+}
+
+
+/**
+ *
+ */
+static int
+intcmp_desc(const void *A, const void *B)
+{
+  return *(const int *)B - *(const int *)A;
+}
+
+
+/**
+ *
+ */
+static void
+parse_ladder(const char *str)
+{
+  char *copy = strdup(str);
+  char *sp = NULL;
+
+  for(const char *s = strtok_r(copy, ",", &sp); s != NULL;
+      s = strtok_r(NULL, ",", &sp)) {
+    if(ladder_len == MAX_LADDER)
+      break;
+    int kbps = atoi(s);
+    if(kbps > 0)
+      ladder[ladder_len++] = kbps * 1000;
+  }
+  free(copy);
+  qsort(ladder, ladder_len, sizeof(int), intcmp_desc);
+}
+
+
+#define POLICY_SIMPLE 0
+#define POLICY_ABR    1
+
+static const char *policy_names[] = {"simple", "abr"};
+
+
+/**
+ * Mirrors the segment loop in hls.c: fetch a segment, feed the
+ * estimator, ask the policy what to fetch next. Stepping up requires
+ * 10s of buffer just like hls_check_bw_switch() does
+ */
+static void
+simulate(int policy, double segdur, double maxbuf, double duration,
+         int start, int verbose)
+{
+  hls_abr_t ha;
+  int bw = 0;
+  int current = start;
+  double buffer = 0;
+  double played = 0;
+  double stalled = 0;
+  int stalls = 0;
+  int switches = 0;
+  double quality = 0;
+  int segments = 0;
+  int playing = 0;
+
+  hls_abr_reset(&ha);
+
+  while(played < duration) {
+    const int tput = trace[segments % trace_len];
+    const int64_t bytes = (int64_t)ladder[current] * segdur / 8;
+    const double dltime = bytes * 8.0 / tput;
+
+    if(playing) {
+      if(dltime > buffer) {
+        stalled += dltime - buffer;
+        played += buffer;
+        buffer = 0;
+        stalls++;
+      } else {
+        buffer -= dltime;
+        played += dltime;
+      }
+    }
+
+    buffer += segdur;
+    playing = 1;
+    quality += ladder[current];
+    segments++;
+
+    const int64_t ts = dltime * 1000000.0;
+    const int64_t buffer_delay = buffer * 1000000.0;
+    int next;
+
+    switch(policy) {
+    case POLICY_SIMPLE:
+      bw = hls_abr_legacy_bw(bw, 8000000LL * bytes / ts,
+                             buffer_delay < 5000000);
+      next = hls_abr_select_simple(ladder, ladder_len, bw);
+      break;
+    default:
+      hls_abr_add_sample(&ha, bytes, ts);
+      next = hls_abr_select(&ha, ladder, ladder_len, current, buffer_delay);
+      break;
+    }
+
+    if(ladder[next] > ladder[current] && buffer < 10)
+      next = current;
+
+    if(verbose)
+      printf("%-8s seg %5d tput %6d kbps buffer %5.1fs bitrate %6d kbps%s\n",
+             policy_names[policy], segments, tput / 1000, buffer,
+             ladder[next] / 1000, next != current ? " *" : "");
+
+    if(next != current)
+      switches++;
+    current = next;
+
+    // Player buffer full, wait for it to drain
+    if(buffer > maxbuf) {
+      played += buffer - maxbuf;
+      buffer = maxbuf;
+    }
+  }
+
+  printf("%-8s avg bitrate: %6d kbps  switches: %4d  "
+         "stalls: %4d  stalled: %7.1fs  segments: %d\n",
+         policy_names[policy], (int)(quality / segments / 1000),
+         switches, stalls, stalled, segments);
+}
+
+
+/**
+ *
+ */
+static void
+usage(const char *argv0)
+{
+  fprintf(stderr,
+          "Usage: %s [options] <trace>\n"
+          "  -l <kbps,kbps,...>  Bitrate ladder "
+          "(default 400,800,1500,3000,6000)\n"
+          "  -s <seconds>        Segment duration (default 10)\n"
+          "  -b <seconds>        Max buffer (default 60)\n"
+          "  -t <seconds>        Playback duration to simulate "
+          "(default 3600)\n"
+          "  -c <kbps>           Start at this bitrate "
+          "(default lowest)\n"
+          "  -v                  Print every segment\n",
+          argv0);
+  exit(1);
+}
+
+
+/**
+ *
+ */
+int
+main(int argc, char **argv)
+{
+  double segdur = 10;
+  double maxbuf = 60;
+  double duration = 3600;
+  int verbose = 0;
+  int start_kbps = 0;
+  int c;
+
+  parse_ladder("400,800,1500,3000,6000");
+
+  while((c = getopt(argc, argv, "l:s:b:t:c:v")) != -1) {
+    switch(c) {
+    case 'l':
+      ladder_len = 0;
+      parse_ladder(optarg);
+      break;
+    case 's':
+      segdur = atof(optarg);
+      break;
+    case 'b':
+      maxbuf = atof(optarg);
+      break;
+    case 't':
+      duration = atof(optarg);
+      break;
+    case 'c':
+      start_kbps = atoi(optarg);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if(optind != argc - 1 || ladder_len == 0 || segdur <= 0)
+    usage(argv[0]);
+
+  load_trace(argv[optind]);
+
+  int start = ladder_len - 1;
+  for(int i = 0; i < ladder_len; i++) {
+    if(ladder[i] == start_kbps * 1000) {
+      start = i;
+      break;
+    }
+  }
+
+  printf("%d samples, %d bitrates, %.0fs segments, %.0fs max buffer\n",
+         trace_len, ladder_len, segdur, maxbuf);
+
+  simulate(POLICY_SIMPLE, segdur, maxbuf, duration, start, verbose);
+  simulate(POLICY_ABR, segdur, maxbuf, duration, start, verbose);
+  return 0;
+}